@@ -23,7 +23,10 @@
 
 #define SNTP_CMD_MID     (CFE_PLATFORM_CMD_MID_BASE + 0x30)
 #define SNTP_SEND_HK_MID (CFE_PLATFORM_CMD_MID_BASE + 0x31)
+#define SNTP_BCAST_WAKEUP_MID (CFE_PLATFORM_CMD_MID_BASE + 0x32)
+#define SNTP_TIME_REQ_MID     (CFE_PLATFORM_CMD_MID_BASE + 0x33)
 
 #define SNTP_HK_TLM_MID  (CFE_PLATFORM_TLM_MID_BASE + 0x30)
+#define SNTP_TIME_TLM_MID (CFE_PLATFORM_TLM_MID_BASE + 0x31)
 
 #endif /* SNTP_MSGIDS_H */
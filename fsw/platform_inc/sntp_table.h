@@ -19,20 +19,95 @@
 /**
  * @file
  *
- * Define sample app table
+ * Define SNTP authentication key, broadcast, load shedding and control query tables
  */
 
 #ifndef SNTP_TABLE_H
 #define SNTP_TABLE_H
 
+#include "sntp_auth.h"
+#include "sntp_shed.h"
+
+/*
+** Symmetric key entry.  A KeyId of 0 marks an unused slot.
+*/
+typedef struct
+{
+    uint32 KeyId;
+    uint16 KeyLen;
+    uint8  Key[SNTP_AUTH_KEY_LEN];
+} SNTP_KeyEntry_t;
+
 /*
 ** Table structure
 */
 typedef struct
 {
-    uint16 Int1;
-    uint16 Int2;
+    SNTP_KeyEntry_t Keys[SNTP_AUTH_MAX_KEYS];
+} SNTP_KeyTbl_t;
+
+/*
+** Broadcast/multicast destinations.  One mode-5 packet is sent to each
+** configured group on every SNTP_BCAST_WAKEUP_MID; with no groups the
+** server only answers unicast requests.
+*/
+#define SNTP_BCAST_MAX_GROUPS 4
+#define SNTP_BCAST_ADDR_LEN   16
+
+typedef struct
+{
+    char   Groups[SNTP_BCAST_MAX_GROUPS][SNTP_BCAST_ADDR_LEN]; /* Dotted-quad multicast or broadcast address, "" if unused */
+    uint16 Port;    /* Destination UDP port, normally 123 */
+    uint8  Ttl;     /* Multicast TTL */
+    int8   PollExp; /* log2 of the wakeup period in seconds, advertised in the poll field */
+    uint32 KeyId;   /* SNTP.KeyTbl key to MAC packets with, 0 to send unauthenticated */
+} SNTP_BcastTbl_t;
+
+/*
+** Load shedding.  Classes are 0 critical (never shed), 1 normal and 2 best
+** effort.  A request takes the class of the first matching prefix, or else
+** of the listener it arrived on.
+*/
+#define SNTP_SHED_LISTENERS 3 /* UTC, TAI and MET listeners */
 
-} SNTP_Table_t;
+typedef struct
+{
+    char  Net[SNTP_BCAST_ADDR_LEN]; /* Dotted-quad network address, "" if unused */
+    uint8 Length;                   /* Prefix length in bits */
+    uint8 Class;
+    uint8 Spare[2];
+} SNTP_ShedPrefix_t;
+
+typedef struct
+{
+    uint32            LatencyUs;  /* Arrival to dequeue latency that signals overload, 0 to ignore */
+    uint32            QueueBytes; /* Receive backlog that signals overload, 0 to ignore */
+    uint32            HoldMs;     /* Time below the thresholds before each shed level is lifted */
+    uint8             Kod;        /* 1 to answer shed requests with KoD RATE, 0 to drop them */
+    uint8             ListenerClass[SNTP_SHED_LISTENERS];
+    SNTP_ShedPrefix_t Prefixes[SNTP_SHED_MAX_RULES];
+} SNTP_ShedTbl_t;
+
+/*
+** Mode-6 control queries (ntpq).  Only sources matching an allowed prefix
+** are answered, within both rates; with no prefixes every query is dropped.
+*/
+#define SNTP_CTL_TBL_ALLOW 8
+
+typedef struct
+{
+    char  Net[SNTP_BCAST_ADDR_LEN]; /* Dotted-quad network address, "" if unused */
+    uint8 Length;                   /* Prefix length in bits */
+    uint8 Spare[3];
+} SNTP_CtlAllow_t;
+
+typedef struct
+{
+    uint16          ClientRate;  /* Queries per second answered per client */
+    uint16          ClientBurst; /* Queries a client may send at once after a quiet spell */
+    uint16          TotalRate;   /* Queries per second answered across all clients */
+    uint16          Spare;
+    SNTP_CtlAllow_t Allow[SNTP_CTL_TBL_ALLOW];
+} SNTP_CtlTbl_t;
 
 #endif /* SNTP_TABLE_H */
@@ -50,7 +50,7 @@
 
 
 
-#define NET_BUF_SIZE SNTP_PACKET_BASE_SIZE // Note Size may increase if auth is added
+#define NET_BUF_SIZE 1024 // Base packet plus extension fields (incl. NTS, SNTP_NTS_MAX_PACKET) and MAC
 
 
 
@@ -31,6 +31,8 @@
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 
 #include "sntp_events.h"
 #include "sntp_version.h"
@@ -40,22 +42,127 @@
 #include "core_sntp_serializer.h"
 #include "core_sntp_config.h"
 #include "sntp_utils.h"
+#include "sntp_auth.h"
+#include "sntp_server.h"
+#include "sntp_transport.h"
+#include "sntp_time.h"
+#include "sntp_probe.h"
 
 #ifndef SNTP_PORT
-#define SNTP_PORT 123
+#define SNTP_PORT 123 /* UTC listener */
+#endif
+#ifndef SNTP_TAI_PORT
+#define SNTP_TAI_PORT 0 /* TAI listener, 0 disables it */
+#endif
+#ifndef SNTP_MET_PORT
+#define SNTP_MET_PORT 0 /* MET listener, 0 disables it */
 #endif
 #ifndef SNTP_STRATUM
 #define SNTP_STRATUM 15
 #endif
+#ifndef SNTP_TIME_SOURCE
+#ifdef SNTP_USE_CFE_TIME
+#define SNTP_TIME_SOURCE SNTP_TIME_SRC_CFE_UTC
+#else
+#define SNTP_TIME_SOURCE SNTP_TIME_SRC_REALTIME
+#endif
+#endif
+#ifndef SNTP_RT_PRIORITY
+#define SNTP_RT_PRIORITY 0 /* SCHED_FIFO priority for the serving task, 0 keeps the ES-assigned policy */
+#endif
+#ifndef SNTP_RT_CPU
+#define SNTP_RT_CPU -1
+#endif
+#ifndef SNTP_RT_LOCK_MEMORY
+#define SNTP_RT_LOCK_MEMORY false
+#endif
+#ifndef SNTP_RT_PREFAULT_STACK
+#define SNTP_RT_PREFAULT_STACK 0
+#endif
+#ifndef SNTP_SO_RCVBUF
+#define SNTP_SO_RCVBUF 0 /* Receive buffer size in bytes, 0 keeps the system default */
+#endif
+#ifndef SNTP_SO_SNDBUF
+#define SNTP_SO_SNDBUF 0
+#endif
+#ifndef SNTP_PCAP_STACK_SIZE
+#define SNTP_PCAP_STACK_SIZE 16384
+#endif
+#ifndef SNTP_PCAP_PRIORITY
+#define SNTP_PCAP_PRIORITY 200 /* Capture writer runs well below the serving task */
+#endif
+#ifndef SNTP_PCAP_STOP_MS
+#define SNTP_PCAP_STOP_MS 2000 /* How long exit waits for the writer to flush a capture before deleting it */
+#endif
+#ifndef SNTP_TIME_QUERY_PIPE_DEPTH
+#define SNTP_TIME_QUERY_PIPE_DEPTH 16
+#endif
+#ifndef SNTP_TIME_QUERY_STACK_SIZE
+#define SNTP_TIME_QUERY_STACK_SIZE 16384
+#endif
+#ifndef SNTP_TIME_QUERY_PRIORITY
+#define SNTP_TIME_QUERY_PRIORITY 50 /* Above the serving task, so a query is answered while it waits on the sockets */
+#endif
+#ifndef SNTP_TIME_QUERY_WAIT_MS
+#define SNTP_TIME_QUERY_WAIT_MS 1000 /* Longest pend on the query pipe, so the task sees the stop flag */
+#endif
+#ifndef SNTP_SPIN_IDLE_US
+#define SNTP_SPIN_IDLE_US 0 /* Busy-poll for this long after each packet, 0 always blocks */
+#endif
+#ifndef SNTP_BUSY_POLL_US
+#define SNTP_BUSY_POLL_US 0 /* SO_BUSY_POLL, 0 leaves the system default */
+#endif
+#ifndef SNTP_TOPK_WINDOW_SECS
+#define SNTP_TOPK_WINDOW_SECS 60 /* Top talker counting window, rotated on housekeeping */
+#endif
+#ifndef SNTP_STAGE_SAMPLE_EVERY
+#define SNTP_STAGE_SAMPLE_EVERY 1000 /* Trace the stages of one answered request in this many, 0 disables */
+#endif
+#ifndef SNTP_FLEET_WINDOW_SECS
+#define SNTP_FLEET_WINDOW_SECS 60 /* Client offset histogram window, rotated on housekeeping */
+#endif
+#ifdef SNTP_ENABLE_NTS
+#ifndef SNTP_NTS_CERT_FILE
+#define SNTP_NTS_CERT_FILE "/cf/sntp_nts.crt"
+#endif
+#ifndef SNTP_NTS_KEY_FILE
+#define SNTP_NTS_KEY_FILE "/cf/sntp_nts.key"
+#endif
+#ifndef SNTP_NTS_KEY_ROTATE_SECS
+#define SNTP_NTS_KEY_ROTATE_SECS 3600
+#endif
+#ifndef SNTP_NTS_KE_STACK_SIZE
+#define SNTP_NTS_KE_STACK_SIZE 65536
+#endif
+#ifndef SNTP_NTS_KE_PRIORITY
+#define SNTP_NTS_KE_PRIORITY 120
+#endif
+#ifndef SNTP_NTS_KE_STOP_MS
+#define SNTP_NTS_KE_STOP_MS 5000 /* How long exit waits for a session in progress before deleting the task */
+#endif
+#endif
 
 /*
 ** global data
 */
 SNTP_Data_t SNTP_Data;
-uint8_t netBuf[NET_BUF_SIZE];
+Sntp_Pcap_t SNTP_Capture;
+Sntp_TopK_t SNTP_TopTalkers;
+Sntp_Fleet_t SNTP_Fleet;
+SNTP_StateCds_t SNTP_StateCds; /* Staging copy of the warm start CDS block */
+
+/* Client offset percentiles published in housekeeping */
+static const uint32 SNTP_FleetPcts[SNTP_FLEET_PERCENTILES] = { 1, 10, 50, 90, 99 };
+
+CompileTimeAssert(SNTP_WAKE_HIST_BUCKETS == SNTP_RT_HIST_BUCKETS, SntpWakeHistSize);
+CompileTimeAssert(SNTP_TIME_SOURCE_COUNT == SNTP_TIME_SRC_COUNT, SntpTimeSourceCount);
+CompileTimeAssert(SNTP_SHED_CLASSES == SNTP_SHED_CLASS_COUNT, SntpShedClassCount);
+CompileTimeAssert(SNTP_SHED_LISTENERS == SNTP_TIMESCALE_COUNT, SntpShedListenerCount);
+CompileTimeAssert(SNTP_FLEET_GROUPS == SNTP_SHED_CLASS_COUNT, SntpFleetGroupCount);
+CompileTimeAssert(SNTP_CTL_TBL_ALLOW == SNTP_CTL_MAX_ALLOW, SntpCtlAllowCount);
 
 /** Initialize socket */
-int initUDPSocket(uint32_t port) {
+int initUDPSocket(uint32_t port, Sntp_RtSockStats_t *stats) {
     int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
     if (sockfd < 0) {
         perror("Error creating socket");
@@ -79,50 +186,787 @@ int initUDPSocket(uint32_t port) {
     struct timeval tv = { .tv_sec = 1, .tv_usec = 0 };
     setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO,&tv,sizeof(struct timeval));
 
+    // Kernel receive timestamps feed the wake latency histogram; drops are reported alongside
+    Sntp_RtEnableTimestamps(sockfd);
+
+    if (Sntp_RtSetBuffers(sockfd, SNTP_SO_RCVBUF, SNTP_SO_SNDBUF, stats) != 0) {
+        perror("Error setting socket buffer sizes");
+    }
+
     return sockfd;
 }
 
-/** Process a single query */
-SntpStatus_t process_sntp_request(struct sockaddr_in *clientAddr, socklen_t clientLen) {
-    SntpStatus_t status;
-    SntpPacket_t request, response;
-    SntpTimestamp_t time;
-    memset(&response,0,sizeof(response));
-    
-    // Receive Time when response is received. Used to calculate system clock offset
-    getCurrentSntpTime(&time);
-    encodeTime(&time, &response.receiveTime);
+/** Wait for a child task to set Stopped, deleting it if it has not within TimeoutMs
+ * @return true if the task stopped by itself
+ */
+bool SNTP_StopChildTask(CFE_ES_TaskId_t TaskId, atomic_bool *Stopped, uint32 TimeoutMs) {
+    for (uint32 waited = 0; waited < TimeoutMs && !atomic_load(Stopped); waited += 10) {
+        OS_TaskDelay(10);
+    }
+    if (atomic_load(Stopped)) {
+        return true;
+    }
+    CFE_ES_DeleteChildTask(TaskId);
+    return false;
+}
 
-    // NOTE: Skip auth decoding
+#ifdef SNTP_ENABLE_NTS
+/** NTS-KE child task: serves TLS key establishment sessions one at a time until the app exits */
+void SNTP_NtsKeTask(void) {
+    // Accepts time out every second, so the stop flag is seen even when no client connects
+    while (!atomic_load(&SNTP_Data.NtsKeStop)) {
+        Sntp_NtsKeServeOne(SNTP_Data.NtsKeSockfd);
+    }
+    atomic_store(&SNTP_Data.NtsKeStopped, true);
+    CFE_ES_ExitChildTask();
+}
 
-    // De-serialize packet
-    status = Sntp_DeserializeRequest( netBuf, &request);
-    if (status != SntpSuccess) {
-        printf("ERROR: Invalid request\n");
-        return status;
+/** Stop the NTS-KE task and close its listener, so the next instance can bind the port */
+void SNTP_StopNts(void) {
+    if (!SNTP_Data.ServerCfg.nts) {
+        return;
     }
+    atomic_store(&SNTP_Data.NtsKeStop, true);
+    SNTP_StopChildTask(SNTP_Data.NtsKeTaskId, &SNTP_Data.NtsKeStopped, SNTP_NTS_KE_STOP_MS);
+    close(SNTP_Data.NtsKeSockfd);
+    SNTP_Data.NtsKeSockfd = -1;
+    SNTP_Data.ServerCfg.nts = false;
+}
 
-    // Echo request in response fields
-    encodeTime( &request.transmitTime, &response.originTime );
+/** Bring up NTS; failures leave the server running without NTS */
+void SNTP_InitNts(void) {
+    int32 status;
 
-    // Set Details
-    response.leapVersionMode = SNTP_MODE_SERVER | ( SNTP_VERSION << SNTP_VERSION_LSB_POSITION );
-    response.stratum = SNTP_STRATUM;
-    response.refId = htonl(SNTP_KISS_OF_DEATH_CODE_NONE);
-    
-    getCurrentSntpTime(&time);
-    encodeTime(&time, &response.transmitTime);
-    
-    if (sendto(SNTP_Data.sockfd, &response, sizeof(response), 0,
-               (struct sockaddr*)clientAddr, clientLen) < 0)
-    {
-        printf("ERROR: Unable to send reply\n");
-        return SntpErrorNetworkFailure;
+    if (Sntp_NtsInit(SNTP_NTS_CERT_FILE, SNTP_NTS_KEY_FILE) != SntpSuccess) {
+        CFE_EVS_SendEvent(SNTP_NTS_ERR_EID, CFE_EVS_EventType_ERROR,
+                          "SNTP: Unable to load NTS certificate %s / key %s", SNTP_NTS_CERT_FILE, SNTP_NTS_KEY_FILE);
+        return;
+    }
+
+    SNTP_Data.NtsKeSockfd = Sntp_NtsKeListen(SNTP_NTS_KE_PORT);
+    if (SNTP_Data.NtsKeSockfd < 0) {
+        CFE_EVS_SendEvent(SNTP_NTS_ERR_EID, CFE_EVS_EventType_ERROR,
+                          "SNTP: Unable to listen for NTS-KE on port %d", SNTP_NTS_KE_PORT);
+        return;
+    }
+
+    atomic_store(&SNTP_Data.NtsKeStop, false);
+    atomic_store(&SNTP_Data.NtsKeStopped, false);
+    status = CFE_ES_CreateChildTask(&SNTP_Data.NtsKeTaskId, "SNTP_NTSKE", SNTP_NtsKeTask, NULL,
+                                    SNTP_NTS_KE_STACK_SIZE, SNTP_NTS_KE_PRIORITY, 0);
+    if (status != CFE_SUCCESS) {
+        CFE_EVS_SendEvent(SNTP_NTS_ERR_EID, CFE_EVS_EventType_ERROR,
+                          "SNTP: Unable to create NTS-KE task, RC = 0x%08lX", (unsigned long)status);
+        close(SNTP_Data.NtsKeSockfd);
+        SNTP_Data.NtsKeSockfd = -1;
+        return;
+    }
+
+    SNTP_Data.ServerCfg.nts = true;
+}
+#endif
+
+/** Capture writer child task: drains the capture ring to file until the app exits */
+void SNTP_PcapWriterTask(void) {
+    Sntp_PcapWriterRun(&SNTP_Capture);
+    atomic_store(&SNTP_Data.PcapStopped, true);
+    CFE_ES_ExitChildTask();
+}
+
+/** Finish any capture, closing its file, and stop the writer task */
+void SNTP_StopCapture(void) {
+    if (!SNTP_Data.PcapReady) {
+        return;
+    }
+    Sntp_PcapShutdown(&SNTP_Capture);
+    if (!SNTP_StopChildTask(SNTP_Data.PcapTaskId, &SNTP_Data.PcapStopped, SNTP_PCAP_STOP_MS) &&
+        SNTP_Capture.file != NULL) {
+        fclose(SNTP_Capture.file);
+        SNTP_Capture.file = NULL;
+    }
+    SNTP_Data.PcapReady = false;
+}
+
+/** Time query child task: answers onboard time queries as they arrive, rather than between socket receives */
+void SNTP_TimeQueryTask(void) {
+    CFE_SB_Buffer_t *SBBufPtr;
+    size_t           Size = 0;
+
+    while (!atomic_load(&SNTP_Data.TimeQueryStop)) {
+        if (CFE_SB_ReceiveBuffer(&SBBufPtr, SNTP_Data.TimeQueryPipe, SNTP_TIME_QUERY_WAIT_MS) != CFE_SUCCESS) {
+            continue;
+        }
+        CFE_MSG_GetSize(&SBBufPtr->Msg, &Size);
+        if (Size != sizeof(SNTP_TimeQueryCmd_t)) {
+            __atomic_fetch_add(&SNTP_Data.TimeQueryCounts.Errors, 1, __ATOMIC_RELAXED);
+            CFE_EVS_SendEvent(SNTP_TIME_QUERY_ERR_EID, CFE_EVS_EventType_ERROR,
+                              "SNTP: Time query of length %u, expected %u", (unsigned int)Size,
+                              (unsigned int)sizeof(SNTP_TimeQueryCmd_t));
+            continue;
+        }
+        SNTP_AnswerTimeQuery((const SNTP_TimeQueryCmd_t *)SBBufPtr);
+    }
+    atomic_store(&SNTP_Data.TimeQueryStopped, true);
+    CFE_ES_ExitChildTask();
+}
+
+/** Start answering time queries; failures leave the app running without them */
+void SNTP_InitTimeQueries(void) {
+    int32 status;
+
+    status = OS_MutSemCreate(&SNTP_Data.TimeMutex, "SNTP_TIME", 0);
+    if (status == OS_SUCCESS) {
+        status = CFE_SB_CreatePipe(&SNTP_Data.TimeQueryPipe, SNTP_TIME_QUERY_PIPE_DEPTH, "SNTP_TIME_PIPE");
+    }
+    if (status == CFE_SUCCESS) {
+        status = CFE_SB_Subscribe(CFE_SB_ValueToMsgId(SNTP_TIME_REQ_MID), SNTP_Data.TimeQueryPipe);
+    }
+    if (status == CFE_SUCCESS) {
+        atomic_store(&SNTP_Data.TimeQueryStop, false);
+        atomic_store(&SNTP_Data.TimeQueryStopped, false);
+        status = CFE_ES_CreateChildTask(&SNTP_Data.TimeQueryTaskId, "SNTP_TIMEQ", SNTP_TimeQueryTask, NULL,
+                                        SNTP_TIME_QUERY_STACK_SIZE, SNTP_TIME_QUERY_PRIORITY, 0);
+    }
+    SNTP_Data.TimeQueryReady = (status == CFE_SUCCESS);
+    if (status != CFE_SUCCESS) {
+        CFE_EVS_SendEvent(SNTP_TIME_QUERY_ERR_EID, CFE_EVS_EventType_ERROR,
+                          "SNTP: Unable to start the time query task, RC = 0x%08lX", (unsigned long)status);
+    }
+}
+
+/** Stop the time query task */
+void SNTP_StopTimeQueries(void) {
+    if (!SNTP_Data.TimeQueryReady) {
+        return;
+    }
+    atomic_store(&SNTP_Data.TimeQueryStop, true);
+    SNTP_StopChildTask(SNTP_Data.TimeQueryTaskId, &SNTP_Data.TimeQueryStopped, 2 * SNTP_TIME_QUERY_WAIT_MS);
+    SNTP_Data.TimeQueryReady = false;
+}
+
+/** Copy the time query task's counters into a housekeeping payload */
+void SNTP_TimeQueryCounts(SNTP_HkTlm_Payload_t *Payload) {
+    Payload->SntpTimeQueries     = __atomic_load_n(&SNTP_Data.TimeQueryCounts.Answered, __ATOMIC_RELAXED);
+    Payload->SntpTimeQueryErrors = __atomic_load_n(&SNTP_Data.TimeQueryCounts.Errors, __ATOMIC_RELAXED);
+}
+
+/** Set the time query task's counters, which may be counting as they are set */
+void SNTP_SetTimeQueryCounts(uint32 Answered, uint32 Errors) {
+    __atomic_store_n(&SNTP_Data.TimeQueryCounts.Answered, Answered, __ATOMIC_RELAXED);
+    __atomic_store_n(&SNTP_Data.TimeQueryCounts.Errors, Errors, __ATOMIC_RELAXED);
+}
+
+/** Apply real-time policy, affinity and memory locking to the serving (main) task */
+void SNTP_InitRealtime(void) {
+    const Sntp_RtConfig_t cfg = {
+        .priority      = SNTP_RT_PRIORITY,
+        .cpu           = SNTP_RT_CPU,
+        .lockMemory    = SNTP_RT_LOCK_MEMORY,
+        .prefaultStack = SNTP_RT_PREFAULT_STACK,
+    };
+    const char *failed;
+
+    if (Sntp_RtApply(&cfg, &failed) != SntpSuccess) {
+        CFE_EVS_SendEvent(SNTP_RT_ERR_EID, CFE_EVS_EventType_ERROR,
+                          "SNTP: Unable to apply %s (priority %d, cpu %d, mlock %d)", failed, SNTP_RT_PRIORITY,
+                          SNTP_RT_CPU, (int)SNTP_RT_LOCK_MEMORY);
+    }
+
+    // Several listeners are multiplexed with poll(), so there is no single socket to spin on
+    SNTP_Data.Poller.idleUs = (SNTP_Data.ListenerCount == 1) ? SNTP_SPIN_IDLE_US : 0;
+    if (SNTP_SPIN_IDLE_US > 0 && SNTP_Data.ListenerCount > 1) {
+        CFE_EVS_SendEvent(SNTP_RT_ERR_EID, CFE_EVS_EventType_ERROR,
+                          "SNTP: SNTP_SPIN_IDLE_US ignored with %u listeners", (unsigned int)SNTP_Data.ListenerCount);
+    }
+    for (uint32 i = 0; i < SNTP_Data.ListenerCount; i++) {
+        if (SNTP_BUSY_POLL_US > 0 && Sntp_RtSetBusyPoll(SNTP_Data.Listeners[i].sockfd, SNTP_BUSY_POLL_US) != 0) {
+            CFE_EVS_SendEvent(SNTP_RT_ERR_EID, CFE_EVS_EventType_ERROR, "SNTP: Unable to set SO_BUSY_POLL to %dus: %s",
+                              SNTP_BUSY_POLL_US, strerror(errno));
+        }
+    }
+}
+
+/** Calibrate every time source, then select the configured one */
+void SNTP_InitTime(void) {
+    const Sntp_TimeSrcInfo_t *info;
+
+    Sntp_TimeCalibrate();
+    if (Sntp_TimeSelect(SNTP_TIME_SOURCE) != SntpSuccess) {
+        CFE_EVS_SendEvent(SNTP_TIME_ERR_EID, CFE_EVS_EventType_ERROR,
+                          "SNTP: Time source %d unavailable, serving %s", (int)SNTP_TIME_SOURCE,
+                          Sntp_TimeInfo(Sntp_TimeSelected())->name);
+    }
+
+    info = Sntp_TimeInfo(Sntp_TimeSelected());
+    CFE_EVS_SendEvent(SNTP_TIME_INF_EID, CFE_EVS_EventType_INFORMATION,
+                      "SNTP: Time source %s, read cost %uns, resolution %uns, precision %d", info->name,
+                      (unsigned int)info->costNs, (unsigned int)info->resolutionNs, (int)info->precision);
+}
+
+/** Rebuild the precomputed key schedules if the key table changed */
+void SNTP_LoadAuthKeys(void) {
+    int32 status;
+    SNTP_KeyTbl_t *tbl = NULL;
+
+    status = CFE_TBL_GetAddress((void **)&tbl, SNTP_Data.TblHandles[SNTP_KEY_TBL_IDX]);
+    if (status == CFE_TBL_INFO_UPDATED) {
+        Sntp_AuthClearKeys(&SNTP_Data.AuthKeys);
+        for (int i = 0; i < SNTP_AUTH_MAX_KEYS; i++) {
+            if (tbl->Keys[i].KeyId != 0) {
+                Sntp_AuthAddKey(&SNTP_Data.AuthKeys, tbl->Keys[i].KeyId, tbl->Keys[i].Key, tbl->Keys[i].KeyLen);
+            }
+        }
+        CFE_EVS_SendEvent(SNTP_KEYS_LOADED_INF_EID, CFE_EVS_EventType_INFORMATION,
+                          "SNTP: Loaded %u authentication keys", (unsigned int)SNTP_Data.AuthKeys.count);
+    }
+    if (status == CFE_SUCCESS || status == CFE_TBL_INFO_UPDATED) {
+        CFE_TBL_ReleaseAddress(SNTP_Data.TblHandles[SNTP_KEY_TBL_IDX]);
+    }
+}
+
+/** Resolve the broadcast destinations if the broadcast table changed */
+void SNTP_LoadBcastConfig(void) {
+    int32 status;
+    SNTP_BcastTbl_t *tbl = NULL;
+
+    status = CFE_TBL_GetAddress((void **)&tbl, SNTP_Data.TblHandles[SNTP_BCAST_TBL_IDX]);
+    if (status == CFE_TBL_INFO_UPDATED) {
+        SNTP_Data.BcastCfg   = *tbl;
+        SNTP_Data.BcastCount = 0;
+        for (int i = 0; i < SNTP_BCAST_MAX_GROUPS; i++) {
+            struct sockaddr_in *addr = &SNTP_Data.BcastAddrs[SNTP_Data.BcastCount];
+            if (tbl->Groups[i][0] == '\0') {
+                continue;
+            }
+            memset(addr, 0, sizeof(*addr));
+            addr->sin_family = AF_INET;
+            addr->sin_port   = htons(tbl->Port);
+            if (inet_pton(AF_INET, tbl->Groups[i], &addr->sin_addr) == 1) {
+                SNTP_Data.BcastCount++;
+            }
+        }
+
+        // Sent from a socket of their own, not bound to the served port, so a peer answering them cannot reach
+        // a listener; the engine also drops any mode-5 packet that comes back
+        if (SNTP_Data.BcastCount > 0 && SNTP_Data.BcastSockfd < 0) {
+            SNTP_Data.BcastSockfd = socket(AF_INET, SOCK_DGRAM, 0);
+        }
+        if (SNTP_Data.BcastCount > 0 && SNTP_Data.BcastSockfd >= 0) {
+            int on = 1;
+            unsigned char ttl = tbl->Ttl;
+            setsockopt(SNTP_Data.BcastSockfd, SOL_SOCKET, SO_BROADCAST, &on, sizeof(on));
+            setsockopt(SNTP_Data.BcastSockfd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+        } else if (SNTP_Data.BcastCount > 0) {
+            CFE_EVS_SendEvent(SNTP_BCAST_ERR_EID, CFE_EVS_EventType_ERROR,
+                              "SNTP: Unable to open broadcast socket: %s", strerror(errno));
+            SNTP_Data.BcastCount = 0;
+        }
+        CFE_EVS_SendEvent(SNTP_BCAST_LOADED_INF_EID, CFE_EVS_EventType_INFORMATION,
+                          "SNTP: Broadcasting to %u groups on port %u", (unsigned int)SNTP_Data.BcastCount,
+                          (unsigned int)tbl->Port);
+    }
+    if (status == CFE_SUCCESS || status == CFE_TBL_INFO_UPDATED) {
+        CFE_TBL_ReleaseAddress(SNTP_Data.TblHandles[SNTP_BCAST_TBL_IDX]);
+    }
+}
+
+/** Rebuild the prefix rules and listener classes if the shedding table changed */
+void SNTP_LoadShedConfig(void) {
+    int32 status;
+    SNTP_ShedTbl_t *tbl = NULL;
+
+    status = CFE_TBL_GetAddress((void **)&tbl, SNTP_Data.TblHandles[SNTP_SHED_TBL_IDX]);
+    if (status == CFE_TBL_INFO_UPDATED) {
+        SNTP_Data.ShedCfg.latencyUs  = tbl->LatencyUs;
+        SNTP_Data.ShedCfg.queueBytes = tbl->QueueBytes;
+        SNTP_Data.ShedCfg.holdMs     = tbl->HoldMs;
+        SNTP_Data.ShedCfg.kod        = tbl->Kod != 0;
+        SNTP_Data.ShedCfg.ruleCount  = 0;
+        for (int i = 0; i < SNTP_SHED_MAX_RULES; i++) {
+            if (tbl->Prefixes[i].Net[0] != '\0' &&
+                Sntp_ShedMakeRule(tbl->Prefixes[i].Net, tbl->Prefixes[i].Length, tbl->Prefixes[i].Class,
+                                  &SNTP_Data.ShedCfg.rules[SNTP_Data.ShedCfg.ruleCount]) == SntpSuccess) {
+                SNTP_Data.ShedCfg.ruleCount++;
+            }
+        }
+        for (uint32 i = 0; i < SNTP_Data.ListenerCount; i++) {
+            SNTP_Data.Listeners[i].Serve.cls = tbl->ListenerClass[SNTP_Data.Listeners[i].Serve.cfg.scale];
+        }
+        CFE_EVS_SendEvent(SNTP_SHED_INF_EID, CFE_EVS_EventType_INFORMATION,
+                          "SNTP: Shedding above %uus latency or %u bytes queued, %u priority prefixes",
+                          (unsigned int)tbl->LatencyUs, (unsigned int)tbl->QueueBytes,
+                          (unsigned int)SNTP_Data.ShedCfg.ruleCount);
+    }
+    if (status == CFE_SUCCESS || status == CFE_TBL_INFO_UPDATED) {
+        CFE_TBL_ReleaseAddress(SNTP_Data.TblHandles[SNTP_SHED_TBL_IDX]);
+    }
+}
+
+/** Rebuild the control query allow list and rates if the control table changed */
+void SNTP_LoadCtlConfig(void) {
+    int32 status;
+    SNTP_CtlTbl_t *tbl = NULL;
+
+    status = CFE_TBL_GetAddress((void **)&tbl, SNTP_Data.TblHandles[SNTP_CTL_TBL_IDX]);
+    if (status == CFE_TBL_INFO_UPDATED) {
+        SNTP_Data.CtlCfg.clientRate  = tbl->ClientRate;
+        SNTP_Data.CtlCfg.clientBurst = tbl->ClientBurst;
+        SNTP_Data.CtlCfg.totalRate   = tbl->TotalRate;
+        SNTP_Data.CtlCfg.allowCount  = 0;
+        for (int i = 0; i < SNTP_CTL_TBL_ALLOW; i++) {
+            if (tbl->Allow[i].Net[0] != '\0' &&
+                Sntp_CtlMakePrefix(tbl->Allow[i].Net, tbl->Allow[i].Length,
+                                   &SNTP_Data.CtlCfg.allow[SNTP_Data.CtlCfg.allowCount]) == SntpSuccess) {
+                SNTP_Data.CtlCfg.allowCount++;
+            }
+        }
+        CFE_EVS_SendEvent(SNTP_CTL_INF_EID, CFE_EVS_EventType_INFORMATION,
+                          "SNTP: Answering control queries from %u prefixes, %u/s per client, %u/s in total",
+                          (unsigned int)SNTP_Data.CtlCfg.allowCount, (unsigned int)tbl->ClientRate,
+                          (unsigned int)tbl->TotalRate);
+    }
+    if (status == CFE_SUCCESS || status == CFE_TBL_INFO_UPDATED) {
+        CFE_TBL_ReleaseAddress(SNTP_Data.TblHandles[SNTP_CTL_TBL_IDX]);
     }
+}
+
+/** Send one mode-5 packet to each broadcast group; paced by SNTP_BCAST_WAKEUP_MID */
+void SNTP_SendBroadcast(void) {
+    uint8_t pkt[SNTP_PACKET_BASE_SIZE + SNTP_AUTH_MAC_SIZE];
+    const Sntp_AuthKey_t *key = NULL;
+    size_t len;
+
+    if (SNTP_Data.BcastCount == 0) {
+        return;
+    }
+
+    // Never fall back to unauthenticated packets if the configured key is missing
+    if (SNTP_Data.BcastCfg.KeyId != 0) {
+        key = Sntp_AuthFindKey(&SNTP_Data.AuthKeys, SNTP_Data.BcastCfg.KeyId);
+        if (key == NULL) {
+            SNTP_Data.cnts.SntpBcastErrors += SNTP_Data.BcastCount;
+            return;
+        }
+    }
+
+    len = Sntp_ServerBuildBroadcast(&SNTP_Data.Listeners[0].Serve.cfg, SNTP_Data.BcastCfg.PollExp, key, pkt);
+    for (uint32 i = 0; i < SNTP_Data.BcastCount; i++) {
+        if (sendto(SNTP_Data.BcastSockfd, pkt, len, 0, (const struct sockaddr *)&SNTP_Data.BcastAddrs[i],
+                   sizeof(SNTP_Data.BcastAddrs[i])) < 0) {
+            SNTP_Data.cnts.SntpBcastErrors++;
+        } else {
+            SNTP_Data.cnts.SntpBcastSent++;
+        }
+    }
+}
+
+/** Report a change of shed level (Sntp_ServeHooks_t) */
+void SNTP_ShedChanged(void *Arg, uint32_t Level, uint32_t LatencyUs, uint32_t QueueBytes) {
+    (void)Arg;
+    CFE_EVS_SendEvent(SNTP_SHED_INF_EID, CFE_EVS_EventType_INFORMATION,
+                      "SNTP: Shed level %u at %uus latency, %u bytes queued", (unsigned int)Level,
+                      (unsigned int)LatencyUs, (unsigned int)QueueBytes);
+}
+
+/** Report a datagram of a bad length or a failed receive (Sntp_ServeHooks_t) */
+void SNTP_InvalidDatagram(void *Arg, ssize_t Len, int Err) {
+    (void)Arg;
+    if (Len > 0) {
+        OS_printf("ERROR: Invalid packet received of size %li\n", (long)Len);
+    } else {
+        OS_printf("Unexpected recvfrom error: %li %i=%s\n", (long)Len, Err, strerror(Err));
+    }
+}
+
+/** Wait up to 1s for requests on any listener and serve them */
+void SNTP_ServeListeners(void) {
+    struct pollfd fds[SNTP_TIMESCALE_COUNT];
+    int ready;
+
+    if (SNTP_Data.ListenerCount == 1) {
+        Sntp_ServeOne(&SNTP_Data.Serve, &SNTP_Data.Listeners[0].Serve);
+        return;
+    }
+
+    for (uint32 i = 0; i < SNTP_Data.ListenerCount; i++) {
+        fds[i].fd = SNTP_Data.Listeners[i].sockfd;
+        fds[i].events = POLLIN;
+        fds[i].revents = 0;
+    }
+    ready = poll(fds, SNTP_Data.ListenerCount, 1000);
+    if (ready <= 0) {
+        return;
+    }
+
+    for (uint32 i = 0; i < SNTP_Data.ListenerCount; i++) {
+        if (fds[i].revents != 0) {
+            Sntp_ServeBatch(&SNTP_Data.Serve, &SNTP_Data.Listeners[i].Serve);
+        }
+    }
+}
+
+/** Map the statistics log at SNTP_STATLOG_FILE; a failure is reported and the app runs without it */
+void SNTP_OpenStatLog(void) {
+    char LocalFile[OS_MAX_LOCAL_PATH_LEN];
+    const char *Reason = NULL;
+
+    // open() needs the host path, not the OSAL virtual one
+    if (OS_TranslatePath(SNTP_STATLOG_FILE, LocalFile) != OS_SUCCESS) {
+        Reason = "invalid path";
+    } else if (Sntp_StatLogOpen(&SNTP_Data.StatLog, LocalFile, SNTP_STATLOG_RECORDS) != 0) {
+        Reason = strerror(errno);
+    }
+    if (Reason != NULL) {
+        CFE_EVS_SendEvent(SNTP_STATLOG_ERR_EID, CFE_EVS_EventType_ERROR,
+                          "SNTP: Unable to map statistics log %s: %s", SNTP_STATLOG_FILE, Reason);
+    }
+}
+
+/** Snapshot the cumulative counters the statistics log differences */
+void SNTP_StatTotals(SNTP_StatTotals_t *Totals) {
+    memset(Totals, 0, sizeof(*Totals));
+    for (int i = 0; i < SNTP_TIMESCALE_COUNT; i++) {
+        Totals->Requests += SNTP_Data.Serve.counts.scaleRequests[i];
+    }
+    Totals->BadRequests     = (uint16)SNTP_Data.Serve.counts.badRequests;
+    Totals->InvalidRequests = (uint16)SNTP_Data.Serve.counts.invalid;
+    Totals->AuthFailures    = SNTP_Data.ServerStats.authFailures + SNTP_Data.ServerStats.ntsFailures;
+    for (int i = 0; i < SNTP_SHED_CLASS_COUNT; i++) {
+        Totals->Shed += SNTP_Data.Shed.shed[i];
+    }
+    for (uint32 i = 0; i < SNTP_Data.ListenerCount; i++) {
+        Totals->KernelDrops += SNTP_Data.Listeners[i].SockStats.drops;
+    }
+    memcpy(Totals->Wake, SNTP_Data.WakeHist.buckets, sizeof(Totals->Wake));
+}
+
+/** Copy the serving loop's request counters into a housekeeping payload */
+void SNTP_ServeCounts(SNTP_HkTlm_Payload_t *Payload) {
+    const Sntp_ServeCounters_t *Counts = &SNTP_Data.Serve.counts;
+
+    Payload->SntpReqRcv          = (uint16)Counts->received;
+    Payload->SntpInvalidRequests = (uint16)Counts->invalid;
+    Payload->SntpBadRequests     = (uint16)Counts->badRequests;
+    Payload->SntpSendErrors      = Counts->sendErrors;
+    memcpy(Payload->SntpScaleRequests, Counts->scaleRequests, sizeof(Payload->SntpScaleRequests));
+}
+
+/** Append a record to the statistics log on the first call in each second */
+void SNTP_LogStatsIfDue(void) {
+    SNTP_StatTotals_t cur;
+    Sntp_StatRecord_t rec;
+    SntpTimestamp_t now;
+    uint32_t wake[SNTP_RT_HIST_BUCKETS];
+    uint32_t top = 0;
+    struct timespec mono;
+
+    // Called after every request, so only a coarse clock read (no system call) is spent until the second turns
+#ifdef CLOCK_MONOTONIC_COARSE
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &mono);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &mono);
+#endif
+    if (mono.tv_sec == SNTP_Data.StatSecond || SNTP_Data.StatLog.hdr == NULL) {
+        return;
+    }
+    SNTP_Data.StatSecond = mono.tv_sec;
+
+    SNTP_StatTotals(&cur);
+    memset(&rec, 0, sizeof(rec));
+    Sntp_TimeReadScale(SNTP_SCALE_UTC, &now);
+    rec.time         = ((uint64_t)now.seconds << 32) | now.fractions;
+    rec.requests     = cur.Requests - SNTP_Data.StatPrev.Requests;
+    rec.badRequests  = (uint16)(cur.BadRequests - SNTP_Data.StatPrev.BadRequests) +
+                       (uint16)(cur.InvalidRequests - SNTP_Data.StatPrev.InvalidRequests);
+    rec.authFailures = cur.AuthFailures - SNTP_Data.StatPrev.AuthFailures;
+    rec.shed         = cur.Shed - SNTP_Data.StatPrev.Shed;
+    rec.kernelDrops  = cur.KernelDrops - SNTP_Data.StatPrev.KernelDrops;
+    for (int i = 0; i < SNTP_RT_HIST_BUCKETS; i++) {
+        wake[i] = cur.Wake[i] - SNTP_Data.StatPrev.Wake[i];
+        top     = (wake[i] != 0) ? 1U << i : top;
+    }
+    rec.wakeP50Us     = Sntp_RtHistPercentile(wake, 50);
+    rec.wakeP99Us     = Sntp_RtHistPercentile(wake, 99);
+    rec.wakeMaxUs     = top;
+    rec.smearUs       = (int32_t)((Sntp_TimeSmearOffset() * 1000000) / 4294967296LL);
+    rec.timeSource    = Sntp_TimeSelected();
+    rec.leapIndicator = Sntp_TimeLeapIndicator();
+    rec.shedLevel     = SNTP_Data.Shed.level;
+    Sntp_StatLogAppend(&SNTP_Data.StatLog, &rec);
+    SNTP_Data.StatPrev = cur;
+}
+
+/** Publish a new time anchor to the shared-memory export on the first call in each second */
+void SNTP_ExportTimeIfDue(void) {
+    struct timespec mono;
+
+#ifdef CLOCK_MONOTONIC_COARSE
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &mono);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &mono);
+#endif
+    if (mono.tv_sec == SNTP_Data.ShmSecond) {
+        return;
+    }
+    SNTP_Data.ShmSecond = mono.tv_sec;
+    Sntp_ShmPublish(&SNTP_Data.Shm);
+}
+
+/** Build the variables a read variables query can return */
+void SNTP_ControlVars(Sntp_CtlVars_t *Vars) {
+    Sntp_CtlSysStats_t stats;
+    SNTP_StatTotals_t totals;
+    struct timespec mono;
+    char ports[24];
+    int used = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &mono);
+    SNTP_StatTotals(&totals);
+    stats.uptime    = (uint32)(mono.tv_sec - SNTP_Data.StartSecond);
+    stats.reset     = (uint32)(mono.tv_sec - SNTP_Data.ResetSecond);
+    stats.received  = SNTP_Data.Serve.counts.received + SNTP_Data.Serve.counts.invalid;
+    stats.processed = totals.Requests;
+    stats.badFormat = (uint32)totals.BadRequests + totals.InvalidRequests;
+    stats.badAuth   = totals.AuthFailures;
+    stats.declined  = totals.Shed;
+    stats.kodSent   = SNTP_Data.Shed.kod;
+
+    Vars->count = 0;
+    Sntp_CtlAddClockVars(Vars, &SNTP_Data.Listeners[0].Serve.cfg);
+    Sntp_CtlAddSysStats(Vars, &stats, &SNTP_Data.Ctl);
+    Sntp_CtlAddVar(Vars, "kernel_drops", "%u", (unsigned int)totals.KernelDrops);
+    Sntp_CtlAddVar(Vars, "shed_level", "%u", (unsigned int)SNTP_Data.Shed.level);
+    Sntp_CtlAddVar(Vars, "wake_p50", "%u", (unsigned int)Sntp_RtHistPercentile(totals.Wake, 50));
+    Sntp_CtlAddVar(Vars, "wake_p99", "%u", (unsigned int)Sntp_RtHistPercentile(totals.Wake, 99));
+    Sntp_CtlAddVar(Vars, "wake_max", "%u", (unsigned int)SNTP_Data.WakeHist.maxUs);
+    Sntp_CtlAddVar(Vars, "fleet_p50", "%d", (int)Sntp_FleetPercentile(&SNTP_Fleet.last, SNTP_FLEET_ALL, 50));
+    Sntp_CtlAddVar(Vars, "fleet_p99", "%d", (int)Sntp_FleetPercentile(&SNTP_Fleet.last, SNTP_FLEET_ALL, 99));
+    Sntp_CtlAddVar(Vars, "auth_keys", "%u", (unsigned int)SNTP_Data.AuthKeys.count);
+    Sntp_CtlAddVar(Vars, "nts", "%u", (unsigned int)SNTP_Data.ServerCfg.nts);
+    Sntp_CtlAddVar(Vars, "bcast_groups", "%u", (unsigned int)SNTP_Data.BcastCount);
+    ports[0] = '\0';
+    for (uint32 i = 0; i < SNTP_Data.ListenerCount && used >= 0 && used < (int)sizeof(ports); i++) {
+        used += snprintf(ports + used, sizeof(ports) - used, "%s%u", (i == 0) ? "" : ",",
+                         (unsigned int)SNTP_Data.Listeners[i].Port);
+    }
+    Sntp_CtlAddVar(Vars, "ports", "\"%s\"", ports);
+}
+
+/** Answer queued control queries, but only while no listener has time requests waiting and nothing is shed */
+void SNTP_AnswerControl(void) {
+    Sntp_CtlVars_t vars;
+
+    if (!Sntp_ServeControlDue(&SNTP_Data.Serve)) {
+        return;
+    }
+    for (uint32 i = 0; i < SNTP_Data.ListenerCount; i++) {
+        if (SNTP_Data.Listeners[i].SockStats.queue != 0) {
+            return;
+        }
+    }
+
+    SNTP_ControlVars(&vars);
+    Sntp_ServeAnswerControl(&SNTP_Data.Serve, &vars);
+}
+
+/** Point the serving loop at the state it counts into, shared with housekeeping and the warm start */
+void SNTP_InitServe(void) {
+    memset(&SNTP_Data.Serve, 0, sizeof(SNTP_Data.Serve));
+    SNTP_Data.Serve.serverStats       = &SNTP_Data.ServerStats;
+    SNTP_Data.Serve.shedCfg           = &SNTP_Data.ShedCfg;
+    SNTP_Data.Serve.shed              = &SNTP_Data.Shed;
+    SNTP_Data.Serve.wakeHist          = &SNTP_Data.WakeHist;
+    SNTP_Data.Serve.topTalkers        = &SNTP_TopTalkers;
+    SNTP_Data.Serve.fleet             = &SNTP_Fleet;
+    SNTP_Data.Serve.capture           = &SNTP_Capture;
+    SNTP_Data.Serve.ctlCfg            = &SNTP_Data.CtlCfg;
+    SNTP_Data.Serve.ctl               = &SNTP_Data.Ctl;
+    SNTP_Data.Serve.hooks.shedChanged = SNTP_ShedChanged;
+    SNTP_Data.Serve.hooks.invalid     = SNTP_InvalidDatagram;
+}
+
+/** Bind a listener serving scale on port; ports of 0 are skipped */
+int32 SNTP_InitListener(uint16 port, Sntp_TimeScale_t scale) {
+    SNTP_Listener_t *listener = &SNTP_Data.Listeners[SNTP_Data.ListenerCount];
 
-    return SntpSuccess;
+    if (port == 0) {
+        return CFE_SUCCESS;
+    }
+
+    memset(listener, 0, sizeof(*listener));
+    listener->Port = port;
+    listener->sockfd = SNTP_AdoptSocket(port, &listener->SockStats);
+    if (listener->sockfd < 0) {
+        listener->sockfd = initUDPSocket(port, &listener->SockStats);
+    }
+    if (listener->sockfd < 0) {
+        CFE_ES_WriteToSysLog("SNTP App: Error initializing UDP socket for %s on port %u\n",
+                             Sntp_TimeScaleName(scale), (unsigned int)port);
+        return CFE_STATUS_EXTERNAL_RESOURCE_FAIL;
+    }
+    listener->Serve.cfg = SNTP_Data.ServerCfg;
+    listener->Serve.cfg.scale = scale;
+    // Tests may substitute an in-memory ring transport after init
+    Sntp_SockTransportInit(&listener->SockTransport, listener->sockfd, &SNTP_Data.Poller, &listener->SockStats);
+    listener->Serve.transport = &listener->SockTransport.base;
+    listener->Serve.sockStats = &listener->SockStats;
+    SNTP_Data.ListenerCount++;
+
+    return CFE_SUCCESS;
+}
+
+/** Read the sockets the previous instance left in the CDS; they are only used if still open in this process */
+void SNTP_RestoreSockets(void) {
+    int32 status;
+
+    memset(&SNTP_Data.SocketCds, 0, sizeof(SNTP_Data.SocketCds));
+    status = CFE_ES_RegisterCDS(&SNTP_Data.SocketCdsHandle, sizeof(SNTP_Data.SocketCds), SNTP_SOCKET_CDS_NAME);
+    SNTP_Data.SocketCdsReady = (status == CFE_SUCCESS || status == CFE_ES_CDS_ALREADY_EXISTS);
+    if (!SNTP_Data.SocketCdsReady) {
+        CFE_ES_WriteToSysLog("SNTP App: Unable to register socket CDS, RC = 0x%08lX\n", (unsigned long)status);
+        return;
+    }
+    if (status == CFE_ES_CDS_ALREADY_EXISTS &&
+        (CFE_ES_RestoreFromCDS(&SNTP_Data.SocketCds, SNTP_Data.SocketCdsHandle) != CFE_SUCCESS ||
+         SNTP_Data.SocketCds.Pid != (uint32)getpid() || SNTP_Data.SocketCds.Count > SNTP_TIMESCALE_COUNT)) {
+        memset(&SNTP_Data.SocketCds, 0, sizeof(SNTP_Data.SocketCds));
+    }
+}
+
+/** Take over the previous instance's socket for a port, keeping the requests queued on it
+ * @return Descriptor, or -1 if there is none to take over
+ */
+int SNTP_AdoptSocket(uint16 port, Sntp_RtSockStats_t *stats) {
+    for (uint32 i = 0; i < SNTP_Data.SocketCds.Count; i++) {
+        int sockfd = SNTP_Data.SocketCds.Sockets[i].Sockfd;
+        if (SNTP_Data.SocketCds.Sockets[i].Port != port || !Sntp_HandoffValid(sockfd, port)) {
+            continue;
+        }
+        SNTP_Data.SocketCds.Sockets[i].Sockfd = -1;
+        // The receive timeout and timestamping options stay set on the socket; the buffer sizes are re-read
+        if (Sntp_RtSetBuffers(sockfd, SNTP_SO_RCVBUF, SNTP_SO_SNDBUF, stats) != 0) {
+            perror("Error setting socket buffer sizes");
+        }
+        SNTP_Data.SocketsAdopted++;
+        return sockfd;
+    }
+    return -1;
+}
+
+/** Record the listener sockets for the next instance and close any of the previous one's no longer served */
+void SNTP_SaveSockets(void) {
+    for (uint32 i = 0; i < SNTP_Data.SocketCds.Count; i++) {
+        if (Sntp_HandoffValid(SNTP_Data.SocketCds.Sockets[i].Sockfd, SNTP_Data.SocketCds.Sockets[i].Port)) {
+            close(SNTP_Data.SocketCds.Sockets[i].Sockfd);
+        }
+    }
+
+    memset(&SNTP_Data.SocketCds, 0, sizeof(SNTP_Data.SocketCds));
+    SNTP_Data.SocketCds.Pid   = (uint32)getpid();
+    SNTP_Data.SocketCds.Count = SNTP_Data.ListenerCount;
+    for (uint32 i = 0; i < SNTP_Data.ListenerCount; i++) {
+        SNTP_Data.SocketCds.Sockets[i].Sockfd = SNTP_Data.Listeners[i].sockfd;
+        SNTP_Data.SocketCds.Sockets[i].Port   = SNTP_Data.Listeners[i].Port;
+    }
+    if (SNTP_Data.SocketCdsReady) {
+        CFE_ES_CopyToCDS(SNTP_Data.SocketCdsHandle, &SNTP_Data.SocketCds);
+    }
+}
+
+static int64 SNTP_ClockMs(clockid_t Clock) {
+    struct timespec now;
+
+    clock_gettime(Clock, &now);
+    return (int64)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/** Restore the counters and client state saved by the previous instance, or start cold if there are none */
+void SNTP_RestoreState(void) {
+    SNTP_StateCds_t *Saved = &SNTP_StateCds;
+    const char      *Reason;
+    int64            Elapsed, Shift;
+    int32            status;
+
+    status = CFE_ES_RegisterCDS(&SNTP_Data.StateCdsHandle, sizeof(SNTP_StateCds), SNTP_STATE_CDS_NAME);
+    SNTP_Data.StateCdsReady = (status == CFE_SUCCESS || status == CFE_ES_CDS_ALREADY_EXISTS);
+    if (status != CFE_ES_CDS_ALREADY_EXISTS) {
+        if (!SNTP_Data.StateCdsReady) {
+            CFE_ES_WriteToSysLog("SNTP App: Unable to register state CDS, RC = 0x%08lX\n", (unsigned long)status);
+        }
+        return;
+    }
+
+    // The CDS checks the block's CRC; the layout and the table indexes are checked here
+    status = CFE_ES_RestoreFromCDS(Saved, SNTP_Data.StateCdsHandle);
+    Reason = Sntp_WarmCheck(&Saved->Header, status == CFE_SUCCESS, SNTP_STATE_CDS_VERSION, sizeof(*Saved));
+    if (Reason == NULL && (Saved->TopTalkers.minSlot >= SNTP_TOPK_K || Saved->TopTalkers.last.count > SNTP_TOPK_K)) {
+        Reason = "top talker indexes out of range";
+    }
+    if (Reason != NULL) {
+        CFE_EVS_SendEvent(SNTP_STATE_ERR_EID, CFE_EVS_EventType_ERROR,
+                          "SNTP: Saved state discarded, %s, RC = 0x%08lX, version %u, starting cold", Reason,
+                          (unsigned long)status, (unsigned int)Saved->Header.version);
+        return;
+    }
+
+    // Monotonic time starts again when the host reboots; move the saved timestamps onto this boot's clock
+    Shift = Sntp_WarmShift(&Saved->Header, SNTP_ClockMs(CLOCK_MONOTONIC), SNTP_ClockMs(CLOCK_REALTIME), &Elapsed);
+    for (int i = 0; i < SNTP_CTL_RATE_SLOTS; i++) {
+        Saved->Ctl.clients[i].lastMs = Sntp_WarmShiftMs(Saved->Ctl.clients[i].lastMs, Shift);
+    }
+    Saved->Ctl.total.lastMs = Sntp_WarmShiftMs(Saved->Ctl.total.lastMs, Shift);
+    Saved->TopTalkers.windowStart.tv_sec += Shift / 1000;
+    Saved->TopTalkers.windowStart.tv_nsec += (Shift % 1000) * 1000000;
+    if (Saved->TopTalkers.windowStart.tv_nsec < 0) {
+        Saved->TopTalkers.windowStart.tv_sec--;
+        Saved->TopTalkers.windowStart.tv_nsec += 1000000000;
+    } else if (Saved->TopTalkers.windowStart.tv_nsec >= 1000000000) {
+        Saved->TopTalkers.windowStart.tv_sec++;
+        Saved->TopTalkers.windowStart.tv_nsec -= 1000000000;
+    }
+
+    SNTP_Data.cnts        = Saved->Cnts;
+    SNTP_Data.Serve.counts.received    = Saved->Cnts.SntpReqRcv;
+    SNTP_Data.Serve.counts.invalid     = Saved->Cnts.SntpInvalidRequests;
+    SNTP_Data.Serve.counts.badRequests = Saved->Cnts.SntpBadRequests;
+    SNTP_Data.Serve.counts.sendErrors  = Saved->Cnts.SntpSendErrors;
+    memcpy(SNTP_Data.Serve.counts.scaleRequests, Saved->Cnts.SntpScaleRequests,
+           sizeof(SNTP_Data.Serve.counts.scaleRequests));
+    SNTP_SetTimeQueryCounts(Saved->Cnts.SntpTimeQueries, Saved->Cnts.SntpTimeQueryErrors);
+    SNTP_Data.ServerStats = Saved->ServerStats;
+    SNTP_Data.WakeHist    = Saved->WakeHist;
+    memcpy(SNTP_Data.Shed.shed, Saved->Shed, sizeof(SNTP_Data.Shed.shed));
+    SNTP_Data.Shed.kod    = Saved->ShedKod;
+    SNTP_Data.Ctl         = Saved->Ctl;
+    SNTP_TopTalkers       = Saved->TopTalkers;
+    SNTP_Data.ResetSecond = (time_t)((Saved->ResetMonoMs + Shift) / 1000);
+
+    CFE_EVS_SendEvent(SNTP_STATE_INF_EID, CFE_EVS_EventType_INFORMATION,
+                      "SNTP: Warm start, counters and client state restored from %lld s ago%s",
+                      (long long)(Elapsed / 1000), (Shift != 0) ? " on a new boot" : "");
 }
 
+/** Save the counters and client state for the next instance */
+void SNTP_SaveState(void) {
+    SNTP_StateCds_t *State = &SNTP_StateCds;
+
+    if (!SNTP_Data.StateCdsReady) {
+        return;
+    }
+    Sntp_WarmSeal(&State->Header, SNTP_STATE_CDS_VERSION, sizeof(*State), SNTP_ClockMs(CLOCK_MONOTONIC),
+                  SNTP_ClockMs(CLOCK_REALTIME));
+    State->ResetMonoMs = (int64)SNTP_Data.ResetSecond * 1000;
+    State->Cnts        = SNTP_Data.cnts;
+    SNTP_ServeCounts(&State->Cnts);
+    SNTP_TimeQueryCounts(&State->Cnts);
+    State->ServerStats = SNTP_Data.ServerStats;
+    State->WakeHist    = SNTP_Data.WakeHist;
+    memcpy(State->Shed, SNTP_Data.Shed.shed, sizeof(State->Shed));
+    State->ShedKod     = SNTP_Data.Shed.kod;
+    State->Ctl         = SNTP_Data.Ctl;
+    State->TopTalkers  = SNTP_TopTalkers;
+    CFE_ES_CopyToCDS(SNTP_Data.StateCdsHandle, State);
+}
 
 /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *  * *  * * * * **/
 /* SNTP_Main() -- Application entry point and main process loop         */
@@ -132,8 +976,6 @@ void SNTP_Main(void)
 {
     int32            status;
     CFE_SB_Buffer_t *SBBufPtr;
-    struct sockaddr_in clientAddr;
-    socklen_t clientLen = sizeof(clientAddr);
 
     /*
     ** Create the first Performance Log entry
@@ -176,25 +1018,28 @@ void SNTP_Main(void)
             SNTP_ProcessCommandPacket(SBBufPtr);
         }
 
-        /* Wait on receipt of UDP Packet, with 1s timeout for periodic checking */
-        ssize_t receivedBytes = recvfrom(SNTP_Data.sockfd, netBuf, NET_BUF_SIZE, 0, (struct sockaddr*)&clientAddr, &clientLen);
-
-        if (receivedBytes == NET_BUF_SIZE ) {
-            SNTP_Data.cnts.SntpReqRcv++;
-            if (process_sntp_request(&clientAddr, clientLen) != SntpSuccess) {
-                SNTP_Data.cnts.SntpBadRequests++;
-            }
-        } else if (receivedBytes > 0 ) {
-            SNTP_Data.cnts.SntpInvalidRequests++;
-            OS_printf("ERROR: Invalid packet received of size %li\n", receivedBytes);
-        } else if (receivedBytes < 0 && errno != ETIMEDOUT && errno != EAGAIN ) {
-            SNTP_Data.cnts.SntpInvalidRequests++;
-            OS_printf("Unexpected recvfrom error: %li %i=%s\n", receivedBytes, errno, strerror(errno));
-        } // else probable timeout
+        /* Wait on receipt of UDP Packets, with 1s timeout for periodic checking */
+        SNTP_ServeListeners();
+        SNTP_LogStatsIfDue();
+        SNTP_ExportTimeIfDue();
+        SNTP_AnswerControl();
         
     }
 
+    // The listener sockets are left open: the next instance finds them in the CDS and serves their queues
     OS_printf("****SNTP App Exiting****\n");
+#ifdef SNTP_ENABLE_NTS
+    SNTP_StopNts();
+#endif
+    SNTP_StopCapture();
+    SNTP_StopTimeQueries();
+    SNTP_SaveState();
+    if (SNTP_Data.BcastSockfd >= 0)
+    {
+        close(SNTP_Data.BcastSockfd);
+    }
+    Sntp_StatLogClose(&SNTP_Data.StatLog);
+    Sntp_ShmClose(&SNTP_Data.Shm);
 
     /*
     ** Performance Log Exit Stamp
@@ -212,7 +1057,8 @@ void SNTP_Main(void)
 /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * **/
 int32 SNTP_Init(void)
 {
-    int32 status;
+    int32           status;
+    struct timespec mono;
 
     SNTP_Data.RunStatus = CFE_ES_RunStatus_APP_RUN;
 
@@ -220,6 +1066,8 @@ int32 SNTP_Init(void)
     ** Initialize app command execution counters
     */
     memset(&SNTP_Data.cnts, 0, sizeof(SNTP_Data.cnts) );
+    memset(&SNTP_Data.Serve.counts, 0, sizeof(SNTP_Data.Serve.counts) );
+    SNTP_SetTimeQueryCounts(0, 0);
 
     /*
     ** Initialize app configuration data
@@ -244,6 +1092,8 @@ int32 SNTP_Init(void)
     */
     CFE_MSG_Init(CFE_MSG_PTR(SNTP_Data.HkTlm.TelemetryHeader), CFE_SB_ValueToMsgId(SNTP_HK_TLM_MID),
                  sizeof(SNTP_Data.HkTlm));
+    CFE_MSG_Init(CFE_MSG_PTR(SNTP_Data.TimeTlm.TelemetryHeader), CFE_SB_ValueToMsgId(SNTP_TIME_TLM_MID),
+                 sizeof(SNTP_Data.TimeTlm));
 
     /*
     ** Create Software Bus message pipe.
@@ -265,6 +1115,16 @@ int32 SNTP_Init(void)
         return (status);
     }
 
+    /*
+    ** Subscribe to the scheduler wakeup that paces broadcast packets
+    */
+    status = CFE_SB_Subscribe(CFE_SB_ValueToMsgId(SNTP_BCAST_WAKEUP_MID), SNTP_Data.CommandPipe);
+    if (status != CFE_SUCCESS)
+    {
+        CFE_ES_WriteToSysLog("SNTP App: Error Subscribing to broadcast wakeup, RC = 0x%08lX\n", (unsigned long)status);
+        return (status);
+    }
+
     /*
     ** Subscribe to ground command packets
     */
@@ -276,24 +1136,181 @@ int32 SNTP_Init(void)
         return (status);
     }
 
-    SNTP_Data.sockfd = initUDPSocket(SNTP_PORT);
-    if (SNTP_Data.sockfd < 0)
+    /*
+    ** Register and load the authentication key table
+    */
+    status = CFE_TBL_Register(&SNTP_Data.TblHandles[SNTP_KEY_TBL_IDX], "KeyTbl", sizeof(SNTP_KeyTbl_t), CFE_TBL_OPT_DEFAULT,
+                              SNTP_TblValidationFunc);
+    if (status != CFE_SUCCESS)
     {
-        CFE_ES_WriteToSysLog("SNTP App: Error initializing UDP socket\n");
-        return CFE_STATUS_EXTERNAL_RESOURCE_FAIL;        
+        CFE_ES_WriteToSysLog("SNTP App: Error Registering Key Table, RC = 0x%08lX\n", (unsigned long)status);
+        return (status);
     }
-    
-    CFE_EVS_SendEvent(SNTP_STARTUP_INF_EID, CFE_EVS_EventType_INFORMATION,
-                      "cFE SNTP Server %s Initialized at port %d, running as stratum %d and serving "
-#ifdef SNTP_USE_CFE_TIME
-                      "CFE UTC Time"
-#else
-                      "system time"
+
+    status = CFE_TBL_Load(SNTP_Data.TblHandles[SNTP_KEY_TBL_IDX], CFE_TBL_SRC_FILE, SNTP_TABLE_FILE);
+    if (status != CFE_SUCCESS)
+    {
+        CFE_EVS_SendEvent(SNTP_TBL_ERR_EID, CFE_EVS_EventType_ERROR,
+                          "SNTP: Error loading key table %s, RC = 0x%08lX", SNTP_TABLE_FILE, (unsigned long)status);
+    }
+    SNTP_LoadAuthKeys();
+
+    /*
+    ** Register and load the broadcast table; destinations are resolved once the socket exists
+    */
+    status = CFE_TBL_Register(&SNTP_Data.TblHandles[SNTP_BCAST_TBL_IDX], "BcastTbl", sizeof(SNTP_BcastTbl_t),
+                              CFE_TBL_OPT_DEFAULT, SNTP_BcastTblValidationFunc);
+    if (status != CFE_SUCCESS)
+    {
+        CFE_ES_WriteToSysLog("SNTP App: Error Registering Broadcast Table, RC = 0x%08lX\n", (unsigned long)status);
+        return (status);
+    }
+
+    status = CFE_TBL_Load(SNTP_Data.TblHandles[SNTP_BCAST_TBL_IDX], CFE_TBL_SRC_FILE, SNTP_BCAST_TABLE_FILE);
+    if (status != CFE_SUCCESS)
+    {
+        CFE_EVS_SendEvent(SNTP_TBL_ERR_EID, CFE_EVS_EventType_ERROR,
+                          "SNTP: Error loading broadcast table %s, RC = 0x%08lX", SNTP_BCAST_TABLE_FILE,
+                          (unsigned long)status);
+    }
+
+    /*
+    ** Register and load the shedding table; listener classes are applied once the listeners exist
+    */
+    status = CFE_TBL_Register(&SNTP_Data.TblHandles[SNTP_SHED_TBL_IDX], "ShedTbl", sizeof(SNTP_ShedTbl_t),
+                              CFE_TBL_OPT_DEFAULT, SNTP_ShedTblValidationFunc);
+    if (status != CFE_SUCCESS)
+    {
+        CFE_ES_WriteToSysLog("SNTP App: Error Registering Shedding Table, RC = 0x%08lX\n", (unsigned long)status);
+        return (status);
+    }
+
+    status = CFE_TBL_Load(SNTP_Data.TblHandles[SNTP_SHED_TBL_IDX], CFE_TBL_SRC_FILE, SNTP_SHED_TABLE_FILE);
+    if (status != CFE_SUCCESS)
+    {
+        CFE_EVS_SendEvent(SNTP_TBL_ERR_EID, CFE_EVS_EventType_ERROR,
+                          "SNTP: Error loading shedding table %s, RC = 0x%08lX", SNTP_SHED_TABLE_FILE,
+                          (unsigned long)status);
+    }
+
+    /*
+    ** Register and load the control query table
+    */
+    status = CFE_TBL_Register(&SNTP_Data.TblHandles[SNTP_CTL_TBL_IDX], "CtlTbl", sizeof(SNTP_CtlTbl_t),
+                              CFE_TBL_OPT_DEFAULT, SNTP_CtlTblValidationFunc);
+    if (status != CFE_SUCCESS)
+    {
+        CFE_ES_WriteToSysLog("SNTP App: Error Registering Control Table, RC = 0x%08lX\n", (unsigned long)status);
+        return (status);
+    }
+
+    status = CFE_TBL_Load(SNTP_Data.TblHandles[SNTP_CTL_TBL_IDX], CFE_TBL_SRC_FILE, SNTP_CTL_TABLE_FILE);
+    if (status != CFE_SUCCESS)
+    {
+        CFE_EVS_SendEvent(SNTP_TBL_ERR_EID, CFE_EVS_EventType_ERROR,
+                          "SNTP: Error loading control table %s, RC = 0x%08lX", SNTP_CTL_TABLE_FILE,
+                          (unsigned long)status);
+    }
+    SNTP_LoadCtlConfig();
+
+    SNTP_InitTime();
+    Sntp_TopKInit(&SNTP_TopTalkers);
+    Sntp_FleetInit(&SNTP_Fleet);
+    Sntp_StageConfigure(SNTP_STAGE_SAMPLE_EVERY);
+    clock_gettime(CLOCK_MONOTONIC, &mono);
+    SNTP_Data.StartSecond = SNTP_Data.ResetSecond = mono.tv_sec;
+    SNTP_InitServe();
+    SNTP_RestoreState();
+    if (SNTP_STATLOG_FILE[0] != '\0')
+    {
+        SNTP_OpenStatLog();
+    }
+    if (SNTP_SHM_NAME[0] != '\0' &&
+        Sntp_ShmOpen(&SNTP_Data.Shm, SNTP_SHM_NAME, SNTP_SHM_REFCLOCK_UNIT, 1000) != 0)
+    {
+        CFE_EVS_SendEvent(SNTP_SHM_ERR_EID, CFE_EVS_EventType_ERROR,
+                          "SNTP: Unable to export time to shared memory %s: %s", SNTP_SHM_NAME, strerror(errno));
+    }
+
+    SNTP_Data.ServerCfg.stratum  = SNTP_STRATUM;
+    SNTP_Data.ServerCfg.authKeys = &SNTP_Data.AuthKeys;
+
+#ifdef SNTP_ENABLE_NTS
+    SNTP_InitNts();
 #endif
-                      "\n",
+
+    SNTP_Data.ListenerCount  = 0;
+    SNTP_Data.SocketsAdopted = 0;
+    SNTP_Data.BcastSockfd    = -1;
+    SNTP_RestoreSockets();
+    status = CFE_SUCCESS;
+    if (SNTP_InitListener(SNTP_PORT, SNTP_SCALE_UTC) != CFE_SUCCESS ||
+        SNTP_InitListener(SNTP_TAI_PORT, SNTP_SCALE_TAI) != CFE_SUCCESS ||
+        SNTP_InitListener(SNTP_MET_PORT, SNTP_SCALE_MET) != CFE_SUCCESS)
+    {
+        status = CFE_STATUS_EXTERNAL_RESOURCE_FAIL;
+    }
+    else if (SNTP_Data.ListenerCount == 0)
+    {
+        CFE_ES_WriteToSysLog("SNTP App: No listener ports configured\n");
+        status = CFE_STATUS_EXTERNAL_RESOURCE_FAIL;
+    }
+    // Saved even if a listener failed: the sockets opened so far go to the next instance, and those the
+    // previous instance left that were not taken up are closed rather than leaked
+    SNTP_SaveSockets();
+    if (status != CFE_SUCCESS)
+    {
+        return status;
+    }
+    // Drained until empty after poll() when multiplexing, so receives must not block; a lone listener blocks
+    // in recv, and its socket may have been left non-blocking by an instance serving several
+    for (uint32 i = 0; i < SNTP_Data.ListenerCount; i++)
+    {
+        int flags = fcntl(SNTP_Data.Listeners[i].sockfd, F_GETFL);
+        fcntl(SNTP_Data.Listeners[i].sockfd, F_SETFL,
+              (SNTP_Data.ListenerCount > 1) ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK));
+    }
+    if (SNTP_Data.SocketsAdopted != 0)
+    {
+        CFE_EVS_SendEvent(SNTP_HANDOFF_INF_EID, CFE_EVS_EventType_INFORMATION,
+                          "SNTP: Serving on %u of %u sockets left by the previous instance",
+                          (unsigned int)SNTP_Data.SocketsAdopted, (unsigned int)SNTP_Data.ListenerCount);
+    }
+    // The statistics log continues from the restored counters rather than logging them as one second's
+    SNTP_StatTotals(&SNTP_Data.StatPrev);
+    SNTP_LoadBcastConfig();
+    SNTP_LoadShedConfig();
+
+    SNTP_InitRealtime();
+
+    /*
+    ** Capture writer, idle until a capture is started by command
+    */
+    atomic_store(&SNTP_Data.PcapStopped, false);
+    status = (Sntp_PcapInit(&SNTP_Capture) == 0) ? CFE_SUCCESS : CFE_STATUS_EXTERNAL_RESOURCE_FAIL;
+    if (status == CFE_SUCCESS)
+    {
+        status = CFE_ES_CreateChildTask(&SNTP_Data.PcapTaskId, "SNTP_PCAP", SNTP_PcapWriterTask, NULL,
+                                        SNTP_PCAP_STACK_SIZE, SNTP_PCAP_PRIORITY, 0);
+    }
+    SNTP_Data.PcapReady = (status == CFE_SUCCESS);
+    if (status != CFE_SUCCESS)
+    {
+        CFE_EVS_SendEvent(SNTP_CAPTURE_ERR_EID, CFE_EVS_EventType_ERROR,
+                          "SNTP: Unable to create capture writer task, RC = 0x%08lX", (unsigned long)status);
+    }
+
+    SNTP_InitTimeQueries();
+    
+    CFE_EVS_SendEvent(SNTP_STARTUP_INF_EID, CFE_EVS_EventType_INFORMATION,
+                      "cFE SNTP Server %s Initialized at port %d, running as stratum %d and serving "
+                      "%s time on %u listeners%s\n",
                       SNTP_VERSION_STRING,
-                      SNTP_PORT,
-                      SNTP_STRATUM
+                      SNTP_Data.Listeners[0].Port,
+                      SNTP_STRATUM,
+                      Sntp_TimeInfo(Sntp_TimeSelected())->name,
+                      (unsigned int)SNTP_Data.ListenerCount,
+                      SNTP_Data.ServerCfg.nts ? " with NTS" : ""
         );
     
     return (CFE_SUCCESS);
@@ -324,6 +1341,10 @@ void SNTP_ProcessCommandPacket(CFE_SB_Buffer_t *SBBufPtr)
             SNTP_ReportHousekeeping((CFE_MSG_CommandHeader_t *)SBBufPtr);
             break;
 
+        case SNTP_BCAST_WAKEUP_MID:
+            SNTP_SendBroadcast();
+            break;
+
         default:
             CFE_EVS_SendEvent(SNTP_INVALID_MSGID_ERR_EID, CFE_EVS_EventType_ERROR,
                               "SNTP: invalid command packet,MID = 0x%x", (unsigned int)CFE_SB_MsgIdToValue(MsgId));
@@ -342,8 +1363,11 @@ void SNTP_ProcessCommandPacket(CFE_SB_Buffer_t *SBBufPtr)
 void SNTP_ProcessGroundCommand(CFE_SB_Buffer_t *SBBufPtr)
 {
     CFE_MSG_FcnCode_t CommandCode = 0;
+    size_t            ActualLength = 0;
 
     CFE_MSG_GetFcnCode(&SBBufPtr->Msg, &CommandCode);
+    CFE_MSG_GetSize(&SBBufPtr->Msg, &ActualLength);
+    SNTP_PROBE2(command__start, CommandCode, ActualLength);
 
     /*
     ** Process "known" SNTP app ground commands
@@ -366,6 +1390,54 @@ void SNTP_ProcessGroundCommand(CFE_SB_Buffer_t *SBBufPtr)
 
             break;
 
+        case SNTP_CAPTURE_START_CC:
+            if (SNTP_VerifyCmdLength(&SBBufPtr->Msg, sizeof(SNTP_CaptureStartCmd_t)))
+            {
+                SNTP_CaptureStart((SNTP_CaptureStartCmd_t *)SBBufPtr);
+            }
+
+            break;
+
+        case SNTP_CAPTURE_STOP_CC:
+            if (SNTP_VerifyCmdLength(&SBBufPtr->Msg, sizeof(SNTP_CaptureStopCmd_t)))
+            {
+                SNTP_CaptureStop((SNTP_CaptureStopCmd_t *)SBBufPtr);
+            }
+
+            break;
+
+        case SNTP_SET_TIME_SOURCE_CC:
+            if (SNTP_VerifyCmdLength(&SBBufPtr->Msg, sizeof(SNTP_SetTimeSourceCmd_t)))
+            {
+                SNTP_SetTimeSource((SNTP_SetTimeSourceCmd_t *)SBBufPtr);
+            }
+
+            break;
+
+        case SNTP_TOPK_DUMP_CC:
+            if (SNTP_VerifyCmdLength(&SBBufPtr->Msg, sizeof(SNTP_TopKDumpCmd_t)))
+            {
+                SNTP_TopKDump((SNTP_TopKDumpCmd_t *)SBBufPtr);
+            }
+
+            break;
+
+        case SNTP_SCHEDULE_LEAP_CC:
+            if (SNTP_VerifyCmdLength(&SBBufPtr->Msg, sizeof(SNTP_ScheduleLeapCmd_t)))
+            {
+                SNTP_ScheduleLeap((SNTP_ScheduleLeapCmd_t *)SBBufPtr);
+            }
+
+            break;
+
+        case SNTP_STAGE_DUMP_CC:
+            if (SNTP_VerifyCmdLength(&SBBufPtr->Msg, sizeof(SNTP_StageDumpCmd_t)))
+            {
+                SNTP_StageDump((SNTP_StageDumpCmd_t *)SBBufPtr);
+            }
+
+            break;
+
         /* default case already found during FC vs length test */
         default:
             CFE_EVS_SendEvent(SNTP_COMMAND_ERR_EID, CFE_EVS_EventType_ERROR,
@@ -373,6 +1445,7 @@ void SNTP_ProcessGroundCommand(CFE_SB_Buffer_t *SBBufPtr)
             break;
     }
 
+    SNTP_PROBE3(command__done, CommandCode, SNTP_Data.cnts.CommandCounter, SNTP_Data.cnts.CommandErrorCounter);
     return;
 
 } /* End of SNTP_ProcessGroundCommand() */
@@ -388,10 +1461,90 @@ void SNTP_ProcessGroundCommand(CFE_SB_Buffer_t *SBBufPtr)
 /* * * * * * * * * * * * * * * * * * * * * * * *  * * * * * * *  * *  * * * * */
 int32 SNTP_ReportHousekeeping(const CFE_MSG_CommandHeader_t *Msg)
 {
+    Sntp_TopKReport_t TopTalkers;
+
+    SNTP_PROBE1(hk__start, SNTP_Data.Serve.counts.received);
+
     /*
     ** Get command execution counters...
     */
     SNTP_Data.HkTlm.Payload = SNTP_Data.cnts;
+    SNTP_ServeCounts(&SNTP_Data.HkTlm.Payload);
+    SNTP_TimeQueryCounts(&SNTP_Data.HkTlm.Payload);
+    SNTP_Data.HkTlm.Payload.SntpAuthKeys      = SNTP_Data.AuthKeys.count;
+    SNTP_Data.HkTlm.Payload.SntpAuthResponses = SNTP_Data.ServerStats.authResponses;
+    SNTP_Data.HkTlm.Payload.SntpAuthFailures  = SNTP_Data.ServerStats.authFailures;
+    SNTP_Data.HkTlm.Payload.SntpNtsResponses  = SNTP_Data.ServerStats.ntsResponses;
+    SNTP_Data.HkTlm.Payload.SntpNtsFailures   = SNTP_Data.ServerStats.ntsFailures;
+    SNTP_Data.HkTlm.Payload.SntpWakeMaxUs     = SNTP_Data.WakeHist.maxUs;
+    SNTP_Data.HkTlm.Payload.SntpCaptured      = SNTP_Capture.captured;
+    SNTP_Data.HkTlm.Payload.SntpCaptureDrops  = SNTP_Capture.dropped;
+    SNTP_Data.HkTlm.Payload.SntpKernelDrops   = 0;
+    SNTP_Data.HkTlm.Payload.SntpPeakQueueBytes = 0;
+    for (uint32 i = 0; i < SNTP_Data.ListenerCount; i++)
+    {
+        Sntp_RtSockStats_t *stats = &SNTP_Data.Listeners[i].SockStats;
+        SNTP_Data.HkTlm.Payload.SntpKernelDrops += stats->drops;
+        if (stats->peakQueue > SNTP_Data.HkTlm.Payload.SntpPeakQueueBytes)
+        {
+            SNTP_Data.HkTlm.Payload.SntpPeakQueueBytes = stats->peakQueue;
+        }
+        stats->peakQueue = 0;
+    }
+    SNTP_Data.HkTlm.Payload.SntpRcvBufBytes   = SNTP_Data.Listeners[0].SockStats.rcvBuf;
+    SNTP_Data.HkTlm.Payload.SntpSndBufBytes   = SNTP_Data.Listeners[0].SockStats.sndBuf;
+    SNTP_Data.HkTlm.Payload.SntpSpinMs        = (uint32)(SNTP_Data.Poller.spinNs / 1000000);
+    SNTP_Data.HkTlm.Payload.SntpSleepMs       = (uint32)(SNTP_Data.Poller.sleepNs / 1000000);
+    memcpy(SNTP_Data.HkTlm.Payload.SntpWakeHist, SNTP_Data.WakeHist.buckets, sizeof(SNTP_Data.WakeHist.buckets));
+    for (int i = 0; i < SNTP_TIME_SOURCE_COUNT; i++)
+    {
+        const Sntp_TimeSrcInfo_t *info = Sntp_TimeInfo((Sntp_TimeSrc_t)i);
+        SNTP_Data.HkTlm.Payload.SntpTimeCostNs[i] = info->available ? info->costNs : 0;
+        SNTP_Data.HkTlm.Payload.SntpTimeResNs[i]  = info->available ? info->resolutionNs : 0;
+    }
+    SNTP_Data.HkTlm.Payload.SntpTimeSource = (uint8)Sntp_TimeSelected();
+    memcpy(SNTP_Data.HkTlm.Payload.SntpShed, SNTP_Data.Shed.shed, sizeof(SNTP_Data.Shed.shed));
+    SNTP_Data.HkTlm.Payload.SntpShedKod   = SNTP_Data.Shed.kod;
+    SNTP_Data.HkTlm.Payload.SntpShedLevel = (uint8)SNTP_Data.Shed.level;
+    SNTP_Data.HkTlm.Payload.SntpCtlAnswered = SNTP_Data.Ctl.answered;
+    SNTP_Data.HkTlm.Payload.SntpCtlRefused  = SNTP_Data.Ctl.restricted + SNTP_Data.Ctl.limited;
+
+    Sntp_TopKRotateIfDue(&SNTP_TopTalkers, SNTP_TOPK_WINDOW_SECS);
+    Sntp_FleetRotateIfDue(&SNTP_Fleet, SNTP_FLEET_WINDOW_SECS);
+    SNTP_Data.HkTlm.Payload.SntpFleetSamples  = SNTP_Fleet.last.samples;
+    SNTP_Data.HkTlm.Payload.SntpFleetUnsynced = SNTP_Fleet.last.unsynced;
+    for (int i = 0; i < SNTP_FLEET_PERCENTILES; i++)
+    {
+        SNTP_Data.HkTlm.Payload.SntpFleetOffsetUs[i] =
+            Sntp_FleetPercentile(&SNTP_Fleet.last, SNTP_FLEET_ALL, SNTP_FleetPcts[i]);
+    }
+    for (int i = 0; i < SNTP_SHED_CLASSES; i++)
+    {
+        SNTP_Data.HkTlm.Payload.SntpFleetMedianUs[i] = Sntp_FleetPercentile(&SNTP_Fleet.last, i, 50);
+    }
+    Sntp_TopKReport(&SNTP_TopTalkers, &TopTalkers);
+    SNTP_Data.HkTlm.Payload.SntpTopTalkerAddr = 0;
+    SNTP_Data.HkTlm.Payload.SntpTopTalkerRate = 0;
+    if (TopTalkers.count > 0 && TopTalkers.seconds > 0)
+    {
+        SNTP_Data.HkTlm.Payload.SntpTopTalkerAddr = TopTalkers.entries[0].addr;
+        SNTP_Data.HkTlm.Payload.SntpTopTalkerRate = (uint32)(TopTalkers.entries[0].count / TopTalkers.seconds);
+    }
+
+    // Track leap second, STCF and clock step changes in the cached timescale offsets
+    OS_MutSemTake(SNTP_Data.TimeMutex);
+    Sntp_TimeRefreshOffsets();
+    OS_MutSemGive(SNTP_Data.TimeMutex);
+    SNTP_Data.HkTlm.Payload.SntpPrecision  = Sntp_TimePrecision();
+    SNTP_Data.HkTlm.Payload.SntpLeapSecs   = Sntp_TimeLeapPending();
+    SNTP_Data.HkTlm.Payload.SntpSmearUs    = (int32)((Sntp_TimeSmearOffset() * 1000000) / 4294967296LL);
+    SNTP_Data.HkTlm.Payload.SntpLeapIndicator = Sntp_TimeLeapIndicator();
+#ifdef SNTP_ENABLE_NTS
+    Sntp_NtsStats_t ntsStats;
+    Sntp_NtsGetStats(&ntsStats);
+    SNTP_Data.HkTlm.Payload.SntpNtsKeSessions = ntsStats.keSessions;
+    SNTP_Data.HkTlm.Payload.SntpNtsKeFailures = ntsStats.keFailures;
+#endif
 
     /*
     ** Send housekeeping telemetry packet...
@@ -399,7 +1552,28 @@ int32 SNTP_ReportHousekeeping(const CFE_MSG_CommandHeader_t *Msg)
     CFE_SB_TimeStampMsg(CFE_MSG_PTR(SNTP_Data.HkTlm.TelemetryHeader));
     CFE_SB_TransmitMsg(CFE_MSG_PTR(SNTP_Data.HkTlm.TelemetryHeader), true);
 
-    
+    // A processor reset gives no warning, so the warm start state is saved as often as it is reported
+    SNTP_SaveState();
+
+    /*
+    ** Manage any pending table loads, validations, etc.
+    */
+    CFE_TBL_Manage(SNTP_Data.TblHandles[SNTP_KEY_TBL_IDX]);
+    SNTP_LoadAuthKeys();
+    CFE_TBL_Manage(SNTP_Data.TblHandles[SNTP_BCAST_TBL_IDX]);
+    SNTP_LoadBcastConfig();
+    CFE_TBL_Manage(SNTP_Data.TblHandles[SNTP_SHED_TBL_IDX]);
+    SNTP_LoadShedConfig();
+    CFE_TBL_Manage(SNTP_Data.TblHandles[SNTP_CTL_TBL_IDX]);
+    SNTP_LoadCtlConfig();
+
+#ifdef SNTP_ENABLE_NTS
+    if (SNTP_Data.ServerCfg.nts) {
+        Sntp_NtsRotateIfDue(SNTP_NTS_KEY_ROTATE_SECS);
+    }
+#endif
+
+    SNTP_PROBE1(hk__done, SNTP_Data.Serve.counts.received);
     return CFE_SUCCESS;
 
 } /* End of SNTP_ReportHousekeeping() */
@@ -421,6 +1595,315 @@ int32 SNTP_Noop(const SNTP_NoopCmd_t *Msg)
 
 } /* End of SNTP_Noop */
 
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * **/
+/*                                                                            */
+/* SNTP_CaptureStart -- Begin capturing requests to a pcap file               */
+/*                                                                            */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * **/
+int32 SNTP_CaptureStart(const SNTP_CaptureStartCmd_t *Msg)
+{
+    char File[CFE_MISSION_MAX_PATH_LEN];
+    char LocalFile[OS_MAX_LOCAL_PATH_LEN];
+    const char *Reason;
+
+    strncpy(File, Msg->Payload.File, sizeof(File) - 1);
+    File[sizeof(File) - 1] = '\0';
+
+    // The file functions need the host path, not the OSAL virtual one
+    Reason = NULL;
+    if (!SNTP_Data.PcapReady)
+    {
+        Reason = "no writer task";
+    }
+    else if (OS_TranslatePath(File, LocalFile) != OS_SUCCESS)
+    {
+        Reason = "invalid path";
+    }
+    else if (Sntp_PcapStart(&SNTP_Capture, LocalFile, Msg->Payload.SampleN, SNTP_PORT) != 0)
+    {
+        Reason = strerror(errno);
+    }
+    if (Reason != NULL)
+    {
+        SNTP_Data.cnts.CommandErrorCounter++;
+        CFE_EVS_SendEvent(SNTP_CAPTURE_ERR_EID, CFE_EVS_EventType_ERROR, "SNTP: Unable to start capture to %s: %s",
+                          File, Reason);
+        return CFE_STATUS_EXTERNAL_RESOURCE_FAIL;
+    }
+
+    SNTP_Data.cnts.CommandCounter++;
+    CFE_EVS_SendEvent(SNTP_CAPTURE_INF_EID, CFE_EVS_EventType_INFORMATION,
+                      "SNTP: Capturing 1 in %u requests to %s", (unsigned int)SNTP_Capture.sampleN, File);
+
+    return CFE_SUCCESS;
+
+} /* End of SNTP_CaptureStart() */
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * **/
+/*                                                                            */
+/* SNTP_CaptureStop -- Stop the active capture                                */
+/*                                                                            */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * **/
+int32 SNTP_CaptureStop(const SNTP_CaptureStopCmd_t *Msg)
+{
+    // Issued from the serving task, so no further requests are queued once this returns
+    Sntp_PcapStop(&SNTP_Capture);
+
+    SNTP_Data.cnts.CommandCounter++;
+    CFE_EVS_SendEvent(SNTP_CAPTURE_INF_EID, CFE_EVS_EventType_INFORMATION,
+                      "SNTP: Capture stopped, %u requests captured, %u dropped", (unsigned int)SNTP_Capture.captured,
+                      (unsigned int)SNTP_Capture.dropped);
+
+    return CFE_SUCCESS;
+
+} /* End of SNTP_CaptureStop() */
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * **/
+/*                                                                            */
+/* SNTP_SetTimeSource -- Select the clock all timestamps are read from        */
+/*                                                                            */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * **/
+int32 SNTP_SetTimeSource(const SNTP_SetTimeSourceCmd_t *Msg)
+{
+    const Sntp_TimeSrcInfo_t *info;
+    SntpStatus_t              Status;
+
+    OS_MutSemTake(SNTP_Data.TimeMutex);
+    Status = Sntp_TimeSelect((Sntp_TimeSrc_t)Msg->Payload.Source);
+    OS_MutSemGive(SNTP_Data.TimeMutex);
+    if (Status != SntpSuccess)
+    {
+        SNTP_Data.cnts.CommandErrorCounter++;
+        CFE_EVS_SendEvent(SNTP_TIME_ERR_EID, CFE_EVS_EventType_ERROR, "SNTP: Time source %u is not available",
+                          (unsigned int)Msg->Payload.Source);
+        return CFE_STATUS_RANGE_ERROR;
+    }
+
+    info = Sntp_TimeInfo(Sntp_TimeSelected());
+    SNTP_Data.cnts.CommandCounter++;
+    CFE_EVS_SendEvent(SNTP_TIME_INF_EID, CFE_EVS_EventType_INFORMATION,
+                      "SNTP: Time source %s, read cost %uns, resolution %uns, precision %d", info->name,
+                      (unsigned int)info->costNs, (unsigned int)info->resolutionNs, (int)info->precision);
+
+    return CFE_SUCCESS;
+
+} /* End of SNTP_SetTimeSource() */
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * **/
+/*                                                                            */
+/* SNTP_TopKDump -- Write the busiest source addresses to a file              */
+/*                                                                            */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * **/
+int32 SNTP_TopKDump(const SNTP_TopKDumpCmd_t *Msg)
+{
+    char  File[CFE_MISSION_MAX_PATH_LEN];
+    char  LocalFile[OS_MAX_LOCAL_PATH_LEN];
+    FILE *out;
+    int   rc;
+    const char *Reason;
+
+    strncpy(File, Msg->Payload.File, sizeof(File) - 1);
+    File[sizeof(File) - 1] = '\0';
+    if (File[0] == '\0')
+    {
+        strncpy(File, SNTP_TOPK_FILE, sizeof(File) - 1);
+    }
+
+    // The file functions need the host path, not the OSAL virtual one
+    Reason = NULL;
+    if (OS_TranslatePath(File, LocalFile) != OS_SUCCESS)
+    {
+        Reason = "invalid path";
+    }
+    else
+    {
+        out = fopen(LocalFile, "w");
+        rc  = (out != NULL) ? Sntp_TopKWrite(&SNTP_TopTalkers, out) : -1;
+        if (out != NULL && fclose(out) != 0)
+        {
+            rc = -1;
+        }
+        if (rc != 0)
+        {
+            Reason = strerror(errno);
+        }
+    }
+    if (Reason != NULL)
+    {
+        SNTP_Data.cnts.CommandErrorCounter++;
+        CFE_EVS_SendEvent(SNTP_TOPK_ERR_EID, CFE_EVS_EventType_ERROR, "SNTP: Unable to write top talkers to %s: %s",
+                          File, Reason);
+        return CFE_STATUS_EXTERNAL_RESOURCE_FAIL;
+    }
+
+    SNTP_Data.cnts.CommandCounter++;
+    CFE_EVS_SendEvent(SNTP_TOPK_INF_EID, CFE_EVS_EventType_INFORMATION,
+                      "SNTP: Top talkers written to %s, %u requests in the current window", File,
+                      (unsigned int)SNTP_TopTalkers.total);
+
+    return CFE_SUCCESS;
+
+} /* End of SNTP_TopKDump() */
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * **/
+/*                                                                            */
+/* SNTP_ScheduleLeap -- Schedule or cancel a leap second and its smear        */
+/*                                                                            */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * **/
+int32 SNTP_ScheduleLeap(const SNTP_ScheduleLeapCmd_t *Msg)
+{
+    const SNTP_ScheduleLeap_Payload_t *Leap = &Msg->Payload;
+    SntpStatus_t                       Status;
+
+    if (Leap->Direction == 0)
+    {
+        OS_MutSemTake(SNTP_Data.TimeMutex);
+        Sntp_TimeCancelLeap();
+        OS_MutSemGive(SNTP_Data.TimeMutex);
+        SNTP_Data.cnts.CommandCounter++;
+        CFE_EVS_SendEvent(SNTP_LEAP_INF_EID, CFE_EVS_EventType_INFORMATION, "SNTP: Leap second cancelled");
+        return CFE_SUCCESS;
+    }
+
+    OS_MutSemTake(SNTP_Data.TimeMutex);
+    Status = Sntp_TimeScheduleLeap(Leap->LeapSecs, Leap->Direction, (Sntp_SmearShape_t)Leap->Shape, Leap->SmearSecs);
+    OS_MutSemGive(SNTP_Data.TimeMutex);
+    if (Status != SntpSuccess)
+    {
+        SNTP_Data.cnts.CommandErrorCounter++;
+        CFE_EVS_SendEvent(SNTP_LEAP_ERR_EID, CFE_EVS_EventType_ERROR,
+                          "SNTP: Invalid leap second %u, direction %d, shape %u, smear %us (smearing needs a TAI "
+                          "time source and a future leap)",
+                          (unsigned int)Leap->LeapSecs, (int)Leap->Direction, (unsigned int)Leap->Shape,
+                          (unsigned int)Leap->SmearSecs);
+        return CFE_STATUS_RANGE_ERROR;
+    }
+
+    SNTP_Data.cnts.CommandCounter++;
+    CFE_EVS_SendEvent(SNTP_LEAP_INF_EID, CFE_EVS_EventType_INFORMATION,
+                      "SNTP: Leap second %+d scheduled at %u, shape %u, smear %us", (int)Leap->Direction,
+                      (unsigned int)Leap->LeapSecs, (unsigned int)Leap->Shape, (unsigned int)Leap->SmearSecs);
+
+    return CFE_SUCCESS;
+
+} /* End of SNTP_ScheduleLeap() */
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * **/
+/*                                                                            */
+/* SNTP_StageDump -- Write the sampled request stage trace to a file          */
+/*                                                                            */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * **/
+int32 SNTP_StageDump(const SNTP_StageDumpCmd_t *Msg)
+{
+    char  File[CFE_MISSION_MAX_PATH_LEN];
+    char  LocalFile[OS_MAX_LOCAL_PATH_LEN];
+    FILE *out;
+    int   written;
+    const char *Reason;
+
+    strncpy(File, Msg->Payload.File, sizeof(File) - 1);
+    File[sizeof(File) - 1] = '\0';
+    if (File[0] == '\0')
+    {
+        strncpy(File, SNTP_STAGE_FILE, sizeof(File) - 1);
+    }
+
+    // The file functions need the host path, not the OSAL virtual one
+    Reason  = NULL;
+    written = 0;
+    if (OS_TranslatePath(File, LocalFile) != OS_SUCCESS)
+    {
+        Reason = "invalid path";
+    }
+    else
+    {
+        out     = fopen(LocalFile, "w");
+        written = (out != NULL) ? Sntp_StageWrite(out) : -1;
+        if (out != NULL && fclose(out) != 0)
+        {
+            written = -1;
+        }
+        if (written < 0)
+        {
+            Reason = strerror(errno);
+        }
+    }
+    if (Reason != NULL)
+    {
+        SNTP_Data.cnts.CommandErrorCounter++;
+        CFE_EVS_SendEvent(SNTP_STAGE_ERR_EID, CFE_EVS_EventType_ERROR, "SNTP: Unable to write stage trace to %s: %s",
+                          File, Reason);
+        return CFE_STATUS_EXTERNAL_RESOURCE_FAIL;
+    }
+
+    SNTP_Data.cnts.CommandCounter++;
+    CFE_EVS_SendEvent(SNTP_STAGE_INF_EID, CFE_EVS_EventType_INFORMATION,
+                      "SNTP: Stage trace of %d sampled requests written to %s", written, File);
+
+    return CFE_SUCCESS;
+
+} /* End of SNTP_StageDump() */
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * **/
+/*                                                                            */
+/* SNTP_AnswerTimeQuery -- Answer an onboard app's time query on the bus      */
+/*                                                                            */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * **/
+int32 SNTP_AnswerTimeQuery(const SNTP_TimeQueryCmd_t *Msg)
+{
+    const SNTP_TimeQuery_Payload_t *Query = &Msg->Payload;
+    SNTP_TimeTlm_Payload_t         *Tlm   = &SNTP_Data.TimeTlm.Payload;
+    Sntp_ServerConfig_t             Cfg   = SNTP_Data.ServerCfg;
+    Sntp_ServerReading_t            Reading;
+    SntpTimestamp_t                 RxTime;
+    SntpStatus_t                    Status;
+    int32                           SbStatus;
+
+    // Read as a plain client request would be answered, under the lock the main task changes the time state under
+    Cfg.scale = (Sntp_TimeScale_t)Query->Timescale;
+    OS_MutSemTake(SNTP_Data.TimeMutex);
+    Sntp_TimeRead(&RxTime);
+    Status = Sntp_ServerRead(&Cfg, &RxTime, &Reading);
+    Tlm->LeapSecs = Sntp_TimeLeapPending();
+    Tlm->TimeSource = (uint8)Sntp_TimeSelected();
+    OS_MutSemGive(SNTP_Data.TimeMutex);
+    if (Status != SntpSuccess)
+    {
+        __atomic_fetch_add(&SNTP_Data.TimeQueryCounts.Errors, 1, __ATOMIC_RELAXED);
+        CFE_EVS_SendEvent(SNTP_TIME_QUERY_ERR_EID, CFE_EVS_EventType_ERROR,
+                          "SNTP: Time query with unknown timescale %u", (unsigned int)Query->Timescale);
+        return CFE_STATUS_RANGE_ERROR;
+    }
+
+    Tlm->Tag               = Query->Tag;
+    Tlm->LeapIndicator     = Reading.leapIndicator;
+    Tlm->Stratum           = Reading.stratum;
+    Tlm->Precision         = Reading.precision;
+    Tlm->Timescale         = Query->Timescale;
+    Tlm->RootDelay         = 0;
+    Tlm->RootDispersion    = 0;
+    Tlm->RefId             = Reading.refId;
+    Tlm->Origin            = Query->Origin;
+    Tlm->Receive.Seconds   = Reading.receive.seconds;
+    Tlm->Receive.Fraction  = Reading.receive.fractions;
+    Tlm->Transmit.Seconds  = Reading.transmit.seconds;
+    Tlm->Transmit.Fraction = Reading.transmit.fractions;
+
+    CFE_SB_TimeStampMsg(CFE_MSG_PTR(SNTP_Data.TimeTlm.TelemetryHeader));
+    SbStatus = CFE_SB_TransmitMsg(CFE_MSG_PTR(SNTP_Data.TimeTlm.TelemetryHeader), true);
+    if (SbStatus != CFE_SUCCESS)
+    {
+        __atomic_fetch_add(&SNTP_Data.TimeQueryCounts.Errors, 1, __ATOMIC_RELAXED);
+        CFE_EVS_SendEvent(SNTP_TIME_QUERY_ERR_EID, CFE_EVS_EventType_ERROR,
+                          "SNTP: Unable to send time query answer, RC = 0x%08lX", (unsigned long)SbStatus);
+        return SbStatus;
+    }
+    __atomic_fetch_add(&SNTP_Data.TimeQueryCounts.Answered, 1, __ATOMIC_RELAXED);
+
+    return CFE_SUCCESS;
+
+} /* End of SNTP_AnswerTimeQuery() */
+
 /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * **/
 /*  Name:  SNTP_ResetCounters                                               */
 /*                                                                            */
@@ -431,7 +1914,29 @@ int32 SNTP_Noop(const SNTP_NoopCmd_t *Msg)
 /* * * * * * * * * * * * * * * * * * * * * * * *  * * * * * * *  * *  * * * * */
 int32 SNTP_ResetCounters(const SNTP_ResetCountersCmd_t *Msg)
 {
+    struct timespec mono;
+
     memset(&SNTP_Data.cnts, 0, sizeof(SNTP_Data.cnts) );
+    SNTP_SetTimeQueryCounts(0, 0);
+    memset(&SNTP_Data.ServerStats, 0, sizeof(SNTP_Data.ServerStats) );
+    memset(&SNTP_Data.WakeHist, 0, sizeof(SNTP_Data.WakeHist) );
+    memset(SNTP_Data.Shed.shed, 0, sizeof(SNTP_Data.Shed.shed) );
+    SNTP_Data.Shed.kod = 0;
+    SNTP_Data.Ctl.queries    = 0;
+    SNTP_Data.Ctl.restricted = 0;
+    SNTP_Data.Ctl.limited    = 0;
+    SNTP_Data.Ctl.answered   = 0;
+    SNTP_Data.Poller.spinNs  = 0;
+    SNTP_Data.Poller.sleepNs = 0;
+#ifdef SNTP_ENABLE_NTS
+    Sntp_NtsResetStats();
+#endif
+    // Keep the statistics log's differences from going negative
+    SNTP_StatTotals(&SNTP_Data.StatPrev);
+    clock_gettime(CLOCK_MONOTONIC, &mono);
+    SNTP_Data.ResetSecond = mono.tv_sec;
+    // Otherwise a reset before the next housekeeping save would bring the old counters back
+    SNTP_SaveState();
 
     CFE_EVS_SendEvent(SNTP_COMMANDRST_INF_EID, CFE_EVS_EventType_INFORMATION, "SNTP: RESET command");
 
@@ -475,3 +1980,132 @@ bool SNTP_VerifyCmdLength(CFE_MSG_Message_t *MsgPtr, size_t ExpectedLength)
 
 } /* End of SNTP_VerifyCmdLength() */
 
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * **/
+/*                                                                            */
+/* SNTP_TblValidationFunc -- Verify contents of the key table                 */
+/*                                                                            */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * **/
+int32 SNTP_TblValidationFunc(void *TblData)
+{
+    SNTP_KeyTbl_t *tbl = (SNTP_KeyTbl_t *)TblData;
+
+    for (int i = 0; i < SNTP_AUTH_MAX_KEYS; i++)
+    {
+        if (tbl->Keys[i].KeyId != 0 && tbl->Keys[i].KeyLen != SNTP_AUTH_KEY_LEN)
+        {
+            CFE_EVS_SendEvent(SNTP_TBL_VAL_ERR_EID, CFE_EVS_EventType_ERROR,
+                              "SNTP: Key table entry %d (key id %u) has invalid length %u", i,
+                              (unsigned int)tbl->Keys[i].KeyId, (unsigned int)tbl->Keys[i].KeyLen);
+            return SNTP_TABLE_OUT_OF_RANGE_ERR_CODE;
+        }
+    }
+
+    return CFE_SUCCESS;
+
+} /* End of SNTP_TblValidationFunc() */
+
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * **/
+/*                                                                            */
+/* SNTP_BcastTblValidationFunc -- Verify contents of the broadcast table      */
+/*                                                                            */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * **/
+int32 SNTP_BcastTblValidationFunc(void *TblData)
+{
+    SNTP_BcastTbl_t *tbl = (SNTP_BcastTbl_t *)TblData;
+    struct in_addr   addr;
+
+    for (int i = 0; i < SNTP_BCAST_MAX_GROUPS; i++)
+    {
+        if (tbl->Groups[i][0] == '\0')
+        {
+            continue;
+        }
+        if (memchr(tbl->Groups[i], '\0', SNTP_BCAST_ADDR_LEN) == NULL || tbl->Port == 0 ||
+            inet_pton(AF_INET, tbl->Groups[i], &addr) != 1)
+        {
+            CFE_EVS_SendEvent(SNTP_TBL_VAL_ERR_EID, CFE_EVS_EventType_ERROR,
+                              "SNTP: Broadcast table entry %d is not a valid destination", i);
+            return SNTP_TABLE_OUT_OF_RANGE_ERR_CODE;
+        }
+    }
+
+    return CFE_SUCCESS;
+
+} /* End of SNTP_BcastTblValidationFunc() */
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * **/
+/*                                                                            */
+/* SNTP_ShedTblValidationFunc -- Verify contents of the shedding table        */
+/*                                                                            */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * **/
+int32 SNTP_ShedTblValidationFunc(void *TblData)
+{
+    SNTP_ShedTbl_t *tbl = (SNTP_ShedTbl_t *)TblData;
+    Sntp_ShedRule_t rule;
+
+    for (int i = 0; i < SNTP_SHED_LISTENERS; i++)
+    {
+        if (tbl->ListenerClass[i] >= SNTP_SHED_CLASS_COUNT)
+        {
+            CFE_EVS_SendEvent(SNTP_TBL_VAL_ERR_EID, CFE_EVS_EventType_ERROR,
+                              "SNTP: Shedding table listener %d has invalid class %u", i,
+                              (unsigned int)tbl->ListenerClass[i]);
+            return SNTP_TABLE_OUT_OF_RANGE_ERR_CODE;
+        }
+    }
+    for (int i = 0; i < SNTP_SHED_MAX_RULES; i++)
+    {
+        if (tbl->Prefixes[i].Net[0] == '\0')
+        {
+            continue;
+        }
+        if (memchr(tbl->Prefixes[i].Net, '\0', SNTP_BCAST_ADDR_LEN) == NULL ||
+            Sntp_ShedMakeRule(tbl->Prefixes[i].Net, tbl->Prefixes[i].Length, tbl->Prefixes[i].Class, &rule) !=
+                SntpSuccess)
+        {
+            CFE_EVS_SendEvent(SNTP_TBL_VAL_ERR_EID, CFE_EVS_EventType_ERROR,
+                              "SNTP: Shedding table prefix %d is not a valid prefix and class", i);
+            return SNTP_TABLE_OUT_OF_RANGE_ERR_CODE;
+        }
+    }
+
+    return CFE_SUCCESS;
+
+} /* End of SNTP_ShedTblValidationFunc() */
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * **/
+/*                                                                            */
+/* SNTP_CtlTblValidationFunc -- Verify contents of the control query table    */
+/*                                                                            */
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * **/
+int32 SNTP_CtlTblValidationFunc(void *TblData)
+{
+    SNTP_CtlTbl_t   *tbl = (SNTP_CtlTbl_t *)TblData;
+    Sntp_CtlPrefix_t prefix;
+
+    if (tbl->ClientRate > tbl->TotalRate || tbl->ClientBurst == 0)
+    {
+        CFE_EVS_SendEvent(SNTP_TBL_VAL_ERR_EID, CFE_EVS_EventType_ERROR,
+                          "SNTP: Control table client rate %u exceeds total %u, or burst is 0",
+                          (unsigned int)tbl->ClientRate, (unsigned int)tbl->TotalRate);
+        return SNTP_TABLE_OUT_OF_RANGE_ERR_CODE;
+    }
+    for (int i = 0; i < SNTP_CTL_TBL_ALLOW; i++)
+    {
+        if (tbl->Allow[i].Net[0] == '\0')
+        {
+            continue;
+        }
+        if (memchr(tbl->Allow[i].Net, '\0', SNTP_BCAST_ADDR_LEN) == NULL ||
+            Sntp_CtlMakePrefix(tbl->Allow[i].Net, tbl->Allow[i].Length, &prefix) != SntpSuccess)
+        {
+            CFE_EVS_SendEvent(SNTP_TBL_VAL_ERR_EID, CFE_EVS_EventType_ERROR,
+                              "SNTP: Control table entry %d is not a valid prefix", i);
+            return SNTP_TABLE_OUT_OF_RANGE_ERR_CODE;
+        }
+    }
+
+    return CFE_SUCCESS;
+
+} /* End of SNTP_CtlTblValidationFunc() */
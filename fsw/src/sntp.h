@@ -34,25 +34,144 @@
 #include "cfe_sb.h"
 #include "cfe_es.h"
 
+#include <netinet/in.h>
+#include <stdatomic.h>
+
 #include "sntp_perfids.h"
 #include "sntp_msgids.h"
 #include "sntp_msg.h"
+#include "sntp_table.h"
+#include "sntp_server.h"
+#include "sntp_rt.h"
+#include "sntp_pcap.h"
+#include "sntp_transport.h"
+#include "sntp_time.h"
+#include "sntp_topk.h"
+#include "sntp_fleet.h"
+#include "sntp_stage.h"
+#include "sntp_statlog.h"
+#include "sntp_ctl.h"
+#include "sntp_shm.h"
+#include "sntp_handoff.h"
+#include "sntp_warm.h"
+#include "sntp_shed.h"
+#include "sntp_batch.h"
+#include "sntp_serve.h"
 
 /***********************************************************************/
 #define SNTP_PIPE_DEPTH 32 /* Depth of the Command Pipe for Application */
 
-#define SNTP_NUMBER_OF_TABLES 1 /* Number of Table(s) */
+#define SNTP_NUMBER_OF_TABLES 4 /* Number of Table(s) */
+#define SNTP_KEY_TBL_IDX      0
+#define SNTP_BCAST_TBL_IDX    1
+#define SNTP_SHED_TBL_IDX     2
+#define SNTP_CTL_TBL_IDX      3
 
 /* Define filenames of default data images for tables */
-#define SNTP_TABLE_FILE "/cf/sntp_tbl.tbl"
+#define SNTP_TABLE_FILE       "/cf/sntp_keys.tbl"
+#define SNTP_BCAST_TABLE_FILE "/cf/sntp_bcast.tbl"
+#define SNTP_SHED_TABLE_FILE  "/cf/sntp_shed.tbl"
+#define SNTP_CTL_TABLE_FILE   "/cf/sntp_ctl.tbl"
+
+/* Default top talker dump file */
+#define SNTP_TOPK_FILE "/cf/sntp_topk.txt"
+
+/* Default stage trace dump file */
+#define SNTP_STAGE_FILE "/cf/sntp_stages.csv"
+
+/* Per-second statistics log, one 64-byte record per second; empty disables it */
+#ifndef SNTP_STATLOG_FILE
+#define SNTP_STATLOG_FILE "/cf/sntp_stats.bin"
+#endif
+#ifndef SNTP_STATLOG_RECORDS
+#define SNTP_STATLOG_RECORDS 86400
+#endif
+
+/* Shared memory object the served time mapping is published to each second; empty disables it */
+#ifndef SNTP_SHM_NAME
+#define SNTP_SHM_NAME "/sntp_time"
+#endif
+/* ntpd/chrony SHM refclock unit also written, -1 for none */
+#ifndef SNTP_SHM_REFCLOCK_UNIT
+#define SNTP_SHM_REFCLOCK_UNIT -1
+#endif
 
 #define SNTP_TABLE_OUT_OF_RANGE_ERR_CODE -1
 
-#define SNTP_TBL_ELEMENT_1_MAX 10
+#define SNTP_SOCKET_CDS_NAME "SockCDS" /* Listener sockets handed to the next instance across a restart or reload */
+#define SNTP_STATE_CDS_NAME  "StateCDS" /* Counters and client state restored at init, so the app starts warm */
+#define SNTP_STATE_CDS_VERSION 1
 /************************************************************************
 ** Type Definitions
 *************************************************************************/
 
+/*
+** Cumulative counters the statistics log takes per-second differences of
+*/
+typedef struct
+{
+    uint32 Requests;
+    uint16 BadRequests;
+    uint16 InvalidRequests;
+    uint32 AuthFailures;
+    uint32 Shed;
+    uint32 KernelDrops;
+    uint32 Wake[SNTP_RT_HIST_BUCKETS];
+} SNTP_StatTotals_t;
+
+/*
+** Listener sockets in the CDS; the descriptors stay open when the app exits, for the next instance to serve from
+*/
+typedef struct
+{
+    uint32 Pid;   /**< Process the descriptors belong to; after a processor reset they are stale */
+    uint32 Count;
+    struct
+    {
+        int32  Sockfd;
+        uint16 Port;
+        uint16 Spare;
+    } Sockets[SNTP_TIMESCALE_COUNT];
+} SNTP_SocketCds_t;
+
+/*
+** Counters and bounded client-state tables in the CDS, saved with each housekeeping packet and on exit.
+** Their timestamps are CLOCK_MONOTONIC, which starts again when the host reboots.
+*/
+typedef struct
+{
+    Sntp_WarmHeader_t    Header;      /**< SNTP_STATE_CDS_VERSION, sizeof(SNTP_StateCds_t) and the save time */
+    int64                ResetMonoMs; /**< CLOCK_MONOTONIC when the counters were last reset */
+    SNTP_HkTlm_Payload_t Cnts;
+    Sntp_ServerStats_t   ServerStats;
+    Sntp_RtHist_t        WakeHist;
+    uint32               Shed[SNTP_SHED_CLASS_COUNT];
+    uint32               ShedKod;
+    Sntp_CtlState_t      Ctl;         /**< Control query rate-limit buckets */
+    Sntp_TopK_t          TopTalkers;
+} SNTP_StateCds_t;
+
+/*
+** One UDP port serving one timescale
+*/
+typedef struct
+{
+    uint16               Port;
+    int                  sockfd;
+    Sntp_ServeListener_t Serve; /**< Engine settings, shedding class and transport (normally &SockTransport.base) */
+    Sntp_RtSockStats_t   SockStats;
+    Sntp_SockTransport_t SockTransport;
+} SNTP_Listener_t;
+
+/*
+** Onboard time query counters, kept by the time query task
+*/
+typedef struct
+{
+    uint32 Answered; /* SntpTimeQueries */
+    uint32 Errors;   /* SntpTimeQueryErrors */
+} SNTP_TimeQueryCounts_t;
+
 /*
 ** Global Data
 */
@@ -67,6 +186,7 @@ typedef struct
     ** Housekeeping telemetry packet...
     */
     SNTP_HkTlm_t HkTlm;
+    SNTP_TimeTlm_t TimeTlm;
 
     /*
     ** Run Status variable used in the main processing loop
@@ -84,9 +204,102 @@ typedef struct
     char   PipeName[CFE_MISSION_MAX_API_LEN];
     uint16 PipeDepth;
 
-    //CFE_TBL_Handle_t TblHandles[SNTP_NUMBER_OF_TABLES];
+    CFE_TBL_Handle_t TblHandles[SNTP_NUMBER_OF_TABLES];
+
+    /*
+    ** Request engine configuration and precomputed authentication keys
+    */
+    Sntp_ServerConfig_t ServerCfg;
+    Sntp_ServerStats_t  ServerStats;
+    Sntp_AuthKeySet_t   AuthKeys;
+
+    /*
+    ** Packet arrival to task wake latency
+    */
+    Sntp_RtHist_t   WakeHist;
+    Sntp_RtPoller_t Poller;
+
+    /*
+    ** Listeners, one per served timescale; Listeners[0] also sends broadcasts
+    */
+    SNTP_Listener_t Listeners[SNTP_TIMESCALE_COUNT];
+    uint32          ListenerCount;
+
+    /*
+    ** Broadcast destinations resolved from the broadcast table
+    */
+    struct sockaddr_in BcastAddrs[SNTP_BCAST_MAX_GROUPS];
+    uint32             BcastCount;
+    int                BcastSockfd; /**< Unbound socket the broadcasts are sent from */
+    SNTP_BcastTbl_t    BcastCfg;
+
+    /*
+    ** Overload detection and priority classes from the shedding table
+    */
+    Sntp_ShedConfig_t ShedCfg;
+    Sntp_ShedState_t  Shed;
+
+    /*
+    ** Serving loop state and request counters, copied into housekeeping
+    */
+    Sntp_Serve_t Serve;
+
+    CFE_ES_TaskId_t PcapTaskId;
+    bool            PcapReady;
+    atomic_bool     PcapStopped; /* Set by the writer task once it has returned */
+
+    /*
+    ** Onboard time queries, answered by their own task; TimeMutex guards changes to the time state it reads
+    */
+    CFE_SB_PipeId_t TimeQueryPipe;
+    CFE_ES_TaskId_t TimeQueryTaskId;
+    bool            TimeQueryReady;
+    atomic_bool     TimeQueryStop;    /* Set by the main task on exit */
+    atomic_bool     TimeQueryStopped; /* Set by the time query task once it has returned */
+    SNTP_TimeQueryCounts_t TimeQueryCounts; /* Counted by the time query task, read and reset by the main task; only touched with __atomic */
+    osal_id_t       TimeMutex;
+
+    /*
+    ** Per-second statistics log
+    */
+    Sntp_StatLog_t    StatLog;
+    SNTP_StatTotals_t StatPrev;
+    time_t            StatSecond;
+
+    /*
+    ** Mode-6 control query access rules; admitted queries wait in Serve
+    */
+    Sntp_CtlConfig_t CtlCfg;
+    Sntp_CtlState_t  Ctl;
+    time_t           StartSecond; /**< CLOCK_MONOTONIC second the app started */
+    time_t           ResetSecond; /**< ... and the counters were last reset */
+
+    /*
+    ** Shared-memory time export for co-located processes
+    */
+    Sntp_Shm_t Shm;
+    time_t     ShmSecond;
+
+    /*
+    ** Sockets inherited from the previous instance and saved for the next
+    */
+    CFE_ES_CDSHandle_t SocketCdsHandle;
+    bool               SocketCdsReady;
+    SNTP_SocketCds_t   SocketCds;
+    uint32             SocketsAdopted;
+
+    /*
+    ** Counters and client state kept for a warm start
+    */
+    CFE_ES_CDSHandle_t StateCdsHandle;
+    bool               StateCdsReady;
 
-    int sockfd;
+#ifdef SNTP_ENABLE_NTS
+    int             NtsKeSockfd;
+    CFE_ES_TaskId_t NtsKeTaskId;
+    atomic_bool     NtsKeStop;    /* Set by the main task on exit */
+    atomic_bool     NtsKeStopped; /* Set by the NTS-KE task once it no longer uses NtsKeSockfd */
+#endif
 
 } SNTP_Data_t;
 
@@ -105,9 +318,56 @@ int32 SNTP_ReportHousekeeping(const CFE_MSG_CommandHeader_t *Msg);
 int32 SNTP_ResetCounters(const SNTP_ResetCountersCmd_t *Msg);
 int32 SNTP_Process(const SNTP_ProcessCmd_t *Msg);
 int32 SNTP_Noop(const SNTP_NoopCmd_t *Msg);
+int32 SNTP_CaptureStart(const SNTP_CaptureStartCmd_t *Msg);
+int32 SNTP_CaptureStop(const SNTP_CaptureStopCmd_t *Msg);
+int32 SNTP_SetTimeSource(const SNTP_SetTimeSourceCmd_t *Msg);
+int32 SNTP_TopKDump(const SNTP_TopKDumpCmd_t *Msg);
+int32 SNTP_ScheduleLeap(const SNTP_ScheduleLeapCmd_t *Msg);
+int32 SNTP_StageDump(const SNTP_StageDumpCmd_t *Msg);
+int32 SNTP_AnswerTimeQuery(const SNTP_TimeQueryCmd_t *Msg);
+void  SNTP_InitTime(void);
+void  SNTP_PcapWriterTask(void);
+void  SNTP_StopCapture(void);
+void  SNTP_TimeQueryTask(void);
+void  SNTP_InitTimeQueries(void);
+void  SNTP_StopTimeQueries(void);
+void  SNTP_TimeQueryCounts(SNTP_HkTlm_Payload_t *Payload);
+void  SNTP_SetTimeQueryCounts(uint32 Answered, uint32 Errors);
+bool  SNTP_StopChildTask(CFE_ES_TaskId_t TaskId, atomic_bool *Stopped, uint32 TimeoutMs);
+void  SNTP_ShedChanged(void *Arg, uint32_t Level, uint32_t LatencyUs, uint32_t QueueBytes);
+void  SNTP_InvalidDatagram(void *Arg, ssize_t Len, int Err);
+void  SNTP_ServeCounts(SNTP_HkTlm_Payload_t *Payload);
+void  SNTP_OpenStatLog(void);
+void  SNTP_StatTotals(SNTP_StatTotals_t *Totals);
+void  SNTP_LogStatsIfDue(void);
+void  SNTP_ExportTimeIfDue(void);
+void  SNTP_ControlVars(Sntp_CtlVars_t *Vars);
+void  SNTP_AnswerControl(void);
+void  SNTP_ServeListeners(void);
+void  SNTP_InitServe(void);
+int32 SNTP_InitListener(uint16 port, Sntp_TimeScale_t scale);
+void  SNTP_RestoreSockets(void);
+int   SNTP_AdoptSocket(uint16 port, Sntp_RtSockStats_t *stats);
+void  SNTP_SaveSockets(void);
+void  SNTP_RestoreState(void);
+void  SNTP_SaveState(void);
 void  SNTP_GetCrc(const char *TableName);
+void  SNTP_LoadAuthKeys(void);
+void  SNTP_LoadBcastConfig(void);
+void  SNTP_LoadShedConfig(void);
+void  SNTP_LoadCtlConfig(void);
+void  SNTP_SendBroadcast(void);
+void  SNTP_InitRealtime(void);
+#ifdef SNTP_ENABLE_NTS
+void  SNTP_InitNts(void);
+void  SNTP_NtsKeTask(void);
+void  SNTP_StopNts(void);
+#endif
 
 int32 SNTP_TblValidationFunc(void *TblData);
+int32 SNTP_BcastTblValidationFunc(void *TblData);
+int32 SNTP_ShedTblValidationFunc(void *TblData);
+int32 SNTP_CtlTblValidationFunc(void *TblData);
 
 bool SNTP_VerifyCmdLength(CFE_MSG_Message_t *MsgPtr, size_t ExpectedLength);
 
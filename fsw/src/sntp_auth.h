@@ -0,0 +1,80 @@
+#ifndef __SNTP_AUTH__
+#define __SNTP_AUTH__
+
+/**
+ * NTP symmetric-key authentication (RFC 5905 section 7.3 MAC trailer).
+ *
+ * The MAC is a 32-bit key identifier followed by the 16-byte AES-128-CMAC
+ * (RFC 4493) of the packet, as RFC 8573 specifies, so keys are shared with
+ * ntpd ("AES128CMAC") and chrony ("AES128") peers.
+ *
+ * The AES round keys and CMAC subkeys are derived once when a key is loaded,
+ * so each MAC generation or verification of a 48-byte header costs three AES
+ * block encryptions.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "core_sntp_serializer.h"
+
+#ifndef SNTP_AUTH_MAX_KEYS
+#define SNTP_AUTH_MAX_KEYS 8
+#endif
+
+#define SNTP_AUTH_KEY_LEN      16 /* AES-128 */
+#define SNTP_AUTH_KEYID_SIZE   4
+#define SNTP_AUTH_DIGEST_SIZE  16
+#define SNTP_AUTH_MAC_SIZE     ( SNTP_AUTH_KEYID_SIZE + SNTP_AUTH_DIGEST_SIZE )
+
+/** Per-key precomputed CMAC state */
+typedef struct {
+    uint32_t keyId;   /**< 0 marks an unused slot */
+    uint32_t rk[44];  /**< AES-128 round keys */
+    uint8_t  k1[16];  /**< CMAC subkey for a complete final block */
+    uint8_t  k2[16];  /**< CMAC subkey for a padded final block */
+} Sntp_AuthKey_t;
+
+typedef struct {
+    uint32_t       count;
+    Sntp_AuthKey_t keys[SNTP_AUTH_MAX_KEYS];
+} Sntp_AuthKeySet_t;
+
+/** AES-128-CMAC of len bytes at msg */
+void Sntp_AuthCmac( const Sntp_AuthKey_t *key, const uint8_t *msg, size_t len, uint8_t mac[SNTP_AUTH_DIGEST_SIZE] );
+
+/** Remove all keys from a key set */
+void Sntp_AuthClearKeys( Sntp_AuthKeySet_t *set );
+
+/** Precompute and add a key to the set
+ * @return SntpErrorBadParameter if the id is 0, the key is not SNTP_AUTH_KEY_LEN bytes or the set is full
+ */
+SntpStatus_t Sntp_AuthAddKey( Sntp_AuthKeySet_t *set, uint32_t keyId, const uint8_t *key, size_t keyLen );
+
+/** Parse a "<keyid>:<hexkey>" command-line key specification */
+SntpStatus_t Sntp_AuthParseKeySpec( const char *spec, uint32_t *keyId, uint8_t *key, size_t *keyLen );
+
+static inline const Sntp_AuthKey_t *Sntp_AuthFindKey( const Sntp_AuthKeySet_t *set, uint32_t keyId ) {
+    for (uint32_t i = 0; i < set->count; i++) {
+        if (set->keys[i].keyId == keyId) {
+            return &set->keys[i];
+        }
+    }
+    return NULL;
+}
+
+/** Verify the MAC trailing a packet
+ * @param [in] pkt - Packet including MAC
+ * @param [in] len - Total packet length; the MAC covers the first (len - SNTP_AUTH_MAC_SIZE) bytes
+ * @param [out] key - Key the packet was signed with, valid on success
+ * @return SntpSuccess, SntpServerNotAuthenticated for an unknown key id, or SntpErrorAuthFailure
+ */
+SntpStatus_t Sntp_AuthVerify( const Sntp_AuthKeySet_t *set, const uint8_t *pkt, size_t len, const Sntp_AuthKey_t **key );
+
+/** Append a MAC at pkt + len.  Caller guarantees SNTP_AUTH_MAC_SIZE bytes of room.
+ * @return Total packet length including MAC
+ */
+size_t Sntp_AuthSign( const Sntp_AuthKey_t *key, uint8_t *pkt, size_t len );
+
+#endif
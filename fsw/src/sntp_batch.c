@@ -0,0 +1,21 @@
+#include <string.h>
+
+#include "sntp_batch.h"
+#include "sntp_utils.h"
+
+#define ORIGIN_OFFSET   24 /* Origin timestamp in the response */
+#define TRANSMIT_OFFSET 40 /* Transmit timestamp in the request */
+
+uint64_t Sntp_BatchRespond( const uint8_t *tmpl, const uint8_t *const *reqs, uint8_t *const *resps, uint32_t count ) {
+    uint64_t valid = 0;
+
+    if (count > SNTP_BATCH_MAX) {
+        count = SNTP_BATCH_MAX;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        memcpy(resps[i], tmpl, SNTP_PACKET_BASE_SIZE);
+        memcpy(resps[i] + ORIGIN_OFFSET, reqs[i] + TRANSMIT_OFFSET, sizeof(SntpTimestamp_t));
+        valid |= (uint64_t)Sntp_IsClientRequest(reqs[i][0]) << i;
+    }
+    return valid;
+}
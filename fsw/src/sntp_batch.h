@@ -0,0 +1,33 @@
+#ifndef __SNTP_BATCH__
+#define __SNTP_BATCH__
+
+/**
+ * Batch response kernel for plain 48-byte client requests.
+ *
+ * Responses to a batch differ only in their timestamps.  The origin
+ * timestamp echoes the request's transmit timestamp byte for byte, so the
+ * kernel copies one pre-encoded response template per request and splices
+ * in bytes 40-47 of the request, with no per-request byte swapping or
+ * clock reads; the caller then fills in the receive and transmit times.
+ * The copy is plain memcpy, which compilers already vectorise.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "core_sntp_serializer.h"
+
+/* Largest batch; validity is returned as one bit per request */
+#define SNTP_BATCH_MAX 64
+
+/** Build one response per request from a template
+ * @param [in] tmpl - SNTP_PACKET_BASE_SIZE-byte response in network order; its origin timestamp is replaced
+ * @param [in] reqs - Requests, each at least SNTP_PACKET_BASE_SIZE bytes
+ * @param [out] resps - Response buffers, each at least SNTP_PACKET_BASE_SIZE bytes
+ * @param [in] count - Number of requests, at most SNTP_BATCH_MAX
+ * @return Bit i set if request i is a client request (Sntp_IsClientRequest); the others are left for
+ *         the per-request path
+ */
+uint64_t Sntp_BatchRespond( const uint8_t *tmpl, const uint8_t *const *reqs, uint8_t *const *resps, uint32_t count );
+
+#endif
@@ -0,0 +1,304 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include "sntp_ctl.h"
+#include "sntp_time.h"
+#include "sntp_version.h"
+
+#define CTL_OP_READSTAT 1
+#define CTL_OP_READVAR  2
+
+#define CTL_RESPONSE 0x80
+#define CTL_ERROR    0x40
+#define CTL_MORE     0x20
+#define CTL_OP_MASK  0x1f
+
+/* Error codes, in the high byte of the status word of an error response */
+#define CTL_ERR_FORMAT     2
+#define CTL_ERR_OPCODE     3
+#define CTL_ERR_ASSOC      4
+#define CTL_ERR_UNKNOWNVAR 5
+
+/* System status clock source: the served clock is the local one */
+#define CTL_SOURCE_LOCAL 5
+
+#define CTL_LINE_LEN 72 /* Variables are wrapped onto lines of about this length, as ntpd does */
+
+#define NTP_UNIX_OFFSET 2208988800U
+
+SntpStatus_t Sntp_CtlMakePrefix( const char *net, uint8_t length, Sntp_CtlPrefix_t *prefix ) {
+    struct in_addr addr;
+
+    if (length > 32 || inet_pton(AF_INET, net, &addr) != 1) {
+        return SntpErrorBadParameter;
+    }
+    prefix->mask = htonl(( length == 0 ) ? 0 : 0xffffffffU << ( 32 - length ));
+    prefix->net = addr.s_addr & prefix->mask;
+    return SntpSuccess;
+}
+
+SntpStatus_t Sntp_CtlParsePrefix( const char *spec, Sntp_CtlPrefix_t *prefix ) {
+    char net[INET_ADDRSTRLEN];
+    unsigned int length;
+    char extra;
+
+    if (sscanf(spec, "%15[0-9.]/%u%c", net, &length, &extra) != 2 || length > 32) {
+        return SntpErrorBadParameter;
+    }
+    return Sntp_CtlMakePrefix(net, (uint8_t)length, prefix);
+}
+
+static uint64_t now_ms( void ) {
+    struct timespec now;
+#ifdef CLOCK_MONOTONIC_COARSE
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &now);
+#endif
+    return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+}
+
+/** Refill a token bucket for the time since it was last used and take one query from it */
+static bool take( Sntp_CtlBucket_t *bucket, uint32_t rate, uint32_t burst, uint64_t nowMs ) {
+    uint64_t cap = (uint64_t)burst * 1000;
+    uint64_t tokens = bucket->tokens + ( nowMs - bucket->lastMs ) * rate;
+
+    bucket->lastMs = nowMs;
+    bucket->tokens = (uint32_t)( ( tokens > cap ) ? cap : tokens );
+    if (bucket->tokens < 1000) {
+        return false;
+    }
+    bucket->tokens -= 1000;
+    return true;
+}
+
+bool Sntp_CtlAdmit( const Sntp_CtlConfig_t *cfg, Sntp_CtlState_t *state, uint32_t addr ) {
+    return Sntp_CtlAdmitAt(cfg, state, addr, now_ms());
+}
+
+bool Sntp_CtlAdmitAt( const Sntp_CtlConfig_t *cfg, Sntp_CtlState_t *state, uint32_t addr, uint64_t nowMs ) {
+    Sntp_CtlBucket_t *client = &state->clients[( addr * 2654435761U ) >> 26];
+    bool allowed = false;
+
+    state->queries++;
+    for (uint32_t i = 0; i < cfg->allowCount && !allowed; i++) {
+        allowed = ( addr & cfg->allow[i].mask ) == cfg->allow[i].net;
+    }
+    if (!allowed) {
+        state->restricted++;
+        return false;
+    }
+
+    if (client->addr != addr || client->lastMs == 0) {
+        client->addr = addr;
+        client->tokens = cfg->clientBurst * 1000;
+        client->lastMs = nowMs;
+    }
+    if (!take(client, cfg->clientRate, cfg->clientBurst, nowMs) ||
+        !take(&state->total, cfg->totalRate, cfg->totalRate, nowMs)) {
+        state->limited++;
+        return false;
+    }
+    return true;
+}
+
+void Sntp_CtlAddVar( Sntp_CtlVars_t *vars, const char *name, const char *fmt, ... ) {
+    Sntp_CtlVar_t *var;
+    va_list args;
+
+    if (vars->count >= SNTP_CTL_MAX_VARS) {
+        return;
+    }
+    var = &vars->vars[vars->count++];
+    snprintf(var->name, sizeof(var->name), "%s", name);
+    va_start(args, fmt);
+    vsnprintf(var->value, sizeof(var->value), fmt, args);
+    va_end(args);
+}
+
+void Sntp_CtlAddClockVars( Sntp_CtlVars_t *vars, const Sntp_ServerConfig_t *cfg ) {
+    SntpTimestamp_t raw, utc, tai;
+    uint8_t li = Sntp_TimeLeapIndicator();
+    uint32_t leap = Sntp_TimeLeapPending();
+    char when[16];
+
+    // One source read gives both scales, so their difference is exactly the offset being served
+    Sntp_TimeRead(&raw);
+    utc = tai = raw;
+    Sntp_TimeApplyScale(SNTP_SCALE_UTC, &utc);
+    Sntp_TimeApplyScale(SNTP_SCALE_TAI, &tai);
+
+    Sntp_CtlAddVar(vars, "version", "\"sntp %s\"", SNTP_APP_VERSION);
+    Sntp_CtlAddVar(vars, "leap", "%u%u", li >> 1, li & 1);
+    Sntp_CtlAddVar(vars, "stratum", "%u", cfg->stratum);
+    Sntp_CtlAddVar(vars, "precision", "%d", Sntp_TimePrecision());
+    Sntp_CtlAddVar(vars, "clock", "%08x.%08x", utc.seconds, utc.fractions);
+    Sntp_CtlAddVar(vars, "tai", "%d",
+                   (int)( ( (int64_t)( ( ( (uint64_t)tai.seconds << 32 ) | tai.fractions ) -
+                                       ( ( (uint64_t)utc.seconds << 32 ) | utc.fractions ) ) +
+                            0x80000000LL ) >> 32 ));
+    if (leap != 0) {
+        time_t secs = (time_t)( leap - NTP_UNIX_OFFSET );
+        struct tm tm;
+        gmtime_r(&secs, &tm);
+        strftime(when, sizeof(when), "%Y%m%d%H%M", &tm);
+        Sntp_CtlAddVar(vars, "leapsec", "%s", when);
+    }
+    Sntp_CtlAddVar(vars, "leapsmearoffset", "%.3f", (double)Sntp_TimeSmearOffset() * 1000.0 / 4294967296.0);
+    Sntp_CtlAddVar(vars, "timesource", "\"%s\"", Sntp_TimeInfo(Sntp_TimeSelected())->name);
+    Sntp_CtlAddVar(vars, "timescale", "\"%s\"", Sntp_TimeScaleName(cfg->scale));
+}
+
+void Sntp_CtlAddSysStats( Sntp_CtlVars_t *vars, const Sntp_CtlSysStats_t *stats, const Sntp_CtlState_t *state ) {
+    Sntp_CtlAddVar(vars, "ss_uptime", "%u", stats->uptime);
+    Sntp_CtlAddVar(vars, "ss_reset", "%u", stats->reset);
+    Sntp_CtlAddVar(vars, "ss_received", "%u", stats->received);
+    Sntp_CtlAddVar(vars, "ss_thisver", "%u", stats->processed);
+    Sntp_CtlAddVar(vars, "ss_oldver", "0");
+    Sntp_CtlAddVar(vars, "ss_badformat", "%u", stats->badFormat);
+    Sntp_CtlAddVar(vars, "ss_badauth", "%u", stats->badAuth);
+    Sntp_CtlAddVar(vars, "ss_declined", "%u", stats->declined);
+    Sntp_CtlAddVar(vars, "ss_restricted", "%u", state->restricted);
+    Sntp_CtlAddVar(vars, "ss_limited", "%u", state->limited);
+    Sntp_CtlAddVar(vars, "ss_kodsent", "%u", stats->kodSent);
+    Sntp_CtlAddVar(vars, "ss_processed", "%u", stats->processed);
+    Sntp_CtlAddVar(vars, "ss_lamport", "0");
+    Sntp_CtlAddVar(vars, "ss_tsrounding", "0");
+}
+
+static const Sntp_CtlVar_t *find_var( const Sntp_CtlVars_t *vars, const char *name, size_t len ) {
+    for (uint32_t i = 0; i < vars->count; i++) {
+        if (strncmp(vars->vars[i].name, name, len) == 0 && vars->vars[i].name[len] == '\0') {
+            return &vars->vars[i];
+        }
+    }
+    return NULL;
+}
+
+/** Append "name=value" to the text, separated from the previous variable by ", " or ",\r\n"
+ * @return false if it does not fit
+ */
+static bool append_var( char *text, size_t *used, size_t cap, size_t *lineLen, const Sntp_CtlVar_t *var ) {
+    size_t itemLen = strlen(var->name) + 1 + strlen(var->value);
+    const char *sep = "";
+
+    if (*used != 0) {
+        sep = ( *lineLen + itemLen + 2 > CTL_LINE_LEN ) ? ",\r\n" : ", ";
+        *lineLen = ( sep[1] == '\r' ) ? 0 : *lineLen + 2;
+    }
+    if (*used + strlen(sep) + itemLen + 2 > cap) {
+        return false;
+    }
+    *used += (size_t)snprintf(text + *used, cap - *used, "%s%s=%s", sep, var->name, var->value);
+    *lineLen += itemLen;
+    return true;
+}
+
+/** Build the text of a read variables response: the variables named in the query, or all of them
+ * @return 0, or a CTL_ERR_* code
+ */
+static uint8_t read_variables( const uint8_t *names, size_t namesLen, const Sntp_CtlVars_t *vars, char *text,
+                               size_t cap, size_t *used ) {
+    size_t lineLen = 0;
+    size_t pos = 0;
+
+    *used = 0;
+    for (uint32_t i = 0; namesLen == 0 && i < vars->count; i++) {
+        if (!append_var(text, used, cap, &lineLen, &vars->vars[i])) {
+            break;
+        }
+    }
+    while (pos < namesLen) {
+        size_t start, end;
+        const Sntp_CtlVar_t *var;
+
+        while (pos < namesLen && ( names[pos] == ',' || names[pos] == ' ' || names[pos] == '\r' || names[pos] == '\n' )) {
+            pos++;
+        }
+        start = pos;
+        while (pos < namesLen && names[pos] != ',' && names[pos] != '=' && names[pos] != ' ' && names[pos] != '\r' &&
+               names[pos] != '\n' && names[pos] != '\0') {
+            pos++;
+        }
+        end = pos;
+        // Skip any "=value": values are only meaningful in write requests
+        while (pos < namesLen && names[pos] != ',') {
+            pos++;
+        }
+        if (end == start) {
+            continue;
+        }
+        var = find_var(vars, (const char *)names + start, end - start);
+        if (var == NULL) {
+            return CTL_ERR_UNKNOWNVAR;
+        }
+        if (!append_var(text, used, cap, &lineLen, var)) {
+            break;
+        }
+    }
+    if (*used != 0) {
+        memcpy(text + *used, "\r\n", 2);
+        *used += 2;
+    }
+    return 0;
+}
+
+SntpStatus_t Sntp_CtlRespond( Sntp_CtlState_t *state, const uint8_t *req, size_t len, const Sntp_CtlVars_t *vars,
+                              Sntp_Transport_t *transport, const struct sockaddr_in *dst ) {
+    uint8_t pkt[SNTP_CTL_HEADER_SIZE + SNTP_CTL_MAX_DATA];
+    char text[SNTP_CTL_MAX_FRAGMENTS * SNTP_CTL_MAX_DATA];
+    uint8_t opcode = req[1] & CTL_OP_MASK;
+    uint16_t assoc = (uint16_t)( ( req[6] << 8 ) | req[7] );
+    size_t count = (size_t)( ( req[10] << 8 ) | req[11] );
+    uint8_t li = Sntp_TimeLeapIndicator();
+    uint16_t status = (uint16_t)( ( li << 14 ) | ( CTL_SOURCE_LOCAL << 8 ) );
+    size_t textLen = 0;
+    size_t offset = 0;
+    uint8_t err = 0;
+
+    state->answered++;
+    if (count > len - SNTP_CTL_HEADER_SIZE || ( req[1] & ( CTL_ERROR | CTL_MORE ) ) != 0) {
+        err = CTL_ERR_FORMAT;
+    } else if (opcode != CTL_OP_READSTAT && opcode != CTL_OP_READVAR) {
+        err = CTL_ERR_OPCODE;
+    } else if (assoc != 0) {
+        err = CTL_ERR_ASSOC;
+    } else if (opcode == CTL_OP_READVAR) {
+        err = read_variables(req + SNTP_CTL_HEADER_SIZE, count, vars, text, sizeof(text), &textLen);
+    }
+    if (err != 0) {
+        status = (uint16_t)( err << 8 );
+        textLen = 0;
+    }
+
+    // Read status of the system association lists the peer associations, of which there are none
+    do {
+        size_t fragLen = ( textLen - offset > SNTP_CTL_MAX_DATA ) ? SNTP_CTL_MAX_DATA : textLen - offset;
+        size_t padded = ( fragLen + 3 ) & ~(size_t)3;
+        bool more = offset + fragLen < textLen;
+
+        pkt[0] = (uint8_t)( ( li << 6 ) | ( req[0] & 0x38 ) | SNTP_CTL_MODE );
+        pkt[1] = (uint8_t)( CTL_RESPONSE | ( err != 0 ? CTL_ERROR : 0 ) | ( more ? CTL_MORE : 0 ) | opcode );
+        pkt[2] = req[2];
+        pkt[3] = req[3];
+        pkt[4] = (uint8_t)( status >> 8 );
+        pkt[5] = (uint8_t)status;
+        pkt[6] = req[6];
+        pkt[7] = req[7];
+        pkt[8] = (uint8_t)( offset >> 8 );
+        pkt[9] = (uint8_t)offset;
+        pkt[10] = (uint8_t)( fragLen >> 8 );
+        pkt[11] = (uint8_t)fragLen;
+        memcpy(pkt + SNTP_CTL_HEADER_SIZE, text + offset, fragLen);
+        memset(pkt + SNTP_CTL_HEADER_SIZE + fragLen, 0, padded - fragLen);
+        if (Sntp_TransportSend(transport, pkt, SNTP_CTL_HEADER_SIZE + padded, dst) < 0) {
+            return SntpErrorNetworkFailure;
+        }
+        offset += fragLen;
+    } while (offset < textLen);
+
+    return SntpSuccess;
+}
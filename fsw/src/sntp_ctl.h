@@ -0,0 +1,134 @@
+#ifndef __SNTP_CTL__
+#define __SNTP_CTL__
+
+/**
+ * NTP mode-6 control queries (RFC 9327), so `ntpq -c rv` and
+ * `ntpq -c sysstats` can read the server's state.
+ *
+ * Only the read-status and read-variables opcodes are answered, for the
+ * system association (0); there are no peer associations.  Variables are
+ * name=value text built by the caller when the query is answered.  A read
+ * variables query that names variables gets only those, and an error if
+ * one is unknown.
+ *
+ * Answers are many times the size of a query, so a query is only answered
+ * if its source is in the allow list and within both the per-client and
+ * the total rate limits.  Anything else is dropped without a reply.
+ * Sntp_CtlAdmit() is cheap enough to run as datagrams are received.
+ * Building and sending the answer is left to the caller, to do when no
+ * time requests are waiting.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <netinet/in.h>
+
+#include "core_sntp_serializer.h"
+#include "sntp_server.h"
+#include "sntp_transport.h"
+
+#define SNTP_CTL_MODE          6
+#define SNTP_CTL_HEADER_SIZE   12
+#define SNTP_CTL_MAX_DATA      468 /* Data bytes per response fragment, as ntpd */
+#define SNTP_CTL_MAX_FRAGMENTS 3   /* Caps the size of an answer */
+#define SNTP_CTL_MAX_ALLOW     8
+#define SNTP_CTL_RATE_SLOTS    64  /* Per-client buckets, indexed by an address hash */
+#define SNTP_CTL_MAX_VARS      48
+#define SNTP_CTL_NAME_LEN      16
+#define SNTP_CTL_VALUE_LEN     48
+
+typedef struct {
+    uint32_t net;  /**< Network address, network byte order */
+    uint32_t mask; /**< Prefix mask, network byte order */
+} Sntp_CtlPrefix_t;
+
+typedef struct {
+    uint32_t         clientRate;  /**< Queries per second answered per client once its burst is spent */
+    uint32_t         clientBurst; /**< Queries a client may send at once after being quiet */
+    uint32_t         totalRate;   /**< Queries per second answered across all clients, with a burst of one second's */
+    uint32_t         allowCount;
+    Sntp_CtlPrefix_t allow[SNTP_CTL_MAX_ALLOW];
+} Sntp_CtlConfig_t;
+
+typedef struct {
+    uint32_t addr;   /**< Client the bucket belongs to; another client hashing here takes it over full */
+    uint32_t tokens; /**< Thousandths of a query */
+    uint64_t lastMs;
+} Sntp_CtlBucket_t;
+
+typedef struct {
+    Sntp_CtlBucket_t clients[SNTP_CTL_RATE_SLOTS];
+    Sntp_CtlBucket_t total;
+    uint32_t         queries;    /**< Mode-6 datagrams received */
+    uint32_t         restricted; /**< Dropped: source not in the allow list */
+    uint32_t         limited;    /**< Dropped: over a rate limit, or by the caller (queue full, shedding) */
+    uint32_t         answered;   /**< Answered, including with an error */
+} Sntp_CtlState_t;
+
+typedef struct {
+    char name[SNTP_CTL_NAME_LEN];
+    char value[SNTP_CTL_VALUE_LEN];
+} Sntp_CtlVar_t;
+
+typedef struct {
+    uint32_t      count;
+    Sntp_CtlVar_t vars[SNTP_CTL_MAX_VARS];
+} Sntp_CtlVars_t;
+
+/** ntpd's system statistics, read by `ntpq -c sysstats`; the restricted and limited counts come from Sntp_CtlState_t */
+typedef struct {
+    uint32_t uptime;    /**< Seconds since the server started */
+    uint32_t reset;     /**< Seconds since the counters were reset */
+    uint32_t received;  /**< Datagrams received */
+    uint32_t processed; /**< Requests answered with the time */
+    uint32_t badFormat; /**< Requests of a bad length or format */
+    uint32_t badAuth;   /**< Requests failing authentication */
+    uint32_t declined;  /**< Requests shed */
+    uint32_t kodSent;   /**< Kiss-o'-Death replies sent */
+} Sntp_CtlSysStats_t;
+
+/** True for a datagram that is a mode-6 control query; responses (R bit set) are not, so two servers cannot loop */
+static inline bool Sntp_CtlIsQuery( const uint8_t *buf, size_t len ) {
+    return len >= SNTP_CTL_HEADER_SIZE && ( buf[0] & 0x7 ) == SNTP_CTL_MODE && ( buf[1] & 0x80 ) == 0;
+}
+
+/** Build an allow list entry from a dotted-quad network address and prefix length
+ * @return SntpErrorBadParameter for a bad address or a length over 32
+ */
+SntpStatus_t Sntp_CtlMakePrefix( const char *net, uint8_t length, Sntp_CtlPrefix_t *prefix );
+
+/** Parse a "<a.b.c.d>/<length>" command-line allow list entry */
+SntpStatus_t Sntp_CtlParsePrefix( const char *spec, Sntp_CtlPrefix_t *prefix );
+
+/** Count a query and decide whether to answer it
+ * @param [in] addr - Source address, network byte order
+ * @return true if the source is allowed and within the rate limits
+ */
+bool Sntp_CtlAdmit( const Sntp_CtlConfig_t *cfg, Sntp_CtlState_t *state, uint32_t addr );
+
+/** Sntp_CtlAdmit() at a given time
+ * @param [in] nowMs - CLOCK_MONOTONIC in milliseconds; never 0, which marks an unused bucket
+ */
+bool Sntp_CtlAdmitAt( const Sntp_CtlConfig_t *cfg, Sntp_CtlState_t *state, uint32_t addr, uint64_t nowMs );
+
+/** Add a variable; the value is printf-formatted and truncated to fit. Ignored once the list is full. */
+void Sntp_CtlAddVar( Sntp_CtlVars_t *vars, const char *name, const char *fmt, ... )
+    __attribute__(( format( printf, 3, 4 ) ));
+
+/** Add the clock state and engine settings: version, leap, stratum, precision, clock, tai, time source,
+ *  timescale, pending leap and smear
+ */
+void Sntp_CtlAddClockVars( Sntp_CtlVars_t *vars, const Sntp_ServerConfig_t *cfg );
+
+/** Add the ss_* variables ntpq's sysstats command reads */
+void Sntp_CtlAddSysStats( Sntp_CtlVars_t *vars, const Sntp_CtlSysStats_t *stats, const Sntp_CtlState_t *state );
+
+/** Answer an admitted query, in up to SNTP_CTL_MAX_FRAGMENTS datagrams
+ * @param [in] vars - Variables for a read variables query
+ * @return SntpSuccess, or SntpErrorNetworkFailure if a fragment could not be sent
+ */
+SntpStatus_t Sntp_CtlRespond( Sntp_CtlState_t *state, const uint8_t *req, size_t len, const Sntp_CtlVars_t *vars,
+                              Sntp_Transport_t *transport, const struct sockaddr_in *dst );
+
+#endif
@@ -33,5 +33,30 @@
 #define SNTP_INVALID_MSGID_ERR_EID 5
 #define SNTP_LEN_ERR_EID           6
 #define SNTP_PIPE_ERR_EID          7
+#define SNTP_TBL_ERR_EID           8
+#define SNTP_TBL_VAL_ERR_EID       9
+#define SNTP_KEYS_LOADED_INF_EID   10
+#define SNTP_NTS_ERR_EID           11
+#define SNTP_BCAST_LOADED_INF_EID  12
+#define SNTP_RT_ERR_EID            13
+#define SNTP_CAPTURE_INF_EID       14
+#define SNTP_CAPTURE_ERR_EID       15
+#define SNTP_TIME_INF_EID          16
+#define SNTP_TIME_ERR_EID          17
+#define SNTP_TOPK_INF_EID          18
+#define SNTP_TOPK_ERR_EID          19
+#define SNTP_SHED_INF_EID          20
+#define SNTP_LEAP_INF_EID          21
+#define SNTP_LEAP_ERR_EID          22
+#define SNTP_STAGE_INF_EID         23
+#define SNTP_STAGE_ERR_EID         24
+#define SNTP_STATLOG_ERR_EID       25
+#define SNTP_CTL_INF_EID           26
+#define SNTP_SHM_ERR_EID           27
+#define SNTP_TIME_QUERY_ERR_EID    28
+#define SNTP_HANDOFF_INF_EID       29
+#define SNTP_STATE_INF_EID         30
+#define SNTP_STATE_ERR_EID         31
+#define SNTP_BCAST_ERR_EID         32
 
 #endif /* SNTP_EVENTS_H */
@@ -0,0 +1,83 @@
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "sntp_ext.h"
+#include "sntp_auth.h"
+
+size_t Sntp_ExtPutField( uint8_t *buf, size_t off, uint16_t type, const uint8_t *body, size_t bodyLen ) {
+    size_t fieldLen = ( 4 + bodyLen + 3 ) & ~(size_t)3;
+    uint16_t hdr[2] = { htons(type), htons((uint16_t)fieldLen) };
+
+    memcpy(buf + off, hdr, sizeof(hdr));
+    if (body != NULL) {
+        memcpy(buf + off + 4, body, bodyLen);
+    }
+    memset(buf + off + 4 + bodyLen, 0, fieldLen - 4 - bodyLen);
+    return off + fieldLen;
+}
+
+int Sntp_ExtNextField( const uint8_t *buf, size_t len, size_t *off, uint16_t *type, const uint8_t **body, size_t *bodyLen ) {
+    uint16_t hdr[2];
+    size_t fieldLen;
+
+    if (*off == len) {
+        return 0;
+    }
+    if (len - *off < 4) {
+        return -1;
+    }
+    memcpy(hdr, buf + *off, sizeof(hdr));
+    fieldLen = ntohs(hdr[1]);
+    if (fieldLen < SNTP_EXT_MIN_FIELD || ( fieldLen & 3 ) != 0 || fieldLen > len - *off) {
+        return -1;
+    }
+    *type = ntohs(hdr[0]);
+    *body = buf + *off + 4;
+    *bodyLen = fieldLen - 4;
+    *off += fieldLen;
+    return 1;
+}
+
+SntpStatus_t Sntp_ExtScanRequest( const uint8_t *req, size_t reqLen, Sntp_ExtRequest_t *ext ) {
+    size_t off = SNTP_PACKET_BASE_SIZE;
+    const uint8_t *body;
+    size_t bodyLen;
+    uint16_t type;
+    bool cookie = false, auth = false;
+    int more;
+
+    ext->uid = NULL;
+    ext->uidLen = 0;
+    ext->hasMac = false;
+
+    // Fields end where the remainder is exactly a MAC, or at the end of the packet
+    while (reqLen - off != SNTP_AUTH_MAC_SIZE &&
+           ( more = Sntp_ExtNextField(req, reqLen, &off, &type, &body, &bodyLen) ) != 0) {
+        if (more < 0) {
+            return SntpErrorBadParameter;
+        }
+        switch (type) {
+            case SNTP_EXT_UNIQUE_ID:
+                if (ext->uid != NULL || bodyLen < SNTP_EXT_UID_MIN || bodyLen > SNTP_EXT_UID_MAX) {
+                    return SntpErrorBadParameter;
+                }
+                ext->uid = body;
+                ext->uidLen = bodyLen;
+                break;
+            case SNTP_EXT_NTS_COOKIE:
+                cookie = true;
+                break;
+            case SNTP_EXT_NTS_AUTH:
+                auth = true;
+                break;
+            default:
+                // Unknown fields are ignored (RFC 7822 section 3)
+                break;
+        }
+    }
+
+    ext->fieldsEnd = off;
+    ext->hasMac = ( reqLen - off == SNTP_AUTH_MAC_SIZE );
+    ext->nts = cookie && auth;
+    return SntpSuccess;
+}
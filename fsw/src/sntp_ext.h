@@ -0,0 +1,56 @@
+#ifndef __SNTP_EXT__
+#define __SNTP_EXT__
+
+/**
+ * NTPv4 extension fields (RFC 7822).
+ *
+ * Requests are scanned in place in the receive buffer: the scan records
+ * pointers/offsets into it for the fields the server acts on, and nothing is
+ * copied.  A trailing block of exactly SNTP_AUTH_MAC_SIZE bytes is a MAC, not
+ * an extension field, since RFC 7822 requires a final field to be at least 28
+ * bytes when no MAC follows.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "core_sntp_serializer.h"
+
+#define SNTP_EXT_MIN_FIELD            16 /* Smallest legal extension field, header included */
+
+/* Extension field types (RFC 8915 section 5.7) */
+#define SNTP_EXT_UNIQUE_ID            0x0104
+#define SNTP_EXT_NTS_COOKIE           0x0204
+#define SNTP_EXT_NTS_PLACEHOLDER      0x0304
+#define SNTP_EXT_NTS_AUTH             0x0404
+
+#define SNTP_EXT_UID_MIN              32
+#define SNTP_EXT_UID_MAX              64
+
+/** Result of scanning a request beyond its 48-byte header */
+typedef struct {
+    const uint8_t *uid;    /**< Unique Identifier body to echo, NULL if absent */
+    size_t uidLen;
+    size_t fieldsEnd;      /**< Offset where extension fields end (start of MAC, if any) */
+    bool hasMac;           /**< A symmetric-key MAC trails the fields */
+    bool nts;              /**< NTS cookie and authenticator fields are present */
+} Sntp_ExtRequest_t;
+
+/** Validate the extension fields and MAC layout of a request longer than SNTP_PACKET_BASE_SIZE
+ * @return SntpSuccess, or SntpErrorBadParameter if a field length is malformed or a
+ *         Unique Identifier is out of range or repeated
+ */
+SntpStatus_t Sntp_ExtScanRequest( const uint8_t *req, size_t reqLen, Sntp_ExtRequest_t *ext );
+
+/** Write an extension field (padded to a 4 byte boundary); returns the new offset.
+ * A NULL body leaves the body bytes in place and only writes the header and padding.
+ */
+size_t Sntp_ExtPutField( uint8_t *buf, size_t off, uint16_t type, const uint8_t *body, size_t bodyLen );
+
+/** Step over the extension field at *off
+ * @return 1 with type/body set, 0 at end of packet, -1 if malformed
+ */
+int Sntp_ExtNextField( const uint8_t *buf, size_t len, size_t *off, uint16_t *type, const uint8_t **body, size_t *bodyLen );
+
+#endif
@@ -0,0 +1,150 @@
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "sntp_fleet.h"
+
+/* Differences of 2^43 units (2048s) and over are not binned; below that the microsecond value fits 31 bits */
+#define FLEET_MAX_DIFF ( (uint64_t)1 << 43 )
+
+static const uint32_t writePcts[] = { 1, 10, 50, 90, 99 };
+
+static uint64_t load_ntp64( const uint8_t *p ) {
+    uint32_t sec, frac;
+    memcpy(&sec, p, sizeof(sec));
+    memcpy(&frac, p + 4, sizeof(frac));
+    return ( (uint64_t)ntohl(sec) << 32 ) | ntohl(frac);
+}
+
+static double elapsed_secs( const struct timespec *since ) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)( now.tv_sec - since->tv_sec ) + (double)( now.tv_nsec - since->tv_nsec ) / 1e9;
+}
+
+static void clear_window( Sntp_Fleet_t *fleet ) {
+    memset(&fleet->cur, 0, sizeof(fleet->cur));
+    clock_gettime(CLOCK_MONOTONIC, &fleet->windowStart);
+}
+
+/** Bucket midpoint in microseconds, signed */
+static int32_t bucket_value( uint32_t bucket ) {
+    uint32_t idx, octave, sub;
+    int64_t mid;
+
+    if (bucket == SNTP_FLEET_SIDE) {
+        return 0;
+    }
+    idx = ( bucket > SNTP_FLEET_SIDE ) ? bucket - SNTP_FLEET_SIDE - 1 : SNTP_FLEET_SIDE - 1 - bucket;
+    octave = idx >> SNTP_FLEET_SUBS_LOG2;
+    sub = idx & ( SNTP_FLEET_SUBS - 1 );
+    // Bucket spans [(SUBS + sub) << octave, (SUBS + sub + 1) << octave) / SUBS
+    mid = ( (int64_t)( 2 * ( SNTP_FLEET_SUBS + sub ) + 1 ) << octave ) >> ( SNTP_FLEET_SUBS_LOG2 + 1 );
+    mid = ( mid == 0 ) ? 1 : mid;
+    return (int32_t)( ( bucket > SNTP_FLEET_SIDE ) ? mid : -mid );
+}
+
+void Sntp_FleetInit( Sntp_Fleet_t *fleet ) {
+    memset(fleet, 0, sizeof(*fleet));
+    clear_window(fleet);
+}
+
+void Sntp_FleetRecord( Sntp_Fleet_t *fleet, const uint8_t *resp, uint32_t group ) {
+    uint64_t origin = load_ntp64(resp + 24);
+    uint64_t receive = load_ntp64(resp + 32);
+    int64_t diff = (int64_t)( origin - receive );
+    uint64_t mag = ( diff < 0 ) ? -(uint64_t)diff : (uint64_t)diff;
+    uint32_t us, octave, idx;
+
+    // Kiss-o'-Death and NTS NAK replies carry no receive time
+    if (receive == 0) {
+        return;
+    }
+    if (origin == 0 || mag >= FLEET_MAX_DIFF) {
+        fleet->cur.unsynced++;
+        return;
+    }
+
+    // 10^6 / 2^32 = 15625 / 2^26
+    us = (uint32_t)( ( mag * 15625 ) >> 26 );
+    if (us == 0) {
+        idx = SNTP_FLEET_SIDE;
+    } else {
+        octave = 31 - __builtin_clz(us);
+        // Two bits of mantissa below the leading one pick the sub-bucket
+        idx = ( octave << SNTP_FLEET_SUBS_LOG2 ) |
+              ( ( ( (uint64_t)us << SNTP_FLEET_SUBS_LOG2 ) >> octave ) & ( SNTP_FLEET_SUBS - 1 ) );
+        idx = ( diff < 0 ) ? SNTP_FLEET_SIDE - 1 - idx : SNTP_FLEET_SIDE + 1 + idx;
+    }
+    fleet->cur.counts[group][idx]++;
+    fleet->cur.samples++;
+}
+
+bool Sntp_FleetRotateIfDue( Sntp_Fleet_t *fleet, uint32_t windowSecs ) {
+    double secs = elapsed_secs(&fleet->windowStart);
+
+    if (secs < (double)windowSecs) {
+        return false;
+    }
+    fleet->last = fleet->cur;
+    fleet->last.seconds = secs;
+    clear_window(fleet);
+    return true;
+}
+
+int32_t Sntp_FleetPercentile( const Sntp_FleetHist_t *hist, uint32_t group, uint32_t pct ) {
+    uint32_t first = ( group == SNTP_FLEET_ALL ) ? 0 : group;
+    uint32_t end = ( group == SNTP_FLEET_ALL ) ? SNTP_FLEET_GROUPS : group + 1;
+    uint64_t total = 0, rank, seen = 0;
+    uint32_t b;
+
+    for (uint32_t g = first; g < end; g++) {
+        for (b = 0; b < SNTP_FLEET_BUCKETS; b++) {
+            total += hist->counts[g][b];
+        }
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    // Nearest rank: the smallest value with at least pct% of the samples at or below it
+    pct = ( pct > 100 ) ? 100 : pct;
+    rank = ( total * pct + 99 ) / 100;
+    rank = ( rank == 0 ) ? 1 : rank;
+    for (b = 0; b < SNTP_FLEET_BUCKETS; b++) {
+        for (uint32_t g = first; g < end; g++) {
+            seen += hist->counts[g][b];
+        }
+        if (seen >= rank) {
+            break;
+        }
+    }
+    return bucket_value(b);
+}
+
+static void write_hist( FILE *out, const char *name, const Sntp_FleetHist_t *hist ) {
+    fprintf(out, "# %s window: %.1fs, %u samples, %u unsynchronised\n", name, hist->seconds, hist->samples,
+            hist->unsynced);
+    for (uint32_t g = 0; g <= SNTP_FLEET_ALL; g++) {
+        if (g == SNTP_FLEET_ALL) {
+            fprintf(out, "%s all", name);
+        } else {
+            fprintf(out, "%s %u", name, g);
+        }
+        for (uint32_t i = 0; i < sizeof(writePcts) / sizeof(writePcts[0]); i++) {
+            fprintf(out, " %d", Sntp_FleetPercentile(hist, g, writePcts[i]));
+        }
+        fprintf(out, "\n");
+    }
+}
+
+int Sntp_FleetWrite( const Sntp_Fleet_t *fleet, FILE *out ) {
+    Sntp_FleetHist_t current = fleet->cur;
+
+    current.seconds = elapsed_secs(&fleet->windowStart);
+    fprintf(out, "# SNTP fleet clock offsets (client minus server, less one-way delay), microseconds\n");
+    fprintf(out, "# window group p1 p10 p50 p90 p99\n");
+    write_hist(out, "current", &current);
+    write_hist(out, "last", &fleet->last);
+
+    return ( fflush(out) == 0 && !ferror(out) ) ? 0 : -1;
+}
@@ -0,0 +1,83 @@
+#ifndef __SNTP_FLEET__
+#define __SNTP_FLEET__
+
+/**
+ * Fleet clock offset histogram.
+ *
+ * Every answered request tells how far its client's clock is off: the
+ * client's transmit timestamp, echoed as the response's origin timestamp,
+ * minus the server's receive timestamp.  This is the client's offset less
+ * the one-way delay from client to server, so on a LAN it is the offset to
+ * within the delay.  Positive means the client is ahead.
+ *
+ * Differences go into a signed log-scale histogram: SNTP_FLEET_SUBS buckets
+ * per power of two microseconds, from 1us to about 35 minutes, plus one
+ * bucket for below a microsecond.  A sample costs two timestamp loads, a
+ * multiply and a count-leading-zeros; percentiles are read to within one
+ * bucket (about 19% of the value).  Clients that send a zero transmit
+ * timestamp, or one further off than the histogram covers (unsynchronised
+ * clocks, or clients such as chrony that randomise it), are only counted.
+ *
+ * Samples are kept per group, e.g. per shed class, so that an address-prefix
+ * breakdown costs no more memory than the groups themselves.  Counts cover
+ * a window; rotating it keeps the finished window for reporting.  Not thread
+ * safe: record, rotate and report from the serving task.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+
+#ifndef SNTP_FLEET_GROUPS
+#define SNTP_FLEET_GROUPS 3
+#endif
+#define SNTP_FLEET_OCTAVES   31 /* 1us to 2^31us; offsets of 2048s and over are not binned */
+#define SNTP_FLEET_SUBS_LOG2 2
+#define SNTP_FLEET_SUBS      ( 1U << SNTP_FLEET_SUBS_LOG2 )
+#define SNTP_FLEET_SIDE      ( SNTP_FLEET_OCTAVES * SNTP_FLEET_SUBS )
+#define SNTP_FLEET_BUCKETS   ( 2 * SNTP_FLEET_SIDE + 1 )
+
+/* Pass as the group to cover all groups */
+#define SNTP_FLEET_ALL SNTP_FLEET_GROUPS
+
+/** Most negative offsets first, then [SNTP_FLEET_SIDE] for under 1us, then positive offsets */
+typedef struct {
+    uint32_t counts[SNTP_FLEET_GROUPS][SNTP_FLEET_BUCKETS];
+    uint32_t samples;  /**< Samples binned */
+    uint32_t unsynced; /**< Zero or out-of-range transmit timestamps */
+    double   seconds;  /**< Window length, set when the window is finished */
+} Sntp_FleetHist_t;
+
+typedef struct {
+    Sntp_FleetHist_t cur;
+    Sntp_FleetHist_t last; /**< Most recently completed window */
+    struct timespec  windowStart;
+} Sntp_Fleet_t;
+
+void Sntp_FleetInit( Sntp_Fleet_t *fleet );
+
+/** Sample the client clock offset from a response built by the server engine
+ * @param [in] resp - Response in network order; only its origin and receive timestamps are read
+ * @param [in] group - Group to count the sample in, below SNTP_FLEET_GROUPS
+ */
+void Sntp_FleetRecord( Sntp_Fleet_t *fleet, const uint8_t *resp, uint32_t group );
+
+/** Finish the window if it is at least windowSecs old, keeping it in fleet->last
+ * @return true if the window was rotated
+ */
+bool Sntp_FleetRotateIfDue( Sntp_Fleet_t *fleet, uint32_t windowSecs );
+
+/** Offset that pct percent of a group's samples are at or below, in microseconds
+ * @param [in] group - Group, or SNTP_FLEET_ALL
+ * @param [in] pct - 0 for the smallest sample to 100 for the largest; larger values are taken as 100
+ * @return Midpoint of the bucket holding the percentile, 0 if there are no samples
+ */
+int32_t Sntp_FleetPercentile( const Sntp_FleetHist_t *hist, uint32_t group, uint32_t pct );
+
+/** Write the percentiles of the window in progress and the last completed window as text
+ * @return 0, or -1 with errno set
+ */
+int Sntp_FleetWrite( const Sntp_Fleet_t *fleet, FILE *out );
+
+#endif
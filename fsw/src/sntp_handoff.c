@@ -0,0 +1,140 @@
+#include <string.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+
+#include "sntp_handoff.h"
+
+bool Sntp_HandoffValid( int fd, uint16_t port ) {
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    int type;
+    socklen_t typeLen = sizeof(type);
+
+    if (fd < 0 || getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &typeLen) != 0 || type != SOCK_DGRAM) {
+        return false;
+    }
+    return getsockname(fd, (struct sockaddr *)&addr, &len) == 0 && addr.sin_family == AF_INET &&
+           ntohs(addr.sin_port) == port;
+}
+
+static int unix_addr( const char *path, struct sockaddr_un *addr ) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+int Sntp_HandoffListen( const char *path ) {
+    struct sockaddr_un addr;
+    int fd;
+
+    if (unix_addr(path, &addr) != 0) {
+        return -1;
+    }
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    // The previous instance has handed off and exited by now, or left the file behind
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 1) != 0) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    return fd;
+}
+
+int Sntp_HandoffOffer( int listenFd, const int *fds, uint32_t count ) {
+    union {
+        char           buf[CMSG_SPACE(sizeof(int) * SNTP_HANDOFF_MAX)];
+        struct cmsghdr align;
+    } ctrl;
+    uint32_t n = count;
+    struct iovec iov = { .iov_base = &n, .iov_len = sizeof(n) };
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1, .msg_control = ctrl.buf,
+                          .msg_controllen = CMSG_SPACE(sizeof(int) * count) };
+    struct cmsghdr *cmsg;
+    int conn;
+    ssize_t sent;
+
+    if (count == 0 || count > SNTP_HANDOFF_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+    conn = accept(listenFd, NULL, NULL);
+    if (conn < 0) {
+        return ( errno == EAGAIN || errno == EWOULDBLOCK ) ? 0 : -1;
+    }
+
+    memset(ctrl.buf, 0, sizeof(ctrl.buf));
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * count);
+    sent = sendmsg(conn, &msg, MSG_NOSIGNAL);
+    close(conn);
+    return ( sent == (ssize_t)sizeof(n) ) ? 1 : -1;
+}
+
+int Sntp_HandoffTake( const char *path, int *fds, uint32_t max ) {
+    union {
+        char           buf[CMSG_SPACE(sizeof(int) * SNTP_HANDOFF_MAX)];
+        struct cmsghdr align;
+    } ctrl;
+    struct sockaddr_un addr;
+    uint32_t n = 0, got;
+    struct iovec iov = { .iov_base = &n, .iov_len = sizeof(n) };
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1, .msg_control = ctrl.buf,
+                          .msg_controllen = sizeof(ctrl.buf) };
+    struct cmsghdr *cmsg;
+    ssize_t len;
+    int fd, err;
+
+    if (unix_addr(path, &addr) != 0) {
+        return -1;
+    }
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    // The running instance offers once a second, so wait a few for it
+    struct timeval tv = { .tv_sec = 5, .tv_usec = 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    len = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+    err = errno;
+    close(fd);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    if (len != (ssize_t)sizeof(n) || cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+        errno = ( len < 0 ) ? err : EPROTO;
+        return -1;
+    }
+
+    got = (uint32_t)( ( cmsg->cmsg_len - CMSG_LEN(0) ) / sizeof(int) );
+    for (uint32_t i = 0; i < got; i++) {
+        int received;
+        memcpy(&received, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+        if (i < max) {
+            fds[i] = received;
+        } else {
+            close(received);
+        }
+    }
+    return (int)( got < max ? got : max );
+}
@@ -0,0 +1,44 @@
+#ifndef __SNTP_HANDOFF__
+#define __SNTP_HANDOFF__
+
+/**
+ * Handing bound UDP sockets from a server instance to its replacement.
+ *
+ * A socket that stays open across a restart keeps its port bound and its
+ * receive queue: requests arriving while the new instance starts are held
+ * rather than refused, and are answered as soon as it reads them.
+ *
+ * Within one process (the cFE app across an ES restart or reload) the
+ * descriptor numbers only need to survive; the app keeps them in a CDS
+ * block and checks them with Sntp_HandoffValid() before use.  Between
+ * processes (the standalone server) they are passed with SCM_RIGHTS over
+ * a Unix domain socket: the running server listens on a path, and a new
+ * one connects to it, receives the descriptors and the old one exits.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SNTP_HANDOFF_MAX 4 /* Descriptors passed in one handoff */
+
+/** True if fd is an open IPv4 UDP socket bound to port, i.e. safe to serve from */
+bool Sntp_HandoffValid( int fd, uint16_t port );
+
+/** Listen on a Unix domain socket path for a replacement instance, replacing a stale socket file
+ * @return Non-blocking listening descriptor, or -1 with errno set
+ */
+int Sntp_HandoffListen( const char *path );
+
+/** Pass descriptors to a replacement if one has connected; does not block
+ * @return 1 if they were handed off (the caller should stop serving and exit), 0 if nobody is waiting,
+ *         or -1 with errno set if a replacement connected but the send failed
+ */
+int Sntp_HandoffOffer( int listenFd, const int *fds, uint32_t count );
+
+/** Connect to a running instance at path and receive its descriptors
+ * @param [out] fds - Received descriptors, at most max
+ * @return Number received, or -1 with errno set; ENOENT or ECONNREFUSED means no instance is running
+ */
+int Sntp_HandoffTake( const char *path, int *fds, uint32_t max );
+
+#endif
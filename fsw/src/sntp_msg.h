@@ -31,6 +31,21 @@
 #define SNTP_NOOP_CC           0
 #define SNTP_RESET_COUNTERS_CC 1
 #define SNTP_PROCESS_CC        2
+#define SNTP_CAPTURE_START_CC  3
+#define SNTP_CAPTURE_STOP_CC   4
+#define SNTP_SET_TIME_SOURCE_CC 5
+#define SNTP_TOPK_DUMP_CC      6
+#define SNTP_SCHEDULE_LEAP_CC  7
+#define SNTP_STAGE_DUMP_CC     8
+
+/*
+** Wake latency histogram size (SNTP_RT_HIST_BUCKETS)
+*/
+#define SNTP_WAKE_HIST_BUCKETS 16
+#define SNTP_TIME_SOURCE_COUNT 4 /* CFE UTC, CFE TAI, CLOCK_REALTIME, CLOCK_TAI */
+#define SNTP_TIMESCALE_COUNT   3 /* UTC, TAI, MET */
+#define SNTP_SHED_CLASSES      3 /* Critical, normal, best effort */
+#define SNTP_FLEET_PERCENTILES 5 /* 1st, 10th, 50th, 90th, 99th */
 
 /*************************************************************************/
 
@@ -52,6 +67,139 @@ typedef struct
 typedef SNTP_NoArgsCmd_t SNTP_NoopCmd_t;
 typedef SNTP_NoArgsCmd_t SNTP_ResetCountersCmd_t;
 typedef SNTP_NoArgsCmd_t SNTP_ProcessCmd_t;
+typedef SNTP_NoArgsCmd_t SNTP_CaptureStopCmd_t;
+
+/*
+** Type definition (start request capture)
+*/
+typedef struct
+{
+    char   File[CFE_MISSION_MAX_PATH_LEN]; /**< pcap file to write, e.g. /cf/sntp.pcap */
+    uint32 SampleN;                        /**< Capture one request in SampleN, 0 or 1 for all */
+} SNTP_CaptureStart_Payload_t;
+
+typedef struct
+{
+    CFE_MSG_CommandHeader_t     CmdHeader; /**< \brief Command header */
+    SNTP_CaptureStart_Payload_t Payload;
+} SNTP_CaptureStartCmd_t;
+
+/*
+** Type definition (select time source)
+*/
+typedef struct
+{
+    uint8 Source;   /**< 0 CFE UTC, 1 CFE TAI, 2 CLOCK_REALTIME, 3 CLOCK_TAI */
+    uint8 Spare[3];
+} SNTP_SetTimeSource_Payload_t;
+
+typedef struct
+{
+    CFE_MSG_CommandHeader_t      CmdHeader; /**< \brief Command header */
+    SNTP_SetTimeSource_Payload_t Payload;
+} SNTP_SetTimeSourceCmd_t;
+
+/*
+** Type definition (write the top talkers to a file)
+*/
+typedef struct
+{
+    char File[CFE_MISSION_MAX_PATH_LEN]; /**< Text file to write, empty for SNTP_TOPK_FILE */
+} SNTP_TopKDump_Payload_t;
+
+typedef struct
+{
+    CFE_MSG_CommandHeader_t CmdHeader; /**< \brief Command header */
+    SNTP_TopKDump_Payload_t Payload;
+} SNTP_TopKDumpCmd_t;
+
+/*
+** Type definition (write the sampled request stage trace to a file)
+*/
+typedef struct
+{
+    char File[CFE_MISSION_MAX_PATH_LEN]; /**< CSV file to write, empty for SNTP_STAGE_FILE */
+} SNTP_StageDump_Payload_t;
+
+typedef struct
+{
+    CFE_MSG_CommandHeader_t  CmdHeader; /**< \brief Command header */
+    SNTP_StageDump_Payload_t Payload;
+} SNTP_StageDumpCmd_t;
+
+/*
+** Type definition (schedule or cancel a leap second)
+*/
+typedef struct
+{
+    uint32 LeapSecs;  /**< UTC instant of the leap, NTP seconds (as in leap-seconds.list) */
+    int8   Direction; /**< +1 inserts a second, -1 deletes one, 0 cancels the scheduled leap */
+    uint8  Shape;     /**< 0 leap indicator only, 1 linear smear, 2 smooth smear */
+    uint16 Spare;
+    uint32 SmearSecs; /**< Smear window, centred on the leap; ignored for shape 0 */
+} SNTP_ScheduleLeap_Payload_t;
+
+typedef struct
+{
+    CFE_MSG_CommandHeader_t     CmdHeader; /**< \brief Command header */
+    SNTP_ScheduleLeap_Payload_t Payload;
+} SNTP_ScheduleLeapCmd_t;
+
+/*
+** Type definition (NTP timestamp: seconds since 1900 and 2^-32 fractions)
+*/
+typedef struct
+{
+    uint32 Seconds;
+    uint32 Fraction;
+} SNTP_NtpTime_t;
+
+/*
+** Type definition (onboard time query, SNTP_TIME_REQ_MID)
+*/
+typedef struct
+{
+    uint32         Tag;       /**< Echoed in the response so a requester can pick out its own, e.g. app id and sequence */
+    uint8          Timescale; /**< 0 UTC, 1 TAI, 2 MET */
+    uint8          Spare[3];
+    SNTP_NtpTime_t Origin;    /**< Requester's clock when sending, echoed for its delay and offset calculation; may be 0 */
+} SNTP_TimeQuery_Payload_t;
+
+typedef struct
+{
+    CFE_MSG_CommandHeader_t  CmdHeader; /**< \brief Command header */
+    SNTP_TimeQuery_Payload_t Payload;
+} SNTP_TimeQueryCmd_t;
+
+/*************************************************************************/
+/*
+** Type definition (onboard time query response, SNTP_TIME_TLM_MID)
+**
+** The fields of the NTP response a UDP client would get for the same request, in host byte order
+*/
+typedef struct
+{
+    uint32         Tag;            /**< From the query */
+    uint8          LeapIndicator;  /**< 0 none, 1 insert, 2 delete */
+    uint8          Stratum;
+    int8           Precision;      /**< log2 seconds */
+    uint8          Timescale;      /**< From the query */
+    uint8          TimeSource;     /**< Selected time source (SNTP_SET_TIME_SOURCE_CC) */
+    uint8          Spare[3];
+    uint32         RootDelay;      /**< NTP short format, 16.16 seconds */
+    uint32         RootDispersion; /**< NTP short format, 16.16 seconds */
+    uint32         RefId;
+    uint32         LeapSecs;       /**< Scheduled leap second, NTP seconds, 0 if none */
+    SNTP_NtpTime_t Origin;         /**< From the query */
+    SNTP_NtpTime_t Receive;        /**< When the query was taken off the pipe */
+    SNTP_NtpTime_t Transmit;       /**< When this response was built */
+} SNTP_TimeTlm_Payload_t;
+
+typedef struct
+{
+    CFE_MSG_TelemetryHeader_t TelemetryHeader; /**< \brief Telemetry header */
+    SNTP_TimeTlm_Payload_t    Payload;
+} SNTP_TimeTlm_t;
 
 /*************************************************************************/
 /*
@@ -65,6 +213,47 @@ typedef struct
     uint16 SntpReqRcv;
     uint16 SntpBadRequests;
     uint16 SntpInvalidRequests;
+    uint16 SntpAuthKeys;      /**< Keys loaded from the key table */
+    uint32 SntpAuthResponses; /**< Authenticated responses sent */
+    uint32 SntpAuthFailures;  /**< Requests dropped for an unknown key id or bad MAC */
+    uint32 SntpNtsResponses;  /**< NTS-protected responses sent */
+    uint32 SntpNtsFailures;   /**< NTS NAKs sent plus requests dropped for a bad authenticator */
+    uint32 SntpNtsKeSessions; /**< Successful NTS-KE sessions */
+    uint32 SntpNtsKeFailures; /**< Failed or rejected NTS-KE sessions */
+    uint32 SntpBcastSent;     /**< Broadcast/multicast packets sent */
+    uint32 SntpBcastErrors;   /**< Broadcast/multicast packets that could not be sent */
+    uint32 SntpSendErrors;    /**< Responses the socket would not take, e.g. with the send buffer full */
+    uint32 SntpCaptured;      /**< Requests queued to the active or last capture */
+    uint32 SntpCaptureDrops;  /**< Sampled requests not captured because the writer fell behind */
+    uint32 SntpKernelDrops;   /**< Requests dropped by the kernel with the receive buffer full */
+    uint32 SntpPeakQueueBytes; /**< Largest receive queue backlog since the previous housekeeping packet */
+    uint32 SntpRcvBufBytes;   /**< Effective socket receive buffer size */
+    uint32 SntpSndBufBytes;   /**< Effective socket send buffer size */
+    uint32 SntpSpinMs;        /**< Time spent busy-polling for requests */
+    uint32 SntpSleepMs;       /**< Time spent blocked waiting for requests */
+    uint32 SntpWakeMaxUs;     /**< Longest packet arrival to task wake latency, microseconds */
+    uint32 SntpWakeHist[SNTP_WAKE_HIST_BUCKETS]; /**< Wake latency log2 histogram: [0] <1us, [i] 2^(i-1)..2^i us */
+    uint32 SntpTimeCostNs[SNTP_TIME_SOURCE_COUNT]; /**< Calibrated read cost per time source, 0 if unavailable */
+    uint32 SntpTimeResNs[SNTP_TIME_SOURCE_COUNT];  /**< Calibrated resolution per time source */
+    uint32 SntpScaleRequests[SNTP_TIMESCALE_COUNT]; /**< Requests answered per timescale: UTC, TAI, MET */
+    uint32 SntpTopTalkerAddr; /**< Busiest source address in the current window, network byte order */
+    uint32 SntpTopTalkerRate; /**< Its estimated request rate, per second */
+    uint32 SntpShed[SNTP_SHED_CLASSES]; /**< Requests shed under overload per class; critical is always 0 */
+    uint32 SntpShedKod;       /**< Shed requests answered with KoD RATE */
+    uint32 SntpLeapSecs;      /**< Scheduled leap second, NTP seconds, 0 if none */
+    int32  SntpSmearUs;       /**< Correction the leap smear currently applies to UTC, microseconds */
+    uint32 SntpFleetSamples;  /**< Client clocks sampled in the last fleet window */
+    uint32 SntpFleetUnsynced; /**< Requests in that window with a zero or wildly wrong transmit timestamp */
+    int32  SntpFleetOffsetUs[SNTP_FLEET_PERCENTILES]; /**< Client clock offset percentiles, microseconds, + ahead */
+    int32  SntpFleetMedianUs[SNTP_SHED_CLASSES];      /**< Median client clock offset per request class */
+    uint32 SntpCtlAnswered;   /**< Mode-6 control queries answered */
+    uint32 SntpCtlRefused;    /**< Mode-6 control queries dropped by the allow list or rate limits */
+    uint32 SntpTimeQueries;   /**< Onboard time queries answered over the software bus */
+    uint32 SntpTimeQueryErrors; /**< Onboard time queries of a bad length or timescale, or whose answer was not sent */
+    uint8  SntpTimeSource;    /**< Selected time source (SNTP_SET_TIME_SOURCE_CC) */
+    int8   SntpPrecision;     /**< NTP precision advertised, log2 seconds */
+    uint8  SntpShedLevel;     /**< 0 serving all, 1 shedding best effort, 2 shedding normal and best effort */
+    uint8  SntpLeapIndicator; /**< Leap indicator in responses: 0 none, 1 insert, 2 delete */
 } SNTP_HkTlm_Payload_t;
 
 typedef struct
@@ -0,0 +1,575 @@
+#include <errno.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/err.h>
+
+#include "core_sntp_config.h"
+#include "sntp_nts.h"
+
+/*** AEAD_AES_SIV_CMAC_256 (RFC 5297) ***/
+
+/* S2V and CTR contexts are re-keyed per use; one set per thread (NTP path and NTS-KE task) */
+static __thread EVP_CIPHER_CTX *sivEcb;
+static __thread EVP_CIPHER_CTX *sivCtr;
+
+static void siv_dbl( uint8_t b[16] ) {
+    uint8_t carry = b[0] >> 7;
+    for (int i = 0; i < 15; i++) {
+        b[i] = (uint8_t)( ( b[i] << 1 ) | ( b[i + 1] >> 7 ) );
+    }
+    b[15] = (uint8_t)( ( b[15] << 1 ) ^ ( carry ? 0x87 : 0 ) );
+}
+
+static void siv_block( const uint8_t in[16], uint8_t out[16] ) {
+    int outl;
+    EVP_EncryptUpdate(sivEcb, out, &outl, in, 16);
+}
+
+/** CMAC over data, with xorEnd (if set) XORed into the final 16 bytes of the message */
+static void siv_cmac( const uint8_t sub1[16], const uint8_t sub2[16], const uint8_t *data, size_t len,
+                      const uint8_t *xorEnd, uint8_t out[16] ) {
+    uint8_t x[16] = { 0 };
+    uint8_t blk[16];
+    size_t off = 0;
+
+    while (len - off > 16) {
+        for (int i = 0; i < 16; i++) {
+            uint8_t m = data[off + i];
+            if (xorEnd != NULL && off + i >= len - 16) {
+                m ^= xorEnd[off + i - ( len - 16 )];
+            }
+            blk[i] = x[i] ^ m;
+        }
+        siv_block(blk, x);
+        off += 16;
+    }
+
+    // Final block: complete blocks use K1, partial/empty ones are padded and use K2
+    size_t rem = len - off;
+    memset(blk, 0, sizeof(blk));
+    for (size_t i = 0; i < rem; i++) {
+        blk[i] = data[off + i];
+        if (xorEnd != NULL && off + i >= len - 16) {
+            blk[i] ^= xorEnd[off + i - ( len - 16 )];
+        }
+    }
+    if (rem == 16) {
+        for (int i = 0; i < 16; i++) {
+            blk[i] ^= sub1[i];
+        }
+    } else {
+        blk[rem] = 0x80;
+        for (int i = 0; i < 16; i++) {
+            blk[i] ^= sub2[i];
+        }
+    }
+    for (int i = 0; i < 16; i++) {
+        blk[i] ^= x[i];
+    }
+    siv_block(blk, out);
+}
+
+static int siv_ctx_init( void ) {
+    if (sivEcb == NULL) {
+        sivEcb = EVP_CIPHER_CTX_new();
+        sivCtr = EVP_CIPHER_CTX_new();
+    }
+    return ( sivEcb != NULL && sivCtr != NULL ) ? 0 : -1;
+}
+
+/** S2V over the associated data components and plaintext, producing the synthetic IV */
+static int siv_s2v( const uint8_t key[SNTP_NTS_KEY_SIZE], const uint8_t *const comp[], const size_t compLen[],
+                    int ncomp, const uint8_t *pt, size_t ptLen, uint8_t v[16] ) {
+    static const uint8_t zero[16] = { 0 };
+    uint8_t sub1[16], sub2[16], d[16], t[16];
+
+    if (EVP_EncryptInit_ex(sivEcb, EVP_aes_128_ecb(), NULL, key, NULL) != 1) {
+        return -1;
+    }
+    EVP_CIPHER_CTX_set_padding(sivEcb, 0);
+
+    siv_block(zero, sub1);
+    siv_dbl(sub1);
+    memcpy(sub2, sub1, 16);
+    siv_dbl(sub2);
+
+    siv_cmac(sub1, sub2, zero, sizeof(zero), NULL, d);
+    for (int c = 0; c < ncomp; c++) {
+        siv_dbl(d);
+        siv_cmac(sub1, sub2, comp[c], compLen[c], NULL, t);
+        for (int i = 0; i < 16; i++) {
+            d[i] ^= t[i];
+        }
+    }
+    if (ptLen >= 16) {
+        siv_cmac(sub1, sub2, pt, ptLen, d, v);
+    } else {
+        siv_dbl(d);
+        memset(t, 0, sizeof(t));
+        memcpy(t, pt, ptLen);
+        t[ptLen] = 0x80;
+        for (int i = 0; i < 16; i++) {
+            t[i] ^= d[i];
+        }
+        siv_cmac(sub1, sub2, t, sizeof(t), NULL, v);
+    }
+    return 0;
+}
+
+static int siv_ctr( const uint8_t key[SNTP_NTS_KEY_SIZE], const uint8_t v[16], const uint8_t *in, size_t len, uint8_t *out ) {
+    uint8_t q[16];
+    int outl;
+
+    memcpy(q, v, sizeof(q));
+    q[8] &= 0x7f;
+    q[12] &= 0x7f;
+    if (EVP_EncryptInit_ex(sivCtr, EVP_aes_128_ctr(), NULL, key + 16, q) != 1) {
+        return -1;
+    }
+    if (len > 0 && EVP_EncryptUpdate(sivCtr, out, &outl, in, (int)len) != 1) {
+        return -1;
+    }
+    return 0;
+}
+
+int Sntp_NtsSeal( const uint8_t key[SNTP_NTS_KEY_SIZE], const uint8_t *ad, size_t adLen, const uint8_t *nonce,
+                  size_t nonceLen, const uint8_t *pt, size_t ptLen, uint8_t *out ) {
+    const uint8_t *comp[2] = { ad, nonce };
+    const size_t compLen[2] = { adLen, nonceLen };
+
+    if (siv_ctx_init() != 0 || siv_s2v(key, comp, compLen, 2, pt, ptLen, out) != 0) {
+        return -1;
+    }
+    return siv_ctr(key, out, pt, ptLen, out + SNTP_NTS_TAG_SIZE);
+}
+
+int Sntp_NtsOpen( const uint8_t key[SNTP_NTS_KEY_SIZE], const uint8_t *ad, size_t adLen, const uint8_t *nonce,
+                  size_t nonceLen, const uint8_t *ct, size_t ctLen, uint8_t *pt ) {
+    const uint8_t *comp[2] = { ad, nonce };
+    const size_t compLen[2] = { adLen, nonceLen };
+    uint8_t v[16];
+    uint8_t diff = 0;
+
+    if (ctLen < SNTP_NTS_TAG_SIZE) {
+        return -1;
+    }
+    if (siv_ctx_init() != 0 ||
+        siv_ctr(key, ct, ct + SNTP_NTS_TAG_SIZE, ctLen - SNTP_NTS_TAG_SIZE, pt) != 0 ||
+        siv_s2v(key, comp, compLen, 2, pt, ctLen - SNTP_NTS_TAG_SIZE, v) != 0) {
+        return -1;
+    }
+    for (int i = 0; i < SNTP_NTS_TAG_SIZE; i++) {
+        diff |= v[i] ^ ct[i];
+    }
+    return ( diff == 0 ) ? 0 : -1;
+}
+
+/*** Cookie master keys ***/
+
+typedef struct {
+    uint32_t id;
+    uint8_t key[SNTP_NTS_KEY_SIZE];
+} NtsMasterKey_t;
+
+static pthread_rwlock_t masterLock = PTHREAD_RWLOCK_INITIALIZER;
+static NtsMasterKey_t masterKeys[2]; /* [current, previous] */
+static time_t lastRotation;
+static SSL_CTX *sslCtx;
+static Sntp_NtsStats_t ntsStats; /* Counted by the NTS-KE task, read and reset by the main task; only touched with __atomic */
+
+static int rotate_master_key( void ) {
+    NtsMasterKey_t next;
+
+    next.id = masterKeys[0].id + 1;
+    if (RAND_bytes(next.key, sizeof(next.key)) != 1) {
+        return -1;
+    }
+    pthread_rwlock_wrlock(&masterLock);
+    masterKeys[1] = masterKeys[0];
+    masterKeys[0] = next;
+    pthread_rwlock_unlock(&masterLock);
+    __atomic_fetch_add(&ntsStats.keyRotations, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+void Sntp_NtsRotateIfDue( uint32_t periodSecs ) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (now.tv_sec - lastRotation >= (time_t)periodSecs) {
+        if (rotate_master_key() == 0) {
+            lastRotation = now.tv_sec;
+        }
+    }
+}
+
+/** Cookie layout: master key id (4) | nonce (16) | SIV(master, ad=key id, C2S || S2C) (16 + 64) */
+static int make_cookie( const Sntp_NtsKeys_t *keys, uint8_t cookie[SNTP_NTS_COOKIE_SIZE] ) {
+    int status;
+
+    if (RAND_bytes(cookie + 4, SNTP_NTS_NONCE_SIZE) != 1) {
+        return -1;
+    }
+    pthread_rwlock_rdlock(&masterLock);
+    uint32_t id = htonl(masterKeys[0].id);
+    memcpy(cookie, &id, 4);
+    status = Sntp_NtsSeal(masterKeys[0].key, cookie, 4, cookie + 4, SNTP_NTS_NONCE_SIZE,
+                          (const uint8_t *)keys, sizeof(*keys), cookie + 4 + SNTP_NTS_NONCE_SIZE);
+    pthread_rwlock_unlock(&masterLock);
+    return status;
+}
+
+static int open_cookie( const uint8_t *cookie, size_t len, Sntp_NtsKeys_t *keys ) {
+    uint32_t id;
+    int status = -1;
+
+    if (len != SNTP_NTS_COOKIE_SIZE) {
+        return -1;
+    }
+    memcpy(&id, cookie, 4);
+    id = ntohl(id);
+    pthread_rwlock_rdlock(&masterLock);
+    for (int i = 0; i < 2; i++) {
+        if (masterKeys[i].id == id && id != 0) {
+            status = Sntp_NtsOpen(masterKeys[i].key, cookie, 4, cookie + 4, SNTP_NTS_NONCE_SIZE,
+                                  cookie + 4 + SNTP_NTS_NONCE_SIZE, len - 4 - SNTP_NTS_NONCE_SIZE, (uint8_t *)keys);
+            break;
+        }
+    }
+    pthread_rwlock_unlock(&masterLock);
+    return status;
+}
+
+/*** NTP path ***/
+
+SntpStatus_t Sntp_NtsParseRequest( const uint8_t *req, size_t reqLen, Sntp_NtsRequest_t *nts ) {
+    size_t off = SNTP_PACKET_BASE_SIZE;
+    size_t authStart = 0;
+    const uint8_t *body;
+    const uint8_t *cookie = NULL;
+    const uint8_t *auth = NULL;
+    size_t bodyLen, cookieLen = 0, authLen = 0;
+    uint16_t type;
+    uint32_t placeholders = 0;
+    int more;
+
+    nts->uid = NULL;
+    while (auth == NULL && ( more = Sntp_ExtNextField(req, reqLen, &off, &type, &body, &bodyLen) ) != 0) {
+        if (more < 0) {
+            return SntpErrorBadParameter;
+        }
+        switch (type) {
+            case SNTP_EXT_UNIQUE_ID:
+                if (nts->uid != NULL || bodyLen < SNTP_EXT_UID_MIN || bodyLen > SNTP_EXT_UID_MAX) {
+                    return SntpErrorBadParameter;
+                }
+                nts->uid = body;
+                nts->uidLen = bodyLen;
+                break;
+            case SNTP_EXT_NTS_COOKIE:
+                if (cookie != NULL) {
+                    return SntpErrorBadParameter;
+                }
+                cookie = body;
+                cookieLen = bodyLen;
+                break;
+            case SNTP_EXT_NTS_PLACEHOLDER:
+                placeholders++;
+                break;
+            case SNTP_EXT_NTS_AUTH:
+                authStart = (size_t)( body - req ) - 4;
+                auth = body;
+                authLen = bodyLen;
+                break;
+            default:
+                // Unknown fields are covered by the authenticator but otherwise ignored
+                break;
+        }
+    }
+    if (nts->uid == NULL || cookie == NULL || auth == NULL || authLen < 4) {
+        return SntpErrorBadParameter;
+    }
+
+    // Authenticator body: nonce length, ciphertext length, nonce, ciphertext (each padded to 4)
+    uint16_t lens[2];
+    memcpy(lens, auth, sizeof(lens));
+    size_t nonceLen = ntohs(lens[0]);
+    size_t ctLen = ntohs(lens[1]);
+    size_t noncePad = ( nonceLen + 3 ) & ~(size_t)3;
+    if (nonceLen < SNTP_NTS_NONCE_SIZE || ctLen < SNTP_NTS_TAG_SIZE || ctLen > SNTP_NTS_MAX_PACKET ||
+        4 + noncePad + ( ( ctLen + 3 ) & ~(size_t)3 ) > authLen) {
+        return SntpErrorBadParameter;
+    }
+
+    nts->reqLen = reqLen;
+    nts->cookies = placeholders + 1;
+    if (nts->cookies > SNTP_NTS_MAX_COOKIES) {
+        nts->cookies = SNTP_NTS_MAX_COOKIES;
+    }
+
+    if (open_cookie(cookie, cookieLen, &nts->keys) != 0) {
+        return SntpServerNotAuthenticated;
+    }
+
+    uint8_t pt[SNTP_NTS_MAX_PACKET];
+    if (Sntp_NtsOpen(nts->keys.c2s, req, authStart, auth + 4, nonceLen, auth + 4 + noncePad, ctLen, pt) != 0) {
+        return SntpErrorAuthFailure;
+    }
+    return SntpSuccess;
+}
+
+size_t Sntp_NtsAppendResponse( const Sntp_NtsRequest_t *nts, uint8_t *resp, size_t len ) {
+    uint8_t pt[SNTP_NTS_MAX_COOKIES * ( 4 + SNTP_NTS_COOKIE_SIZE )];
+    uint8_t cookie[SNTP_NTS_COOKIE_SIZE];
+    size_t ptLen = 0;
+    size_t authStart;
+    uint32_t cookies = nts->cookies;
+    uint16_t lens[2];
+
+    len = Sntp_ExtPutField(resp, len, SNTP_EXT_UNIQUE_ID, nts->uid, nts->uidLen);
+    authStart = len;
+
+    // Never answer with more than was received, to avoid amplification
+    while (cookies > 1 && authStart + 4 + 4 + SNTP_NTS_NONCE_SIZE + SNTP_NTS_TAG_SIZE +
+                                  cookies * ( 4 + SNTP_NTS_COOKIE_SIZE ) > nts->reqLen) {
+        cookies--;
+    }
+    for (uint32_t i = 0; i < cookies; i++) {
+        if (make_cookie(&nts->keys, cookie) != 0) {
+            return 0;
+        }
+        ptLen = Sntp_ExtPutField(pt, ptLen, SNTP_EXT_NTS_COOKIE, cookie, sizeof(cookie));
+    }
+
+    uint8_t *auth = resp + authStart + 4;
+    lens[0] = htons(SNTP_NTS_NONCE_SIZE);
+    lens[1] = htons((uint16_t)( SNTP_NTS_TAG_SIZE + ptLen ));
+    memcpy(auth, lens, sizeof(lens));
+    if (RAND_bytes(auth + 4, SNTP_NTS_NONCE_SIZE) != 1 ||
+        Sntp_NtsSeal(nts->keys.s2c, resp, authStart, auth + 4, SNTP_NTS_NONCE_SIZE, pt, ptLen,
+                     auth + 4 + SNTP_NTS_NONCE_SIZE) != 0) {
+        return 0;
+    }
+    // Body is already in place, so only the field header is written
+    return Sntp_ExtPutField(resp, authStart, SNTP_EXT_NTS_AUTH, NULL,
+                            4 + SNTP_NTS_NONCE_SIZE + SNTP_NTS_TAG_SIZE + ptLen);
+}
+
+size_t Sntp_NtsAppendNak( const Sntp_NtsRequest_t *nts, uint8_t *resp, size_t len ) {
+    return Sntp_ExtPutField(resp, len, SNTP_EXT_UNIQUE_ID, nts->uid, nts->uidLen);
+}
+
+/*** NTS-KE ***/
+
+static int alpn_select( SSL *ssl, const unsigned char **out, unsigned char *outlen, const unsigned char *in,
+                        unsigned int inlen, void *arg ) {
+    static const unsigned char ntske[] = "\x07ntske/1";
+
+    (void)ssl;
+    (void)arg;
+
+    if (SSL_select_next_proto((unsigned char **)out, outlen, ntske, sizeof(ntske) - 1, in, inlen) !=
+        OPENSSL_NPN_NEGOTIATED) {
+        return SSL_TLSEXT_ERR_ALERT_FATAL;
+    }
+    return SSL_TLSEXT_ERR_OK;
+}
+
+SntpStatus_t Sntp_NtsInit( const char *certFile, const char *keyFile ) {
+    sslCtx = SSL_CTX_new(TLS_server_method());
+    if (sslCtx == NULL) {
+        return SntpErrorContextNotInitialized;
+    }
+    SSL_CTX_set_min_proto_version(sslCtx, TLS1_3_VERSION);
+    SSL_CTX_set_alpn_select_cb(sslCtx, alpn_select, NULL);
+    if (SSL_CTX_use_certificate_chain_file(sslCtx, certFile) != 1 ||
+        SSL_CTX_use_PrivateKey_file(sslCtx, keyFile, SSL_FILETYPE_PEM) != 1) {
+        ERR_print_errors_fp(stderr);
+        SSL_CTX_free(sslCtx);
+        sslCtx = NULL;
+        return SntpErrorBadParameter;
+    }
+    Sntp_NtsRotateIfDue(0);
+    return SntpSuccess;
+}
+
+void Sntp_NtsGetStats( Sntp_NtsStats_t *stats ) {
+    stats->keSessions = __atomic_load_n(&ntsStats.keSessions, __ATOMIC_RELAXED);
+    stats->keFailures = __atomic_load_n(&ntsStats.keFailures, __ATOMIC_RELAXED);
+    stats->keyRotations = __atomic_load_n(&ntsStats.keyRotations, __ATOMIC_RELAXED);
+}
+
+void Sntp_NtsResetStats( void ) {
+    __atomic_store_n(&ntsStats.keSessions, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&ntsStats.keFailures, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&ntsStats.keyRotations, 0, __ATOMIC_RELAXED);
+}
+
+int Sntp_NtsKeListen( uint16_t port ) {
+    struct sockaddr_in addr;
+    struct timeval tv = { .tv_sec = 1, .tv_usec = 0 };
+    int one = 1;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+    if (fd < 0) {
+        return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    // Applies to accept(), so the serving loop can check for a stop request
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 16) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+SntpStatus_t Sntp_NtsExportKeys( SSL *ssl, Sntp_NtsKeys_t *keys ) {
+    static const char label[] = "EXPORTER-network-time-security";
+    /* Protocol id (NTPv4 = 0), AEAD id, then 0 for C2S / 1 for S2C */
+    uint8_t context[5] = { 0, 0, 0, SNTP_NTS_AEAD_AES_SIV_CMAC_256, 0 };
+
+    if (SSL_export_keying_material(ssl, keys->c2s, sizeof(keys->c2s), label, sizeof(label) - 1, context,
+                                   sizeof(context), 1) != 1) {
+        return SntpErrorAuthFailure;
+    }
+    context[4] = 1;
+    if (SSL_export_keying_material(ssl, keys->s2c, sizeof(keys->s2c), label, sizeof(label) - 1, context,
+                                   sizeof(context), 1) != 1) {
+        return SntpErrorAuthFailure;
+    }
+    return SntpSuccess;
+}
+
+static size_t put_record( uint8_t *buf, size_t off, uint16_t type, const uint8_t *body, uint16_t bodyLen ) {
+    uint16_t hdr[2] = { htons(type), htons(bodyLen) };
+
+    memcpy(buf + off, hdr, sizeof(hdr));
+    if (bodyLen > 0) {
+        memcpy(buf + off + 4, body, bodyLen);
+    }
+    return off + 4 + bodyLen;
+}
+
+/** Validate a client NTS-KE request; returns -1 if incomplete, else an error code or SNTP_NTSKE_END on success */
+static int check_ke_request( const uint8_t *buf, size_t len ) {
+    bool ntpv4 = false, siv = false;
+    size_t off = 0;
+
+    while (len - off >= 4) {
+        uint16_t hdr[2];
+        memcpy(hdr, buf + off, sizeof(hdr));
+        uint16_t type = ntohs(hdr[0]);
+        size_t bodyLen = ntohs(hdr[1]);
+        const uint8_t *body = buf + off + 4;
+        if (len - off - 4 < bodyLen) {
+            return -1;
+        }
+        off += 4 + bodyLen;
+
+        switch (type & ~SNTP_NTSKE_CRITICAL) {
+            case SNTP_NTSKE_END:
+                return ( ntpv4 && siv ) ? SNTP_NTSKE_END : SNTP_NTSKE_ERR_BAD_REQUEST;
+            case SNTP_NTSKE_NEXT_PROTO:
+            case SNTP_NTSKE_AEAD:
+                for (size_t i = 0; i + 1 < bodyLen; i += 2) {
+                    uint16_t id = (uint16_t)( ( body[i] << 8 ) | body[i + 1] );
+                    if (( type & ~SNTP_NTSKE_CRITICAL ) == SNTP_NTSKE_NEXT_PROTO) {
+                        ntpv4 |= ( id == 0 );
+                    } else {
+                        siv |= ( id == SNTP_NTS_AEAD_AES_SIV_CMAC_256 );
+                    }
+                }
+                break;
+            default:
+                if (type & SNTP_NTSKE_CRITICAL) {
+                    return SNTP_NTSKE_ERR_UNRECOGNIZED;
+                }
+                break;
+        }
+    }
+    return -1;
+}
+
+SntpStatus_t Sntp_NtsKeServeOne( int listenFd ) {
+    static const uint8_t protoNtpv4[2] = { 0, 0 };
+    static const uint8_t aeadSiv[2] = { 0, SNTP_NTS_AEAD_AES_SIV_CMAC_256 };
+    struct timeval tv = { .tv_sec = 2, .tv_usec = 0 };
+    uint8_t buf[SNTP_NTS_MAX_COOKIES * ( 4 + SNTP_NTS_COOKIE_SIZE ) + 64];
+    Sntp_NtsKeys_t keys;
+    SntpStatus_t status = SntpErrorNetworkFailure;
+    size_t len = 0;
+    int result = -1;
+    SSL *ssl = NULL;
+
+    int fd = accept(listenFd, NULL, NULL);
+    if (fd < 0) {
+        return ( errno == EAGAIN || errno == EWOULDBLOCK ) ? SntpNoResponseReceived : SntpErrorNetworkFailure;
+    }
+    // Bound how long a stalled client can hold the (single) NTS-KE task
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    if (sslCtx == NULL || ( ssl = SSL_new(sslCtx) ) == NULL || SSL_set_fd(ssl, fd) != 1 || SSL_accept(ssl) != 1) {
+        goto done;
+    }
+
+    while (result < 0 && len < sizeof(buf)) {
+        int n = SSL_read(ssl, buf + len, (int)( sizeof(buf) - len ));
+        if (n <= 0) {
+            goto done;
+        }
+        len += n;
+        result = check_ke_request(buf, len);
+    }
+
+    len = 0;
+    if (result == SNTP_NTSKE_END && Sntp_NtsExportKeys(ssl, &keys) == SntpSuccess) {
+        len = put_record(buf, len, SNTP_NTSKE_NEXT_PROTO | SNTP_NTSKE_CRITICAL, protoNtpv4, sizeof(protoNtpv4));
+        len = put_record(buf, len, SNTP_NTSKE_AEAD | SNTP_NTSKE_CRITICAL, aeadSiv, sizeof(aeadSiv));
+        for (int i = 0; i < SNTP_NTS_MAX_COOKIES; i++) {
+            uint8_t cookie[SNTP_NTS_COOKIE_SIZE];
+            if (make_cookie(&keys, cookie) != 0) {
+                result = SNTP_NTSKE_ERR_INTERNAL;
+                break;
+            }
+            len = put_record(buf, len, SNTP_NTSKE_NEW_COOKIE, cookie, sizeof(cookie));
+        }
+        memset(&keys, 0, sizeof(keys));
+    } else if (result == SNTP_NTSKE_END || result < 0) {
+        result = SNTP_NTSKE_ERR_BAD_REQUEST;
+    }
+    if (result != SNTP_NTSKE_END) {
+        uint8_t code[2] = { 0, (uint8_t)result };
+        len = put_record(buf, 0, SNTP_NTSKE_ERROR | SNTP_NTSKE_CRITICAL, code, sizeof(code));
+    }
+    len = put_record(buf, len, SNTP_NTSKE_END | SNTP_NTSKE_CRITICAL, NULL, 0);
+
+    if (SSL_write(ssl, buf, (int)len) == (int)len && result == SNTP_NTSKE_END) {
+        status = SntpSuccess;
+    }
+    SSL_shutdown(ssl);
+
+done:
+    if (status == SntpSuccess) {
+        __atomic_fetch_add(&ntsStats.keSessions, 1, __ATOMIC_RELAXED);
+    } else {
+        __atomic_fetch_add(&ntsStats.keFailures, 1, __ATOMIC_RELAXED);
+    }
+    SSL_free(ssl);
+    close(fd);
+    return status;
+}
@@ -0,0 +1,115 @@
+#ifndef __SNTP_NTS__
+#define __SNTP_NTS__
+
+/**
+ * Network Time Security (RFC 8915) for the SNTP server.
+ *
+ * NTS-KE runs over TLS 1.3 on a separate TCP listener and hands out cookies.
+ * Cookies carry the client's C2S/S2C keys sealed under a server master key,
+ * so the NTP path needs no per-client memory: each request's cookie is opened,
+ * its authenticator checked with C2S, and fresh cookies are sealed with S2C
+ * into the response.  Master keys rotate; cookies from the previous key are
+ * still accepted so clients survive one rotation without re-running NTS-KE.
+ *
+ * Only AEAD_AES_SIV_CMAC_256 and the NTPv4 next protocol are supported.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <openssl/ssl.h>
+
+#include "core_sntp_serializer.h"
+#include "sntp_ext.h"
+
+#define SNTP_NTS_KE_PORT              4460
+#define SNTP_NTS_MAX_PACKET           1024 /* Largest NTS-protected request or response */
+#define SNTP_NTS_MAX_COOKIES          8
+#define SNTP_NTS_AEAD_AES_SIV_CMAC_256 15
+#define SNTP_NTS_KEY_SIZE             32
+#define SNTP_NTS_NONCE_SIZE           16
+#define SNTP_NTS_TAG_SIZE             16
+#define SNTP_NTS_COOKIE_SIZE          ( 4 + SNTP_NTS_NONCE_SIZE + SNTP_NTS_TAG_SIZE + 2 * SNTP_NTS_KEY_SIZE )
+
+/* NTS-KE record types (RFC 8915 section 4) */
+#define SNTP_NTSKE_END                0
+#define SNTP_NTSKE_NEXT_PROTO         1
+#define SNTP_NTSKE_ERROR              2
+#define SNTP_NTSKE_WARNING            3
+#define SNTP_NTSKE_AEAD               4
+#define SNTP_NTSKE_NEW_COOKIE         5
+#define SNTP_NTSKE_CRITICAL           0x8000
+
+#define SNTP_NTSKE_ERR_UNRECOGNIZED   0
+#define SNTP_NTSKE_ERR_BAD_REQUEST    1
+#define SNTP_NTSKE_ERR_INTERNAL       2
+
+/** Kiss code sent when a cookie cannot be opened (RFC 8915 section 5.7) */
+#define SNTP_NTS_KOD_NTSN             0x4e54534eU
+
+typedef struct {
+    uint8_t c2s[SNTP_NTS_KEY_SIZE];
+    uint8_t s2c[SNTP_NTS_KEY_SIZE];
+} Sntp_NtsKeys_t;
+
+/** State carried from request verification to response generation */
+typedef struct {
+    const uint8_t *uid;
+    size_t uidLen;
+    uint32_t cookies;  /**< Cookies to return: one plus the number of placeholders */
+    size_t reqLen;     /**< Responses never exceed the request size */
+    Sntp_NtsKeys_t keys;
+} Sntp_NtsRequest_t;
+
+typedef struct {
+    uint32_t keSessions;
+    uint32_t keFailures;
+    uint32_t keyRotations;
+} Sntp_NtsStats_t;
+
+/** Load the TLS certificate/key and create the first master key */
+SntpStatus_t Sntp_NtsInit( const char *certFile, const char *keyFile );
+
+/** Rotate the cookie master key if at least periodSecs have elapsed since the last rotation */
+void Sntp_NtsRotateIfDue( uint32_t periodSecs );
+
+/** Create the NTS-KE TCP listener; returns the socket or -1 */
+int Sntp_NtsKeListen( uint16_t port );
+
+/** Accept and serve a single NTS-KE session, waiting up to a second for a client
+ * @return SntpNoResponseReceived if no client connected in that time
+ */
+SntpStatus_t Sntp_NtsKeServeOne( int listenFd );
+
+/** Read or clear the counters; safe while the NTS-KE task is counting, though the three are not read as one snapshot */
+void Sntp_NtsGetStats( Sntp_NtsStats_t *stats );
+void Sntp_NtsResetStats( void );
+
+/** Verify an NTS-protected request
+ * @return SntpSuccess; SntpServerNotAuthenticated if the cookie cannot be opened (answer with a NAK);
+ *         SntpErrorAuthFailure if the authenticator does not verify; SntpErrorBadParameter if malformed
+ */
+SntpStatus_t Sntp_NtsParseRequest( const uint8_t *req, size_t reqLen, Sntp_NtsRequest_t *nts );
+
+/** Append the unique identifier and authenticator with fresh cookies to a response header
+ * @return Total response length, or 0 on failure
+ */
+size_t Sntp_NtsAppendResponse( const Sntp_NtsRequest_t *nts, uint8_t *resp, size_t len );
+
+/** Append the unique identifier to an NTS NAK (KoD "NTSN") response header */
+size_t Sntp_NtsAppendNak( const Sntp_NtsRequest_t *nts, uint8_t *resp, size_t len );
+
+/*** Helpers shared with the test client ***/
+
+/** AEAD_AES_SIV_CMAC_256 seal; out receives the 16-byte synthetic IV followed by ptLen bytes of ciphertext */
+int Sntp_NtsSeal( const uint8_t key[SNTP_NTS_KEY_SIZE], const uint8_t *ad, size_t adLen, const uint8_t *nonce,
+                  size_t nonceLen, const uint8_t *pt, size_t ptLen, uint8_t *out );
+
+/** AEAD_AES_SIV_CMAC_256 open; returns 0 when authentic, pt receives ctLen - 16 bytes */
+int Sntp_NtsOpen( const uint8_t key[SNTP_NTS_KEY_SIZE], const uint8_t *ad, size_t adLen, const uint8_t *nonce,
+                  size_t nonceLen, const uint8_t *ct, size_t ctLen, uint8_t *pt );
+
+/** Derive C2S/S2C keys from an established NTS-KE TLS session */
+SntpStatus_t Sntp_NtsExportKeys( SSL *ssl, Sntp_NtsKeys_t *keys );
+
+#endif
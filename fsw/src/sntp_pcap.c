@@ -0,0 +1,171 @@
+#include <string.h>
+#include <errno.h>
+#include <arpa/inet.h>
+
+#include "sntp_pcap.h"
+
+#define PCAP_IP_UDP_HDR 28
+
+/** Post the writer if it is asleep or about to be; it sees anything published before this */
+static void wake_writer( Sntp_Pcap_t *cap ) {
+    if (atomic_load(&cap->sleeping) && atomic_exchange(&cap->sleeping, false)) {
+        sem_post(&cap->wake);
+    }
+}
+
+int Sntp_PcapInit( Sntp_Pcap_t *cap ) {
+    atomic_store(&cap->state, SNTP_PCAP_IDLE);
+    atomic_store(&cap->sleeping, false);
+    atomic_store(&cap->shutdown, false);
+    cap->file = NULL;
+    return sem_init(&cap->wake, 0, 0);
+}
+
+int Sntp_PcapStart( Sntp_Pcap_t *cap, const char *path, uint32_t sampleN, uint16_t port ) {
+    struct {
+        uint32_t magic;
+        uint16_t major, minor;
+        int32_t  thiszone;
+        uint32_t sigfigs, snaplen, linktype;
+    } hdr = { SNTP_PCAP_MAGIC_NSEC, 2, 4, 0, 0, NET_BUF_SIZE + PCAP_IP_UDP_HDR, SNTP_PCAP_LINK_IPV4 };
+
+    if (atomic_load(&cap->state) != SNTP_PCAP_IDLE) {
+        errno = EBUSY;
+        return -1;
+    }
+    cap->file = fopen(path, "wb");
+    if (cap->file == NULL) {
+        return -1;
+    }
+    if (fwrite(&hdr, sizeof(hdr), 1, cap->file) != 1) {
+        fclose(cap->file);
+        cap->file = NULL;
+        return -1;
+    }
+
+    cap->sampleN = ( sampleN == 0 ) ? 1 : sampleN;
+    cap->sampleCount = 0;
+    cap->port = port;
+    cap->captured = 0;
+    cap->dropped = 0;
+    atomic_store(&cap->head, 0);
+    atomic_store(&cap->tail, 0);
+    atomic_store(&cap->state, SNTP_PCAP_RUNNING);
+    return 0;
+}
+
+void Sntp_PcapStop( Sntp_Pcap_t *cap ) {
+    uint32_t running = SNTP_PCAP_RUNNING;
+    if (atomic_compare_exchange_strong(&cap->state, &running, SNTP_PCAP_STOPPING)) {
+        wake_writer(cap);
+    }
+}
+
+void Sntp_PcapShutdown( Sntp_Pcap_t *cap ) {
+    Sntp_PcapStop(cap);
+    atomic_store(&cap->shutdown, true);
+    wake_writer(cap);
+}
+
+void Sntp_PcapRecord( Sntp_Pcap_t *cap, const struct timespec *rxTime, const struct sockaddr_in *src,
+                      const uint8_t *pkt, size_t len ) {
+    uint32_t head, tail;
+    Sntp_PcapSlot_t *slot;
+
+    if (++cap->sampleCount < cap->sampleN) {
+        return;
+    }
+    cap->sampleCount = 0;
+
+    head = atomic_load_explicit(&cap->head, memory_order_relaxed);
+    tail = atomic_load_explicit(&cap->tail, memory_order_acquire);
+    if (head - tail >= SNTP_PCAP_RING_SLOTS) {
+        cap->dropped++;
+        return;
+    }
+
+    slot = &cap->slots[head & ( SNTP_PCAP_RING_SLOTS - 1 )];
+    if (rxTime->tv_sec != 0 || rxTime->tv_nsec != 0) {
+        slot->ts = *rxTime;
+    } else {
+        clock_gettime(CLOCK_REALTIME, &slot->ts);
+    }
+    slot->src = *src;
+    slot->len = (uint16_t)( len < sizeof(slot->data) ? len : sizeof(slot->data) );
+    memcpy(slot->data, pkt, slot->len);
+    // Sequentially consistent with the writer's sleeping flag, so either it sees this slot or it is posted
+    atomic_store(&cap->head, head + 1);
+    cap->captured++;
+    wake_writer(cap);
+}
+
+static void write_record( Sntp_Pcap_t *cap, const Sntp_PcapSlot_t *slot ) {
+    uint32_t rec[4] = { (uint32_t)slot->ts.tv_sec, (uint32_t)slot->ts.tv_nsec,
+                        slot->len + PCAP_IP_UDP_HDR, slot->len + PCAP_IP_UDP_HDR };
+    uint8_t hdr[PCAP_IP_UDP_HDR] = { 0 };
+    uint16_t totalLen = htons(slot->len + PCAP_IP_UDP_HDR);
+    uint16_t udpLen = htons(slot->len + 8);
+    uint16_t dstPort = htons(cap->port);
+
+    // IPv4 header (no options, checksum left zero) followed by the UDP header
+    hdr[0] = 0x45;
+    memcpy(&hdr[2], &totalLen, 2);
+    hdr[8] = 64;
+    hdr[9] = IPPROTO_UDP;
+    memcpy(&hdr[12], &slot->src.sin_addr, 4);
+    memcpy(&hdr[20], &slot->src.sin_port, 2);
+    memcpy(&hdr[22], &dstPort, 2);
+    memcpy(&hdr[24], &udpLen, 2);
+
+    fwrite(rec, sizeof(rec), 1, cap->file);
+    fwrite(hdr, sizeof(hdr), 1, cap->file);
+    fwrite(slot->data, slot->len, 1, cap->file);
+}
+
+bool Sntp_PcapWriterPoll( Sntp_Pcap_t *cap ) {
+    uint32_t state = atomic_load(&cap->state);
+    uint32_t tail, head;
+    bool wrote = false;
+
+    if (state == SNTP_PCAP_IDLE) {
+        return false;
+    }
+    tail = atomic_load_explicit(&cap->tail, memory_order_relaxed);
+    head = atomic_load_explicit(&cap->head, memory_order_acquire);
+    while (tail != head) {
+        write_record(cap, &cap->slots[tail & ( SNTP_PCAP_RING_SLOTS - 1 )]);
+        tail++;
+        atomic_store_explicit(&cap->tail, tail, memory_order_release);
+        wrote = true;
+    }
+
+    // The serving task no longer queues once STOPPING was seen above, so the ring is fully drained
+    if (state == SNTP_PCAP_STOPPING) {
+        fclose(cap->file);
+        cap->file = NULL;
+        atomic_store(&cap->state, SNTP_PCAP_IDLE);
+    } else if (wrote) {
+        fflush(cap->file);
+    }
+    return wrote;
+}
+
+void Sntp_PcapWriterRun( Sntp_Pcap_t *cap ) {
+    while (true) {
+        Sntp_PcapWriterPoll(cap);
+        if (atomic_load(&cap->shutdown) && atomic_load(&cap->state) == SNTP_PCAP_IDLE) {
+            return;
+        }
+
+        // Say we are going to sleep, then look again: a record or stop published before the flag was seen is
+        // picked up here, and one published after it posts the semaphore
+        atomic_store(&cap->sleeping, true);
+        if (atomic_load(&cap->head) != atomic_load_explicit(&cap->tail, memory_order_relaxed) ||
+            atomic_load(&cap->state) == SNTP_PCAP_STOPPING || atomic_load(&cap->shutdown)) {
+            atomic_store(&cap->sleeping, false);
+            continue;
+        }
+        while (sem_wait(&cap->wake) != 0 && errno == EINTR) {
+        }
+    }
+}
@@ -0,0 +1,104 @@
+#ifndef __SNTP_PCAP__
+#define __SNTP_PCAP__
+
+/**
+ * Request capture to pcap without blocking the serving path.
+ *
+ * The serving task only copies sampled requests into a single-producer /
+ * single-consumer ring; a background writer drains the ring to the file.
+ * When the ring is full the request is counted as dropped, never waited on.
+ * The writer sleeps on a semaphore while the ring is empty, and the serving
+ * task only posts it when the writer has said it is going to sleep, so a
+ * burst of requests costs at most one wakeup.
+ * Records carry the kernel arrival timestamp (nanosecond pcap) and
+ * synthesized IPv4/UDP headers so captures open directly in Wireshark and
+ * feed tools/replay_test.c.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include <semaphore.h>
+#include <time.h>
+#include <netinet/in.h>
+
+#include "core_sntp_config.h"
+
+#ifndef SNTP_PCAP_RING_SLOTS
+#define SNTP_PCAP_RING_SLOTS 512 /* Must be a power of two */
+#endif
+
+#define SNTP_PCAP_MAGIC_NSEC   0xa1b23c4dU
+#define SNTP_PCAP_MAGIC_USEC   0xa1b2c3d4U
+#define SNTP_PCAP_LINK_ETHERNET 1
+#define SNTP_PCAP_LINK_RAW      101
+#define SNTP_PCAP_LINK_SLL      113
+#define SNTP_PCAP_LINK_IPV4     228
+
+enum {
+    SNTP_PCAP_IDLE,
+    SNTP_PCAP_RUNNING,
+    SNTP_PCAP_STOPPING
+};
+
+typedef struct {
+    struct timespec    ts;
+    struct sockaddr_in src;
+    uint16_t           len;
+    uint8_t            data[NET_BUF_SIZE];
+} Sntp_PcapSlot_t;
+
+typedef struct {
+    _Atomic uint32_t state;
+    _Atomic uint32_t head;     /**< Next slot the serving task fills */
+    _Atomic uint32_t tail;     /**< Next slot the writer drains */
+    uint32_t sampleN;          /**< Capture one request in sampleN */
+    uint32_t sampleCount;
+    uint16_t port;             /**< Server port written as the UDP destination */
+    uint32_t captured;         /**< Requests queued for writing (serving task only) */
+    uint32_t dropped;          /**< Sampled requests lost to a full ring (serving task only) */
+    FILE    *file;
+    sem_t    wake;             /**< Posted to wake a sleeping writer */
+    atomic_bool sleeping;      /**< Writer is about to wait, or is waiting, on wake */
+    atomic_bool shutdown;      /**< Writer returns once idle */
+    Sntp_PcapSlot_t slots[SNTP_PCAP_RING_SLOTS];
+} Sntp_Pcap_t;
+
+/** Prepare an idle capture before its writer is started
+ * @return 0, or -1 with errno set
+ */
+int Sntp_PcapInit( Sntp_Pcap_t *cap );
+
+/** Begin a capture; the writer owns the file until the capture has stopped
+ * @param [in] sampleN - Capture every Nth request, 0 or 1 for all
+ * @return 0, or -1 with errno set (EBUSY if a capture is still active)
+ */
+int Sntp_PcapStart( Sntp_Pcap_t *cap, const char *path, uint32_t sampleN, uint16_t port );
+
+/** Ask the writer to flush and close the capture.  Call from the serving task, so that no
+ * Sntp_PcapRecord() can race with the writer's final drain.
+ */
+void Sntp_PcapStop( Sntp_Pcap_t *cap );
+
+static inline bool Sntp_PcapActive( const Sntp_Pcap_t *cap ) {
+    return atomic_load_explicit(&cap->state, memory_order_relaxed) == SNTP_PCAP_RUNNING;
+}
+
+/** Queue a request if it is sampled; never blocks.  rxTime may be zero to stamp with the current time. */
+void Sntp_PcapRecord( Sntp_Pcap_t *cap, const struct timespec *rxTime, const struct sockaddr_in *src,
+                      const uint8_t *pkt, size_t len );
+
+/** Write out queued records, closing the file once a stopped capture has drained
+ * @return true if any record was written
+ */
+bool Sntp_PcapWriterPoll( Sntp_Pcap_t *cap );
+
+/** Writer loop for a background task or thread; returns after Sntp_PcapShutdown() once the file is closed */
+void Sntp_PcapWriterRun( Sntp_Pcap_t *cap );
+
+/** Stop any capture and make the writer loop return; call from the serving task */
+void Sntp_PcapShutdown( Sntp_Pcap_t *cap );
+
+#endif
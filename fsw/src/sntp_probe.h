@@ -0,0 +1,52 @@
+#ifndef __SNTP_PROBE__
+#define __SNTP_PROBE__
+
+/**
+ * USDT (user-level statically defined tracing) probes, provider "sntp".
+ *
+ * Each probe is a single nop in the code plus an ELF note naming it and
+ * describing where its arguments live, so it costs nothing until bpftrace
+ * or perf attaches and patches the nop into a breakpoint.  Arguments are
+ * plain integers the code already holds; keep them that way, since they are
+ * computed whether or not anyone is tracing.  Addresses and ports are in
+ * network byte order, NTP timestamps are host-order seconds and fractions.
+ *
+ * The probes need <sys/sdt.h> (systemtap-sdt-dev / systemtap-sdt-devel),
+ * which is header-only and needs no root or kernel support to build.
+ * Without it, or with SNTP_NO_PROBES defined, the macros compile to nothing.
+ * tools/trace/ has example bpftrace scripts.
+ *
+ *   request__receive(addr, port, len, scale, rx_sec, rx_nsec)  datagram received, kernel receive time
+ *   request__shed(addr, port, listener_class, level)           request shed (before any KoD is sent)
+ *   request__parse(len, leap_version_mode, org_sec, org_frac)  request accepted by the engine
+ *   request__timestamp(scale, rx_sec, rx_frac, tx_sec, tx_frac) receive and transmit timestamps set
+ *   request__send(addr, port, len, status)                     response sent, or status of the failure
+ *   batch__respond(count, plain, valid)                        batch answered; valid is the kernel's bitmask
+ *   command__start(cc, len) / command__done(cc, cmd_count, err_count)
+ *   hk__start(requests) / hk__done(requests)
+ */
+
+#if !defined(SNTP_NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define SNTP_PROBES_ENABLED 1
+#endif
+#endif
+
+#ifdef SNTP_PROBES_ENABLED
+#define SNTP_PROBE1(name, a)                   DTRACE_PROBE1(sntp, name, a)
+#define SNTP_PROBE2(name, a, b)                DTRACE_PROBE2(sntp, name, a, b)
+#define SNTP_PROBE3(name, a, b, c)             DTRACE_PROBE3(sntp, name, a, b, c)
+#define SNTP_PROBE4(name, a, b, c, d)          DTRACE_PROBE4(sntp, name, a, b, c, d)
+#define SNTP_PROBE5(name, a, b, c, d, e)       DTRACE_PROBE5(sntp, name, a, b, c, d, e)
+#define SNTP_PROBE6(name, a, b, c, d, e, f)    DTRACE_PROBE6(sntp, name, a, b, c, d, e, f)
+#else
+#define SNTP_PROBE1(name, a)                   do { (void)(a); } while (0)
+#define SNTP_PROBE2(name, a, b)                do { (void)(a); (void)(b); } while (0)
+#define SNTP_PROBE3(name, a, b, c)             do { (void)(a); (void)(b); (void)(c); } while (0)
+#define SNTP_PROBE4(name, a, b, c, d)          do { (void)(a); (void)(b); (void)(c); (void)(d); } while (0)
+#define SNTP_PROBE5(name, a, b, c, d, e)       do { (void)(a); (void)(b); (void)(c); (void)(d); (void)(e); } while (0)
+#define SNTP_PROBE6(name, a, b, c, d, e, f)    do { (void)(a); (void)(b); (void)(c); (void)(d); (void)(e); (void)(f); } while (0)
+#endif
+
+#endif
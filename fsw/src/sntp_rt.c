@@ -0,0 +1,244 @@
+#define _GNU_SOURCE
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <linux/sock_diag.h>
+
+#include "sntp_rt.h"
+
+__attribute__((noinline)) static void prefault_stack( size_t bytes ) {
+    volatile uint8_t *stack = __builtin_alloca(bytes);
+    for (size_t i = 0; i < bytes; i += 4096) {
+        stack[i] = 0;
+    }
+}
+
+SntpStatus_t Sntp_RtApply( const Sntp_RtConfig_t *cfg, const char **failed ) {
+    *failed = NULL;
+
+    if (cfg->lockMemory && mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        *failed = "mlockall";
+    }
+    // Touch the stack after locking so the pages stay resident
+    if (cfg->prefaultStack > 0) {
+        prefault_stack(cfg->prefaultStack);
+    }
+    if (cfg->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cfg->cpu, &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0 && *failed == NULL) {
+            *failed = "CPU affinity";
+        }
+    }
+    if (cfg->priority > 0) {
+        struct sched_param param = { .sched_priority = cfg->priority };
+        if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0 && *failed == NULL) {
+            *failed = "SCHED_FIFO";
+        }
+    }
+    return ( *failed == NULL ) ? SntpSuccess : SntpErrorBadParameter;
+}
+
+int Sntp_RtEnableTimestamps( int sockfd ) {
+    int on = 1;
+    setsockopt(sockfd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on));
+    return setsockopt(sockfd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on));
+}
+
+static int set_buffer( int sockfd, int opt, int forceOpt, int size ) {
+    int actual = 0;
+    socklen_t len = sizeof(actual);
+
+    if (setsockopt(sockfd, SOL_SOCKET, opt, &size, sizeof(size)) != 0) {
+        return -1;
+    }
+    // The kernel doubles the request for bookkeeping and caps it at rmem_max/wmem_max
+    getsockopt(sockfd, SOL_SOCKET, opt, &actual, &len);
+    if (actual < size * 2 && setsockopt(sockfd, SOL_SOCKET, forceOpt, &size, sizeof(size)) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+int Sntp_RtSetBuffers( int sockfd, int rcvBuf, int sndBuf, Sntp_RtSockStats_t *stats ) {
+    int status = 0;
+    socklen_t len;
+
+    if (rcvBuf > 0 && set_buffer(sockfd, SO_RCVBUF, SO_RCVBUFFORCE, rcvBuf) != 0) {
+        status = -1;
+    }
+    if (sndBuf > 0 && set_buffer(sockfd, SO_SNDBUF, SO_SNDBUFFORCE, sndBuf) != 0) {
+        status = -1;
+    }
+    len = sizeof(stats->rcvBuf);
+    getsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &stats->rcvBuf, &len);
+    len = sizeof(stats->sndBuf);
+    getsockopt(sockfd, SOL_SOCKET, SO_SNDBUF, &stats->sndBuf, &len);
+    return status;
+}
+
+void Sntp_RtSampleSocket( int sockfd, const Sntp_RtRxMeta_t *meta, Sntp_RtSockStats_t *stats ) {
+    uint32_t meminfo[SK_MEMINFO_VARS];
+    socklen_t len = sizeof(meminfo);
+
+    if (meta->dropsValid) {
+        stats->drops = meta->drops;
+    }
+    if (getsockopt(sockfd, SOL_SOCKET, SO_MEMINFO, meminfo, &len) == 0) {
+        stats->queue = meminfo[SK_MEMINFO_RMEM_ALLOC];
+        if (stats->queue > stats->peakQueue) {
+            stats->peakQueue = stats->queue;
+        }
+    }
+}
+
+ssize_t Sntp_RtRecv( int sockfd, void *buf, size_t len, int flags, struct sockaddr *addr, socklen_t *addrLen,
+                     Sntp_RtRxMeta_t *meta ) {
+    union {
+        char buf[CMSG_SPACE(sizeof(struct timespec)) + CMSG_SPACE(sizeof(uint32_t))];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov = { .iov_base = buf, .iov_len = len };
+    struct msghdr msg = {
+        .msg_name = addr,
+        .msg_namelen = ( addrLen != NULL ) ? *addrLen : 0,
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buf,
+        .msg_controllen = sizeof(control.buf),
+    };
+    ssize_t received = recvmsg(sockfd, &msg, flags);
+
+    meta->rxTime.tv_sec = 0;
+    meta->rxTime.tv_nsec = 0;
+    meta->dropsValid = false;
+    if (received < 0) {
+        return received;
+    }
+    if (addrLen != NULL) {
+        *addrLen = msg.msg_namelen;
+    }
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET) {
+            continue;
+        }
+        if (cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+            memcpy(&meta->rxTime, CMSG_DATA(cmsg), sizeof(meta->rxTime));
+        } else if (cmsg->cmsg_type == SO_RXQ_OVFL) {
+            memcpy(&meta->drops, CMSG_DATA(cmsg), sizeof(meta->drops));
+            meta->dropsValid = true;
+        }
+    }
+    return received;
+}
+
+uint32_t Sntp_RtRecordWake( Sntp_RtHist_t *hist, const struct timespec *rxTime ) {
+    struct timespec now;
+    int64_t us;
+    uint32_t bucket = 0;
+
+    if (rxTime->tv_sec == 0 && rxTime->tv_nsec == 0) {
+        return 0;
+    }
+    clock_gettime(CLOCK_REALTIME, &now);
+    us = ( (int64_t)( now.tv_sec - rxTime->tv_sec ) * 1000000000 + ( now.tv_nsec - rxTime->tv_nsec ) ) / 1000;
+    if (us < 0) {
+        us = 0; // Clock stepped between the kernel timestamp and now
+    }
+    if (us > 0) {
+        bucket = 64 - __builtin_clzll((uint64_t)us);
+        if (bucket >= SNTP_RT_HIST_BUCKETS) {
+            bucket = SNTP_RT_HIST_BUCKETS - 1;
+        }
+    }
+    hist->buckets[bucket]++;
+    if (us > UINT32_MAX) {
+        us = UINT32_MAX;
+    }
+    if (us > hist->maxUs) {
+        hist->maxUs = (uint32_t)us;
+    }
+    return (uint32_t)us;
+}
+
+uint32_t Sntp_RtHistPercentile( const uint32_t buckets[SNTP_RT_HIST_BUCKETS], uint32_t pct ) {
+    uint64_t total = 0, rank, seen = 0;
+    uint32_t i;
+
+    for (i = 0; i < SNTP_RT_HIST_BUCKETS; i++) {
+        total += buckets[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+    rank = ( total * pct + 99 ) / 100;
+    rank = ( rank == 0 ) ? 1 : rank;
+    for (i = 0; i < SNTP_RT_HIST_BUCKETS - 1; i++) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            break;
+        }
+    }
+    return 1U << i;
+}
+
+int Sntp_RtSetBusyPoll( int sockfd, uint32_t usecs ) {
+    int value = (int)usecs;
+    return setsockopt(sockfd, SOL_SOCKET, SO_BUSY_POLL, &value, sizeof(value));
+}
+
+static inline int64_t elapsed_ns( const struct timespec *from, const struct timespec *to ) {
+    return (int64_t)( to->tv_sec - from->tv_sec ) * 1000000000 + ( to->tv_nsec - from->tv_nsec );
+}
+
+ssize_t Sntp_RtPollRecv( Sntp_RtPoller_t *poller, int sockfd, void *buf, size_t len, int flags, struct sockaddr *addr,
+                         socklen_t *addrLen, Sntp_RtRxMeta_t *meta ) {
+    struct timespec start, now;
+    socklen_t addrCap = ( addrLen != NULL ) ? *addrLen : 0;
+    ssize_t received;
+    int err;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (poller->spinning) {
+        now = start;
+        while (true) {
+            if (addrLen != NULL) {
+                *addrLen = addrCap;
+            }
+            received = Sntp_RtRecv(sockfd, buf, len, flags | MSG_DONTWAIT, addr, addrLen, meta);
+            err = errno;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            if (received >= 0 || ( err != EAGAIN && err != EWOULDBLOCK )) {
+                break;
+            }
+            if (elapsed_ns(&poller->lastPacket, &now) > (int64_t)poller->idleUs * 1000) {
+                poller->spinning = false;
+                break;
+            }
+            if (elapsed_ns(&start, &now) > SNTP_RT_SPIN_SLICE_NS) {
+                break;
+            }
+        }
+        poller->spinNs += elapsed_ns(&start, &now);
+        if (received > 0) {
+            poller->lastPacket = now;
+        }
+        errno = err;
+        return received;
+    }
+
+    received = Sntp_RtRecv(sockfd, buf, len, flags, addr, addrLen, meta);
+    err = errno;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    poller->sleepNs += elapsed_ns(&start, &now);
+    if (received > 0 && poller->idleUs > 0) {
+        poller->spinning = true;
+        poller->lastPacket = now;
+    }
+    errno = err;
+    return received;
+}
@@ -0,0 +1,114 @@
+#ifndef __SNTP_RT__
+#define __SNTP_RT__
+
+/**
+ * Real-time setup and wake latency measurement for the task serving the UDP path.
+ *
+ * Wake latency is the time from the kernel timestamping a datagram
+ * (SO_TIMESTAMPNS) to the serving task holding it after recvmsg returns.
+ * It captures preemption and page faults on the receive path, and is
+ * accumulated in a log2 histogram of microseconds.
+ *
+ * Socket health is tracked alongside: kernel drops reported with each
+ * datagram (SO_RXQ_OVFL) and the receive backlog sampled after each
+ * receive.  The backlog comes from SO_MEMINFO, since SIOCINQ on a UDP
+ * socket only reports the size of the next datagram.
+ *
+ * The adaptive poller trades CPU for latency: while packets keep arriving
+ * it spins on non-blocking receives, and once none has arrived for
+ * idleUs it goes back to blocking in the kernel.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include "core_sntp_serializer.h"
+
+/* Bucket 0 counts wakes under 1us, bucket i wakes in [2^(i-1), 2^i) us, the last bucket everything longer */
+#define SNTP_RT_HIST_BUCKETS 16
+
+typedef struct {
+    int    priority;     /**< SCHED_FIFO priority, 0 leaves the scheduling policy alone */
+    int    cpu;          /**< CPU to pin the calling thread to, -1 for no affinity */
+    bool   lockMemory;   /**< mlockall() current and future pages */
+    size_t prefaultStack; /**< Bytes of stack to touch so it is resident before serving */
+} Sntp_RtConfig_t;
+
+typedef struct {
+    uint32_t buckets[SNTP_RT_HIST_BUCKETS];
+    uint32_t maxUs;
+} Sntp_RtHist_t;
+
+/** Per-datagram metadata from the control messages */
+typedef struct {
+    struct timespec rxTime; /**< Kernel receive timestamp, zero if none was attached */
+    uint32_t drops;         /**< Cumulative kernel drop count for the socket, valid if dropsValid */
+    bool     dropsValid;
+} Sntp_RtRxMeta_t;
+
+typedef struct {
+    uint32_t drops;      /**< Datagrams dropped by the kernel because the receive buffer was full */
+    uint32_t queue;      /**< Receive queue backlog at the last sample, bytes */
+    uint32_t peakQueue;  /**< Largest receive queue backlog sampled, bytes */
+    int32_t  rcvBuf;     /**< Effective SO_RCVBUF */
+    int32_t  sndBuf;     /**< Effective SO_SNDBUF */
+} Sntp_RtSockStats_t;
+
+/* Longest uninterrupted spin before returning EAGAIN so the caller can service other work */
+#define SNTP_RT_SPIN_SLICE_NS 1000000
+
+typedef struct {
+    uint32_t idleUs;     /**< Keep spinning this long after the last packet; 0 always blocks */
+    bool     spinning;
+    struct timespec lastPacket;
+    uint64_t spinNs;     /**< Time spent in non-blocking receive loops */
+    uint64_t sleepNs;    /**< Time spent blocked in the kernel */
+} Sntp_RtPoller_t;
+
+/** Apply the configuration to the calling thread (and the process for memory locking)
+ * @param [out] failed - Name of the first step that failed, for reporting
+ * @return SntpSuccess, or SntpErrorBadParameter if any step failed (later steps are still attempted)
+ */
+SntpStatus_t Sntp_RtApply( const Sntp_RtConfig_t *cfg, const char **failed );
+
+/** Ask the kernel to timestamp received datagrams and report drops with them */
+int Sntp_RtEnableTimestamps( int sockfd );
+
+/** Set the socket buffer sizes (0 leaves a size alone) and read back the effective sizes into stats.
+ * Sizes above the system limit are forced when the process has CAP_NET_ADMIN.
+ * @return 0, or -1 if a requested size could not be set
+ */
+int Sntp_RtSetBuffers( int sockfd, int rcvBuf, int sndBuf, Sntp_RtSockStats_t *stats );
+
+/** Update drop and peak backlog statistics after a receive */
+void Sntp_RtSampleSocket( int sockfd, const Sntp_RtRxMeta_t *meta, Sntp_RtSockStats_t *stats );
+
+/** recvfrom() that also returns the kernel receive timestamp and drop count */
+ssize_t Sntp_RtRecv( int sockfd, void *buf, size_t len, int flags, struct sockaddr *addr, socklen_t *addrLen,
+                     Sntp_RtRxMeta_t *meta );
+
+/** Set SO_BUSY_POLL so the kernel polls the device queue for usecs before sleeping */
+int Sntp_RtSetBusyPoll( int sockfd, uint32_t usecs );
+
+/** Sntp_RtRecv() through the adaptive poller.  Blocking receives rely on the socket's SO_RCVTIMEO;
+ * a spin also returns -1/EAGAIN after SNTP_RT_SPIN_SLICE_NS without traffic.
+ */
+ssize_t Sntp_RtPollRecv( Sntp_RtPoller_t *poller, int sockfd, void *buf, size_t len, int flags, struct sockaddr *addr,
+                         socklen_t *addrLen, Sntp_RtRxMeta_t *meta );
+
+/** Record the latency from rxTime to now; does nothing if rxTime is zero
+ * @return The latency in microseconds, 0 if rxTime is zero
+ */
+uint32_t Sntp_RtRecordWake( Sntp_RtHist_t *hist, const struct timespec *rxTime );
+
+/** Latency that pct percent of the counted wakes are below
+ * @param [in] buckets - Wake counts per bucket, e.g. the difference of two snapshots of a histogram
+ * @return Upper bound of the bucket holding the percentile in microseconds (1 for bucket 0), 0 if nothing was counted
+ */
+uint32_t Sntp_RtHistPercentile( const uint32_t buckets[SNTP_RT_HIST_BUCKETS], uint32_t pct );
+
+#endif
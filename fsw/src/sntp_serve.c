@@ -0,0 +1,190 @@
+#include <string.h>
+#include <errno.h>
+
+#include "sntp_serve.h"
+#include "sntp_batch.h"
+#include "sntp_probe.h"
+
+_Static_assert(SNTP_LISTEN_BATCH <= SNTP_BATCH_MAX, "a listener's batch must fit the batch kernel");
+
+/** Hold an admitted control query for Sntp_ServeAnswerControl(); the rest are dropped without a reply */
+static void queue_control( Sntp_Serve_t *serve, const Sntp_ServeListener_t *listener, const uint8_t *buf,
+                           ssize_t len, const struct sockaddr_in *src ) {
+    Sntp_ServeCtlQuery_t *query;
+
+    if (!Sntp_CtlAdmit(serve->ctlCfg, serve->ctl, src->sin_addr.s_addr)) {
+        return;
+    }
+    if (serve->ctlPending == SNTP_CTL_QUEUE_DEPTH || len > (ssize_t)sizeof(query->buf)) {
+        serve->ctl->limited++;
+        return;
+    }
+    query = &serve->ctlQueue[serve->ctlPending++];
+    query->listener = listener;
+    query->addr = *src;
+    query->len = (uint16_t)len;
+    memcpy(query->buf, buf, len);
+}
+
+/** Send a response, then trace, sample and probe it
+ * @return status, or SntpErrorNetworkFailure if the transport would not take the response
+ */
+static SntpStatus_t send_response( Sntp_Serve_t *serve, const Sntp_ServeListener_t *listener,
+                                   const struct sockaddr_in *dst, const uint8_t *resp, size_t respLen,
+                                   SntpStatus_t status, Sntp_StageRecord_t *stage ) {
+    if (status == SntpSuccess && Sntp_TransportSend(listener->transport, resp, respLen, dst) < 0) {
+        serve->counts.sendErrors++;
+        status = SntpErrorNetworkFailure;
+    }
+    Sntp_StageEnd(stage, status);
+    if (status == SntpSuccess) {
+        // Client clock offsets are grouped by shed class
+        Sntp_FleetRecord(serve->fleet, resp, Sntp_ShedClassify(serve->shedCfg, dst->sin_addr.s_addr, listener->cls));
+    }
+    SNTP_PROBE4(request__send, dst->sin_addr.s_addr, dst->sin_port, status == SntpSuccess ? respLen : 0, status);
+    return status;
+}
+
+/** Count the outcome of answering one request */
+static void count_result( Sntp_Serve_t *serve, const Sntp_ServeListener_t *listener, SntpStatus_t status ) {
+    // Authentication failures are counted by the engine, send failures in sendErrors
+    if (status == SntpSuccess) {
+        serve->counts.scaleRequests[listener->cfg.scale]++;
+    } else if (status != SntpServerNotAuthenticated && status != SntpErrorAuthFailure &&
+               status != SntpErrorNetworkFailure) {
+        serve->counts.badRequests++;
+    }
+}
+
+ssize_t Sntp_ServeReceive( Sntp_Serve_t *serve, const Sntp_ServeListener_t *listener, uint8_t *buf,
+                           struct sockaddr_in *src, struct timespec *rxTime, Sntp_StageRecord_t **stage ) {
+    Sntp_RtRxMeta_t rxMeta;
+    uint8_t kod[SNTP_PACKET_BASE_SIZE];
+    size_t kodLen;
+    ssize_t received;
+    int err;
+
+    *stage = NULL;
+
+    // Blocks for up to the transport's receive timeout (or a spin slice) so the caller still polls for commands
+    received = Sntp_TransportRecv(listener->transport, buf, NET_BUF_SIZE, src, &rxMeta);
+    err = errno;
+    if (received > 0) {
+        uint32_t wakeUs = Sntp_RtRecordWake(serve->wakeHist, &rxMeta.rxTime);
+        uint32_t queue = listener->sockStats->queue;
+
+        *rxTime = rxMeta.rxTime;
+        SNTP_PROBE6(request__receive, src->sin_addr.s_addr, src->sin_port, received, listener->cfg.scale,
+                    rxMeta.rxTime.tv_sec, rxMeta.rxTime.tv_nsec);
+        Sntp_TopKUpdate(serve->topTalkers, src->sin_addr.s_addr);
+        if (serve->capture != NULL && Sntp_PcapActive(serve->capture)) {
+            Sntp_PcapRecord(serve->capture, &rxMeta.rxTime, src, buf, received);
+        }
+        if (Sntp_ShedUpdate(serve->shedCfg, serve->shed, wakeUs, queue) && serve->hooks.shedChanged != NULL) {
+            serve->hooks.shedChanged(serve->hooks.arg, serve->shed->level, wakeUs, queue);
+        }
+    }
+
+    // Control queries are only admitted here; they are answered once no time requests are waiting
+    if (received > 0 && Sntp_CtlIsQuery(buf, received)) {
+        queue_control(serve, listener, buf, received, src);
+        return 0;
+    }
+    if (received > 0 && Sntp_ServerAcceptsLength(received)) {
+        serve->counts.received++;
+        if (Sntp_ShedCheck(serve->shedCfg, serve->shed, src->sin_addr.s_addr, listener->cls)) {
+            SNTP_PROBE4(request__shed, src->sin_addr.s_addr, src->sin_port, listener->cls, serve->shed->level);
+            kodLen = serve->shedCfg->kod ? Sntp_ServerBuildKod(buf, received, SNTP_KISS_OF_DEATH_CODE_RATE, kod) : 0;
+            if (kodLen > 0 && Sntp_TransportSend(listener->transport, kod, kodLen, src) >= 0) {
+                serve->shed->kod++;
+            }
+            return 0;
+        }
+        *stage = Sntp_StageBegin(&rxMeta.rxTime, src->sin_addr.s_addr, src->sin_port, received);
+        return received;
+    }
+    if (received > 0 || ( received < 0 && err != ETIMEDOUT && err != EAGAIN )) {
+        serve->counts.invalid++;
+        if (serve->hooks.invalid != NULL) {
+            serve->hooks.invalid(serve->hooks.arg, received, err);
+        }
+    } // else probable timeout
+
+    return ( received >= 0 ) ? 0 : -1;
+}
+
+bool Sntp_ServeOne( Sntp_Serve_t *serve, const Sntp_ServeListener_t *listener ) {
+    static uint8_t req[NET_BUF_SIZE];
+    uint8_t resp[SNTP_SERVER_MAX_RESPONSE];
+    size_t respLen = 0;
+    struct sockaddr_in src;
+    struct timespec rxTime;
+    Sntp_StageRecord_t *stage;
+    ssize_t reqLen = Sntp_ServeReceive(serve, listener, req, &src, &rxTime, &stage);
+    SntpStatus_t status;
+
+    if (reqLen > 0) {
+        status = Sntp_ServerProcess(&listener->cfg, serve->serverStats, req, reqLen, resp, &respLen);
+        status = send_response(serve, listener, &src, resp, respLen, status, stage);
+        count_result(serve, listener, status);
+    }
+    return reqLen >= 0;
+}
+
+uint32_t Sntp_ServeBatch( Sntp_Serve_t *serve, const Sntp_ServeListener_t *listener ) {
+    static uint8_t reqBuf[SNTP_LISTEN_BATCH][NET_BUF_SIZE];
+    static uint8_t respBuf[SNTP_LISTEN_BATCH][SNTP_SERVER_MAX_RESPONSE];
+    struct sockaddr_in src[SNTP_LISTEN_BATCH];
+    struct timespec rxTimes[SNTP_LISTEN_BATCH];
+    Sntp_StageRecord_t *stage[SNTP_LISTEN_BATCH];
+    const uint8_t *reqs[SNTP_LISTEN_BATCH];
+    uint8_t *resps[SNTP_LISTEN_BATCH];
+    size_t reqLens[SNTP_LISTEN_BATCH];
+    size_t respLens[SNTP_LISTEN_BATCH];
+    SntpStatus_t status[SNTP_LISTEN_BATCH];
+    uint32_t received = 0, count = 0;
+    ssize_t reqLen = 0;
+
+    for (; received < SNTP_LISTEN_BATCH; received++) {
+        reqLen = Sntp_ServeReceive(serve, listener, reqBuf[count], &src[count], &rxTimes[count], &stage[count]);
+        if (reqLen < 0) {
+            break;
+        }
+        if (reqLen > 0) {
+            reqs[count] = reqBuf[count];
+            resps[count] = respBuf[count];
+            reqLens[count++] = reqLen;
+        }
+    }
+    if (count == 0) {
+        return received;
+    }
+
+    Sntp_ServerProcessBatch(&listener->cfg, serve->serverStats, rxTimes, reqs, reqLens, resps, respLens, status,
+                            count);
+    for (uint32_t i = 0; i < count; i++) {
+        status[i] = send_response(serve, listener, &src[i], resps[i], respLens[i], status[i], stage[i]);
+        count_result(serve, listener, status[i]);
+    }
+    return received;
+}
+
+bool Sntp_ServeControlDue( Sntp_Serve_t *serve ) {
+    if (serve->ctlPending == 0) {
+        return false;
+    }
+    if (serve->shed->level != 0) {
+        serve->ctl->limited += serve->ctlPending;
+        serve->ctlPending = 0;
+        return false;
+    }
+    return true;
+}
+
+void Sntp_ServeAnswerControl( Sntp_Serve_t *serve, const Sntp_CtlVars_t *vars ) {
+    for (uint32_t i = 0; i < serve->ctlPending; i++) {
+        const Sntp_ServeCtlQuery_t *query = &serve->ctlQueue[i];
+        Sntp_CtlRespond(serve->ctl, query->buf, query->len, vars, query->listener->transport, &query->addr);
+    }
+    serve->ctlPending = 0;
+}
@@ -0,0 +1,123 @@
+#ifndef __SNTP_SERVE__
+#define __SNTP_SERVE__
+
+/**
+ * The serving loop's per-datagram work, for a listener's transport.
+ *
+ * Each datagram received is recorded (wake latency, top talkers, capture)
+ * and re-evaluates the shed level.  Mode-6 control queries are admitted and
+ * queued, to be answered once no time requests are waiting.  Requests of a
+ * length the engine accepts are counted and, unless shed (optionally with a
+ * KoD RATE reply), answered one at a time or drained and answered as a batch.
+ * Answered requests are traced, sampled for the fleet histogram and counted
+ * per timescale.
+ *
+ * Everything the loop touches is reached through a Sntp_Serve_t, so the app
+ * and the host tools run the same code: the app on its UDP listeners, the
+ * replay tool and tests on the in-memory ring transport.  Single-threaded.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+
+#include "core_sntp_config.h"
+#include "sntp_server.h"
+#include "sntp_time.h"
+#include "sntp_transport.h"
+#include "sntp_rt.h"
+#include "sntp_shed.h"
+#include "sntp_ctl.h"
+#include "sntp_topk.h"
+#include "sntp_fleet.h"
+#include "sntp_pcap.h"
+#include "sntp_stage.h"
+
+#ifndef SNTP_LISTEN_BATCH
+#define SNTP_LISTEN_BATCH 32 /* Datagrams drained from one listener per wake when serving several */
+#endif
+#ifndef SNTP_CTL_QUEUE_DEPTH
+#define SNTP_CTL_QUEUE_DEPTH 4 /* Admitted control queries held until no time requests are waiting */
+#endif
+
+/** One transport serving one timescale */
+typedef struct {
+    Sntp_ServerConfig_t       cfg;       /**< Shared engine settings plus this listener's timescale */
+    uint8_t                   cls;       /**< Load shedding class of requests matching no prefix */
+    Sntp_Transport_t         *transport; /**< Request path I/O */
+    const Sntp_RtSockStats_t *sockStats; /**< Receive backlog sampled by the transport */
+} Sntp_ServeListener_t;
+
+typedef struct {
+    uint32_t received;    /**< Time requests of a length the engine accepts */
+    uint32_t invalid;     /**< Datagrams of any other length, and receive errors */
+    uint32_t badRequests; /**< Requests the engine refused, other than for authentication */
+    uint32_t sendErrors;  /**< Responses the transport would not take */
+    uint32_t scaleRequests[SNTP_SCALE_COUNT]; /**< Responses sent per timescale */
+} Sntp_ServeCounters_t;
+
+/** Mode-6 control query awaiting an answer */
+typedef struct {
+    const Sntp_ServeListener_t *listener;
+    struct sockaddr_in          addr;
+    uint16_t                    len;
+    uint8_t                     buf[SNTP_CTL_HEADER_SIZE + SNTP_CTL_MAX_DATA];
+} Sntp_ServeCtlQuery_t;
+
+typedef struct {
+    void *arg;
+    /** The shed level changed on a datagram with this queueing latency and receive backlog; may be NULL */
+    void ( *shedChanged )( void *arg, uint32_t level, uint32_t latencyUs, uint32_t queueBytes );
+    /** A datagram of a bad length arrived (len > 0), or the receive failed (len < 0, err set); may be NULL */
+    void ( *invalid )( void *arg, ssize_t len, int err );
+} Sntp_ServeHooks_t;
+
+/** State the serving loop reads and updates; the pointers are owned by the caller and, but for capture, required */
+typedef struct {
+    Sntp_ServerStats_t      *serverStats;
+    const Sntp_ShedConfig_t *shedCfg;
+    Sntp_ShedState_t        *shed;
+    Sntp_RtHist_t           *wakeHist;
+    Sntp_TopK_t             *topTalkers;
+    Sntp_Fleet_t            *fleet;
+    Sntp_Pcap_t             *capture; /**< NULL if requests are never captured */
+    const Sntp_CtlConfig_t  *ctlCfg;
+    Sntp_CtlState_t         *ctl;
+    Sntp_ServeHooks_t        hooks;
+
+    Sntp_ServeCounters_t     counts;
+    Sntp_ServeCtlQuery_t     ctlQueue[SNTP_CTL_QUEUE_DEPTH];
+    uint32_t                 ctlPending;
+} Sntp_Serve_t;
+
+/** Receive one datagram from a listener and do the per-datagram work above
+ * @param [out] buf - NET_BUF_SIZE bytes
+ * @param [out] rxTime - Kernel receive timestamp, zero if the transport gave none
+ * @param [out] stage - Stage trace record if the request is to be answered and was sampled, else NULL
+ * @return Request length if it is to be answered, 0 if it was consumed (invalid, control or shed), -1 if
+ *         nothing was received
+ */
+ssize_t Sntp_ServeReceive( Sntp_Serve_t *serve, const Sntp_ServeListener_t *listener, uint8_t *buf,
+                           struct sockaddr_in *src, struct timespec *rxTime, Sntp_StageRecord_t **stage );
+
+/** Receive and answer at most one request
+ * @return true if a datagram was received
+ */
+bool Sntp_ServeOne( Sntp_Serve_t *serve, const Sntp_ServeListener_t *listener );
+
+/** Drain up to SNTP_LISTEN_BATCH datagrams and answer the requests among them together
+ * @return Number of datagrams received
+ */
+uint32_t Sntp_ServeBatch( Sntp_Serve_t *serve, const Sntp_ServeListener_t *listener );
+
+/** Whether queued control queries may be answered: some are queued and nothing is being shed.  Under
+ * shedding the queue is dropped, counted as rate limited.  The caller also holds them while any listener
+ * has requests waiting.
+ */
+bool Sntp_ServeControlDue( Sntp_Serve_t *serve );
+
+/** Answer the queued control queries with vars and empty the queue */
+void Sntp_ServeAnswerControl( Sntp_Serve_t *serve, const Sntp_CtlVars_t *vars );
+
+#endif
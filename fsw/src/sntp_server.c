@@ -0,0 +1,316 @@
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include "sntp_server.h"
+#include "sntp_utils.h"
+#include "sntp_time.h"
+#include "sntp_batch.h"
+#include "sntp_probe.h"
+#include "sntp_stage.h"
+
+/** Leap indicator for responses on scale: TAI and MET have no leap seconds, so only UTC announces one */
+static uint8_t leap_indicator( Sntp_TimeScale_t scale ) {
+    return ( scale == SNTP_SCALE_UTC ) ? Sntp_TimeLeapIndicator() : 0;
+}
+
+SntpStatus_t Sntp_ServerProcess( const Sntp_ServerConfig_t *cfg,
+                                 Sntp_ServerStats_t *stats,
+                                 const uint8_t *req,
+                                 size_t reqLen,
+                                 uint8_t *resp,
+                                 size_t *respLen )
+{
+    SntpTimestamp_t rxTime;
+
+    // Receive Time when response is received. Used to calculate system clock offset
+    Sntp_TimeRead(&rxTime);
+    return Sntp_ServerProcessAt(cfg, stats, &rxTime, req, reqLen, resp, respLen);
+}
+
+SntpStatus_t Sntp_ServerProcessAt( const Sntp_ServerConfig_t *cfg,
+                                   Sntp_ServerStats_t *stats,
+                                   const SntpTimestamp_t *rxTime,
+                                   const uint8_t *req,
+                                   size_t reqLen,
+                                   uint8_t *resp,
+                                   size_t *respLen )
+{
+    SntpStatus_t status;
+    SntpPacket_t request;
+    SntpPacket_t *response = (SntpPacket_t *)resp;
+    SntpTimestamp_t time;
+    SntpTimestamp_t txTime;
+    const Sntp_AuthKey_t *key = NULL;
+    Sntp_ExtRequest_t ext = { .uid = NULL };
+#ifdef SNTP_ENABLE_NTS
+    Sntp_NtsRequest_t nts;
+    SntpStatus_t ntsStatus;
+    bool ntsRequest = false;
+#endif
+
+    // Only client requests are answered: a server or broadcast packet, possibly our own, answered in turn
+    // would start a reply loop
+    if (reqLen < SNTP_PACKET_BASE_SIZE || !Sntp_IsClientRequest(req[0])) {
+        return SntpErrorBadParameter;
+    }
+
+    time = *rxTime;
+    Sntp_TimeApplyScale(cfg->scale, &time);
+
+    // Plain 48-byte requests skip the extension field scan entirely
+    if (reqLen != SNTP_PACKET_BASE_SIZE) {
+        status = Sntp_ExtScanRequest(req, reqLen, &ext);
+        if (status != SntpSuccess) {
+            return status;
+        }
+
+        // Reject unauthenticated traffic before doing any other work
+        if (ext.hasMac) {
+            status = SntpServerNotAuthenticated;
+            if (cfg->authKeys != NULL) {
+                status = Sntp_AuthVerify(cfg->authKeys, req, reqLen, &key);
+            }
+            if (status != SntpSuccess) {
+                stats->authFailures++;
+                return status;
+            }
+        }
+#ifdef SNTP_ENABLE_NTS
+        else if (ext.nts && cfg->nts) {
+            ntsStatus = Sntp_NtsParseRequest(req, reqLen, &nts);
+            if (ntsStatus == SntpErrorAuthFailure) {
+                stats->ntsFailures++;
+                return ntsStatus;
+            } else if (ntsStatus != SntpSuccess && ntsStatus != SntpServerNotAuthenticated) {
+                return ntsStatus;
+            }
+            ntsRequest = true;
+        }
+#endif
+    }
+
+    memset(response, 0, SNTP_PACKET_BASE_SIZE);
+    encodeTime(&time, &response->receiveTime);
+
+    // De-serialize packet
+    status = Sntp_DeserializeRequest( req, &request);
+    if (status != SntpSuccess) {
+        return status;
+    }
+    Sntp_StageMark(SNTP_STAGE_PARSE);
+    SNTP_PROBE4(request__parse, reqLen, request.leapVersionMode, request.transmitTime.seconds,
+                request.transmitTime.fractions);
+
+    // Echo request in response fields
+    encodeTime( &request.transmitTime, &response->originTime );
+
+    // Set Details
+    response->leapVersionMode = ( leap_indicator(cfg->scale) << SNTP_LEAP_INDICATOR_LSB_POSITION ) | SNTP_MODE_SERVER |
+                                ( SNTP_VERSION << SNTP_VERSION_LSB_POSITION );
+    response->stratum = cfg->stratum;
+    response->precision = Sntp_TimePrecision();
+    response->refId = htonl(SNTP_KISS_OF_DEATH_CODE_NONE);
+
+    Sntp_TimeReadScale(cfg->scale, &txTime);
+    Sntp_StageMark(SNTP_STAGE_TIME_READ);
+    encodeTime(&txTime, &response->transmitTime);
+    SNTP_PROBE5(request__timestamp, cfg->scale, time.seconds, time.fractions, txTime.seconds, txTime.fractions);
+
+    *respLen = SNTP_PACKET_BASE_SIZE;
+#ifdef SNTP_ENABLE_NTS
+    if (ntsRequest && ntsStatus == SntpSuccess) {
+        *respLen = Sntp_NtsAppendResponse(&nts, resp, SNTP_PACKET_BASE_SIZE);
+        if (*respLen == 0) {
+            stats->ntsFailures++;
+            return SntpErrorAuthFailure;
+        }
+        stats->ntsResponses++;
+        return SntpSuccess;
+    } else if (ntsRequest) {
+        // Cookie could not be opened (e.g. master key rotated out): NTS NAK so the client re-keys
+        response->stratum = 0;
+        response->refId = htonl(SNTP_NTS_KOD_NTSN);
+        memset(&response->receiveTime, 0, sizeof(response->receiveTime));
+        memset(&response->transmitTime, 0, sizeof(response->transmitTime));
+        *respLen = Sntp_NtsAppendNak(&nts, resp, SNTP_PACKET_BASE_SIZE);
+        stats->ntsFailures++;
+        return SntpSuccess;
+    }
+#endif
+
+    // Echo the Unique Identifier so the client can match the response to its request
+    if (ext.uid != NULL) {
+        *respLen = Sntp_ExtPutField(resp, *respLen, SNTP_EXT_UNIQUE_ID, ext.uid, ext.uidLen);
+    }
+    if (key != NULL) {
+        *respLen = Sntp_AuthSign(key, resp, *respLen);
+        stats->authResponses++;
+    }
+    return SntpSuccess;
+}
+
+size_t Sntp_ServerBuildBroadcast( const Sntp_ServerConfig_t *cfg, int8_t pollExp, const Sntp_AuthKey_t *key, uint8_t *pkt )
+{
+    SntpPacket_t *packet = (SntpPacket_t *)pkt;
+    SntpTimestamp_t time;
+
+    memset(packet, 0, SNTP_PACKET_BASE_SIZE);
+    packet->leapVersionMode = ( leap_indicator(cfg->scale) << SNTP_LEAP_INDICATOR_LSB_POSITION ) | SNTP_MODE_BROADCAST |
+                              ( SNTP_VERSION << SNTP_VERSION_LSB_POSITION );
+    packet->stratum = cfg->stratum;
+    packet->pollInterval = (uint8_t)pollExp;
+    packet->precision = Sntp_TimePrecision();
+    packet->refId = htonl(SNTP_KISS_OF_DEATH_CODE_NONE);
+
+    Sntp_TimeReadScale(cfg->scale, &time);
+    encodeTime(&time, &packet->transmitTime);
+
+    if (key != NULL) {
+        return Sntp_AuthSign(key, pkt, SNTP_PACKET_BASE_SIZE);
+    }
+    return SNTP_PACKET_BASE_SIZE;
+}
+
+size_t Sntp_ServerBuildKod( const uint8_t *req, size_t reqLen, uint32_t code, uint8_t *resp )
+{
+    const SntpPacket_t *request = (const SntpPacket_t *)req;
+    SntpPacket_t *reply = (SntpPacket_t *)resp;
+
+    // Never answer server or broadcast packets, which could set up a reply loop
+    if (reqLen < SNTP_PACKET_BASE_SIZE || !Sntp_IsClientRequest(request->leapVersionMode)) {
+        return 0;
+    }
+
+    // RFC 5905 section 7.4: stratum 0 with the kiss code in the reference id, leap indicator unsynchronized
+    memset(reply, 0, SNTP_PACKET_BASE_SIZE);
+    reply->leapVersionMode = ( 3U << SNTP_LEAP_INDICATOR_LSB_POSITION ) | SNTP_MODE_SERVER |
+                             ( SNTP_VERSION << SNTP_VERSION_LSB_POSITION );
+    reply->pollInterval = request->pollInterval;
+    reply->precision = Sntp_TimePrecision();
+    reply->refId = htonl(code);
+    reply->originTime = request->transmitTime;
+    return SNTP_PACKET_BASE_SIZE;
+}
+
+SntpStatus_t Sntp_ServerRead( const Sntp_ServerConfig_t *cfg, const SntpTimestamp_t *rxTime,
+                              Sntp_ServerReading_t *reading )
+{
+    if (cfg->scale >= SNTP_SCALE_COUNT) {
+        return SntpErrorBadParameter;
+    }
+    reading->leapIndicator = leap_indicator(cfg->scale);
+    reading->stratum = cfg->stratum;
+    reading->precision = Sntp_TimePrecision();
+    reading->refId = SNTP_KISS_OF_DEATH_CODE_NONE;
+    reading->receive = *rxTime;
+    Sntp_TimeApplyScale(cfg->scale, &reading->receive);
+    Sntp_TimeReadScale(cfg->scale, &reading->transmit);
+    return SntpSuccess;
+}
+
+/** Receive time of a datagram the kernel stamped at rx, from a source reading taken at CLOCK_REALTIME real
+ * @param [in] rx - Kernel receive timestamp; zero, or later than real, leaves *t = *now
+ */
+static void receive_time( const SntpTimestamp_t *now, const struct timespec *real, const struct timespec *rx,
+                          SntpTimestamp_t *t ) {
+    int64_t ageNs = ( (int64_t)real->tv_sec - rx->tv_sec ) * 1000000000LL + ( real->tv_nsec - rx->tv_nsec );
+    uint64_t v;
+
+    *t = *now;
+    if (( rx->tv_sec == 0 && rx->tv_nsec == 0 ) || ageNs <= 0) {
+        return;
+    }
+    v = ( (uint64_t)now->seconds << 32 | now->fractions ) - ( ( (uint64_t)( ageNs / 1000000000LL ) << 32 ) +
+                                                              ( ( (uint64_t)( ageNs % 1000000000LL ) << 32 ) / 1000000000ULL ) );
+    t->seconds = (uint32_t)( v >> 32 );
+    t->fractions = (uint32_t)v;
+}
+
+void Sntp_ServerProcessBatch( const Sntp_ServerConfig_t *cfg,
+                              Sntp_ServerStats_t *stats,
+                              const struct timespec *rxTimes,
+                              const uint8_t *const *reqs,
+                              const size_t *reqLens,
+                              uint8_t *const *resps,
+                              size_t *respLens,
+                              SntpStatus_t *status,
+                              uint32_t count )
+{
+    const uint8_t *plainReqs[SNTP_BATCH_MAX];
+    uint8_t *plainResps[SNTP_BATCH_MAX];
+    uint32_t plainIdx[SNTP_BATCH_MAX];
+    uint32_t plain = 0;
+    bool full[SNTP_BATCH_MAX];
+    SntpPacket_t tmpl;
+    SntpPacket_t *response = &tmpl;
+    SntpTimestamp_t now;
+    SntpTimestamp_t time;
+    SntpTimestamp_t txTime;
+    SntpTimestamp_t txWire;
+    struct timespec real;
+    uint64_t valid;
+
+    if (count > SNTP_BATCH_MAX) {
+        count = SNTP_BATCH_MAX;
+    }
+
+    // Extension fields and MACs need the full per-request path; server and broadcast packets are never answered
+    for (uint32_t i = 0; i < count; i++) {
+        if (reqLens[i] < SNTP_PACKET_BASE_SIZE || !Sntp_IsClientRequest(reqs[i][0])) {
+            full[i] = false;
+            respLens[i] = 0;
+            status[i] = SntpErrorBadParameter;
+            continue;
+        }
+        full[i] = ( reqLens[i] != SNTP_PACKET_BASE_SIZE );
+        if (!full[i]) {
+            plainReqs[plain] = reqs[i];
+            plainResps[plain] = resps[i];
+            plainIdx[plain++] = i;
+        }
+    }
+
+    // Everything but the timestamps is common to the batch, so it is encoded once
+    memset(&tmpl, 0, sizeof(tmpl));
+    response->leapVersionMode = ( leap_indicator(cfg->scale) << SNTP_LEAP_INDICATOR_LSB_POSITION ) | SNTP_MODE_SERVER |
+                                ( SNTP_VERSION << SNTP_VERSION_LSB_POSITION );
+    response->stratum = cfg->stratum;
+    response->precision = Sntp_TimePrecision();
+    response->refId = htonl(SNTP_KISS_OF_DEATH_CODE_NONE);
+    valid = Sntp_BatchRespond((const uint8_t *)&tmpl, plainReqs, plainResps, plain);
+    Sntp_StageMark(SNTP_STAGE_PARSE);
+    SNTP_PROBE3(batch__respond, count, plain, valid);
+
+    // One read of the served clock, paired with the clock the kernel stamps datagrams with, dates every request
+    Sntp_TimeRead(&now);
+    clock_gettime(CLOCK_REALTIME, &real);
+    Sntp_StageMark(SNTP_STAGE_TIME_READ);
+    txTime = now;
+    Sntp_TimeApplyScale(cfg->scale, &txTime);
+    encodeTime(&txTime, &txWire);
+
+    for (uint32_t j = 0; j < plain; j++) {
+        uint32_t i = plainIdx[j];
+        SntpPacket_t *resp = (SntpPacket_t *)resps[i];
+
+        // Only client requests reach the kernel, so every bit should be set; any other goes to the engine
+        full[i] = !( ( valid >> j ) & 1 );
+        if (!full[i]) {
+            receive_time(&now, &real, &rxTimes[i], &time);
+            Sntp_TimeApplyScale(cfg->scale, &time);
+            encodeTime(&time, &resp->receiveTime);
+            resp->transmitTime = txWire;
+            respLens[i] = SNTP_PACKET_BASE_SIZE;
+            status[i] = SntpSuccess;
+            SNTP_PROBE5(request__timestamp, cfg->scale, time.seconds, time.fractions, txTime.seconds,
+                        txTime.fractions);
+        }
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        if (full[i]) {
+            receive_time(&now, &real, &rxTimes[i], &time);
+            status[i] = Sntp_ServerProcessAt(cfg, stats, &time, reqs[i], reqLens[i], resps[i], &respLens[i]);
+        }
+    }
+}
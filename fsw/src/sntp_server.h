@@ -0,0 +1,127 @@
+#ifndef __SNTP_SERVER__
+#define __SNTP_SERVER__
+
+/**
+ * Request -> response engine shared by the cFE app and the standalone test server.
+ * No I/O is done here; callers own the sockets.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "core_sntp_serializer.h"
+#include "core_sntp_config.h"
+#include "sntp_auth.h"
+#include "sntp_ext.h"
+#include "sntp_time.h"
+#ifdef SNTP_ENABLE_NTS
+#include "sntp_nts.h"
+#endif
+
+/** Largest response the engine produces */
+#define SNTP_SERVER_MAX_RESPONSE NET_BUF_SIZE
+
+typedef struct {
+    uint8_t stratum;
+    const Sntp_AuthKeySet_t *authKeys; /**< NULL disables symmetric-key authentication */
+    bool nts;                          /**< Serve NTS-protected requests (SNTP_ENABLE_NTS builds only) */
+    Sntp_TimeScale_t scale;            /**< Timescale stamped into responses */
+} Sntp_ServerConfig_t;
+
+typedef struct {
+    uint32_t authResponses; /**< Responses signed with a symmetric key */
+    uint32_t authFailures;  /**< Requests dropped for an unknown key id or bad MAC */
+    uint32_t ntsResponses;  /**< NTS-protected responses sent */
+    uint32_t ntsFailures;   /**< NTS NAKs sent plus requests dropped for a bad authenticator */
+} Sntp_ServerStats_t;
+
+/** The header fields of the response to a plain client request, for answering without a packet */
+typedef struct {
+    uint8_t         leapIndicator; /**< 0 unless cfg->scale is UTC */
+    uint8_t         stratum;
+    int8_t          precision;
+    uint32_t        refId;    /**< Host byte order */
+    SntpTimestamp_t receive;  /**< On cfg->scale */
+    SntpTimestamp_t transmit; /**< On cfg->scale, read after the receive time */
+} Sntp_ServerReading_t;
+
+/** Request sizes worth handing to Sntp_ServerProcess: the header plus whole 32-bit words of fields/MAC */
+static inline bool Sntp_ServerAcceptsLength( size_t len ) {
+    return len >= SNTP_PACKET_BASE_SIZE && len <= NET_BUF_SIZE && ( len & 3 ) == 0;
+}
+
+/** Build an unsolicited mode-5 broadcast packet stamped with the current time
+ * @param [in] pollExp - log2 of the broadcast interval in seconds, advertised to listeners
+ * @param [in] key - Key to MAC the packet with, or NULL
+ * @param [out] pkt - Packet buffer of at least SNTP_PACKET_BASE_SIZE + SNTP_AUTH_MAC_SIZE bytes
+ * @return Packet length
+ */
+size_t Sntp_ServerBuildBroadcast( const Sntp_ServerConfig_t *cfg, int8_t pollExp, const Sntp_AuthKey_t *key, uint8_t *pkt );
+
+/** Build a Kiss-o'-Death reply to a request without reading the clock or checking authentication
+ * @param [in] code - Kiss code, e.g. SNTP_KISS_OF_DEATH_CODE_RATE
+ * @param [out] resp - Reply buffer of at least SNTP_PACKET_BASE_SIZE bytes
+ * @return Reply length, or 0 if the request is not a client-mode request and must not be answered
+ */
+size_t Sntp_ServerBuildKod( const uint8_t *req, size_t reqLen, uint32_t code, uint8_t *resp );
+
+/** Read the time as a plain 48-byte client request received at rxTime would be answered; root delay and
+ * dispersion are 0, as in every response
+ * @param [in] rxTime - Receive time on the Sntp_TimeRead() timescale; cfg->scale is applied to it
+ * @return SntpSuccess, or SntpErrorBadParameter for an unknown cfg->scale
+ */
+SntpStatus_t Sntp_ServerRead( const Sntp_ServerConfig_t *cfg, const SntpTimestamp_t *rxTime,
+                              Sntp_ServerReading_t *reading );
+
+/** Build the response to a single request
+ * @param [in] req - Received datagram
+ * @param [in] reqLen - Received length
+ * @param [out] resp - Response buffer of at least SNTP_SERVER_MAX_RESPONSE bytes
+ * @param [out] respLen - Response length
+ * @return SntpSuccess; SntpServerNotAuthenticated/SntpErrorAuthFailure if the request failed
+ *         authentication (no response should be sent, already counted in stats); or another
+ *         error for malformed requests
+ */
+SntpStatus_t Sntp_ServerProcess( const Sntp_ServerConfig_t *cfg,
+                                 Sntp_ServerStats_t *stats,
+                                 const uint8_t *req,
+                                 size_t reqLen,
+                                 uint8_t *resp,
+                                 size_t *respLen );
+
+/** Sntp_ServerProcess() with a receive time the caller has already read
+ * @param [in] rxTime - Receive time on the Sntp_TimeRead() timescale; cfg->scale is applied to it
+ */
+SntpStatus_t Sntp_ServerProcessAt( const Sntp_ServerConfig_t *cfg,
+                                   Sntp_ServerStats_t *stats,
+                                   const SntpTimestamp_t *rxTime,
+                                   const uint8_t *req,
+                                   size_t reqLen,
+                                   uint8_t *resp,
+                                   size_t *respLen );
+
+/** Answer a batch of requests received together from one clock read, which is their transmit time.
+ * Each receive time is that read less the age of the request's kernel receive timestamp, so requests
+ * that waited in the socket queue are dated when they arrived rather than when they were read.
+ * Plain 48-byte client requests are answered by the batch kernel (sntp_batch.h) from one response template;
+ * requests with extension fields or a MAC go through Sntp_ServerProcessAt() one at a time.  Anything but a
+ * client request is refused with SntpErrorBadParameter and never reaches either path.
+ * @param [in] rxTimes - Per-request CLOCK_REALTIME kernel receive timestamps; zero dates a request at the read
+ * @param [in] count - Number of requests, at most SNTP_BATCH_MAX
+ * @param [out] resps - Response buffers of at least SNTP_SERVER_MAX_RESPONSE bytes
+ * @param [out] respLens - Response lengths, valid where status is SntpSuccess
+ * @param [out] status - Per-request result, as returned by Sntp_ServerProcess()
+ */
+void Sntp_ServerProcessBatch( const Sntp_ServerConfig_t *cfg,
+                              Sntp_ServerStats_t *stats,
+                              const struct timespec *rxTimes,
+                              const uint8_t *const *reqs,
+                              const size_t *reqLens,
+                              uint8_t *const *resps,
+                              size_t *respLens,
+                              SntpStatus_t *status,
+                              uint32_t count );
+
+#endif
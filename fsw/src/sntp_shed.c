@@ -0,0 +1,75 @@
+#include <string.h>
+#include <stdio.h>
+#include <arpa/inet.h>
+
+#include "sntp_shed.h"
+
+SntpStatus_t Sntp_ShedMakeRule( const char *net, uint8_t length, uint8_t cls, Sntp_ShedRule_t *rule ) {
+    struct in_addr addr;
+
+    if (length > 32 || cls >= SNTP_SHED_CLASS_COUNT || inet_pton(AF_INET, net, &addr) != 1) {
+        return SntpErrorBadParameter;
+    }
+    rule->mask = htonl(( length == 0 ) ? 0 : 0xffffffffU << ( 32 - length ));
+    rule->net = addr.s_addr & rule->mask;
+    rule->cls = cls;
+    return SntpSuccess;
+}
+
+SntpStatus_t Sntp_ShedParseRule( const char *spec, Sntp_ShedRule_t *rule ) {
+    char net[INET_ADDRSTRLEN];
+    unsigned int length, cls;
+    char extra;
+
+    if (sscanf(spec, "%15[0-9.]/%u=%u%c", net, &length, &cls, &extra) != 3 || length > 32 ||
+        cls >= SNTP_SHED_CLASS_COUNT) {
+        return SntpErrorBadParameter;
+    }
+    return Sntp_ShedMakeRule(net, (uint8_t)length, (uint8_t)cls, rule);
+}
+
+static uint32_t severity( uint32_t value, uint32_t threshold ) {
+    if (threshold == 0 || value < threshold) {
+        return 0;
+    }
+    return ( value / threshold >= SNTP_SHED_SEVERE ) ? SNTP_SHED_MAX_LEVEL : 1;
+}
+
+bool Sntp_ShedUpdate( const Sntp_ShedConfig_t *cfg, Sntp_ShedState_t *state, uint32_t latencyUs, uint32_t queueBytes ) {
+    uint32_t target = severity(latencyUs, cfg->latencyUs);
+    uint32_t queued = severity(queueBytes, cfg->queueBytes);
+    struct timespec now;
+    int64_t heldMs;
+
+    if (queued > target) {
+        target = queued;
+    }
+    if (target == 0 && state->level == 0) {
+        return false;
+    }
+
+    // The coarse clock is a plain memory read on Linux; millisecond accuracy is plenty for the hold time
+#ifdef CLOCK_MONOTONIC_COARSE
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &now);
+#endif
+    if (target >= state->level) {
+        state->lastOverload = now;
+        if (target == state->level) {
+            return false;
+        }
+        state->level = target;
+        return true;
+    }
+
+    // Step down one level at a time, holding each, so shed traffic is let back in gradually
+    heldMs = (int64_t)( now.tv_sec - state->lastOverload.tv_sec ) * 1000 +
+             ( now.tv_nsec - state->lastOverload.tv_nsec ) / 1000000;
+    if (heldMs < (int64_t)cfg->holdMs) {
+        return false;
+    }
+    state->level--;
+    state->lastOverload = now;
+    return true;
+}
@@ -0,0 +1,105 @@
+#ifndef __SNTP_SHED__
+#define __SNTP_SHED__
+
+/**
+ * Overload detection and priority load shedding.
+ *
+ * Every request has a class, taken from the first matching address prefix
+ * rule or else from the listener it arrived on.  Overload is judged per
+ * received datagram from its queueing latency (kernel arrival to dequeue)
+ * and the socket receive backlog.  Exceeding a threshold raises the shed
+ * level to 1, where best-effort requests are shed; four times a threshold
+ * raises it to 2, where normal requests are shed too.  Critical requests are
+ * never shed.  The level only falls after holdMs below the thresholds, so it
+ * does not flap on every queue drain.
+ *
+ * Shed requests cost a prefix lookup and optionally a Kiss-o'-Death RATE
+ * reply (Sntp_ServerBuildKod) asking the client to back off; no clock read,
+ * authentication or extension parsing is done for them.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "core_sntp_serializer.h"
+
+#define SNTP_SHED_CLASS_COUNT 3
+#define SNTP_SHED_MAX_RULES   8
+#define SNTP_SHED_MAX_LEVEL   2
+#define SNTP_SHED_SEVERE      4 /* Multiple of a threshold that raises the level to SNTP_SHED_MAX_LEVEL */
+
+typedef enum {
+    SNTP_CLASS_CRITICAL = 0,
+    SNTP_CLASS_NORMAL = 1,
+    SNTP_CLASS_BEST_EFFORT = 2
+} Sntp_ShedClass_t;
+
+typedef struct {
+    uint32_t net;  /**< Network address, network byte order */
+    uint32_t mask; /**< Prefix mask, network byte order */
+    uint8_t  cls;
+} Sntp_ShedRule_t;
+
+typedef struct {
+    uint32_t latencyUs;  /**< Queueing latency that signals overload, 0 ignores latency */
+    uint32_t queueBytes; /**< Receive backlog that signals overload, 0 ignores the backlog */
+    uint32_t holdMs;     /**< Time below the thresholds before the level falls */
+    bool     kod;        /**< Answer shed requests with KoD RATE rather than dropping them */
+    uint32_t ruleCount;
+    Sntp_ShedRule_t rules[SNTP_SHED_MAX_RULES];
+} Sntp_ShedConfig_t;
+
+typedef struct {
+    uint32_t level;                        /**< 0 serves everything, see above */
+    struct timespec lastOverload;          /**< Last datagram at or above the current level */
+    uint32_t shed[SNTP_SHED_CLASS_COUNT];  /**< Requests shed per class */
+    uint32_t kod;                          /**< Shed requests answered with KoD RATE (counted by the caller) */
+} Sntp_ShedState_t;
+
+/** Build a rule from a dotted-quad network address and prefix length
+ * @return SntpErrorBadParameter for a bad address, length over 32 or unknown class
+ */
+SntpStatus_t Sntp_ShedMakeRule( const char *net, uint8_t length, uint8_t cls, Sntp_ShedRule_t *rule );
+
+/** Parse a "<a.b.c.d>/<length>=<class>" command-line rule */
+SntpStatus_t Sntp_ShedParseRule( const char *spec, Sntp_ShedRule_t *rule );
+
+/** Re-evaluate the shed level from one datagram's queueing latency and the socket backlog
+ * @return true if the level changed
+ */
+bool Sntp_ShedUpdate( const Sntp_ShedConfig_t *cfg, Sntp_ShedState_t *state, uint32_t latencyUs, uint32_t queueBytes );
+
+/** Class of a request: the first matching prefix rule's, else listenerClass
+ * @param [in] addr - Source address, network byte order
+ */
+static inline uint8_t Sntp_ShedClassify( const Sntp_ShedConfig_t *cfg, uint32_t addr, uint8_t listenerClass ) {
+    for (uint32_t i = 0; i < cfg->ruleCount; i++) {
+        if (( addr & cfg->rules[i].mask ) == cfg->rules[i].net) {
+            return cfg->rules[i].cls;
+        }
+    }
+    return listenerClass;
+}
+
+/** Classify a request and count it if it is to be shed
+ * @param [in] addr - Source address, network byte order
+ * @param [in] listenerClass - Class of requests matching no rule
+ * @return true if the request should be shed
+ */
+static inline bool Sntp_ShedCheck( const Sntp_ShedConfig_t *cfg, Sntp_ShedState_t *state, uint32_t addr,
+                                   uint8_t listenerClass ) {
+    uint8_t cls;
+
+    if (state->level == 0) {
+        return false;
+    }
+    cls = Sntp_ShedClassify(cfg, addr, listenerClass);
+    if (cls == SNTP_CLASS_CRITICAL || cls + state->level < SNTP_SHED_CLASS_COUNT) {
+        return false;
+    }
+    state->shed[cls]++;
+    return true;
+}
+
+#endif
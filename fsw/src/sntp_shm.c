@@ -0,0 +1,179 @@
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <sys/stat.h>
+
+#include "sntp_shm.h"
+#include "sntp_time.h"
+
+_Static_assert(sizeof(Sntp_ShmTime_t) == 64, "shared time segment layout changed");
+_Static_assert(SNTP_SHM_SCALES == SNTP_SCALE_COUNT, "one anchor per timescale");
+
+#define NTPD_SHM_KEY    0x4e545030 /* "NTP0" */
+#define NTP_UNIX_OFFSET 2208988800U
+
+/* Segment layout of the ntpd/chrony SHM refclock driver (mode 1) */
+struct ntpdShmTime {
+    int          mode;
+    volatile int count;
+    time_t       clockTimeStampSec;
+    int          clockTimeStampUSec;
+    time_t       receiveTimeStampSec;
+    int          receiveTimeStampUSec;
+    int          leap;
+    int          precision;
+    int          nsamples;
+    volatile int valid;
+    unsigned     clockTimeStampNSec;
+    unsigned     receiveTimeStampNSec;
+    int          dummy[8];
+};
+
+static uint64_t to_ntp64( const SntpTimestamp_t *t ) {
+    return ( (uint64_t)t->seconds << 32 ) | t->fractions;
+}
+
+static uint64_t mono_ns( void ) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+int Sntp_ShmOpen( Sntp_Shm_t *shm, const char *name, int refclockUnit, uint32_t periodMs ) {
+    int fd, id;
+    void *map;
+
+    memset(shm, 0, sizeof(*shm));
+    if (refclockUnit >= 0) {
+        // Units 0 and 1 are root-only in ntpd, higher units are open to all
+        id = shmget(NTPD_SHM_KEY + refclockUnit, sizeof(struct ntpdShmTime), IPC_CREAT | ( refclockUnit < 2 ? 0600 : 0666 ));
+        map = ( id < 0 ) ? (void *)-1 : shmat(id, NULL, 0);
+        if (map == (void *)-1) {
+            return -1;
+        }
+        shm->refclock = map;
+    }
+
+    fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+    if (fd < 0 || ftruncate(fd, sizeof(Sntp_ShmTime_t)) != 0) {
+        int err = errno;
+        if (fd >= 0) {
+            close(fd);
+        }
+        Sntp_ShmClose(shm);
+        errno = err;
+        return -1;
+    }
+    map = mmap(NULL, sizeof(Sntp_ShmTime_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        int err = errno;
+        Sntp_ShmClose(shm);
+        errno = err;
+        return -1;
+    }
+
+    // Readers attached to an old segment see seq odd until the first anchor, then the new layout
+    shm->seg = map;
+    __atomic_store_n(&shm->seg->seq, shm->seg->seq | 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    shm->seg->magic = SNTP_SHM_MAGIC;
+    shm->seg->version = SNTP_SHM_VERSION;
+    shm->seg->size = sizeof(Sntp_ShmTime_t);
+    shm->seg->periodMs = periodMs;
+    Sntp_ShmPublish(shm);
+    return 0;
+}
+
+/** Write a sample to the ntpd refclock segment: the served UTC and the system clock at the same instant */
+static void publish_refclock( struct ntpdShmTime *ref, uint64_t utc, uint8_t leapIndicator ) {
+    struct timespec sys;
+    uint32_t frac = (uint32_t)utc;
+
+    clock_gettime(CLOCK_REALTIME, &sys);
+    ref->mode = 1;
+    ref->valid = 0;
+    ref->count++;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    ref->clockTimeStampSec = (time_t)( ( utc >> 32 ) - NTP_UNIX_OFFSET );
+    ref->clockTimeStampNSec = (unsigned)( ( (uint64_t)frac * 1000000000ULL ) >> 32 );
+    ref->clockTimeStampUSec = (int)( ref->clockTimeStampNSec / 1000 );
+    ref->receiveTimeStampSec = sys.tv_sec;
+    ref->receiveTimeStampNSec = (unsigned)sys.tv_nsec;
+    ref->receiveTimeStampUSec = (int)( sys.tv_nsec / 1000 );
+    ref->leap = leapIndicator;
+    ref->precision = Sntp_TimePrecision();
+    ref->nsamples = 3;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    ref->count++;
+    ref->valid = 1;
+}
+
+void Sntp_ShmPublish( Sntp_Shm_t *shm ) {
+    Sntp_ShmTime_t *seg = shm->seg;
+    SntpTimestamp_t raw, t;
+    uint64_t before, monoNs, anchor[SNTP_SHM_SCALES];
+    int64_t rate = 0;
+    uint32_t seq;
+
+    if (seg == NULL) {
+        return;
+    }
+
+    // Anchor the source read at the middle of the monotonic reads around it
+    before = mono_ns();
+    Sntp_TimeRead(&raw);
+    monoNs = before + ( mono_ns() - before ) / 2;
+    for (int s = 0; s < SNTP_SHM_SCALES; s++) {
+        t = raw;
+        Sntp_TimeApplyScale((Sntp_TimeScale_t)s, &t);
+        anchor[s] = to_ntp64(&t);
+    }
+
+    if (shm->prevMonoNs != 0 && monoNs > shm->prevMonoNs) {
+        int64_t dMono = (int64_t)( monoNs - shm->prevMonoNs );
+        int64_t dNtp = (int64_t)( anchor[SNTP_SCALE_UTC] - shm->prevUtc );
+        int64_t dServed = ( dNtp >> 32 ) * 1000000000LL + (int64_t)( ( ( dNtp & 0xffffffffLL ) * 1000000000LL ) >> 32 );
+        int64_t diff = dServed - dMono;
+
+        // Within 500 ppm the shift cannot overflow for any gap under days; beyond it the served clock stepped
+        if (diff <= dMono / 2000 && -diff <= dMono / 2000) {
+            rate = (int64_t)( (uint64_t)diff << 32 ) / dMono;
+        }
+    }
+    shm->prevMonoNs = monoNs;
+    shm->prevUtc = anchor[SNTP_SCALE_UTC];
+
+    seq = seg->seq | 1;
+    __atomic_store_n(&seg->seq, seq, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&seg->monoNs, monoNs, __ATOMIC_RELAXED);
+    for (int s = 0; s < SNTP_SHM_SCALES; s++) {
+        __atomic_store_n(&seg->anchor[s], anchor[s], __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&seg->rate, rate, __ATOMIC_RELAXED);
+    __atomic_store_n(&seg->leapSecs, Sntp_TimeLeapPending(), __ATOMIC_RELAXED);
+    __atomic_store_n(&seg->leapIndicator, Sntp_TimeLeapIndicator(), __ATOMIC_RELAXED);
+    __atomic_store_n(&seg->timeSource, (uint8_t)Sntp_TimeSelected(), __ATOMIC_RELAXED);
+    __atomic_store_n(&seg->seq, seq + 1, __ATOMIC_RELEASE);
+
+    if (shm->refclock != NULL) {
+        publish_refclock(shm->refclock, anchor[SNTP_SCALE_UTC], Sntp_TimeLeapIndicator());
+    }
+}
+
+void Sntp_ShmClose( Sntp_Shm_t *shm ) {
+    if (shm->seg != NULL) {
+        munmap(shm->seg, sizeof(Sntp_ShmTime_t));
+        shm->seg = NULL;
+    }
+    if (shm->refclock != NULL) {
+        shmdt(shm->refclock);
+        shm->refclock = NULL;
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef __SNTP_SHM__
+#define __SNTP_SHM__
+
+/**
+ * Shared-memory time export for co-located processes.
+ *
+ * The server publishes the mapping from CLOCK_MONOTONIC to the time it
+ * serves into a POSIX shared memory object once a second: the served UTC,
+ * TAI and MET at one monotonic instant, and the rate of the served clock
+ * against the monotonic one over the last interval.  A local process reads
+ * the mapping and CLOCK_MONOTONIC (a vDSO call, no system call) and
+ * extrapolates, getting the served time without a round trip to the
+ * server.  The rate follows CFE STCF adjustments and leap smears; a step
+ * (time source change, CFE time set) shows as a new anchor with rate 0.
+ *
+ * The segment is guarded by a seqlock: the writer makes seq odd, updates
+ * the fields and makes seq even again, and a reader retries if seq was odd
+ * or changed while it copied.  tools/shm_reader.h is a reader library.
+ *
+ * The same samples can optionally be written to an ntpd/chrony SHM
+ * refclock segment (System V key 0x4e545030 + unit), so either daemon can
+ * discipline the system clock to the served time.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SNTP_SHM_MAGIC   0x534e544dU /* "SNTM" in the writer's byte order */
+#define SNTP_SHM_VERSION 1
+#define SNTP_SHM_SCALES  3 /* UTC, TAI, MET, as Sntp_TimeScale_t */
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size;                    /**< sizeof(Sntp_ShmTime_t) */
+    uint32_t seq;                     /**< Seqlock: odd while the writer is updating the fields below */
+    uint32_t periodMs;                /**< Publishing interval; an anchor much older than this is stale */
+    uint64_t monoNs;                  /**< CLOCK_MONOTONIC nanoseconds at the anchor */
+    uint64_t anchor[SNTP_SHM_SCALES]; /**< Served time per timescale at monoNs, NTP seconds and 2^-32 fractions */
+    int64_t  rate;                    /**< Served seconds per monotonic second, minus 1, in 2^-32 units */
+    uint32_t leapSecs;                /**< Scheduled leap second in NTP seconds, 0 if none */
+    uint8_t  leapIndicator;           /**< Leap indicator in responses */
+    uint8_t  timeSource;              /**< Sntp_TimeSrc_t being served */
+    uint8_t  spare[2];
+} Sntp_ShmTime_t;
+
+typedef struct {
+    Sntp_ShmTime_t *seg;      /**< NULL while not exporting */
+    void           *refclock; /**< ntpd SHM refclock segment, NULL if not attached */
+    uint64_t        prevMonoNs;
+    uint64_t        prevUtc;
+} Sntp_Shm_t;
+
+/** Create or attach the shared memory object name (e.g. "/sntp_time"), readable by all local users
+ * @param [in] refclockUnit - ntpd SHM refclock unit to also write, or -1 for none
+ * @return 0, or -1 with errno set; a refclock that cannot be attached fails the call
+ */
+int Sntp_ShmOpen( Sntp_Shm_t *shm, const char *name, int refclockUnit, uint32_t periodMs );
+
+/** Publish a new anchor read from the selected time source. Does nothing if not open. */
+void Sntp_ShmPublish( Sntp_Shm_t *shm );
+
+/** Unmap the segments; the object is left for readers, which see the anchor go stale */
+void Sntp_ShmClose( Sntp_Shm_t *shm );
+
+#endif
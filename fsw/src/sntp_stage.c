@@ -0,0 +1,101 @@
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "sntp_stage.h"
+#include "core_sntp_serializer.h"
+
+bool Sntp_StageArmed;
+
+static struct {
+    uint32_t           sampleEvery;
+    uint32_t           countdown;
+    uint64_t           requests;   /**< Requests counted by Sntp_StageBegin() */
+    uint64_t           recorded;   /**< Records started; the ring holds the last SNTP_STAGE_RING */
+    uint32_t           pending;    /**< Sampled requests begun but not ended */
+    uint64_t           scratch[SNTP_STAGE_COUNT];
+    Sntp_StageRecord_t ring[SNTP_STAGE_RING];
+} trace;
+
+static const char *const stageNames[SNTP_STAGE_COUNT] = { "kernel_rx", "user_rx", "parse", "time_read", "send" };
+
+static uint64_t now_ns( void ) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+void Sntp_StageConfigure( uint32_t sampleEvery ) {
+    trace.sampleEvery = sampleEvery;
+    trace.countdown = sampleEvery;
+}
+
+Sntp_StageRecord_t *Sntp_StageBegin( const struct timespec *kernelRx, uint32_t addr, uint16_t port, uint32_t len ) {
+    Sntp_StageRecord_t *rec;
+
+    trace.requests++;
+    if (trace.sampleEvery == 0 || --trace.countdown != 0) {
+        return NULL;
+    }
+    trace.countdown = trace.sampleEvery;
+
+    rec = &trace.ring[trace.recorded++ % SNTP_STAGE_RING];
+    memset(rec, 0, sizeof(*rec));
+    rec->seq = trace.requests;
+    rec->addr = addr;
+    rec->port = port;
+    rec->len = (uint16_t)len;
+    rec->ns[SNTP_STAGE_KERNEL_RX] = (uint64_t)kernelRx->tv_sec * 1000000000ULL + (uint64_t)kernelRx->tv_nsec;
+    rec->ns[SNTP_STAGE_USER_RX] = now_ns();
+    if (trace.pending++ == 0) {
+        memset(trace.scratch, 0, sizeof(trace.scratch));
+        Sntp_StageArmed = true;
+    }
+    return rec;
+}
+
+void Sntp_StageStamp( Sntp_Stage_t stage ) {
+    trace.scratch[stage] = now_ns();
+}
+
+void Sntp_StageEnd( Sntp_StageRecord_t *rec, int32_t status ) {
+    if (rec == NULL) {
+        return;
+    }
+    rec->ns[SNTP_STAGE_PARSE] = trace.scratch[SNTP_STAGE_PARSE];
+    rec->ns[SNTP_STAGE_TIME_READ] = trace.scratch[SNTP_STAGE_TIME_READ];
+    rec->ns[SNTP_STAGE_SEND] = ( status == SntpSuccess ) ? now_ns() : 0;
+    rec->status = status;
+    if (trace.pending > 0 && --trace.pending == 0) {
+        Sntp_StageArmed = false;
+    }
+}
+
+int Sntp_StageWrite( FILE *out ) {
+    uint64_t first = ( trace.recorded > SNTP_STAGE_RING ) ? trace.recorded - SNTP_STAGE_RING : 0;
+    char addr[INET_ADDRSTRLEN];
+    int written = 0;
+
+    fprintf(out, "seq,addr,port,len,status,kernel_rx_ns");
+    for (int s = SNTP_STAGE_USER_RX; s < SNTP_STAGE_COUNT; s++) {
+        fprintf(out, ",%s", stageNames[s]);
+    }
+    fprintf(out, "\n");
+
+    for (uint64_t i = first; i < trace.recorded; i++) {
+        const Sntp_StageRecord_t *rec = &trace.ring[i % SNTP_STAGE_RING];
+        struct in_addr in = { .s_addr = rec->addr };
+        uint64_t base = ( rec->ns[SNTP_STAGE_KERNEL_RX] != 0 ) ? rec->ns[SNTP_STAGE_KERNEL_RX]
+                                                               : rec->ns[SNTP_STAGE_USER_RX];
+
+        inet_ntop(AF_INET, &in, addr, sizeof(addr));
+        fprintf(out, "%llu,%s,%u,%u,%d,%llu", (unsigned long long)rec->seq, addr, ntohs(rec->port), rec->len,
+                rec->status, (unsigned long long)rec->ns[SNTP_STAGE_KERNEL_RX]);
+        for (int s = SNTP_STAGE_USER_RX; s < SNTP_STAGE_COUNT; s++) {
+            fprintf(out, ",%lld", ( rec->ns[s] != 0 ) ? (long long)( rec->ns[s] - base ) : -1LL);
+        }
+        fprintf(out, "\n");
+        written++;
+    }
+
+    return ( fflush(out) == 0 && !ferror(out) ) ? written : -1;
+}
@@ -0,0 +1,86 @@
+#ifndef __SNTP_STAGE__
+#define __SNTP_STAGE__
+
+/**
+ * Sampled per-request stage tracing.
+ *
+ * One request in N is followed through the serving path.  Its stages are
+ * stamped with CLOCK_REALTIME nanoseconds, the clock of the kernel receive
+ * timestamp, and kept in a preallocated ring of the last SNTP_STAGE_RING
+ * sampled requests.  Histograms show how often requests are slow; the
+ * ring shows where a particular slow request spent its time.
+ *
+ * A request that is not sampled costs a countdown in Sntp_StageBegin() and
+ * a flag test at each Sntp_StageMark().  The engine marks the deserialize
+ * and time read stages without knowing which request is sampled.  The marks
+ * go to scratch stamps, which every sampled request still pending copies
+ * when it ends.  A batch is therefore traced as one unit: a sampled request
+ * in it shows when the batch was deserialized and when its time was read.
+ * The batch kernel validates requests after the transmit time is read, so
+ * in batches the time read comes before the deserialize stage.
+ *
+ * Not thread safe: begin, mark, end and write from the serving task.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+
+#ifndef SNTP_STAGE_RING
+#define SNTP_STAGE_RING 1024
+#endif
+
+typedef enum {
+    SNTP_STAGE_KERNEL_RX, /**< Kernel receive timestamp, 0 if the socket gave none */
+    SNTP_STAGE_USER_RX,   /**< Datagram returned to the serving task */
+    SNTP_STAGE_PARSE,     /**< Request deserialized (batch: responses built by the kernel) */
+    SNTP_STAGE_TIME_READ, /**< Transmit timestamp read */
+    SNTP_STAGE_SEND,      /**< Response handed to the socket */
+    SNTP_STAGE_COUNT
+} Sntp_Stage_t;
+
+typedef struct {
+    uint64_t seq;                    /**< Request number among those received, counting from 1 */
+    uint64_t ns[SNTP_STAGE_COUNT];   /**< CLOCK_REALTIME nanoseconds, 0 if the stage was not reached */
+    uint32_t addr;                   /**< Client address, network byte order */
+    uint16_t port;                   /**< Client port, network byte order */
+    uint16_t len;                    /**< Request length */
+    int32_t  status;                 /**< SntpStatus_t of the request */
+} Sntp_StageRecord_t;
+
+/* Scratch stamps are only taken while a sampled request is pending */
+extern bool Sntp_StageArmed;
+
+/** Sample one request in every sampleEvery, 0 to stop sampling; the ring is kept */
+void Sntp_StageConfigure( uint32_t sampleEvery );
+
+/** Count a request to be answered, and start a record if it is sampled
+ * @param [in] kernelRx - Kernel receive timestamp, zero if none
+ * @param [in] addr, port - Client, network byte order
+ * @return Record to pass to Sntp_StageEnd(), or NULL if the request is not sampled
+ */
+Sntp_StageRecord_t *Sntp_StageBegin( const struct timespec *kernelRx, uint32_t addr, uint16_t port, uint32_t len );
+
+/** Stamp a shared stage in the scratch stamps; call only through Sntp_StageMark() */
+void Sntp_StageStamp( Sntp_Stage_t stage );
+
+static inline void Sntp_StageMark( Sntp_Stage_t stage ) {
+    if (Sntp_StageArmed) {
+        Sntp_StageStamp(stage);
+    }
+}
+
+/** Finish a sampled request once its response is sent, or it failed
+ * @param [in] rec - Record from Sntp_StageBegin(); NULL is ignored
+ * @param [in] status - Result; the send stage is stamped only for SntpSuccess
+ */
+void Sntp_StageEnd( Sntp_StageRecord_t *rec, int32_t status );
+
+/** Write the ring, oldest first, as CSV; stage columns are nanoseconds after kernel receive
+ *  (after user receive when there is no kernel timestamp), -1 for stages not reached
+ * @return Number of records written, or -1 with errno set
+ */
+int Sntp_StageWrite( FILE *out );
+
+#endif
@@ -0,0 +1,80 @@
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "sntp_statlog.h"
+
+/* A record must never straddle the header, and readers rely on the layout */
+_Static_assert(sizeof(Sntp_StatLogHeader_t) == 64, "statistics log header layout");
+_Static_assert(sizeof(Sntp_StatRecord_t) == 64, "statistics log record layout");
+
+static bool header_matches( const Sntp_StatLogHeader_t *hdr, uint32_t capacity ) {
+    return hdr->magic == SNTP_STATLOG_MAGIC && hdr->version == SNTP_STATLOG_VERSION &&
+           hdr->recordSize == sizeof(Sntp_StatRecord_t) && hdr->capacity == capacity;
+}
+
+int Sntp_StatLogOpen( Sntp_StatLog_t *log, const char *path, uint32_t capacity ) {
+    size_t len = sizeof(Sntp_StatLogHeader_t) + (size_t)capacity * sizeof(Sntp_StatRecord_t);
+    struct stat st;
+    void *map;
+    int fd;
+
+    memset(log, 0, sizeof(*log));
+    if (capacity == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    if (fstat(fd, &st) != 0 || ( (size_t)st.st_size != len && ftruncate(fd, (off_t)len) != 0 )) {
+        close(fd);
+        return -1;
+    }
+    map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd); // The mapping keeps the file open
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+
+    log->hdr = map;
+    log->records = (Sntp_StatRecord_t *)( log->hdr + 1 );
+    log->mapLen = len;
+    if (!header_matches(log->hdr, capacity)) {
+        // A new file, or one from another build or capacity: start an empty log
+        memset(map, 0, len);
+        log->hdr->magic = SNTP_STATLOG_MAGIC;
+        log->hdr->version = SNTP_STATLOG_VERSION;
+        log->hdr->recordSize = sizeof(Sntp_StatRecord_t);
+        log->hdr->capacity = capacity;
+    }
+    return 0;
+}
+
+void Sntp_StatLogAppend( Sntp_StatLog_t *log, Sntp_StatRecord_t *rec ) {
+    uint64_t written;
+
+    if (log->hdr == NULL) {
+        return;
+    }
+    written = log->hdr->written;
+    rec->seq = written + 1;
+    log->records[written % log->hdr->capacity] = *rec;
+    // Publish the count only after the record, so a concurrent reader never counts a half-written slot
+    __atomic_store_n(&log->hdr->written, written + 1, __ATOMIC_RELEASE);
+}
+
+void Sntp_StatLogClose( Sntp_StatLog_t *log ) {
+    if (log->hdr == NULL) {
+        return;
+    }
+    msync(log->hdr, log->mapLen, MS_ASYNC);
+    munmap(log->hdr, log->mapLen);
+    log->hdr = NULL;
+    log->records = NULL;
+}
@@ -0,0 +1,72 @@
+#ifndef __SNTP_STATLOG__
+#define __SNTP_STATLOG__
+
+/**
+ * Memory-mapped circular statistics log.
+ *
+ * One fixed-size record per second of service: load, errors, drops, wake
+ * latency percentiles and clock state.  The log file is sized once and mapped
+ * shared, so appending a record is a store into the page cache; the kernel
+ * writes dirty pages back on its own schedule, and no system call is made
+ * per record.  The file therefore keeps the last `capacity` seconds across
+ * housekeeping gaps and restarts: an existing log with the same layout is
+ * appended to rather than cleared.
+ *
+ * Records are in the writer's byte order; the header magic tells a reader
+ * which.  Each record carries its sequence number, so a reader copying a
+ * live log can recognise slots overwritten while it read them.
+ * tools/statlog_convert.c turns a log into CSV or ntpd sysstats lines.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SNTP_STATLOG_MAGIC   0x534e5453U /* "SNTS" in the writer's byte order */
+#define SNTP_STATLOG_VERSION 1
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t recordSize; /**< sizeof(Sntp_StatRecord_t) */
+    uint32_t capacity;   /**< Records the file holds */
+    uint32_t reserved;
+    uint64_t written;    /**< Records appended since the log was created; the next goes to slot written % capacity */
+    uint8_t  pad[40];    /**< Keeps the records 64-byte aligned */
+} Sntp_StatLogHeader_t;
+
+/** One second of service; all fields are 32 or 64 bits so a reader can byte-swap them blindly */
+typedef struct {
+    uint64_t seq;           /**< 1 for the first record of the log; a slot not holding the expected value is stale */
+    uint64_t time;          /**< UTC at the end of the second, NTP seconds and 2^-32 fractions */
+    uint32_t requests;      /**< Requests answered */
+    uint32_t badRequests;   /**< Malformed or invalid requests */
+    uint32_t authFailures;  /**< Requests dropped by symmetric-key or NTS authentication */
+    uint32_t shed;          /**< Requests shed under overload */
+    uint32_t kernelDrops;   /**< Datagrams the kernel dropped with the receive buffer full */
+    uint32_t wakeP50Us;     /**< Median packet arrival to task wake latency, upper bound of its log2 bucket */
+    uint32_t wakeP99Us;     /**< 99th percentile wake latency, likewise */
+    uint32_t wakeMaxUs;     /**< Upper bound of the highest bucket reached in the second */
+    int32_t  smearUs;       /**< Leap smear correction applied to UTC */
+    uint32_t timeSource;    /**< Sntp_TimeSrc_t being served */
+    uint32_t leapIndicator; /**< Leap indicator in responses */
+    uint32_t shedLevel;     /**< Load shedding level at the end of the second */
+} Sntp_StatRecord_t;
+
+typedef struct {
+    Sntp_StatLogHeader_t *hdr;     /**< NULL while the log is closed */
+    Sntp_StatRecord_t    *records;
+    size_t                mapLen;
+} Sntp_StatLog_t;
+
+/** Map a log file, creating or resizing it for capacity records if it does not already hold such a log
+ * @return 0, or -1 with errno set (EINVAL for a zero capacity)
+ */
+int Sntp_StatLogOpen( Sntp_StatLog_t *log, const char *path, uint32_t capacity );
+
+/** Append a record, overwriting the oldest once the log is full; rec->seq is filled in. Does nothing if closed. */
+void Sntp_StatLogAppend( Sntp_StatLog_t *log, Sntp_StatRecord_t *rec );
+
+/** Schedule write-back and unmap */
+void Sntp_StatLogClose( Sntp_StatLog_t *log );
+
+#endif
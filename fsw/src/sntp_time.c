@@ -0,0 +1,442 @@
+#include <string.h>
+#include <time.h>
+#include <sys/timex.h>
+
+#ifdef SNTP_USE_CFE_TIME
+#include "cfe.h"
+#endif
+
+#include "sntp_time.h"
+#include "sntp_utils.h"
+
+#ifndef CLOCK_TAI
+#define CLOCK_TAI 11
+#endif
+
+#ifndef SNTP_CFE_EPOCH_NTP_SECS
+#define SNTP_CFE_EPOCH_NTP_SECS SNTP_TIME_AT_UNIX_EPOCH_SECS /* NTP seconds at CFE_MISSION_TIME_EPOCH */
+#endif
+
+#define CALIBRATE_BATCH     32
+#define CALIBRATE_BATCHES   31
+#define CALIBRATE_MAX_NS    20000000ULL /* Wait at most this long for a coarse clock to step */
+
+#define SMEAR_MAX_SECS      604800 /* Keeps the window and segment arithmetic within 64 bits */
+#define SMEAR_SLOPE_BITS    62     /* Fraction bits of a segment slope; the steepest smooth smear is 1.5 s/s */
+
+typedef bool ( *read_fn )( SntpTimestamp_t *t );
+
+static const char *const scaleNames[SNTP_SCALE_COUNT] = { "utc", "tai", "met" };
+
+/* Added to a reading of the selected source to get each timescale, in 2^-32 s units */
+static int64_t scaleOffsets[SNTP_SCALE_COUNT];
+
+/* Selects the timescales the smear applies to */
+static const int64_t smearMask[SNTP_SCALE_COUNT] = { [SNTP_SCALE_UTC] = -1 };
+
+static const char *const smearNames[SNTP_SMEAR_SHAPE_COUNT] = { "none", "linear", "smooth" };
+
+typedef struct {
+    int64_t offset; /**< Correction at the start of the segment, 2^-32 s */
+    int64_t slope;  /**< Change in correction per 2^-32 s, with SMEAR_SLOPE_BITS fraction bits */
+} smear_seg_t;
+
+/* Scheduled leap second; all zero when none is scheduled, which makes the smear 0 */
+static struct {
+    uint32_t          leapSecs;   /**< UTC instant of the leap, NTP seconds */
+    int8_t            direction;
+    Sntp_SmearShape_t shape;
+    uint8_t           indicator;  /**< Leap indicator for outgoing packets */
+    int64_t           leapCount;  /**< TAI - UTC when the leap was scheduled, 2^-32 s */
+    uint64_t          start;      /**< Raw source reading at the start of the smear window */
+    int64_t           span;       /**< Window length, 2^-32 s */
+    uint32_t          shift;      /**< log2 of the segment length in 2^-32 s */
+    smear_seg_t       seg[SNTP_SMEAR_SEGMENTS];
+} leap;
+
+static uint64_t to_ntp64( const SntpTimestamp_t *t ) {
+    return ( (uint64_t)t->seconds << 32 ) | t->fractions;
+}
+
+static bool read_clock( clockid_t id, SntpTimestamp_t *t ) {
+    struct timespec ts;
+
+    if (clock_gettime(id, &ts) != 0) {
+        return false;
+    }
+    t->seconds = (uint32_t)ts.tv_sec + SNTP_TIME_AT_UNIX_EPOCH_SECS;
+    t->fractions = (uint32_t)( ( (uint64_t)ts.tv_nsec << 32 ) / 1000000000U );
+    return true;
+}
+
+static bool read_realtime( SntpTimestamp_t *t ) {
+    return read_clock(CLOCK_REALTIME, t);
+}
+
+static bool read_tai( SntpTimestamp_t *t ) {
+    return read_clock(CLOCK_TAI, t);
+}
+
+#ifdef SNTP_USE_CFE_TIME
+// CFE subseconds are already in units of 2^-32 s, the same as NTP fractions
+static bool read_cfe_utc( SntpTimestamp_t *t ) {
+    CFE_TIME_SysTime_t time = CFE_TIME_GetUTC();
+    t->seconds = time.Seconds + SNTP_CFE_EPOCH_NTP_SECS;
+    t->fractions = time.Subseconds;
+    return true;
+}
+
+static bool read_cfe_tai( SntpTimestamp_t *t ) {
+    CFE_TIME_SysTime_t time = CFE_TIME_GetTAI();
+    t->seconds = time.Seconds + SNTP_CFE_EPOCH_NTP_SECS;
+    t->fractions = time.Subseconds;
+    return true;
+}
+#endif
+
+#ifdef SNTP_USE_CFE_TIME
+/** TAI = UTC + leap seconds; TAI = MET + STCF */
+static void offsets_cfe( Sntp_TimeScale_t base, int64_t off[SNTP_SCALE_COUNT] ) {
+    CFE_TIME_SysTime_t stcf = CFE_TIME_GetSTCF();
+    int64_t leap = (int64_t)CFE_TIME_GetLeapSeconds() << 32;
+    int64_t tai = ( base == SNTP_SCALE_UTC ) ? leap : 0;
+
+    off[SNTP_SCALE_UTC] = tai - leap;
+    off[SNTP_SCALE_TAI] = tai;
+    off[SNTP_SCALE_MET] = tai - (int64_t)( ( (uint64_t)stcf.Seconds << 32 ) | stcf.Subseconds ) -
+                          ( (int64_t)SNTP_CFE_EPOCH_NTP_SECS << 32 );
+}
+#endif
+
+/** Kernel TAI offset from adjtimex; MET is CLOCK_MONOTONIC */
+static void offsets_system( clockid_t id, Sntp_TimeScale_t base, int64_t off[SNTP_SCALE_COUNT] ) {
+    struct timex tx = { .modes = 0 };
+    struct timespec mono, now;
+    int64_t leap = ( adjtimex(&tx) >= 0 ) ? (int64_t)tx.tai << 32 : 0;
+    int64_t tai = ( base == SNTP_SCALE_UTC ) ? leap : 0;
+    uint64_t mono64, now64;
+
+    clock_gettime(CLOCK_MONOTONIC, &mono);
+    clock_gettime(id, &now);
+    mono64 = ( (uint64_t)mono.tv_sec << 32 ) + ( ( (uint64_t)mono.tv_nsec << 32 ) / 1000000000U );
+    now64 = ( (uint64_t)( now.tv_sec + SNTP_TIME_AT_UNIX_EPOCH_SECS ) << 32 ) +
+            ( ( (uint64_t)now.tv_nsec << 32 ) / 1000000000U );
+
+    off[SNTP_SCALE_UTC] = tai - leap;
+    off[SNTP_SCALE_TAI] = tai;
+    off[SNTP_SCALE_MET] = (int64_t)( mono64 - now64 );
+}
+
+static void offsets_realtime( Sntp_TimeScale_t base, int64_t off[SNTP_SCALE_COUNT] ) {
+    offsets_system(CLOCK_REALTIME, base, off);
+}
+
+static void offsets_tai( Sntp_TimeScale_t base, int64_t off[SNTP_SCALE_COUNT] ) {
+    offsets_system(CLOCK_TAI, base, off);
+}
+
+static struct {
+    read_fn            read;
+    void ( *offsets )( Sntp_TimeScale_t base, int64_t off[SNTP_SCALE_COUNT] );
+    Sntp_TimeScale_t   scale; /**< Timescale the source reads in */
+    Sntp_TimeSrcInfo_t info;
+} sources[SNTP_TIME_SRC_COUNT] = {
+#ifdef SNTP_USE_CFE_TIME
+    [SNTP_TIME_SRC_CFE_UTC]  = { read_cfe_utc, offsets_cfe, SNTP_SCALE_UTC, { .name = "cfe-utc", .available = true } },
+    [SNTP_TIME_SRC_CFE_TAI]  = { read_cfe_tai, offsets_cfe, SNTP_SCALE_TAI, { .name = "cfe-tai", .available = true } },
+#else
+    [SNTP_TIME_SRC_CFE_UTC]  = { NULL, NULL, SNTP_SCALE_UTC, { .name = "cfe-utc", .available = false } },
+    [SNTP_TIME_SRC_CFE_TAI]  = { NULL, NULL, SNTP_SCALE_TAI, { .name = "cfe-tai", .available = false } },
+#endif
+    [SNTP_TIME_SRC_REALTIME] = { read_realtime, offsets_realtime, SNTP_SCALE_UTC, { .name = "realtime", .available = true } },
+    [SNTP_TIME_SRC_TAI]      = { read_tai, offsets_tai, SNTP_SCALE_TAI, { .name = "tai", .available = true } },
+};
+
+#ifdef SNTP_USE_CFE_TIME
+static Sntp_TimeSrc_t selected = SNTP_TIME_SRC_CFE_UTC;
+#else
+static Sntp_TimeSrc_t selected = SNTP_TIME_SRC_REALTIME;
+#endif
+
+static uint64_t mono_ns( void ) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void calibrate( read_fn read, Sntp_TimeSrcInfo_t *info ) {
+    uint64_t batchNs[CALIBRATE_BATCHES];
+    uint64_t minStep = UINT64_MAX, prev, cur, start;
+    SntpTimestamp_t t;
+    int b, i, j;
+
+    if (!read(&t)) {
+        info->available = false;
+        return;
+    }
+    prev = to_ntp64(&t);
+    start = mono_ns();
+    for (b = 0; b < CALIBRATE_BATCHES; b++) {
+        uint64_t batchStart = mono_ns();
+        for (i = 0; i < CALIBRATE_BATCH; i++) {
+            read(&t);
+            cur = to_ntp64(&t);
+            if (cur > prev && cur - prev < minStep) {
+                minStep = cur - prev;
+            }
+            prev = cur;
+        }
+        batchNs[b] = mono_ns() - batchStart;
+    }
+
+    // A coarse clock may not have stepped during the timed batches
+    while (minStep == UINT64_MAX && mono_ns() - start < CALIBRATE_MAX_NS) {
+        read(&t);
+        cur = to_ntp64(&t);
+        if (cur > prev) {
+            minStep = cur - prev;
+        }
+    }
+    if (minStep == UINT64_MAX) {
+        minStep = ( CALIBRATE_MAX_NS << 32 ) / 1000000000ULL;
+    }
+
+    // Median batch, so a preemption during calibration does not skew the cost
+    for (i = 1; i < CALIBRATE_BATCHES; i++) {
+        uint64_t v = batchNs[i];
+        for (j = i; j > 0 && batchNs[j - 1] > v; j--) {
+            batchNs[j] = batchNs[j - 1];
+        }
+        batchNs[j] = v;
+    }
+    info->costNs = (uint32_t)( batchNs[CALIBRATE_BATCHES / 2] / CALIBRATE_BATCH );
+    info->resolutionNs = (uint32_t)( ( minStep * 1000000000ULL ) >> 32 );
+    if (info->resolutionNs == 0) {
+        info->resolutionNs = 1;
+    }
+    for (b = 0; b < 63 && ( 1ULL << b ) < minStep; b++) {
+    }
+    info->precision = (int8_t)( b - 32 );
+}
+
+void Sntp_TimeCalibrate( void ) {
+    for (int i = 0; i < SNTP_TIME_SRC_COUNT; i++) {
+        if (sources[i].info.available) {
+            calibrate(sources[i].read, &sources[i].info);
+        }
+    }
+    Sntp_TimeRefreshOffsets();
+}
+
+SntpStatus_t Sntp_TimeSelect( Sntp_TimeSrc_t src ) {
+    // A smear table is keyed on TAI readings, so it cannot carry over to a UTC source
+    if ((unsigned)src >= SNTP_TIME_SRC_COUNT || !sources[src].info.available ||
+        ( leap.shape != SNTP_SMEAR_NONE && sources[src].scale != SNTP_SCALE_TAI )) {
+        return SntpErrorBadParameter;
+    }
+    selected = src;
+    Sntp_TimeRefreshOffsets();
+    return SntpSuccess;
+}
+
+Sntp_TimeSrc_t Sntp_TimeSelected( void ) {
+    return selected;
+}
+
+Sntp_TimeSrc_t Sntp_TimeFind( const char *name ) {
+    int i;
+    for (i = 0; i < SNTP_TIME_SRC_COUNT && strcmp(sources[i].info.name, name) != 0; i++) {
+    }
+    return (Sntp_TimeSrc_t)i;
+}
+
+const Sntp_TimeSrcInfo_t *Sntp_TimeInfo( Sntp_TimeSrc_t src ) {
+    return &sources[src].info;
+}
+
+int8_t Sntp_TimePrecision( void ) {
+    return sources[selected].info.precision;
+}
+
+void Sntp_TimeRead( SntpTimestamp_t *t ) {
+    if (!sources[selected].read(t)) {
+        t->seconds = 0;
+        t->fractions = 0;
+    }
+}
+
+/** Smear correction for a raw source reading: clamp to the window, index by the high bits, interpolate */
+static inline int64_t smear_at( uint64_t raw ) {
+    int64_t dt = (int64_t)( raw - leap.start );
+    const smear_seg_t *seg;
+
+    dt = ( dt < 0 ) ? 0 : dt;
+    dt = ( dt > leap.span ) ? leap.span : dt;
+    seg = &leap.seg[dt >> leap.shift];
+    return seg->offset + Sntp_MulShift(dt & ( ( (int64_t)1 << leap.shift ) - 1 ), seg->slope, SMEAR_SLOPE_BITS);
+}
+
+/** Correction at dt into the window: the full second times the shape's progress, against the leap */
+static double smear_shape( int64_t dt ) {
+    double x = (double)dt / (double)leap.span;
+    double progress = ( leap.shape == SNTP_SMEAR_SMOOTH ) ? x * x * ( 3 - 2 * x ) : x;
+    return -leap.direction * progress * 4294967296.0;
+}
+
+/** Slope of a segment rising rise over len (> 0): rise * 2^SMEAR_SLOPE_BITS / len rounded up, by long division */
+static int64_t smear_slope( int64_t rise, int64_t len ) {
+    uint64_t mag = ( rise < 0 ) ? -(uint64_t)rise : (uint64_t)rise;
+    uint64_t q = mag / (uint64_t)len;
+    uint64_t r = mag % (uint64_t)len;
+
+    // r < len < 2^63, so doubling it cannot overflow
+    for (int bit = 0; bit < SMEAR_SLOPE_BITS; bit++) {
+        r <<= 1;
+        q <<= 1;
+        if (r >= (uint64_t)len) {
+            r -= (uint64_t)len;
+            q |= 1;
+        }
+    }
+    return ( rise < 0 ) ? -(int64_t)q : (int64_t)( q + ( r != 0 ) );
+}
+
+/** Fill the segment table; segments are the shortest power of two seconds that covers the window */
+static void build_smear( void ) {
+    int64_t offset[SNTP_SMEAR_SEGMENTS + 1];
+
+    leap.shift = 32;
+    while (( leap.span >> leap.shift ) >= SNTP_SMEAR_SEGMENTS) {
+        leap.shift++;
+    }
+    for (int64_t i = 0; i <= SNTP_SMEAR_SEGMENTS; i++) {
+        offset[i] = (int64_t)smear_shape(( ( i << leap.shift ) < leap.span ) ? ( i << leap.shift ) : leap.span);
+    }
+    for (int64_t i = 0; i < SNTP_SMEAR_SEGMENTS; i++) {
+        int64_t t0 = ( ( i << leap.shift ) < leap.span ) ? ( i << leap.shift ) : leap.span;
+        int64_t t1 = ( ( ( i + 1 ) << leap.shift ) < leap.span ) ? ( ( i + 1 ) << leap.shift ) : leap.span;
+
+        // Rounded up, so the floored interpolation lands exactly on the next offset and the window ends on the full second
+        leap.seg[i].offset = offset[i];
+        leap.seg[i].slope = ( t1 > t0 ) ? smear_slope(offset[i + 1] - offset[i], t1 - t0) : 0;
+    }
+}
+
+/** Retire the leap once it is behind us, and keep UTC on the pre-leap count until then */
+static void refresh_leap( int64_t off[SNTP_SCALE_COUNT] ) {
+    int64_t count = off[SNTP_SCALE_TAI] - off[SNTP_SCALE_UTC];
+    SntpTimestamp_t now;
+    uint64_t raw;
+
+    Sntp_TimeRead(&now);
+    raw = to_ntp64(&now);
+    if (leap.shape == SNTP_SMEAR_NONE) {
+        uint32_t utcSecs = (uint32_t)( ( raw + (uint64_t)off[SNTP_SCALE_UTC] ) >> 32 );
+        if (utcSecs >= leap.leapSecs) {
+            memset(&leap, 0, sizeof(leap));
+        } else if (leap.leapSecs - utcSecs <= SNTP_LEAP_ANNOUNCE_SECS) {
+            leap.indicator = ( leap.direction > 0 ) ? 1 : 2;
+        }
+        return;
+    }
+
+    // The source's leap count may be updated before, during or after the window; only the table moves UTC
+    if ((int64_t)( raw - leap.start ) >= leap.span && count == leap.leapCount + ( (int64_t)leap.direction << 32 )) {
+        memset(&leap, 0, sizeof(leap));
+        return;
+    }
+    off[SNTP_SCALE_UTC] = off[SNTP_SCALE_TAI] - leap.leapCount;
+}
+
+void Sntp_TimeRefreshOffsets( void ) {
+    int64_t off[SNTP_SCALE_COUNT];
+
+    sources[selected].offsets(sources[selected].scale, off);
+    if (leap.leapSecs != 0) {
+        refresh_leap(off);
+    }
+    memcpy(scaleOffsets, off, sizeof(scaleOffsets));
+}
+
+SntpStatus_t Sntp_TimeScheduleLeap( uint32_t leapSecs, int8_t direction, Sntp_SmearShape_t shape, uint32_t smearSecs ) {
+    SntpTimestamp_t now;
+
+    if (( direction != 1 && direction != -1 ) || (unsigned)shape >= SNTP_SMEAR_SHAPE_COUNT ||
+        ( shape != SNTP_SMEAR_NONE &&
+          ( smearSecs == 0 || smearSecs > SMEAR_MAX_SECS || sources[selected].scale != SNTP_SCALE_TAI ) )) {
+        return SntpErrorBadParameter;
+    }
+    Sntp_TimeReadScale(SNTP_SCALE_UTC, &now);
+    if (now.seconds >= leapSecs) {
+        return SntpErrorBadParameter;
+    }
+
+    memset(&leap, 0, sizeof(leap));
+    leap.leapSecs = leapSecs;
+    leap.direction = direction;
+    leap.shape = shape;
+    leap.leapCount = scaleOffsets[SNTP_SCALE_TAI] - scaleOffsets[SNTP_SCALE_UTC];
+    if (shape != SNTP_SMEAR_NONE) {
+        // The source reads TAI, which is UTC plus the pre-leap count up to the leap
+        leap.span = (int64_t)smearSecs << 32;
+        leap.start = ( (uint64_t)leapSecs << 32 ) + (uint64_t)leap.leapCount - (uint64_t)( leap.span / 2 );
+        build_smear();
+    }
+    Sntp_TimeRefreshOffsets();
+    return SntpSuccess;
+}
+
+void Sntp_TimeCancelLeap( void ) {
+    memset(&leap, 0, sizeof(leap));
+    Sntp_TimeRefreshOffsets();
+}
+
+uint32_t Sntp_TimeLeapPending( void ) {
+    return leap.leapSecs;
+}
+
+
+uint8_t Sntp_TimeLeapIndicator( void ) {
+    return leap.indicator;
+}
+
+int64_t Sntp_TimeSmearOffset( void ) {
+    SntpTimestamp_t now;
+
+    Sntp_TimeRead(&now);
+    return smear_at(to_ntp64(&now));
+}
+
+const char *Sntp_TimeSmearName( Sntp_SmearShape_t shape ) {
+    return ( (unsigned)shape < SNTP_SMEAR_SHAPE_COUNT ) ? smearNames[shape] : "unknown";
+}
+
+Sntp_SmearShape_t Sntp_TimeSmearFind( const char *name ) {
+    int i;
+    for (i = 0; i < SNTP_SMEAR_SHAPE_COUNT && strcmp(smearNames[i], name) != 0; i++) {
+    }
+    return (Sntp_SmearShape_t)i;
+}
+
+void Sntp_TimeApplyScale( Sntp_TimeScale_t scale, SntpTimestamp_t *t ) {
+    uint64_t raw = to_ntp64(t);
+    uint64_t v = raw + (uint64_t)scaleOffsets[scale] + (uint64_t)( smear_at(raw) & smearMask[scale] );
+    t->seconds = (uint32_t)( v >> 32 );
+    t->fractions = (uint32_t)v;
+}
+
+void Sntp_TimeReadScale( Sntp_TimeScale_t scale, SntpTimestamp_t *t ) {
+    Sntp_TimeRead(t);
+    Sntp_TimeApplyScale(scale, t);
+}
+
+const char *Sntp_TimeScaleName( Sntp_TimeScale_t scale ) {
+    return ( (unsigned)scale < SNTP_SCALE_COUNT ) ? scaleNames[scale] : "unknown";
+}
+
+Sntp_TimeScale_t Sntp_TimeScaleFind( const char *name ) {
+    int i;
+    for (i = 0; i < SNTP_SCALE_COUNT && strcmp(scaleNames[i], name) != 0; i++) {
+    }
+    return (Sntp_TimeScale_t)i;
+}
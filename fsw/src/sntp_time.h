@@ -0,0 +1,136 @@
+#ifndef __SNTP_TIME__
+#define __SNTP_TIME__
+
+/**
+ * Runtime-selectable time sources.
+ *
+ * Every timestamp the server hands out is read through the selected
+ * provider.  Sntp_TimeCalibrate() measures each available provider's read
+ * cost and resolution once at startup.  The resolution of the selected
+ * provider is advertised in the NTP precision field.
+ *
+ * The CFE providers are only built when SNTP_USE_CFE_TIME is defined (the
+ * app build); the standalone tools have the system clocks only.
+ *
+ * Timescales (UTC, TAI, MET) are derived from a single read of the
+ * selected source plus a cached offset, so serving several timescales
+ * costs no extra clock reads.  Offsets come from the CFE leap seconds and
+ * STCF, or from the kernel TAI offset and CLOCK_MONOTONIC for the system
+ * clocks, and are refreshed by Sntp_TimeRefreshOffsets().  MET is served
+ * as elapsed seconds, i.e. MET 0 maps to the start of NTP era 0.
+ *
+ * A scheduled leap second is either announced with the leap indicator
+ * during the preceding day, so clients step with the server, or smeared:
+ * UTC runs slow (or fast) over a window around the leap so that it absorbs
+ * the second without a step, and the leap indicator stays clear.  The smear
+ * is a piecewise-linear table over SNTP_SMEAR_SEGMENTS power-of-two-length
+ * segments, precomputed when the leap is scheduled; per timestamp it costs
+ * a clamp, a table index and a fixed-point multiply, with no division or
+ * data-dependent branch.  The table is keyed on the raw source reading, so
+ * smearing needs a TAI-based source, which does not step at the leap.
+ * Served UTC is held on the pre-leap leap count until the window has passed
+ * and the source's leap count has caught up, whenever the ground updates it.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "core_sntp_serializer.h"
+
+typedef enum {
+    SNTP_TIME_SRC_CFE_UTC  = 0,
+    SNTP_TIME_SRC_CFE_TAI  = 1,
+    SNTP_TIME_SRC_REALTIME = 2, /**< CLOCK_REALTIME (UTC) */
+    SNTP_TIME_SRC_TAI      = 3, /**< CLOCK_TAI; equals UTC unless the kernel TAI offset has been set */
+    SNTP_TIME_SRC_COUNT
+} Sntp_TimeSrc_t;
+
+typedef enum {
+    SNTP_SCALE_UTC = 0,
+    SNTP_SCALE_TAI = 1,
+    SNTP_SCALE_MET = 2,
+    SNTP_SCALE_COUNT
+} Sntp_TimeScale_t;
+
+typedef enum {
+    SNTP_SMEAR_NONE   = 0, /**< Announce with the leap indicator only */
+    SNTP_SMEAR_LINEAR = 1, /**< Constant rate over the window */
+    SNTP_SMEAR_SMOOTH = 2, /**< Smoothstep (3x^2 - 2x^3): the rate changes gradually at both ends */
+    SNTP_SMEAR_SHAPE_COUNT
+} Sntp_SmearShape_t;
+
+#define SNTP_SMEAR_SEGMENTS 32
+#define SNTP_LEAP_ANNOUNCE_SECS 86400 /* Leap indicator is set for this long before an unsmeared leap */
+
+typedef struct {
+    const char *name;
+    bool        available;
+    uint32_t    costNs;       /**< Median cost of one read */
+    uint32_t    resolutionNs; /**< Smallest step seen between consecutive reads */
+    int8_t      precision;    /**< log2 of the resolution in seconds, rounded up */
+} Sntp_TimeSrcInfo_t;
+
+/** Measure read cost and resolution of every available source; call once before serving */
+void Sntp_TimeCalibrate( void );
+
+/** Switch all time reads to src
+ * @return SntpErrorBadParameter if src is unknown or not available in this build
+ */
+SntpStatus_t Sntp_TimeSelect( Sntp_TimeSrc_t src );
+
+Sntp_TimeSrc_t Sntp_TimeSelected( void );
+
+/** Find a source by name ("cfe-utc", "cfe-tai", "realtime", "tai"); returns SNTP_TIME_SRC_COUNT if unknown */
+Sntp_TimeSrc_t Sntp_TimeFind( const char *name );
+
+const Sntp_TimeSrcInfo_t *Sntp_TimeInfo( Sntp_TimeSrc_t src );
+
+/** NTP precision of the selected source (0 until calibrated) */
+int8_t Sntp_TimePrecision( void );
+
+/** Read the selected source as a host-order NTP timestamp */
+void Sntp_TimeRead( SntpTimestamp_t *t );
+
+/** Recompute the cached timescale offsets; call periodically to track leap second, STCF and clock step changes */
+void Sntp_TimeRefreshOffsets( void );
+
+/** Convert a Sntp_TimeRead() value to a timescale in place */
+void Sntp_TimeApplyScale( Sntp_TimeScale_t scale, SntpTimestamp_t *t );
+
+/** Sntp_TimeRead() followed by Sntp_TimeApplyScale() */
+void Sntp_TimeReadScale( Sntp_TimeScale_t scale, SntpTimestamp_t *t );
+
+/** "utc", "tai" or "met" */
+const char *Sntp_TimeScaleName( Sntp_TimeScale_t scale );
+
+/** Find a timescale by name; returns SNTP_SCALE_COUNT if unknown */
+Sntp_TimeScale_t Sntp_TimeScaleFind( const char *name );
+
+/** Schedule a leap second, replacing any already scheduled
+ * @param [in] leapSecs - UTC instant of the leap in NTP seconds, as listed in leap-seconds.list
+ * @param [in] direction - 1 to insert a second, -1 to delete one
+ * @param [in] smearSecs - Smear window, centred on the leap; ignored for SNTP_SMEAR_NONE
+ * @return SntpErrorBadParameter for a bad direction, shape or window, a leap already past,
+ *         or a smear with a source that does not read TAI
+ */
+SntpStatus_t Sntp_TimeScheduleLeap( uint32_t leapSecs, int8_t direction, Sntp_SmearShape_t shape, uint32_t smearSecs );
+
+/** Drop the scheduled leap; a smear in progress is abandoned, stepping UTC back */
+void Sntp_TimeCancelLeap( void );
+
+/** Scheduled leap in NTP seconds, 0 if none */
+uint32_t Sntp_TimeLeapPending( void );
+
+/** Leap indicator for outgoing packets: 1 or 2 while an unsmeared leap is announced, else 0 */
+uint8_t Sntp_TimeLeapIndicator( void );
+
+/** Correction the smear currently adds to UTC, in 2^-32 s units (negative while inserting) */
+int64_t Sntp_TimeSmearOffset( void );
+
+/** "none", "linear" or "smooth" */
+const char *Sntp_TimeSmearName( Sntp_SmearShape_t shape );
+
+/** Find a smear shape by name; returns SNTP_SMEAR_SHAPE_COUNT if unknown */
+Sntp_SmearShape_t Sntp_TimeSmearFind( const char *name );
+
+#endif
@@ -0,0 +1,148 @@
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "sntp_topk.h"
+
+static uint64_t splitmix64( uint64_t *state ) {
+    uint64_t z = ( *state += 0x9e3779b97f4a7c15ULL );
+    z = ( z ^ ( z >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+    z = ( z ^ ( z >> 27 ) ) * 0x94d049bb133111ebULL;
+    return z ^ ( z >> 31 );
+}
+
+static double elapsed_secs( const struct timespec *since ) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)( now.tv_sec - since->tv_sec ) + (double)( now.tv_nsec - since->tv_nsec ) / 1e9;
+}
+
+static void find_min( Sntp_TopK_t *tk ) {
+    uint32_t slot = 0;
+    for (uint32_t i = 1; i < SNTP_TOPK_K; i++) {
+        if (tk->top[i].count < tk->top[slot].count) {
+            slot = i;
+        }
+    }
+    tk->minSlot = slot;
+    tk->minCount = tk->top[slot].count;
+}
+
+static void clear_window( Sntp_TopK_t *tk ) {
+    memset(tk->rows, 0, sizeof(tk->rows));
+    memset(tk->top, 0, sizeof(tk->top));
+    tk->minCount = 0;
+    tk->minSlot = 0;
+    tk->total = 0;
+    clock_gettime(CLOCK_MONOTONIC, &tk->windowStart);
+}
+
+void Sntp_TopKInit( Sntp_TopK_t *tk ) {
+    struct timespec now;
+    uint64_t state;
+
+    memset(tk, 0, sizeof(*tk));
+
+    // Seeds vary per run so that no fixed set of source addresses collides in every row
+    clock_gettime(CLOCK_REALTIME, &now);
+    state = ( (uint64_t)now.tv_sec << 32 ) ^ (uint64_t)now.tv_nsec ^ (uint64_t)(uintptr_t)tk;
+    for (int d = 0; d < SNTP_TOPK_DEPTH; d++) {
+        tk->mul[d] = splitmix64(&state) | 1;
+        tk->add[d] = splitmix64(&state);
+    }
+    clear_window(tk);
+}
+
+void Sntp_TopKUpdate( Sntp_TopK_t *tk, uint32_t addr ) {
+    uint32_t *cell[SNTP_TOPK_DEPTH];
+    uint32_t est = UINT32_MAX;
+    uint32_t i;
+
+    for (int d = 0; d < SNTP_TOPK_DEPTH; d++) {
+        cell[d] = &tk->rows[d][( tk->mul[d] * addr + tk->add[d] ) >> ( 64 - SNTP_TOPK_WIDTH_LOG2 )];
+        est = ( *cell[d] < est ) ? *cell[d] : est;
+    }
+    if (est == UINT32_MAX) {
+        return;
+    }
+
+    // Conservative update: only raise the cells that are below the new estimate.  Stores are
+    // unconditional so the compiler can use conditional moves; the comparisons are unpredictable.
+    est++;
+    for (int d = 0; d < SNTP_TOPK_DEPTH; d++) {
+        *cell[d] = ( *cell[d] < est ) ? est : *cell[d];
+    }
+    tk->total++;
+
+    // An address already in the table always beats the minimum, so most requests stop here
+    if (est <= tk->minCount) {
+        return;
+    }
+    for (i = 0; i < SNTP_TOPK_K; i++) {
+        if (tk->top[i].addr == addr && tk->top[i].count != 0) {
+            break;
+        }
+    }
+    if (i == SNTP_TOPK_K) {
+        i = tk->minSlot;
+        tk->top[i].addr = addr;
+    }
+    tk->top[i].count = est;
+    if (i == tk->minSlot) {
+        find_min(tk);
+    }
+}
+
+bool Sntp_TopKRotateIfDue( Sntp_TopK_t *tk, uint32_t windowSecs ) {
+    if (elapsed_secs(&tk->windowStart) < (double)windowSecs) {
+        return false;
+    }
+    Sntp_TopKReport(tk, &tk->last);
+    clear_window(tk);
+    return true;
+}
+
+void Sntp_TopKReport( const Sntp_TopK_t *tk, Sntp_TopKReport_t *report ) {
+    report->count = 0;
+    report->total = tk->total;
+    report->seconds = elapsed_secs(&tk->windowStart);
+
+    // Insertion sort, largest first; K is small
+    for (uint32_t i = 0; i < SNTP_TOPK_K; i++) {
+        uint32_t j = report->count;
+        if (tk->top[i].count == 0) {
+            continue;
+        }
+        while (j > 0 && report->entries[j - 1].count < tk->top[i].count) {
+            report->entries[j] = report->entries[j - 1];
+            j--;
+        }
+        report->entries[j] = tk->top[i];
+        report->count++;
+    }
+}
+
+static void write_report( FILE *out, const char *name, const Sntp_TopKReport_t *report ) {
+    char addr[INET_ADDRSTRLEN];
+    double secs = ( report->seconds > 0 ) ? report->seconds : 1;
+
+    fprintf(out, "# %s window: %.1fs, %u requests\n", name, report->seconds, report->total);
+    for (uint32_t i = 0; i < report->count; i++) {
+        struct in_addr in = { .s_addr = report->entries[i].addr };
+        inet_ntop(AF_INET, &in, addr, sizeof(addr));
+        fprintf(out, "%s %u %s %u %.1f\n", name, i + 1, addr, report->entries[i].count,
+                report->entries[i].count / secs);
+    }
+}
+
+int Sntp_TopKWrite( const Sntp_TopK_t *tk, FILE *out ) {
+    Sntp_TopKReport_t current;
+
+    Sntp_TopKReport(tk, &current);
+    fprintf(out, "# SNTP top talkers: count-min %ux%u, top %u, counts are upper bounds\n", SNTP_TOPK_DEPTH,
+            SNTP_TOPK_WIDTH, SNTP_TOPK_K);
+    fprintf(out, "# window rank address requests rate_per_s\n");
+    write_report(out, "current", &current);
+    write_report(out, "last", &tk->last);
+
+    return ( fflush(out) == 0 && !ferror(out) ) ? 0 : -1;
+}
@@ -0,0 +1,77 @@
+#ifndef __SNTP_TOPK__
+#define __SNTP_TOPK__
+
+/**
+ * Fixed-memory top-talker tracking.
+ *
+ * Each request's source address is counted in a count-min sketch with
+ * conservative update, and the addresses with the largest estimates are kept
+ * in a small top-K table.  Estimates never undercount and overcount by at
+ * most about e/SNTP_TOPK_WIDTH of the window's requests.  An address whose
+ * estimate does not beat the smallest top-K entry costs only the sketch
+ * update, so the per-request cost stays flat however many clients there are.
+ *
+ * Counts cover a window; rotating the window keeps the finished window's
+ * top-K for reporting and starts an empty sketch.  Not thread safe: update,
+ * rotate and report from the serving task.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+
+#ifndef SNTP_TOPK_K
+#define SNTP_TOPK_K 16
+#endif
+#ifndef SNTP_TOPK_WIDTH_LOG2
+#define SNTP_TOPK_WIDTH_LOG2 10
+#endif
+#define SNTP_TOPK_DEPTH 4
+#define SNTP_TOPK_WIDTH ( 1U << SNTP_TOPK_WIDTH_LOG2 )
+
+typedef struct {
+    uint32_t addr;  /**< IPv4 address, network byte order */
+    uint32_t count; /**< Estimated requests in the window */
+} Sntp_TopKEntry_t;
+
+/** Heaviest addresses of one window, largest first */
+typedef struct {
+    uint32_t         count;
+    uint32_t         total;    /**< Requests counted in the window */
+    double           seconds;  /**< Window length */
+    Sntp_TopKEntry_t entries[SNTP_TOPK_K];
+} Sntp_TopKReport_t;
+
+typedef struct {
+    uint32_t         rows[SNTP_TOPK_DEPTH][SNTP_TOPK_WIDTH];
+    uint64_t         mul[SNTP_TOPK_DEPTH];  /**< Multiply-shift hash parameters per row */
+    uint64_t         add[SNTP_TOPK_DEPTH];
+    Sntp_TopKEntry_t top[SNTP_TOPK_K];  /**< Unordered; count 0 marks a free slot */
+    uint32_t         minCount;          /**< Smallest top[] count, 0 while any slot is free */
+    uint32_t         minSlot;
+    uint32_t         total;
+    struct timespec  windowStart;
+    Sntp_TopKReport_t last;             /**< Most recently completed window */
+} Sntp_TopK_t;
+
+/** Clear all state and pick new hash seeds */
+void Sntp_TopKInit( Sntp_TopK_t *tk );
+
+/** Count one request from addr (network byte order) */
+void Sntp_TopKUpdate( Sntp_TopK_t *tk, uint32_t addr );
+
+/** Finish the window if it is at least windowSecs old, keeping its report in tk->last
+ * @return true if the window was rotated
+ */
+bool Sntp_TopKRotateIfDue( Sntp_TopK_t *tk, uint32_t windowSecs );
+
+/** Sorted snapshot of the window in progress */
+void Sntp_TopKReport( const Sntp_TopK_t *tk, Sntp_TopKReport_t *report );
+
+/** Write the window in progress and the last completed window as text, one address per line
+ * @return 0, or -1 with errno set
+ */
+int Sntp_TopKWrite( const Sntp_TopK_t *tk, FILE *out );
+
+#endif
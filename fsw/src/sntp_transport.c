@@ -0,0 +1,112 @@
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+
+#include "sntp_transport.h"
+
+#define RING_MASK ( SNTP_RING_TRANSPORT_SLOTS - 1 )
+
+static ssize_t sock_recv( Sntp_Transport_t *t, uint8_t *buf, size_t len, struct sockaddr_in *src,
+                          Sntp_RtRxMeta_t *meta ) {
+    Sntp_SockTransport_t *sock = (Sntp_SockTransport_t *)t;
+    socklen_t srcLen = sizeof(*src);
+    ssize_t received;
+
+    // MSG_TRUNC reports the real datagram length so oversized packets are not mistaken for authenticated ones
+    received = Sntp_RtPollRecv(sock->poller, sock->fd, buf, len, MSG_TRUNC, (struct sockaddr *)src, &srcLen, meta);
+    if (received > 0) {
+        int err = errno;
+        Sntp_RtSampleSocket(sock->fd, meta, sock->stats);
+        errno = err;
+    }
+    return received;
+}
+
+static ssize_t sock_send( Sntp_Transport_t *t, const uint8_t *buf, size_t len, const struct sockaddr_in *dst ) {
+    Sntp_SockTransport_t *sock = (Sntp_SockTransport_t *)t;
+    return sendto(sock->fd, buf, len, 0, (const struct sockaddr *)dst, sizeof(*dst));
+}
+
+static const Sntp_TransportOps_t sockOps = { sock_recv, sock_send };
+
+void Sntp_SockTransportInit( Sntp_SockTransport_t *t, int fd, Sntp_RtPoller_t *poller, Sntp_RtSockStats_t *stats ) {
+    t->base.ops = &sockOps;
+    t->fd = fd;
+    t->poller = poller;
+    t->stats = stats;
+}
+
+static ssize_t ring_recv( Sntp_Transport_t *t, uint8_t *buf, size_t len, struct sockaddr_in *src,
+                          Sntp_RtRxMeta_t *meta ) {
+    Sntp_RingTransport_t *ring = (Sntp_RingTransport_t *)t;
+    const Sntp_RingPacket_t *pkt;
+
+    memset(meta, 0, sizeof(*meta));
+    if (ring->rxHead == ring->rxTail) {
+        errno = EAGAIN;
+        return -1;
+    }
+    pkt = &ring->rx[ring->rxTail++ & RING_MASK];
+    memcpy(buf, pkt->data, pkt->len < len ? pkt->len : len);
+    *src = pkt->addr;
+    return pkt->len;
+}
+
+static ssize_t ring_send( Sntp_Transport_t *t, const uint8_t *buf, size_t len, const struct sockaddr_in *dst ) {
+    Sntp_RingTransport_t *ring = (Sntp_RingTransport_t *)t;
+    Sntp_RingPacket_t *pkt;
+
+    if (len > NET_BUF_SIZE) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    // Like a full socket send buffer: the response is lost, not waited on
+    if (ring->txHead - ring->txTail >= SNTP_RING_TRANSPORT_SLOTS) {
+        ring->txDropped++;
+        errno = ENOBUFS;
+        return -1;
+    }
+    pkt = &ring->tx[ring->txHead++ & RING_MASK];
+    memcpy(pkt->data, buf, len);
+    pkt->len = (uint16_t)len;
+    pkt->addr = *dst;
+    return (ssize_t)len;
+}
+
+static const Sntp_TransportOps_t ringOps = { ring_recv, ring_send };
+
+void Sntp_RingTransportInit( Sntp_RingTransport_t *t ) {
+    t->base.ops = &ringOps;
+    t->rxHead = t->rxTail = 0;
+    t->txHead = t->txTail = 0;
+    t->txDropped = 0;
+}
+
+int Sntp_RingTransportInject( Sntp_RingTransport_t *t, const uint8_t *pkt, size_t len, const struct sockaddr_in *src ) {
+    Sntp_RingPacket_t *slot;
+
+    if (len > NET_BUF_SIZE || t->rxHead - t->rxTail >= SNTP_RING_TRANSPORT_SLOTS) {
+        return -1;
+    }
+    slot = &t->rx[t->rxHead++ & RING_MASK];
+    memcpy(slot->data, pkt, len);
+    slot->len = (uint16_t)len;
+    slot->addr = *src;
+    return 0;
+}
+
+ssize_t Sntp_RingTransportTake( Sntp_RingTransport_t *t, uint8_t *buf, size_t len, struct sockaddr_in *dst ) {
+    const Sntp_RingPacket_t *slot;
+
+    if (t->txHead == t->txTail) {
+        return -1;
+    }
+    slot = &t->tx[t->txTail++ & RING_MASK];
+    if (buf != NULL) {
+        memcpy(buf, slot->data, slot->len < len ? slot->len : len);
+    }
+    if (dst != NULL) {
+        *dst = slot->addr;
+    }
+    return slot->len;
+}
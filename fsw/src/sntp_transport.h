@@ -0,0 +1,91 @@
+#ifndef __SNTP_TRANSPORT__
+#define __SNTP_TRANSPORT__
+
+/**
+ * Datagram transport for the request path.
+ *
+ * The serving loop receives requests and sends responses only through a
+ * Sntp_Transport_t, so the same loop can run on the UDP socket or on an
+ * in-memory ring.  The ring lets tests and benchmarks push requests through
+ * the real serving logic deterministically, without kernel noise.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+
+#include "core_sntp_config.h"
+#include "sntp_rt.h"
+
+#ifndef SNTP_RING_TRANSPORT_SLOTS
+#define SNTP_RING_TRANSPORT_SLOTS 256 /* Must be a power of two */
+#endif
+
+typedef struct Sntp_Transport Sntp_Transport_t;
+
+typedef struct {
+    /** Receive one datagram.  Returns its full length, which may exceed len (as with MSG_TRUNC),
+     * or -1 with errno set; EAGAIN or ETIMEDOUT means nothing arrived.
+     */
+    ssize_t ( *recv )( Sntp_Transport_t *t, uint8_t *buf, size_t len, struct sockaddr_in *src, Sntp_RtRxMeta_t *meta );
+    /** Send one datagram; returns the length sent or -1 with errno set */
+    ssize_t ( *send )( Sntp_Transport_t *t, const uint8_t *buf, size_t len, const struct sockaddr_in *dst );
+} Sntp_TransportOps_t;
+
+struct Sntp_Transport {
+    const Sntp_TransportOps_t *ops;
+};
+
+static inline ssize_t Sntp_TransportRecv( Sntp_Transport_t *t, uint8_t *buf, size_t len, struct sockaddr_in *src,
+                                          Sntp_RtRxMeta_t *meta ) {
+    return t->ops->recv(t, buf, len, src, meta);
+}
+
+static inline ssize_t Sntp_TransportSend( Sntp_Transport_t *t, const uint8_t *buf, size_t len,
+                                          const struct sockaddr_in *dst ) {
+    return t->ops->send(t, buf, len, dst);
+}
+
+/*** UDP socket ***/
+
+typedef struct {
+    Sntp_Transport_t    base;
+    int                 fd;
+    Sntp_RtPoller_t    *poller; /**< Adaptive busy-poll state */
+    Sntp_RtSockStats_t *stats;  /**< Drop/backlog counters sampled after each receive */
+} Sntp_SockTransport_t;
+
+/** Wrap a bound UDP socket; receives go through the poller and sample the socket's backlog */
+void Sntp_SockTransportInit( Sntp_SockTransport_t *t, int fd, Sntp_RtPoller_t *poller, Sntp_RtSockStats_t *stats );
+
+/*** In-memory ring (single-threaded) ***/
+
+typedef struct {
+    struct sockaddr_in addr; /**< Source of a request, destination of a response */
+    uint16_t           len;
+    uint8_t            data[NET_BUF_SIZE];
+} Sntp_RingPacket_t;
+
+typedef struct {
+    Sntp_Transport_t  base;
+    uint32_t          rxHead, rxTail; /**< Requests injected / received by the server */
+    uint32_t          txHead, txTail; /**< Responses sent by the server / taken */
+    uint32_t          txDropped;      /**< Responses discarded because the response ring was full */
+    Sntp_RingPacket_t rx[SNTP_RING_TRANSPORT_SLOTS];
+    Sntp_RingPacket_t tx[SNTP_RING_TRANSPORT_SLOTS];
+} Sntp_RingTransport_t;
+
+void Sntp_RingTransportInit( Sntp_RingTransport_t *t );
+
+/** Queue a request for the server to receive
+ * @return 0, or -1 if the request ring is full or len exceeds NET_BUF_SIZE
+ */
+int Sntp_RingTransportInject( Sntp_RingTransport_t *t, const uint8_t *pkt, size_t len, const struct sockaddr_in *src );
+
+/** Take the oldest response the server sent
+ * @return Response length, or -1 if none is queued
+ */
+ssize_t Sntp_RingTransportTake( Sntp_RingTransport_t *t, uint8_t *buf, size_t len, struct sockaddr_in *dst );
+
+#endif
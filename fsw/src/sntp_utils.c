@@ -4,6 +4,7 @@
 
 #include "core_sntp_config.h"
 #include "core_sntp_serializer.h"
+#include "sntp_time.h"
 
 const char* sntp_util_status_to_str(SntpStatus_t status) {
     static const char* SntpStatusStrs[] = {
@@ -36,31 +37,10 @@ const char* sntp_util_status_to_str(SntpStatus_t status) {
 }
 
 
-/*** System Utility Functions - NOTICE: These functions may vary by target system and may be split into a discrete file later ***/
-#if defined(SNTP_USE_CFE_TIME)
-#include "cfe.h"
-
+/*** System Utility Functions - the clock read is delegated to the runtime-selected time source ***/
 void getCurrentSntpTime( SntpTimestamp_t *sntp ) {
-    CFE_TIME_SysTime_t time = CFE_TIME_GetUTC();
-    sntp->seconds = time.Seconds + SNTP_TIME_AT_UNIX_EPOCH_SECS;
-
-    // TODO: VERIFY NTP and CFE subseconds are equivalent
-    //MILLISECONDS_TO_SNTP_FRACTIONS( CFE_TIME_Sub2MicroSecs(time->Subseconds) );
-    sntp->fractions = time.Subseconds;
-}
-#else
-
-void getCurrentSntpTime( SntpTimestamp_t *sntp ) {
-    struct timespec currentTime;
-    if (clock_gettime(CLOCK_REALTIME, &currentTime) == -1) {
-        perror("Error getting current time");
-        return;
-    }
-
-    sntp->seconds = currentTime.tv_sec + SNTP_TIME_AT_UNIX_EPOCH_SECS;
-    sntp->fractions = MILLISECONDS_TO_SNTP_FRACTIONS( currentTime.tv_nsec / 1000000 );
+    Sntp_TimeRead(sntp);
 }
-#endif
 
 /** Sntp Query deserializer
  * @param [in] buf - Input buffer
@@ -1,8 +1,19 @@
 #ifndef __SNTP_UTILS__
 #define __SNTP_UTILS__
 
+#include <stdint.h>
+#include <stdbool.h>
+#include <arpa/inet.h>
+
 #include "core_sntp_serializer.h"
 
+#ifndef SNTP_MODE_BROADCAST
+#define SNTP_MODE_BROADCAST 5U
+#endif
+#ifndef SNTP_MODE_BITS_MASK
+#define SNTP_MODE_BITS_MASK 0x07U
+#endif
+
 const char* sntp_util_status_to_str(SntpStatus_t status);
 void getCurrentSntpTime( SntpTimestamp_t *sntp );
 
@@ -11,6 +22,31 @@ static inline void encodeTime( const SntpTimestamp_t *in, SntpTimestamp_t *out )
     out->fractions = htonl(in->fractions);
 }
 
+/** True for a client-mode request of NTP version 1 to 4, the only requests a server answers */
+static inline bool Sntp_IsClientRequest( uint8_t leapVersionMode ) {
+    uint8_t version = ( leapVersionMode >> SNTP_VERSION_LSB_POSITION ) & 0x07;
+    return ( leapVersionMode & SNTP_MODE_BITS_MASK ) == SNTP_MODE_CLIENT && version >= 1 && version <= 4;
+}
+
+/** floor(a * b / 2^shift) without a 128-bit type, for 0 < shift < 64 and a result that fits in 64 bits */
+static inline int64_t Sntp_MulShift( int64_t a, int64_t b, unsigned int shift ) {
+    uint64_t ua = ( a < 0 ) ? -(uint64_t)a : (uint64_t)a;
+    uint64_t ub = ( b < 0 ) ? -(uint64_t)b : (uint64_t)b;
+    uint64_t ll = ( ua & 0xffffffffU ) * ( ub & 0xffffffffU );
+    uint64_t lh = ( ua & 0xffffffffU ) * ( ub >> 32 );
+    uint64_t hl = ( ua >> 32 ) * ( ub & 0xffffffffU );
+    uint64_t mid = ( ll >> 32 ) + ( lh & 0xffffffffU ) + ( hl & 0xffffffffU );
+    uint64_t lo = ( mid << 32 ) | ( ll & 0xffffffffU );
+    uint64_t hi = ( ua >> 32 ) * ( ub >> 32 ) + ( lh >> 32 ) + ( hl >> 32 ) + ( mid >> 32 );
+    uint64_t q = ( hi << ( 64 - shift ) ) | ( lo >> shift );
+
+    // A negative product rounds away from zero if any bits were shifted out, as an arithmetic shift does
+    if (( a < 0 ) != ( b < 0 )) {
+        return (int64_t)( ~q + ( ( lo & ( ( (uint64_t)1 << shift ) - 1 ) ) == 0 ) );
+    }
+    return (int64_t)q;
+}
+
 SntpStatus_t Sntp_DeserializeRequest( const void * buf,
                                       SntpPacket_t* request    
     );
@@ -0,0 +1,38 @@
+#include "sntp_warm.h"
+
+#define SAME_BOOT_MS 1000 /* Clock read and save skew below which the monotonic clock is taken to have carried on */
+
+void Sntp_WarmSeal( Sntp_WarmHeader_t *hdr, uint32_t version, size_t size, int64_t nowMonoMs, int64_t nowRealMs ) {
+    hdr->version = version;
+    hdr->size = (uint32_t)size;
+    hdr->savedMonoMs = nowMonoMs;
+    hdr->savedRealMs = nowRealMs;
+}
+
+const char *Sntp_WarmCheck( const Sntp_WarmHeader_t *hdr, bool intact, uint32_t version, size_t size ) {
+    if (!intact) {
+        return "unreadable or corrupt";
+    } else if (hdr->version != version) {
+        return "another layout version";
+    } else if (hdr->size != size) {
+        return "another size";
+    }
+    return NULL;
+}
+
+int64_t Sntp_WarmShift( const Sntp_WarmHeader_t *hdr, int64_t nowMonoMs, int64_t nowRealMs, int64_t *elapsedMs ) {
+    int64_t shift;
+
+    *elapsedMs = nowRealMs - hdr->savedRealMs;
+    if (*elapsedMs < 0) {
+        *elapsedMs = 0;
+    }
+    shift = nowMonoMs - *elapsedMs - hdr->savedMonoMs;
+    return ( shift > -SAME_BOOT_MS && shift < SAME_BOOT_MS ) ? 0 : shift;
+}
+
+uint64_t Sntp_WarmShiftMs( uint64_t ms, int64_t shiftMs ) {
+    int64_t shifted = (int64_t)ms + shiftMs;
+
+    return ( ms == 0 ) ? 0 : ( shifted > 0 ) ? (uint64_t)shifted : 1;
+}
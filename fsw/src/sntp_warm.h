@@ -0,0 +1,44 @@
+#ifndef __SNTP_WARM__
+#define __SNTP_WARM__
+
+/**
+ * Checks for a warm start from saved counters and client state.
+ *
+ * The saved block begins with a header giving its layout version and size
+ * and the clocks when it was saved.  A block of another layout, or one the
+ * store could not read back intact, is not used.  The block's timestamps
+ * are CLOCK_MONOTONIC, which starts again when the host reboots;
+ * CLOCK_REALTIME at the save tells a reboot from time simply passing, so
+ * the timestamps can be moved onto the new boot's clock.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct {
+    uint32_t version;     /**< Layout version; a block of another is discarded */
+    uint32_t size;        /**< Size of the whole block, header included */
+    int64_t  savedMonoMs; /**< CLOCK_MONOTONIC when saved */
+    int64_t  savedRealMs; /**< CLOCK_REALTIME when saved */
+} Sntp_WarmHeader_t;
+
+/** Fill in the header of a block about to be saved */
+void Sntp_WarmSeal( Sntp_WarmHeader_t *hdr, uint32_t version, size_t size, int64_t nowMonoMs, int64_t nowRealMs );
+
+/** Check a restored block's header
+ * @param [in] intact - The store read the block back and its CRC matched
+ * @return NULL if the block can be used, or why not
+ */
+const char *Sntp_WarmCheck( const Sntp_WarmHeader_t *hdr, bool intact, uint32_t version, size_t size );
+
+/** Milliseconds to add to the block's CLOCK_MONOTONIC timestamps to put them on the current clock
+ * @param [out] elapsedMs - Wall clock time since the save, 0 if the wall clock went back
+ * @return 0 unless the host rebooted since the save
+ */
+int64_t Sntp_WarmShift( const Sntp_WarmHeader_t *hdr, int64_t nowMonoMs, int64_t nowRealMs, int64_t *elapsedMs );
+
+/** Move a CLOCK_MONOTONIC timestamp by shiftMs, keeping it above zero; zero, which marks an unused slot, stays zero */
+uint64_t Sntp_WarmShiftMs( uint64_t ms, int64_t shiftMs );
+
+#endif
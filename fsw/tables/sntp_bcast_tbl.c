@@ -0,0 +1,36 @@
+/************************************************************************
+ * NASA Docket No. GSC-18,719-1, and identified as “core Flight System: Bootes”
+ *
+ * Copyright (c) 2020 United States Government as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License. You may obtain
+ * a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ************************************************************************/
+
+#include "cfe_tbl_filedef.h" /* Required to obtain the CFE_TBL_FILEDEF macro definition */
+#include "sntp_table.h"
+
+/*
+** Default broadcast table.  No groups are configured, so broadcast mode is
+** off until a mission lists destinations, e.g. .Groups = { "224.0.1.1" }
+** (the IANA NTP multicast group).
+*/
+SNTP_BcastTbl_t SNTP_BcastTbl = { .Groups = { "" }, .Port = 123, .Ttl = 1, .PollExp = 4, .KeyId = 0 };
+
+/*
+** The macro below identifies:
+**    1) the data structure type to use as the table image format
+**    2) the name of the table to be placed into the cFE Table File Header
+**    3) a brief description of the contents of the file image
+**    4) the desired name of the table image binary file that is cFE compatible
+*/
+CFE_TBL_FILEDEF(SNTP_BcastTbl, SNTP.BcastTbl, SNTP Broadcast Destinations, sntp_bcast.tbl)
@@ -0,0 +1,40 @@
+/************************************************************************
+ * NASA Docket No. GSC-18,719-1, and identified as “core Flight System: Bootes”
+ *
+ * Copyright (c) 2020 United States Government as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License. You may obtain
+ * a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ************************************************************************/
+
+#include "cfe_tbl_filedef.h" /* Required to obtain the CFE_TBL_FILEDEF macro definition */
+#include "sntp_table.h"
+
+/*
+** Default control query table.  Only the local host may query, so ntpq
+** works on the server itself; operations networks are added as prefixes,
+** e.g. .Allow = { { "127.0.0.0", 8 }, { "10.20.0.0", 16 } }.  A client gets
+** 2 queries per second with bursts of 8, enough for an interactive ntpq.
+*/
+SNTP_CtlTbl_t SNTP_CtlTbl = { .ClientRate  = 2,
+                              .ClientBurst = 8,
+                              .TotalRate   = 20,
+                              .Allow       = { { "127.0.0.0", 8 } } };
+
+/*
+** The macro below identifies:
+**    1) the data structure type to use as the table image format
+**    2) the name of the table to be placed into the cFE Table File Header
+**    3) a brief description of the contents of the file image
+**    4) the desired name of the table image binary file that is cFE compatible
+*/
+CFE_TBL_FILEDEF(SNTP_CtlTbl, SNTP.CtlTbl, SNTP Control Query Access, sntp_ctl.tbl)
@@ -0,0 +1,43 @@
+/************************************************************************
+ * NASA Docket No. GSC-18,719-1, and identified as “core Flight System: Bootes”
+ *
+ * Copyright (c) 2020 United States Government as represented by the
+ * Administrator of the National Aeronautics and Space Administration.
+ * All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License. You may obtain
+ * a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ************************************************************************/
+
+#include "cfe_tbl_filedef.h" /* Required to obtain the CFE_TBL_FILEDEF macro definition */
+#include "sntp_table.h"
+
+/*
+** Default load shedding table.  Overload starts at 2ms of queueing latency
+** or 128 KB of receive backlog (about half the default buffer).  All listeners serve normal class requests
+** and no prefixes are listed, so only a severe overload sheds anything.
+** Missions list flight consumers as critical and ground tools as best
+** effort, e.g. .Prefixes = { { "192.168.1.0", 24, 0 }, { "10.0.0.0", 8, 2 } }
+*/
+SNTP_ShedTbl_t SNTP_ShedTbl = { .LatencyUs     = 2000,
+                                .QueueBytes    = 131072,
+                                .HoldMs        = 1000,
+                                .Kod           = 1,
+                                .ListenerClass = { 1, 1, 1 },
+                                .Prefixes      = { { "" } } };
+
+/*
+** The macro below identifies:
+**    1) the data structure type to use as the table image format
+**    2) the name of the table to be placed into the cFE Table File Header
+**    3) a brief description of the contents of the file image
+**    4) the desired name of the table image binary file that is cFE compatible
+*/
+CFE_TBL_FILEDEF(SNTP_ShedTbl, SNTP.ShedTbl, SNTP Load Shedding Classes, sntp_shed.tbl)
@@ -0,0 +1,37 @@
+#!/bin/sh
+#
+# Compare two netns_bench.sh reports, e.g. from two server versions.
+#
+# Each row of the second report is matched to the last row of the first
+# with the same link profile and offered rate.  For each pair the
+# loss, delay p50/p99 and |offset| p50/p99 of both reports are printed with
+# the change from the first to the second.
+#
+# Usage: bench_compare.sh <before.csv> <after.csv>
+
+set -eu
+
+if [ $# -ne 2 ]; then
+    sed -n '3,10p' "$0"
+    exit 1
+fi
+
+awk -F, '
+    /^#/ || $1 == "label" { next }
+    # Columns: 1 label, 2 offered_rps, 7 loss_pct, 8 delay_p50_us, 10 delay_p99_us, 13 offset_abs_p50_us, 14 offset_abs_p99_us
+    FNR == NR { before[$1 "," $2] = $7 " " $8 " " $10 " " $13 " " $14; next }
+    ($1 "," $2) in before {
+        if (!printed) {
+            printf "%-8s %8s  %-26s %-26s %-26s %-26s %s\n", "profile", "req/s", "loss %", "delay p50 us",
+                   "delay p99 us", "|offset| p50 us", "|offset| p99 us"
+            printed = 1
+        }
+        split(before[$1 "," $2], b, " ")
+        split($7 " " $8 " " $10 " " $13 " " $14, a, " ")
+        printf "%-8s %8s ", $1, $2
+        for (i = 1; i <= 5; i++) {
+            printf " %8.2f > %-8.2f %+6.1f", b[i], a[i], a[i] - b[i]
+        }
+        printf "\n"
+    }
+' "$1" "$2"
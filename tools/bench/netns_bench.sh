@@ -0,0 +1,137 @@
+#!/bin/sh
+#
+# Accuracy and latency bench over emulated links.
+#
+# Runs sntp_test_server and sntp_load in two network namespaces joined by a
+# veth pair, shapes the link with tc netem, and loads the server at several
+# offered rates per link profile.  Both namespaces share the host clock, so
+# the offset sntp_load measures is the error of the served time across the
+# link.  Every run appends a row to a CSV report, named after the version by
+# default; its header records the version and host.  Compare the reports of
+# two versions with bench_compare.sh.
+#
+# Needs root, iproute2 and, for any profile but "none", the sch_netem module.
+#
+# Usage: netns_bench.sh [-b <build dir>] [-o <report.csv>] [-d <seconds>]
+#                       [-r "<rate> ..."] [-p "<profile> ..."] [-- <server options>]
+#
+# Profiles (delay is applied in each direction unless noted):
+#   none    no shaping
+#   lan     100us +-20us
+#   wan     20ms +-2ms, normal distribution
+#   lossy   50ms +-10ms, 2% loss
+#   asym    10ms server to client only, to show the offset error from path asymmetry
+
+set -eu
+
+BUILD=$(pwd)
+VERSION=$(git -C "$(dirname "$0")" describe --always --dirty 2>/dev/null || echo unknown)
+REPORT=sntp_bench-$VERSION.csv
+DURATION=10
+RATES="100 1000 10000"
+PROFILES="none lan wan lossy asym"
+PORT=123
+
+SRV_NS=sntp-bench-srv
+CLI_NS=sntp-bench-cli
+SRV_IF=sntpb0
+CLI_IF=sntpb1
+SRV_ADDR=10.123.0.1
+CLI_ADDR=10.123.0.2
+
+while getopts "b:o:d:r:p:" opt; do
+    case $opt in
+        b) BUILD=$OPTARG ;;
+        o) REPORT=$OPTARG ;;
+        d) DURATION=$OPTARG ;;
+        r) RATES=$OPTARG ;;
+        p) PROFILES=$OPTARG ;;
+        *) sed -n '3,23p' "$0"; exit 1 ;;
+    esac
+done
+shift $((OPTIND - 1))
+
+for tool in sntp_test_server sntp_load; do
+    if [ ! -x "$BUILD/$tool" ]; then
+        echo "$BUILD/$tool not found; build tools/ and pass the build directory with -b" >&2
+        exit 1
+    fi
+done
+
+SERVER_PID=
+cleanup() {
+    if [ -n "$SERVER_PID" ]; then
+        kill "$SERVER_PID" 2>/dev/null || true
+        wait "$SERVER_PID" 2>/dev/null || true
+    fi
+    ip netns del $SRV_NS 2>/dev/null || true
+    ip netns del $CLI_NS 2>/dev/null || true
+}
+trap cleanup EXIT INT TERM
+
+# Start from a clean slate in case an earlier run was killed
+cleanup
+ip netns add $SRV_NS
+ip netns add $CLI_NS
+ip link add $SRV_IF type veth peer name $CLI_IF
+ip link set $SRV_IF netns $SRV_NS
+ip link set $CLI_IF netns $CLI_NS
+ip -n $SRV_NS addr add $SRV_ADDR/24 dev $SRV_IF
+ip -n $CLI_NS addr add $CLI_ADDR/24 dev $CLI_IF
+ip -n $SRV_NS link set $SRV_IF up
+ip -n $CLI_NS link set $CLI_IF up
+ip -n $SRV_NS link set lo up
+ip -n $CLI_NS link set lo up
+
+# shape <namespace> <interface> [netem options]; no options removes the shaping
+shape() {
+    ip netns exec "$1" tc qdisc del dev "$2" root 2>/dev/null || true
+    if [ $# -gt 2 ]; then
+        ns=$1 dev=$2
+        shift 2
+        if ! ip netns exec "$ns" tc qdisc add dev "$dev" root netem "$@"; then
+            echo "tc netem is not available (modprobe sch_netem); only the 'none' profile can run" >&2
+            exit 1
+        fi
+    fi
+}
+
+apply_profile() {
+    case $1 in
+        none)  shape $SRV_NS $SRV_IF; shape $CLI_NS $CLI_IF ;;
+        lan)   shape $SRV_NS $SRV_IF delay 100us 20us; shape $CLI_NS $CLI_IF delay 100us 20us ;;
+        wan)   shape $SRV_NS $SRV_IF delay 20ms 2ms distribution normal
+               shape $CLI_NS $CLI_IF delay 20ms 2ms distribution normal ;;
+        lossy) shape $SRV_NS $SRV_IF delay 50ms 10ms loss 2%; shape $CLI_NS $CLI_IF delay 50ms 10ms loss 2% ;;
+        asym)  shape $SRV_NS $SRV_IF delay 10ms; shape $CLI_NS $CLI_IF ;;
+        *)     echo "Unknown profile: $1" >&2; exit 1 ;;
+    esac
+}
+
+if [ ! -s "$REPORT" ]; then
+    {
+        echo "# sntp netns bench"
+        echo "# version: $VERSION"
+        echo "# host: $(uname -srm), $(nproc) cpus, $(date -u +%Y-%m-%dT%H:%M:%SZ)"
+        echo "# duration: ${DURATION}s per run, server options: $*"
+    } > "$REPORT"
+fi
+
+ip netns exec $SRV_NS "$BUILD/sntp_test_server" -p $PORT "$@" > /dev/null 2>&1 &
+SERVER_PID=$!
+sleep 0.5
+if ! kill -0 $SERVER_PID 2>/dev/null; then
+    echo "Server failed to start" >&2
+    exit 1
+fi
+
+for profile in $PROFILES; do
+    apply_profile "$profile"
+    for rate in $RATES; do
+        echo "== $profile, $rate req/s"
+        ip netns exec $CLI_NS "$BUILD/sntp_load" -u $SRV_ADDR:$PORT -r "$rate" -d "$DURATION" \
+            -l "$profile" -o "$REPORT"
+    done
+done
+
+echo "Report: $REPORT"
@@ -20,11 +20,19 @@
 #include "core_sntp_serializer.h"
 #include "core_sntp_config.h"
 #include "sntp_utils.h"
+#include "sntp_auth.h"
+#include "sntp_ext.h"
+#ifdef SNTP_ENABLE_NTS
+#include <openssl/rand.h>
+#include <openssl/err.h>
+#include "sntp_nts.h"
+#endif
 
 // Glboals
 uint8_t netBuf[NET_BUF_SIZE];
 int sockfd = -1;
 struct sockaddr_in serverAddr; // We will only support a single server in this implementation, cache it
+Sntp_AuthKeySet_t authKeys; // Holds at most one key; if present every request is authenticated
 
 // Command-line Argument Parsing
 typedef struct {
@@ -32,13 +40,23 @@ typedef struct {
     char serverIP[64];
     uint16_t port;
     uint16_t client_port;
+    uint32_t count;
+    uint16_t nts_port;
+    char nts_ca[256];
+    char listen_addr[64];
+    uint32_t uid_len;
 } client_args_t;
 
 client_args_t client_args = {
     .serverName = "localhost",
     .serverIP = "127.0.0.1",
     .port = 123,
-    .client_port = 0
+    .client_port = 0,
+    .count = 1,
+    .nts_port = 0,
+    .nts_ca = "",
+    .listen_addr = "",
+    .uid_len = 0
 };
 
 // Function to parse command-line arguments and override struct values
@@ -49,6 +67,14 @@ void printUsage(void) {
     printf("  -ip, --ip <server_ip>        Set the server IP (default: 127.0.0.1)\n");
     printf("  -p, --port <port_number>     Set the server port (default: 123)\n");
     printf("  -cp, --client-port <client_port_number> Set the client port (default: 0)\n");
+    printf("  -k, --key <keyid>:<hexkey>   Authenticate the request with this key\n");
+    printf("  -u, --uid <bytes>            Attach a Unique Identifier extension field of 32-64 bytes\n");
+    printf("  -c, --count <queries>        Number of queries to send (default: 1)\n");
+    printf("  -l, --listen <ip>            Listen on --port for broadcast/multicast (mode 5) packets to this address\n");
+#ifdef SNTP_ENABLE_NTS
+    printf("  -n, --nts <ke_port>          Use NTS, running NTS-KE against this port (typically 4460)\n");
+    printf("  --nts-ca <pem_file>          Trust anchor for the NTS-KE certificate (default: system store)\n");
+#endif
     printf("  --help                       Display this help message\n");
 }
 void parseCommandLineArgs(int argc, char* argv[]) {
@@ -65,6 +91,32 @@ void parseCommandLineArgs(int argc, char* argv[]) {
                 client_args.port = atoi(argv[i + 1]);
             } else if (strcmp(argv[i], "-cp") == 0 || strcmp(argv[i], "--client-port") == 0) {
                 client_args.client_port = atoi(argv[i + 1]);
+            } else if (strcmp(argv[i], "-k") == 0 || strcmp(argv[i], "--key") == 0) {
+                uint32_t keyId;
+                uint8_t key[SNTP_AUTH_KEY_LEN];
+                size_t keyLen;
+                Sntp_AuthClearKeys(&authKeys);
+                if (Sntp_AuthParseKeySpec(argv[i + 1], &keyId, key, &keyLen) != SntpSuccess ||
+                    Sntp_AuthAddKey(&authKeys, keyId, key, keyLen) != SntpSuccess) {
+                    fprintf(stderr, "Invalid key: %s\n", argv[i + 1]);
+                    exit(EXIT_FAILURE);
+                }
+            } else if (strcmp(argv[i], "-u") == 0 || strcmp(argv[i], "--uid") == 0) {
+                client_args.uid_len = atoi(argv[i + 1]);
+                if (client_args.uid_len < SNTP_EXT_UID_MIN || client_args.uid_len > SNTP_EXT_UID_MAX) {
+                    fprintf(stderr, "Unique Identifier must be %d-%d bytes\n", SNTP_EXT_UID_MIN, SNTP_EXT_UID_MAX);
+                    exit(EXIT_FAILURE);
+                }
+            } else if (strcmp(argv[i], "-c") == 0 || strcmp(argv[i], "--count") == 0) {
+                client_args.count = atoi(argv[i + 1]);
+            } else if (strcmp(argv[i], "-l") == 0 || strcmp(argv[i], "--listen") == 0) {
+                snprintf(client_args.listen_addr, sizeof(client_args.listen_addr), "%s", argv[i + 1]);
+#ifdef SNTP_ENABLE_NTS
+            } else if (strcmp(argv[i], "-n") == 0 || strcmp(argv[i], "--nts") == 0) {
+                client_args.nts_port = atoi(argv[i + 1]);
+            } else if (strcmp(argv[i], "--nts-ca") == 0) {
+                snprintf(client_args.nts_ca, sizeof(client_args.nts_ca), "%s", argv[i + 1]);
+#endif
             } else {
                 fprintf(stderr, "Unknown option: %s\n", argv[i]);
                 exit(EXIT_FAILURE);
@@ -76,6 +128,9 @@ void parseCommandLineArgs(int argc, char* argv[]) {
     }
     printf("Configuration:\n\t Server Name: %s\n\t Server IP: %s \n\t Port: %d \n",
 	   client_args.serverName, client_args.serverIP, client_args.port);
+    if (authKeys.count != 0) {
+	printf("\t Auth key id: %u\n", authKeys.keys[0].keyId);
+    }
     if (client_args.client_port != 0) {
 	printf("\t Client (listen) port: %d\n", client_args.client_port);
     }
@@ -113,6 +168,182 @@ void initUDPClientSocket(void) {
     return;
 }
 
+#ifdef SNTP_ENABLE_NTS
+// NTS session state established by NTS-KE
+typedef struct {
+    Sntp_NtsKeys_t keys;
+    uint8_t cookies[SNTP_NTS_MAX_COOKIES][SNTP_NTS_COOKIE_SIZE];
+    int numCookies;
+    uint8_t uid[SNTP_EXT_UID_MIN];
+} nts_client_t;
+nts_client_t nts;
+
+static size_t put_ke_record(uint8_t *buf, size_t off, uint16_t type, const uint8_t *body, uint16_t bodyLen) {
+    uint16_t hdr[2] = { htons(type), htons(bodyLen) };
+    memcpy(buf + off, hdr, sizeof(hdr));
+    if (bodyLen > 0) {
+        memcpy(buf + off + 4, body, bodyLen);
+    }
+    return off + 4 + bodyLen;
+}
+
+/** Run NTS-KE against the server to obtain keys and an initial set of cookies */
+SntpStatus_t run_nts_ke(void) {
+    static const uint8_t protoNtpv4[2] = { 0, 0 };
+    static const uint8_t aeadSiv[2] = { 0, SNTP_NTS_AEAD_AES_SIV_CMAC_256 };
+    SntpStatus_t status = SntpErrorNetworkFailure;
+    uint8_t buf[2048];
+    size_t len = 0;
+    SSL *ssl = NULL;
+
+    SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+    SSL_CTX_set_min_proto_version(ctx, TLS1_3_VERSION);
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, NULL);
+    SSL_CTX_set_alpn_protos(ctx, (const unsigned char *)"\x07ntske/1", 8);
+    if (client_args.nts_ca[0] != '\0') {
+        SSL_CTX_load_verify_locations(ctx, client_args.nts_ca, NULL);
+    } else {
+        SSL_CTX_set_default_verify_paths(ctx);
+    }
+
+    struct sockaddr_in keAddr = serverAddr;
+    keAddr.sin_port = htons(client_args.nts_port);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&keAddr, sizeof(keAddr)) < 0) {
+        perror("Error connecting to NTS-KE server");
+        goto done;
+    }
+
+    ssl = SSL_new(ctx);
+    SSL_set_fd(ssl, fd);
+    SSL_set_tlsext_host_name(ssl, client_args.serverName);
+    SSL_set1_host(ssl, client_args.serverName);
+    if (SSL_connect(ssl) != 1) {
+        printf("NTS-KE TLS handshake failed\n");
+        ERR_print_errors_fp(stdout);
+        status = SntpServerNotAuthenticated;
+        goto done;
+    }
+
+    len = put_ke_record(buf, len, SNTP_NTSKE_NEXT_PROTO | SNTP_NTSKE_CRITICAL, protoNtpv4, sizeof(protoNtpv4));
+    len = put_ke_record(buf, len, SNTP_NTSKE_AEAD, aeadSiv, sizeof(aeadSiv));
+    len = put_ke_record(buf, len, SNTP_NTSKE_END | SNTP_NTSKE_CRITICAL, NULL, 0);
+    if (SSL_write(ssl, buf, (int)len) != (int)len) {
+        goto done;
+    }
+
+    // Server closes the session after its End of Message record
+    len = 0;
+    int n;
+    while (len < sizeof(buf) && (n = SSL_read(ssl, buf + len, (int)(sizeof(buf) - len))) > 0) {
+        len += n;
+    }
+
+    nts.numCookies = 0;
+    for (size_t off = 0; off + 4 <= len; ) {
+        uint16_t hdr[2];
+        memcpy(hdr, buf + off, sizeof(hdr));
+        uint16_t type = ntohs(hdr[0]) & ~SNTP_NTSKE_CRITICAL;
+        uint16_t bodyLen = ntohs(hdr[1]);
+        const uint8_t *body = buf + off + 4;
+        if (off + 4 + bodyLen > len) {
+            break;
+        }
+        off += 4 + bodyLen;
+        if (type == SNTP_NTSKE_ERROR) {
+            printf("NTS-KE error record, code %u\n", bodyLen >= 2 ? (body[0] << 8) | body[1] : 0);
+            status = SntpRejectedResponse;
+            goto done;
+        } else if (type == SNTP_NTSKE_NEW_COOKIE && bodyLen == SNTP_NTS_COOKIE_SIZE &&
+                   nts.numCookies < SNTP_NTS_MAX_COOKIES) {
+            memcpy(nts.cookies[nts.numCookies++], body, bodyLen);
+        } else if (type == SNTP_NTSKE_END) {
+            break;
+        }
+    }
+
+    if (nts.numCookies > 0 && Sntp_NtsExportKeys(ssl, &nts.keys) == SntpSuccess) {
+        printf("NTS-KE complete: %d cookies\n", nts.numCookies);
+        status = SntpSuccess;
+    }
+
+done:
+    if (ssl != NULL) {
+        SSL_shutdown(ssl);
+        SSL_free(ssl);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    SSL_CTX_free(ctx);
+    return status;
+}
+
+/** Append unique id, cookie, placeholders and authenticator to a serialized request */
+size_t nts_build_request(uint8_t *buf, size_t len) {
+    uint16_t lens[2] = { htons(SNTP_NTS_NONCE_SIZE), htons(SNTP_NTS_TAG_SIZE) };
+
+    RAND_bytes(nts.uid, sizeof(nts.uid));
+    len = Sntp_ExtPutField(buf, len, SNTP_EXT_UNIQUE_ID, nts.uid, sizeof(nts.uid));
+    len = Sntp_ExtPutField(buf, len, SNTP_EXT_NTS_COOKIE, nts.cookies[--nts.numCookies], SNTP_NTS_COOKIE_SIZE);
+    // Ask for enough cookies to refill the pool
+    for (int i = nts.numCookies + 1; i < SNTP_NTS_MAX_COOKIES; i++) {
+        len = Sntp_ExtPutField(buf, len, SNTP_EXT_NTS_PLACEHOLDER, NULL, SNTP_NTS_COOKIE_SIZE);
+    }
+
+    size_t authStart = len;
+    uint8_t *auth = buf + authStart + 4;
+    memcpy(auth, lens, sizeof(lens));
+    RAND_bytes(auth + 4, SNTP_NTS_NONCE_SIZE);
+    Sntp_NtsSeal(nts.keys.c2s, buf, authStart, auth + 4, SNTP_NTS_NONCE_SIZE, NULL, 0, auth + 4 + SNTP_NTS_NONCE_SIZE);
+    return Sntp_ExtPutField(buf, authStart, SNTP_EXT_NTS_AUTH, NULL, 4 + SNTP_NTS_NONCE_SIZE + SNTP_NTS_TAG_SIZE);
+}
+
+/** Verify an NTS-protected response and collect the fresh cookies it carries */
+SntpStatus_t nts_check_response(const uint8_t *buf, size_t len) {
+    const SntpPacket_t *pkt = (const SntpPacket_t *)buf;
+    bool uidOk = false;
+    size_t off = SNTP_PACKET_BASE_SIZE;
+    const uint8_t *body;
+    size_t bodyLen;
+    uint16_t type;
+    int more;
+
+    while ((more = Sntp_ExtNextField(buf, len, &off, &type, &body, &bodyLen)) > 0) {
+        if (type == SNTP_EXT_UNIQUE_ID) {
+            uidOk = bodyLen == sizeof(nts.uid) && memcmp(body, nts.uid, bodyLen) == 0;
+        } else if (type == SNTP_EXT_NTS_AUTH && uidOk && bodyLen >= 4) {
+            uint8_t pt[SNTP_NTS_MAX_PACKET];
+            uint16_t lens[2];
+            memcpy(lens, body, sizeof(lens));
+            size_t nonceLen = ntohs(lens[0]), ctLen = ntohs(lens[1]);
+            size_t noncePad = (nonceLen + 3) & ~(size_t)3;
+            if (4 + noncePad + ctLen > bodyLen ||
+                Sntp_NtsOpen(nts.keys.s2c, buf, (size_t)(body - buf) - 4, body + 4, nonceLen,
+                             body + 4 + noncePad, ctLen, pt) != 0) {
+                return SntpErrorAuthFailure;
+            }
+            size_t ptOff = 0;
+            while (Sntp_ExtNextField(pt, ctLen - SNTP_NTS_TAG_SIZE, &ptOff, &type, &body, &bodyLen) > 0) {
+                if (type == SNTP_EXT_NTS_COOKIE && bodyLen == SNTP_NTS_COOKIE_SIZE &&
+                    nts.numCookies < SNTP_NTS_MAX_COOKIES) {
+                    memcpy(nts.cookies[nts.numCookies++], body, bodyLen);
+                }
+            }
+            printf("Response authenticated with NTS, %d cookies held\n", nts.numCookies);
+            return SntpSuccess;
+        }
+    }
+
+    if (uidOk && pkt->stratum == 0 && ntohl(pkt->refId) == SNTP_NTS_KOD_NTSN) {
+        printf("NTS NAK received; cookies are no longer valid\n");
+        nts.numCookies = 0;
+        return SntpRejectedResponse;
+    }
+    return SntpServerNotAuthenticated;
+}
+#endif
+
 /** Perform a single query of the SNTP server and await a response */
 SntpStatus_t run_sntp_query(void) {
     uint32_t randomNumber = rand();
@@ -129,10 +360,28 @@ SntpStatus_t run_sntp_query(void) {
 	);
     assert( status == SntpSuccess );
 
-    // NOTE: To support authentication, it would be appended to buffer now
+    size_t requestLen = SNTP_PACKET_BASE_SIZE;
+    uint8_t uid[SNTP_EXT_UID_MAX];
+    if (client_args.uid_len != 0) {
+        for (uint32_t i = 0; i < client_args.uid_len; i++) {
+            uid[i] = (uint8_t)rand();
+        }
+        requestLen = Sntp_ExtPutField(netBuf, requestLen, SNTP_EXT_UNIQUE_ID, uid, client_args.uid_len);
+    }
+    if (authKeys.count != 0) {
+        requestLen = Sntp_AuthSign(&authKeys.keys[0], netBuf, requestLen);
+    }
+#ifdef SNTP_ENABLE_NTS
+    if (client_args.nts_port != 0) {
+        if (nts.numCookies == 0 && run_nts_ke() != SntpSuccess) {
+            return SntpServerNotAuthenticated;
+        }
+        requestLen = nts_build_request(netBuf, requestLen);
+    }
+#endif
 
     // Send data to the server
-    ssize_t sentBytes = sendto(sockfd, netBuf, NET_BUF_SIZE, 0,
+    ssize_t sentBytes = sendto(sockfd, netBuf, requestLen, 0,
                                (struct sockaddr*)&serverAddr, sizeof(serverAddr));
     if (sentBytes < 0) {
         perror("Error sending data");
@@ -149,7 +398,8 @@ SntpStatus_t run_sntp_query(void) {
     } else if (receivedBytes == 0) {
 	perror("No response received");
 	return SntpNoResponseReceived;
-    } else if (receivedBytes != NET_BUF_SIZE ) {
+    } else if (receivedBytes < SNTP_PACKET_BASE_SIZE ||
+               (client_args.nts_port == 0 && receivedBytes != (ssize_t)requestLen) ) {
 	printf("Received unexpected number of bytes %li\n", receivedBytes);
 	return SntpErrorNetworkFailure;
     }
@@ -158,13 +408,42 @@ SntpStatus_t run_sntp_query(void) {
     // Receive Time when response is received. Used to calculate system clock offset
     getCurrentSntpTime(&responseTime);
 
-    // NOTE: Skip auth decoding
+    if (authKeys.count != 0) {
+        const Sntp_AuthKey_t *key;
+        status = Sntp_AuthVerify(&authKeys, netBuf, receivedBytes, &key);
+        if (status != SntpSuccess) {
+            printf("SNTP Response failed authentication. Status was %i=%s\n", status, sntp_util_status_to_str(status));
+            return status;
+        }
+        printf("Response authenticated with key %u\n", key->keyId);
+    }
+    if (client_args.uid_len != 0) {
+        const uint8_t *body = NULL;
+        size_t bodyLen = 0, off = SNTP_PACKET_BASE_SIZE;
+        uint16_t type = 0;
+        size_t fieldsLen = receivedBytes - (authKeys.count != 0 ? SNTP_AUTH_MAC_SIZE : 0);
+        if (Sntp_ExtNextField(netBuf, fieldsLen, &off, &type, &body, &bodyLen) != 1 || type != SNTP_EXT_UNIQUE_ID ||
+            bodyLen < client_args.uid_len || memcmp(body, uid, client_args.uid_len) != 0) {
+            printf("SNTP Response did not echo the Unique Identifier\n");
+            return SntpInvalidResponse;
+        }
+        printf("Unique Identifier echoed\n");
+    }
+#ifdef SNTP_ENABLE_NTS
+    if (client_args.nts_port != 0) {
+        status = nts_check_response(netBuf, receivedBytes);
+        if (status != SntpSuccess) {
+            printf("SNTP Response failed NTS validation. Status was %i=%s\n", status, sntp_util_status_to_str(status));
+            return status;
+        }
+    }
+#endif
 
     // De-serialize packet
     status = Sntp_DeserializeResponse( &requestTime,
 				       &responseTime,
 				       netBuf,
-				       receivedBytes,
+				       SNTP_PACKET_BASE_SIZE,
 				       &parsedResponse
 	);
 				       
@@ -187,6 +466,80 @@ SntpStatus_t run_sntp_query(void) {
     return status;
 }
 
+/** Join the broadcast/multicast group and bind to the server port */
+void initListenSocket(void) {
+    struct sockaddr_in addr;
+    struct ip_mreq mreq;
+    int on = 1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(client_args.port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (inet_pton(AF_INET, client_args.listen_addr, &mreq.imr_multiaddr) != 1) {
+        fprintf(stderr, "Invalid listen address: %s\n", client_args.listen_addr);
+        exit(EXIT_FAILURE);
+    }
+
+    sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sockfd < 0) {
+        perror("Error creating socket");
+        exit(EXIT_FAILURE);
+    }
+    // Several listeners (and possibly the server itself) may share the port on one host
+    setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (bind(sockfd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        perror("Error binding to listen port");
+        exit(EXIT_FAILURE);
+    }
+    if (IN_MULTICAST(ntohl(mreq.imr_multiaddr.s_addr))) {
+        mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+        if (setsockopt(sockfd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
+            perror("Error joining multicast group");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+/** Wait for a single broadcast packet and report the offset it implies */
+SntpStatus_t run_sntp_listen(void) {
+    SntpTimestamp_t localTime, serverTime;
+    const SntpPacket_t *pkt = (const SntpPacket_t *)netBuf;
+
+    ssize_t receivedBytes = recvfrom(sockfd, netBuf, NET_BUF_SIZE, 0, NULL, NULL);
+    getCurrentSntpTime(&localTime);
+    if (receivedBytes < 0) {
+        perror("Error receiving data");
+        return SntpErrorNetworkFailure;
+    } else if (receivedBytes != SNTP_PACKET_BASE_SIZE && receivedBytes != SNTP_PACKET_BASE_SIZE + SNTP_AUTH_MAC_SIZE) {
+        printf("Received unexpected number of bytes %li\n", receivedBytes);
+        return SntpInvalidResponse;
+    }
+    if ((pkt->leapVersionMode & SNTP_MODE_BITS_MASK) != SNTP_MODE_BROADCAST) {
+        printf("Ignoring packet with mode %u\n", pkt->leapVersionMode & SNTP_MODE_BITS_MASK);
+        return SntpInvalidResponse;
+    }
+
+    if (authKeys.count != 0) {
+        const Sntp_AuthKey_t *key;
+        SntpStatus_t status = Sntp_AuthVerify(&authKeys, netBuf, receivedBytes, &key);
+        if (status != SntpSuccess) {
+            printf("Broadcast failed authentication. Status was %i=%s\n", status, sntp_util_status_to_str(status));
+            return status;
+        }
+    }
+
+    serverTime.seconds = ntohl(pkt->transmitTime.seconds);
+    serverTime.fractions = ntohl(pkt->transmitTime.fractions);
+    // Broadcast clients cannot measure path delay, so the offset includes it
+    int64_t offsetMs = ((int64_t)serverTime.seconds - (int64_t)localTime.seconds) * 1000 +
+                       (int64_t)FRACTIONS_TO_MS(serverTime.fractions) - (int64_t)FRACTIONS_TO_MS(localTime.fractions);
+    printf("Broadcast: stratum %u poll 2^%u ServerTime=%lu %lums Offset=%ldms%s\n", pkt->stratum, pkt->pollInterval,
+           (unsigned long)serverTime.seconds, (unsigned long)FRACTIONS_TO_MS(serverTime.fractions), (long)offsetMs,
+           receivedBytes > SNTP_PACKET_BASE_SIZE ? " (authenticated)" : "");
+    return SntpSuccess;
+}
+
 int main( int argc, char *argv[] )
 {
     printf("SNTP Client Test App\n");
@@ -195,12 +548,29 @@ int main( int argc, char *argv[] )
     // Initialize pseudo-random number generator
     srand((unsigned int)time(NULL));
     
+    SntpStatus_t status = SntpSuccess;
+    if (client_args.listen_addr[0] != '\0') {
+        initListenSocket();
+        printf("SNTP Client Listening for broadcasts\n");
+        for (uint32_t i = 0; i < client_args.count; i++) {
+            if (run_sntp_listen() != SntpSuccess) {
+                status = SntpErrorNetworkFailure;
+            }
+        }
+        printf("Done\n");
+        return (status == SntpSuccess) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
     // Create UDP Socket (to be reused for all requests/responses)
     initUDPClientSocket();
 
-    // Initial test: Only query server once
     printf("SNTP Client Demo Query\n");
-    run_sntp_query();
+    for (uint32_t i = 0; i < client_args.count; i++) {
+        if (run_sntp_query() != SntpSuccess) {
+            status = SntpErrorNetworkFailure;
+        }
+    }
     printf("Done\n");
+    return (status == SntpSuccess) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
@@ -0,0 +1,306 @@
+/*
+ * Open-loop load and accuracy client.
+ *
+ * Sends plain client requests to a server at a fixed offered rate for a set
+ * time, whatever the server's response rate, and matches each response by
+ * its origin timestamp.  For every response the round-trip delay and the
+ * clock offset are computed from the four NTP timestamps, with the client
+ * side read from CLOCK_REALTIME and the kernel receive timestamp.  When the
+ * client and server share a clock (e.g. network namespaces on one host),
+ * the offset is the error of the served time as seen across the link.
+ *
+ * Results are printed as a summary and can be appended as one CSV row to a
+ * report file, for comparing links, loads and server versions.
+ */
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "core_sntp_serializer.h"
+#include "core_sntp_config.h"
+#include "sntp_rt.h"
+
+#define NTP_UNIX_OFFSET 2208988800ULL /* Seconds from 1900 to 1970 */
+#define LOAD_DRAIN_NS   1000000000ULL /* Wait for late responses after the last request */
+
+// Command-line Argument Parsing
+typedef struct {
+    struct sockaddr_in target;
+    uint32_t rate;
+    double   duration;
+    const char *report;
+    const char *label;
+} load_args_t;
+
+load_args_t load_args = {
+    .rate = 100,
+    .duration = 10,
+    .report = NULL,
+    .label = "-"
+};
+
+typedef struct {
+    int64_t rttNs;
+    int64_t offsetNs;
+} load_sample_t;
+
+uint8_t netBuf[NET_BUF_SIZE];
+load_sample_t *samples;
+size_t sampleCount;
+uint64_t sent, kod, stray;
+
+void printUsage() {
+    printf("Usage: sntp_load -u <ip>[:<port>] [options]\n");
+    printf("Options:\n");
+    printf("  -u, --udp <ip>:<port>        Server to load (default port: 123)\n");
+    printf("  -r, --rate <req/s>           Offered load (default: 100)\n");
+    printf("  -d, --duration <seconds>     Time to send for (default: 10)\n");
+    printf("  -o, --report <file>          Append a CSV row of results, writing the header before the first row\n");
+    printf("  -l, --label <text>           First column of the CSV row, e.g. the link profile (default: -)\n");
+    printf("  --help                       Display this help message\n");
+}
+
+void parseCommandLineArgs(int argc, char* argv[]) {
+    bool haveTarget = false;
+
+    for (int i = 1; i < argc; i += 2) {
+        if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
+            printUsage();
+            exit(EXIT_SUCCESS);
+        } else if (i + 1 < argc) {
+            if (strcmp(argv[i], "-r") == 0 || strcmp(argv[i], "--rate") == 0) {
+                load_args.rate = atoi(argv[i + 1]);
+            } else if (strcmp(argv[i], "-d") == 0 || strcmp(argv[i], "--duration") == 0) {
+                load_args.duration = atof(argv[i + 1]);
+            } else if (strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "--report") == 0) {
+                load_args.report = argv[i + 1];
+            } else if (strcmp(argv[i], "-l") == 0 || strcmp(argv[i], "--label") == 0) {
+                load_args.label = argv[i + 1];
+            } else if (strcmp(argv[i], "-u") == 0 || strcmp(argv[i], "--udp") == 0) {
+                char addr[64];
+                char *port;
+                snprintf(addr, sizeof(addr), "%s", argv[i + 1]);
+                port = strchr(addr, ':');
+                if (port != NULL) {
+                    *port++ = '\0';
+                }
+                memset(&load_args.target, 0, sizeof(load_args.target));
+                load_args.target.sin_family = AF_INET;
+                load_args.target.sin_port = htons(port != NULL ? atoi(port) : 123);
+                if (inet_pton(AF_INET, addr, &load_args.target.sin_addr) != 1) {
+                    fprintf(stderr, "Invalid address: %s\n", argv[i + 1]);
+                    exit(EXIT_FAILURE);
+                }
+                haveTarget = true;
+            } else {
+                fprintf(stderr, "Unknown option: %s\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        } else {
+            fprintf(stderr, "Unknown option or missing value for option: %s\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (!haveTarget || load_args.rate == 0 || load_args.duration <= 0) {
+        printUsage();
+        exit(EXIT_FAILURE);
+    }
+}
+
+static uint64_t ns_now( clockid_t clock ) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/** Nanoseconds since the NTP epoch from a network-order timestamp */
+static int64_t ntp_to_ns( const SntpTimestamp_t *t ) {
+    uint64_t secs = ntohl(t->seconds);
+    uint64_t frac = ntohl(t->fractions);
+    return (int64_t)( secs * 1000000000ULL + ( ( frac * 1000000000ULL ) >> 32 ) );
+}
+
+/** Network-order NTP timestamp from nanoseconds since the Unix epoch */
+static void ns_to_ntp( uint64_t unixNs, SntpTimestamp_t *t ) {
+    t->seconds = htonl((uint32_t)( unixNs / 1000000000ULL + NTP_UNIX_OFFSET ));
+    t->fractions = htonl((uint32_t)( ( ( unixNs % 1000000000ULL ) << 32 ) / 1000000000ULL ));
+}
+
+static void send_request( int fd ) {
+    SntpPacket_t req;
+
+    memset(&req, 0, sizeof(req));
+    req.leapVersionMode = SNTP_MODE_CLIENT | ( SNTP_VERSION << SNTP_VERSION_LSB_POSITION );
+    // Read the clock last so the timestamp is as close to the send as possible; it also identifies the response
+    ns_to_ntp(ns_now(CLOCK_REALTIME), &req.transmitTime);
+    if (send(fd, &req, sizeof(req), 0) == (ssize_t)sizeof(req)) {
+        sent++;
+    }
+}
+
+/** Receive every queued response and record its delay and offset */
+static void drain_responses( int fd, int64_t firstNs ) {
+    const SntpPacket_t *resp = (const SntpPacket_t *)netBuf;
+    Sntp_RtRxMeta_t meta;
+    ssize_t n;
+
+    while (( n = Sntp_RtRecv(fd, netBuf, sizeof(netBuf), MSG_DONTWAIT, NULL, NULL, &meta) ) >= 0) {
+        int64_t t1, t2, t3, t4;
+
+        if (n < SNTP_PACKET_BASE_SIZE) {
+            stray++;
+            continue;
+        }
+        t1 = ntp_to_ns(&resp->originTime);
+        if (t1 < firstNs || sampleCount >= sent) {
+            stray++;
+            continue;
+        }
+        if (resp->stratum == 0) {
+            kod++;
+            continue;
+        }
+        if (meta.rxTime.tv_sec != 0) {
+            t4 = (int64_t)( ( meta.rxTime.tv_sec + NTP_UNIX_OFFSET ) * 1000000000ULL + meta.rxTime.tv_nsec );
+        } else {
+            t4 = (int64_t)( ns_now(CLOCK_REALTIME) + NTP_UNIX_OFFSET * 1000000000ULL );
+        }
+        t2 = ntp_to_ns(&resp->receiveTime);
+        t3 = ntp_to_ns(&resp->transmitTime);
+        samples[sampleCount].rttNs = ( t4 - t1 ) - ( t3 - t2 );
+        samples[sampleCount].offsetNs = ( ( t2 - t1 ) + ( t3 - t4 ) ) / 2;
+        sampleCount++;
+    }
+}
+
+static int cmp_i64( const void *a, const void *b ) {
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return ( x > y ) - ( x < y );
+}
+
+static double percentile_us( const int64_t *sorted, size_t count, double p ) {
+    return ( count > 0 ) ? sorted[(size_t)( p * ( count - 1 ) + 0.5 )] / 1e3 : 0;
+}
+
+/** Print the summary and append the CSV row */
+void report( double elapsed ) {
+    int64_t *rtt = malloc(( sampleCount + 1 ) * sizeof(*rtt));
+    int64_t *offset = malloc(( sampleCount + 1 ) * sizeof(*offset));
+    double lossPct = sent ? 100.0 * ( (double)sent - sampleCount - kod ) / sent : 0;
+    double mean = 0;
+    FILE *out;
+    bool header;
+
+    if (rtt == NULL || offset == NULL) {
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < sampleCount; i++) {
+        rtt[i] = samples[i].rttNs;
+        offset[i] = samples[i].offsetNs;
+        mean += samples[i].offsetNs;
+    }
+    mean = sampleCount ? mean / sampleCount / 1e3 : 0;
+    for (size_t i = 0; i < sampleCount; i++) {
+        offset[i] = ( offset[i] < 0 ) ? -offset[i] : offset[i];
+    }
+    qsort(rtt, sampleCount, sizeof(*rtt), cmp_i64);
+    qsort(offset, sampleCount, sizeof(*offset), cmp_i64);
+
+    printf("Offered %u req/s for %.1fs: sent %lu (%.0f req/s), answered %zu, KoD %lu, lost %.2f%%, stray %lu\n",
+           load_args.rate, load_args.duration, (unsigned long)sent, sent / elapsed, sampleCount, (unsigned long)kod,
+           lossPct, (unsigned long)stray);
+    printf("\tdelay p50 %.1fus, p90 %.1fus, p99 %.1fus, max %.1fus\n", percentile_us(rtt, sampleCount, 0.5),
+           percentile_us(rtt, sampleCount, 0.9), percentile_us(rtt, sampleCount, 0.99),
+           percentile_us(rtt, sampleCount, 1));
+    printf("\toffset mean %.1fus, |offset| p50 %.1fus, p99 %.1fus, max %.1fus\n", mean,
+           percentile_us(offset, sampleCount, 0.5), percentile_us(offset, sampleCount, 0.99),
+           percentile_us(offset, sampleCount, 1));
+
+    if (load_args.report != NULL) {
+        out = fopen(load_args.report, "a+");
+        if (out == NULL) {
+            perror("Unable to open report");
+            exit(EXIT_FAILURE);
+        }
+        // The header goes before the first row; lines starting with '#' are comments, e.g. from the bench script
+        header = true;
+        while (header && fgets((char *)netBuf, sizeof(netBuf), out) != NULL) {
+            header = ( netBuf[0] == '#' );
+        }
+        if (header) {
+            fprintf(out, "label,offered_rps,sent_rps,sent,answered,kod,loss_pct,delay_p50_us,delay_p90_us,"
+                         "delay_p99_us,delay_max_us,offset_mean_us,offset_abs_p50_us,offset_abs_p99_us,"
+                         "offset_abs_max_us\n");
+        }
+        fprintf(out, "%s,%u,%.0f,%lu,%zu,%lu,%.3f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f\n", load_args.label,
+                load_args.rate, sent / elapsed, (unsigned long)sent, sampleCount, (unsigned long)kod, lossPct,
+                percentile_us(rtt, sampleCount, 0.5), percentile_us(rtt, sampleCount, 0.9),
+                percentile_us(rtt, sampleCount, 0.99), percentile_us(rtt, sampleCount, 1), mean,
+                percentile_us(offset, sampleCount, 0.5), percentile_us(offset, sampleCount, 0.99),
+                percentile_us(offset, sampleCount, 1));
+        fclose(out);
+    }
+    free(rtt);
+    free(offset);
+}
+
+int main( int argc, char *argv[] )
+{
+    int fd;
+    int rcvBuf = 4 * 1024 * 1024;
+    uint64_t total, interval, start, end, next, now;
+    int64_t firstNs;
+
+    parseCommandLineArgs(argc, argv);
+    total = (uint64_t)( load_args.rate * load_args.duration );
+    interval = 1000000000ULL / load_args.rate;
+    samples = malloc(( total + 1 ) * sizeof(*samples));
+
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (samples == NULL || fd < 0 ||
+        connect(fd, (struct sockaddr*)&load_args.target, sizeof(load_args.target)) < 0) {
+        perror("Unable to connect to server");
+        exit(EXIT_FAILURE);
+    }
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvBuf, sizeof(rcvBuf));
+    Sntp_RtEnableTimestamps(fd);
+
+    firstNs = (int64_t)( ns_now(CLOCK_REALTIME) + NTP_UNIX_OFFSET * 1000000000ULL );
+    start = ns_now(CLOCK_MONOTONIC);
+    next = start;
+    end = start + (uint64_t)( load_args.duration * 1e9 ) + LOAD_DRAIN_NS;
+
+    // Open loop: requests go out on schedule whether or not earlier ones were answered
+    while (( now = ns_now(CLOCK_MONOTONIC) ) < end) {
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        struct timespec timeout;
+        uint64_t wait;
+
+        while (sent < total && next <= now) {
+            send_request(fd);
+            next += interval;
+        }
+        if (sent >= total && sampleCount + kod >= sent) {
+            break; // Everything answered, no need to wait out the drain time
+        }
+        wait = ( sent < total ) ? next - now : end - now;
+        timeout.tv_sec = wait / 1000000000ULL;
+        timeout.tv_nsec = wait % 1000000000ULL;
+        if (ppoll(&pfd, 1, &timeout, NULL) > 0) {
+            drain_responses(fd, firstNs);
+        }
+    }
+
+    report(( next - start ) / 1e9);
+    close(fd);
+    free(samples);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,483 @@
+/*
+ * Replay a pcap capture of SNTP requests for repeatable benchmarking.
+ *
+ * Requests are fed either straight into the server engine in-process,
+ * through the app's serving loop (sntp_serve.h) on the in-memory ring
+ * transport, or over UDP to a running server (one outstanding request at a
+ * time), at the capture's original timing or as fast as possible.  In-process
+ * requests can also be answered in batches through the batch kernel, as the
+ * flight app does for multiple listeners.  Each run reports throughput and
+ * per-request latency.
+ */
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "core_sntp_serializer.h"
+#include "core_sntp_config.h"
+#include "sntp_utils.h"
+#include "sntp_auth.h"
+#include "sntp_server.h"
+#include "sntp_pcap.h"
+#include "sntp_transport.h"
+#include "sntp_time.h"
+#include "sntp_batch.h"
+#include "sntp_serve.h"
+
+typedef struct {
+    uint64_t       ts;  /**< Capture timestamp, ns */
+    const uint8_t *data;
+    size_t         len;
+} replay_req_t;
+
+// Command-line Argument Parsing
+typedef struct {
+    const char *file;
+    uint16_t port;
+    uint8_t  stratum;
+    double   speed;
+    uint32_t runs;
+    struct sockaddr_in target;
+    bool     udp;
+    bool     ring;
+    uint32_t batch;
+} replay_args_t;
+
+replay_args_t replay_args = {
+    .file = NULL,
+    .port = 123,
+    .stratum = 15,
+    .speed = 0,
+    .runs = 1,
+    .udp = false,
+    .ring = false,
+    .batch = 0
+};
+
+Sntp_AuthKeySet_t authKeys;
+Sntp_ServerConfig_t serverCfg;
+Sntp_ServerStats_t serverStats;
+Sntp_RingTransport_t ring;
+Sntp_RtSockStats_t ringStats;
+Sntp_ShedConfig_t shedCfg;
+Sntp_ShedState_t shed;
+Sntp_RtHist_t wakeHist;
+Sntp_TopK_t topTalkers;
+Sntp_Fleet_t fleet;
+Sntp_CtlConfig_t ctlCfg; /* Empty allow list: control queries are dropped */
+Sntp_CtlState_t ctl;
+Sntp_ServeListener_t listener;
+Sntp_Serve_t serve;
+uint8_t *capBuf;
+replay_req_t *reqs;
+size_t reqCount;
+
+void printUsage() {
+    printf("Usage: sntp_replay -f <pcap_file> [options]\n");
+    printf("Options:\n");
+    printf("  -f, --file <pcap_file>       Capture to replay (ethernet, linux cooked, raw or IPv4 link types)\n");
+    printf("  -p, --port <port_number>     Replay UDP datagrams sent to this port (default: 123)\n");
+    printf("  -s, --stratum <stratum>      Stratum for the in-process engine (default: 15)\n");
+    printf("  -k, --key <keyid>:<hexkey>   Key known to the in-process engine (repeatable)\n");
+    printf("  -u, --udp <ip>:<port>        Send to a running server instead of the in-process engine\n");
+    printf("  --ring <0|1>                 Serve in-process requests with the app's serving loop on the in-memory ring transport\n");
+    printf("  --batch <count>              Answer in-process requests in batches of up to %u (default: 0, one at a time; ignores --speed)\n", SNTP_BATCH_MAX);
+    printf("                               With --ring, inject that many and drain them as the app does for several listeners\n");
+    printf("  --speed <factor>             1 replays at original timing, 2 twice as fast, 0 as fast as possible (default: 0)\n");
+    printf("  -r, --runs <count>           Number of runs (default: 1)\n");
+    printf("  --help                       Display this help message\n");
+}
+
+void parseCommandLineArgs(int argc, char* argv[]) {
+    for (int i = 1; i < argc; i += 2) {
+        if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
+            printUsage();
+            exit(EXIT_SUCCESS);
+        } else if (i + 1 < argc) {
+            if (strcmp(argv[i], "-f") == 0 || strcmp(argv[i], "--file") == 0) {
+                replay_args.file = argv[i + 1];
+            } else if (strcmp(argv[i], "-p") == 0 || strcmp(argv[i], "--port") == 0) {
+                replay_args.port = atoi(argv[i + 1]);
+            } else if (strcmp(argv[i], "-s") == 0 || strcmp(argv[i], "--stratum") == 0) {
+                replay_args.stratum = atoi(argv[i + 1]);
+            } else if (strcmp(argv[i], "--speed") == 0) {
+                replay_args.speed = atof(argv[i + 1]);
+            } else if (strcmp(argv[i], "--ring") == 0) {
+                replay_args.ring = atoi(argv[i + 1]) != 0;
+            } else if (strcmp(argv[i], "--batch") == 0) {
+                replay_args.batch = atoi(argv[i + 1]);
+                if (replay_args.batch > SNTP_BATCH_MAX) {
+                    fprintf(stderr, "Batch size must be at most %u\n", SNTP_BATCH_MAX);
+                    exit(EXIT_FAILURE);
+                }
+            } else if (strcmp(argv[i], "-r") == 0 || strcmp(argv[i], "--runs") == 0) {
+                replay_args.runs = atoi(argv[i + 1]);
+            } else if (strcmp(argv[i], "-k") == 0 || strcmp(argv[i], "--key") == 0) {
+                uint32_t keyId;
+                uint8_t key[SNTP_AUTH_KEY_LEN];
+                size_t keyLen;
+                if (Sntp_AuthParseKeySpec(argv[i + 1], &keyId, key, &keyLen) != SntpSuccess ||
+                    Sntp_AuthAddKey(&authKeys, keyId, key, keyLen) != SntpSuccess) {
+                    fprintf(stderr, "Invalid key: %s\n", argv[i + 1]);
+                    exit(EXIT_FAILURE);
+                }
+            } else if (strcmp(argv[i], "-u") == 0 || strcmp(argv[i], "--udp") == 0) {
+                char addr[64];
+                char *port;
+                snprintf(addr, sizeof(addr), "%s", argv[i + 1]);
+                port = strchr(addr, ':');
+                if (port != NULL) {
+                    *port++ = '\0';
+                }
+                memset(&replay_args.target, 0, sizeof(replay_args.target));
+                replay_args.target.sin_family = AF_INET;
+                replay_args.target.sin_port = htons(port != NULL ? atoi(port) : 123);
+                if (inet_pton(AF_INET, addr, &replay_args.target.sin_addr) != 1) {
+                    fprintf(stderr, "Invalid address: %s\n", argv[i + 1]);
+                    exit(EXIT_FAILURE);
+                }
+                replay_args.udp = true;
+            } else {
+                fprintf(stderr, "Unknown option: %s\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        } else {
+            fprintf(stderr, "Unknown option or missing value for option: %s\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (replay_args.file == NULL || replay_args.runs == 0 || replay_args.speed < 0) {
+        printUsage();
+        exit(EXIT_FAILURE);
+    }
+}
+
+static uint32_t get32( const uint8_t *p, bool swap ) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return swap ? __builtin_bswap32(v) : v;
+}
+
+static uint64_t ns_now( void ) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/** Strip the link, IPv4 and UDP headers; return the UDP payload if it was sent to the server port */
+static const uint8_t *udp_payload( uint32_t linkType, const uint8_t *p, size_t len, size_t *payloadLen ) {
+    size_t off, ihl, udpLen;
+    uint16_t proto;
+
+    if (linkType == SNTP_PCAP_LINK_ETHERNET) {
+        if (len < 14) {
+            return NULL;
+        }
+        off = 12;
+        proto = ( p[off] << 8 ) | p[off + 1];
+        if (proto == 0x8100 && len >= 18) { // 802.1Q tag
+            off += 4;
+            proto = ( p[off] << 8 ) | p[off + 1];
+        }
+        off += 2;
+    } else if (linkType == SNTP_PCAP_LINK_SLL) {
+        if (len < 16) {
+            return NULL;
+        }
+        proto = ( p[14] << 8 ) | p[15];
+        off = 16;
+    } else {
+        proto = 0x0800;
+        off = 0;
+    }
+    if (proto != 0x0800 || len < off + 20 || ( p[off] >> 4 ) != 4 || p[off + 9] != IPPROTO_UDP) {
+        return NULL;
+    }
+    // Later fragments carry no UDP header
+    if (( ( ( p[off + 6] << 8 ) | p[off + 7] ) & 0x1fff ) != 0) {
+        return NULL;
+    }
+    ihl = ( p[off] & 0x0f ) * 4;
+    off += ihl;
+    if (ihl < 20 || len < off + 8 || ( ( p[off + 2] << 8 ) | p[off + 3] ) != replay_args.port) {
+        return NULL;
+    }
+    udpLen = ( p[off + 4] << 8 ) | p[off + 5];
+    if (udpLen < 8) {
+        return NULL;
+    }
+    off += 8;
+    *payloadLen = udpLen - 8 <= len - off ? udpLen - 8 : len - off;
+    return p + off;
+}
+
+/** Load the capture and index the requests in it */
+void loadCapture(void) {
+    FILE *f = fopen(replay_args.file, "rb");
+    long size;
+    uint32_t magic, linkType;
+    bool swap, nsec;
+    size_t off, skipped = 0;
+
+    if (f == NULL || fseek(f, 0, SEEK_END) != 0 || ( size = ftell(f) ) < 24) {
+        fprintf(stderr, "Unable to read %s\n", replay_args.file);
+        exit(EXIT_FAILURE);
+    }
+    rewind(f);
+    capBuf = malloc(size);
+    reqs = calloc(size / 16, sizeof(*reqs));
+    if (capBuf == NULL || reqs == NULL || fread(capBuf, size, 1, f) != 1) {
+        fprintf(stderr, "Unable to read %s\n", replay_args.file);
+        exit(EXIT_FAILURE);
+    }
+    fclose(f);
+
+    magic = get32(capBuf, false);
+    swap = ( magic == __builtin_bswap32(SNTP_PCAP_MAGIC_NSEC) || magic == __builtin_bswap32(SNTP_PCAP_MAGIC_USEC) );
+    magic = get32(capBuf, swap);
+    if (magic != SNTP_PCAP_MAGIC_NSEC && magic != SNTP_PCAP_MAGIC_USEC) {
+        fprintf(stderr, "%s is not a pcap file\n", replay_args.file);
+        exit(EXIT_FAILURE);
+    }
+    nsec = ( magic == SNTP_PCAP_MAGIC_NSEC );
+    linkType = get32(capBuf + 20, swap) & 0xffff;
+    if (linkType != SNTP_PCAP_LINK_ETHERNET && linkType != SNTP_PCAP_LINK_SLL &&
+        linkType != SNTP_PCAP_LINK_RAW && linkType != SNTP_PCAP_LINK_IPV4) {
+        fprintf(stderr, "Unsupported link type %u\n", linkType);
+        exit(EXIT_FAILURE);
+    }
+
+    for (off = 24; off + 16 <= (size_t)size; ) {
+        uint32_t capLen = get32(capBuf + off + 8, swap);
+        const uint8_t *payload;
+        size_t payloadLen;
+
+        if (off + 16 + capLen > (size_t)size) {
+            break; // Truncated final record
+        }
+        payload = udp_payload(linkType, capBuf + off + 16, capLen, &payloadLen);
+        if (payload != NULL) {
+            reqs[reqCount].ts = (uint64_t)get32(capBuf + off, swap) * 1000000000ULL +
+                                (uint64_t)get32(capBuf + off + 4, swap) * ( nsec ? 1 : 1000 );
+            reqs[reqCount].data = payload;
+            reqs[reqCount].len = payloadLen;
+            reqCount++;
+        } else {
+            skipped++;
+        }
+        off += 16 + capLen;
+    }
+    printf("Loaded %zu requests from %s (%zu other packets skipped)\n", reqCount, replay_args.file, skipped);
+    if (reqCount == 0) {
+        exit(EXIT_FAILURE);
+    }
+}
+
+/** Send one request to the target and wait for its response
+ * @return 0 when answered, -1 on timeout
+ */
+static int udp_exchange( int fd, const replay_req_t *req ) {
+    uint8_t resp[NET_BUF_SIZE];
+
+    if (send(fd, req->data, req->len, 0) < 0) {
+        return -1;
+    }
+    while (1) {
+        ssize_t n = recv(fd, resp, sizeof(resp), 0);
+        if (n < 0) {
+            return -1;
+        }
+        // Skip late responses to earlier requests: the origin timestamp echoes our transmit timestamp
+        if (n >= SNTP_PACKET_BASE_SIZE && req->len >= SNTP_PACKET_BASE_SIZE &&
+            memcmp(resp + 24, req->data + 40, 8) == 0) {
+            return 0;
+        }
+    }
+}
+
+/** Serve requests [first, first + count) through the ring transport with the serving loop, one at a time as the
+ * app does for a single listener, or drained in batches as it does for several
+ * @return Number of requests answered
+ */
+static size_t ring_serve_exchange( size_t first, uint32_t count, bool batch ) {
+    static const struct sockaddr_in client = { .sin_family = AF_INET };
+    size_t answered = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (Sntp_RingTransportInject(&ring, reqs[first + i].data, reqs[first + i].len, &client) != 0) {
+            break;
+        }
+    }
+    while (ring.rxHead != ring.rxTail) {
+        if (batch) {
+            Sntp_ServeBatch(&serve, &listener);
+        } else {
+            Sntp_ServeOne(&serve, &listener);
+        }
+    }
+    while (Sntp_RingTransportTake(&ring, NULL, 0, NULL) >= 0) {
+        answered++;
+    }
+    return answered;
+}
+
+/** Answer requests [first, first + count) in-process as one batch
+ * @return Number of requests answered
+ */
+static size_t batch_exchange( size_t first, uint32_t count ) {
+    static uint8_t respBuf[SNTP_BATCH_MAX][SNTP_SERVER_MAX_RESPONSE];
+    const uint8_t *batchReqs[SNTP_BATCH_MAX];
+    uint8_t *batchResps[SNTP_BATCH_MAX];
+    size_t reqLens[SNTP_BATCH_MAX], respLens[SNTP_BATCH_MAX];
+    SntpStatus_t status[SNTP_BATCH_MAX];
+    // Replayed requests have no kernel receive timestamp, so each is dated at the batch's clock read
+    static const struct timespec rxTimes[SNTP_BATCH_MAX];
+    uint32_t n = 0;
+    size_t answered = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (Sntp_ServerAcceptsLength(reqs[first + i].len)) {
+            batchReqs[n] = reqs[first + i].data;
+            reqLens[n] = reqs[first + i].len;
+            batchResps[n] = respBuf[n];
+            n++;
+        }
+    }
+    Sntp_ServerProcessBatch(&serverCfg, &serverStats, rxTimes, batchReqs, reqLens, batchResps, respLens, status, n);
+    for (uint32_t i = 0; i < n; i++) {
+        answered += ( status[i] == SntpSuccess );
+    }
+    return answered;
+}
+
+static int cmp_u64( const void *a, const void *b ) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return ( x > y ) - ( x < y );
+}
+
+/** Replay every request once and print the run's statistics */
+void replayRun(uint32_t run, int fd, uint64_t *lat) {
+    uint8_t resp[SNTP_SERVER_MAX_RESPONSE];
+    size_t respLen, answered = 0, failed = 0;
+    uint64_t start = ns_now(), end;
+
+    memset(&serverStats, 0, sizeof(serverStats));
+    memset(&serve.counts, 0, sizeof(serve.counts));
+
+    for (size_t i = 0; i < reqCount; i++) {
+        uint64_t t0;
+        int rc;
+
+        // Every request in a batch is charged the whole batch's time, as it waits for the batch to finish
+        if (replay_args.batch > 0 && fd < 0) {
+            uint32_t count = ( reqCount - i < replay_args.batch ) ? (uint32_t)( reqCount - i ) : replay_args.batch;
+            size_t done;
+
+            t0 = ns_now();
+            done = replay_args.ring ? ring_serve_exchange(i, count, true) : batch_exchange(i, count);
+            t0 = ns_now() - t0;
+            for (size_t j = 0; j < done; j++) {
+                lat[answered++] = t0;
+            }
+            failed += count - done;
+            i += count - 1;
+            continue;
+        }
+
+        if (replay_args.speed > 0) {
+            uint64_t due = start + (uint64_t)( ( reqs[i].ts - reqs[0].ts ) / replay_args.speed );
+            struct timespec ts = { .tv_sec = due / 1000000000ULL, .tv_nsec = due % 1000000000ULL };
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+        }
+
+        t0 = ns_now();
+        if (fd >= 0) {
+            rc = udp_exchange(fd, &reqs[i]);
+        } else if (replay_args.ring) {
+            rc = ( ring_serve_exchange(i, 1, false) == 1 ) ? 0 : -1;
+        } else {
+            rc = ( Sntp_ServerAcceptsLength(reqs[i].len) &&
+                   Sntp_ServerProcess(&serverCfg, &serverStats, reqs[i].data, reqs[i].len, resp, &respLen) == SntpSuccess ) ? 0 : -1;
+        }
+        if (rc == 0) {
+            lat[answered++] = ns_now() - t0;
+        } else {
+            failed++;
+        }
+    }
+    end = ns_now();
+
+    printf("Run %u: %zu requests, %zu answered, %zu %s in %.6fs, %.0f req/s\n", run, reqCount, answered, failed,
+           fd >= 0 ? "lost" : "rejected", ( end - start ) / 1e9, reqCount / ( ( end - start ) / 1e9 ));
+    if (answered > 0) {
+        qsort(lat, answered, sizeof(*lat), cmp_u64);
+        printf("\tlatency p50 %.3fus, p99 %.3fus, max %.3fus\n", lat[answered / 2] / 1e3,
+               lat[( answered * 99 ) / 100] / 1e3, lat[answered - 1] / 1e3);
+    }
+    if (replay_args.batch > 0 && fd < 0) {
+        printf("\tbatches of %u\n", replay_args.batch);
+    }
+    if (replay_args.ring && fd < 0) {
+        printf("\tserving loop: %u requests received, %u refused, %u invalid, %u send errors\n", serve.counts.received,
+               serve.counts.badRequests, serve.counts.invalid, serve.counts.sendErrors);
+    }
+    if (serverStats.authResponses != 0 || serverStats.authFailures != 0) {
+        printf("\tauthenticated %u, authentication failures %u\n", serverStats.authResponses, serverStats.authFailures);
+    }
+}
+
+int main( int argc, char *argv[] )
+{
+    int fd = -1;
+    uint64_t *lat;
+
+    parseCommandLineArgs(argc, argv);
+    loadCapture();
+    Sntp_TimeCalibrate();
+    serverCfg.stratum = replay_args.stratum;
+    serverCfg.authKeys = &authKeys;
+    Sntp_RingTransportInit(&ring);
+    Sntp_TopKInit(&topTalkers);
+    Sntp_FleetInit(&fleet);
+    listener.cfg = serverCfg;
+    listener.cls = SNTP_CLASS_NORMAL;
+    listener.transport = &ring.base;
+    listener.sockStats = &ringStats;
+    serve.serverStats = &serverStats;
+    serve.shedCfg = &shedCfg;
+    serve.shed = &shed;
+    serve.wakeHist = &wakeHist;
+    serve.topTalkers = &topTalkers;
+    serve.fleet = &fleet;
+    serve.ctlCfg = &ctlCfg;
+    serve.ctl = &ctl;
+
+    if (replay_args.udp) {
+        struct timeval timeout = { .tv_sec = 1, .tv_usec = 0 };
+        fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (fd < 0 || connect(fd, (struct sockaddr*)&replay_args.target, sizeof(replay_args.target)) < 0) {
+            perror("Unable to connect to server");
+            exit(EXIT_FAILURE);
+        }
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    }
+
+    lat = malloc(reqCount * sizeof(*lat));
+    if (lat == NULL) {
+        exit(EXIT_FAILURE);
+    }
+    for (uint32_t run = 1; run <= replay_args.runs; run++) {
+        replayRun(run, fd, lat);
+    }
+
+    free(lat);
+    free(reqs);
+    free(capBuf);
+    return EXIT_SUCCESS;
+}
@@ -12,10 +12,28 @@
 #include <time.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
+#include <pthread.h>
+#include <signal.h>
+#include <errno.h>
 
 #include "core_sntp_serializer.h"
 #include "core_sntp_config.h"
 #include "sntp_utils.h"
+#include "sntp_auth.h"
+#include "sntp_server.h"
+#include "sntp_rt.h"
+#include "sntp_pcap.h"
+#include "sntp_transport.h"
+#include "sntp_time.h"
+#include "sntp_topk.h"
+#include "sntp_fleet.h"
+#include "sntp_stage.h"
+#include "sntp_statlog.h"
+#include "sntp_ctl.h"
+#include "sntp_shm.h"
+#include "sntp_handoff.h"
+#include "sntp_shed.h"
+#include "sntp_probe.h"
 
 // Glboals
 uint8_t netBuf[NET_BUF_SIZE];
@@ -25,19 +43,144 @@ int sockfd = -1;
 typedef struct {
     uint16_t port;
     uint8_t  stratum;
+    const char *nts_cert;
+    const char *nts_key;
+    uint16_t nts_port;
+    uint32_t nts_rotate;
+    struct sockaddr_in bcast[4];
+    uint32_t bcast_count;
+    uint32_t bcast_interval;
+    uint32_t bcast_key;
+    Sntp_RtConfig_t rt;
+    uint32_t spin_idle;
+    uint32_t busy_poll;
+    int rcvbuf;
+    int sndbuf;
+    const char *capture;
+    uint32_t capture_sample;
+    uint8_t shed_class;
+    uint32_t leap_secs;
+    int8_t leap_dir;
+    Sntp_SmearShape_t smear;
+    uint32_t smear_secs;
+    uint32_t stage_sample;
+    const char *stage_file;
+    const char *stats_log;
+    uint32_t stats_records;
+    const char *shm;
+    int shm_refclock;
+    const char *handoff;
 } server_args_t;
 
 server_args_t server_args = {
     .port = 123,
-    .stratum = 15
+    .stratum = 15,
+    .nts_cert = NULL,
+    .nts_key = NULL,
+    .nts_port = 4460,
+    .nts_rotate = 3600,
+    .bcast_count = 0,
+    .bcast_interval = 16,
+    .bcast_key = 0,
+    .rt = { .priority = 0, .cpu = -1, .lockMemory = false, .prefaultStack = 0 },
+    .spin_idle = 0,
+    .busy_poll = 0,
+    .rcvbuf = 0,
+    .sndbuf = 0,
+    .capture = NULL,
+    .capture_sample = 1,
+    .shed_class = SNTP_CLASS_NORMAL,
+    .leap_secs = 0,
+    .smear = SNTP_SMEAR_NONE,
+    .smear_secs = 86400,
+    .stage_sample = 0,
+    .stage_file = NULL,
+    .stats_log = NULL,
+    .stats_records = 86400,
+    .shm = NULL,
+    .shm_refclock = -1,
+    .handoff = NULL
 };
 
+Sntp_AuthKeySet_t authKeys;
+Sntp_ServerConfig_t serverCfg;
+Sntp_ServerStats_t serverStats;
+Sntp_RtHist_t wakeHist;
+Sntp_RtPoller_t poller;
+Sntp_RtSockStats_t sockStats;
+Sntp_Pcap_t capture;
+pthread_t captureThread;
+Sntp_SockTransport_t transport;
+int bcastSockfd = -1;
+Sntp_TopK_t topTalkers;
+Sntp_Fleet_t fleet;
+Sntp_ShedConfig_t shedCfg = { .holdMs = 1000, .kod = true };
+Sntp_ShedState_t shed;
+Sntp_StatLog_t statLog;
+Sntp_StatRecord_t statSecond; /* Counts of the second being served */
+Sntp_RtHist_t statWakePrev;
+Sntp_CtlConfig_t ctlCfg = { .clientRate = 2, .clientBurst = 8, .totalRate = 20 };
+Sntp_CtlState_t ctl;
+Sntp_CtlSysStats_t sysStats;
+struct {
+    struct sockaddr_in addr;
+    uint16_t len;
+    uint8_t buf[SNTP_CTL_HEADER_SIZE + SNTP_CTL_MAX_DATA];
+} ctlQueue[4]; /* Admitted control queries, answered when no time requests are waiting */
+uint32_t ctlPending;
+Sntp_Shm_t shmExport;
+int handoffFd = -1;
+time_t startSecond;
+volatile sig_atomic_t running = 1;
+
 // Function to parse command-line arguments and override struct values
 void printUsage() {
     printf("Usage: program_name [options]\n");
     printf("Options:\n");
     printf("  -p, --port <port_number>     Set the server port (default: 123)\n");
     printf("  -s, --stratum <startum>         Set the NTP Stratum level (default: 15)\n");
+    printf("  -k, --key <keyid>:<hexkey>   Accept/sign requests MACed with this key (repeatable)\n");
+#ifdef SNTP_ENABLE_NTS
+    printf("  --nts-cert <pem_file>        Enable NTS using this TLS certificate chain\n");
+    printf("  --nts-key <pem_file>         Private key for --nts-cert\n");
+    printf("  --nts-port <port_number>     NTS-KE listen port (default: 4460)\n");
+    printf("  --nts-rotate <seconds>       Cookie master key rotation period (default: 3600)\n");
+#endif
+    printf("  -b, --broadcast <ip>[:port]  Send mode-5 packets to this broadcast/multicast address (repeatable, max 4)\n");
+    printf("  --bcast-interval <seconds>   Broadcast interval (default: 16)\n");
+    printf("  --bcast-key <keyid>          MAC broadcast packets with this -k key\n");
+    printf("  --rt-prio <priority>         Serve with SCHED_FIFO at this priority\n");
+    printf("  --cpu <cpu>                  Pin the serving thread to this CPU\n");
+    printf("  --mlock <0|1>                Lock all current and future memory\n");
+    printf("  --prefault <bytes>           Prefault this much serving thread stack\n");
+    printf("  --spin-idle <usecs>          Busy-poll for this long after each request (default: 0, always block)\n");
+    printf("  --busy-poll <usecs>          Set SO_BUSY_POLL on the socket\n");
+    printf("  --rcvbuf <bytes>             Socket receive buffer size\n");
+    printf("  --sndbuf <bytes>             Socket send buffer size\n");
+    printf("  --time-source <realtime|tai> Clock to serve (default: realtime)\n");
+    printf("  --timescale <utc|tai|met>    Timescale to serve (default: utc)\n");
+    printf("  --capture <pcap_file>        Capture received requests to this file\n");
+    printf("  --capture-sample <N>         Capture one request in N (default: 1, all)\n");
+    printf("  --shed-latency <usecs>       Shed under overload above this queueing latency (default: 0, off)\n");
+    printf("  --shed-queue <bytes>         Shed under overload above this receive backlog (default: 0, off)\n");
+    printf("  --shed-hold <msecs>          Time below the thresholds before a shed level is lifted (default: 1000)\n");
+    printf("  --shed-kod <0|1>             Answer shed requests with KoD RATE (default: 1)\n");
+    printf("  --shed-class <0|1|2>         Class of requests matching no prefix (default: 1, normal)\n");
+    printf("  --shed-prefix <net>/<len>=<class> Class for a source prefix: 0 critical, 1 normal, 2 best effort (repeatable)\n");
+    printf("  --leap <ntpsecs>:<+1|-1>     Schedule a leap second at this UTC instant, NTP seconds\n");
+    printf("  --smear <none|linear|smooth> Smear the leap instead of announcing it (default: none; needs --time-source tai)\n");
+    printf("  --smear-window <secs>        Smear window, centred on the leap (default: 86400)\n");
+    printf("  --stage-sample <N>           Trace the stages of one request in N (default: 0, off)\n");
+    printf("  --stage-file <csv_file>      Write the stage trace here on exit (default: stdout)\n");
+    printf("  --stats-log <file>           Append per-second statistics to this memory-mapped log\n");
+    printf("  --stats-records <N>          Seconds the statistics log holds (default: 86400)\n");
+    printf("  --ctl-allow <net>/<len>      Answer mode-6 (ntpq) queries from this prefix (repeatable; default: none)\n");
+    printf("  --ctl-rate <N>               Mode-6 queries per second answered per client (default: 2)\n");
+    printf("  --ctl-burst <N>              Mode-6 queries a client may send at once (default: 8)\n");
+    printf("  --ctl-total <N>              Mode-6 queries per second answered in total (default: 20)\n");
+    printf("  --shm <name>                 Publish the served time to this shared memory object, e.g. /sntp_time\n");
+    printf("  --shm-refclock <unit>        Also write the ntpd/chrony SHM refclock segment of this unit (needs --shm)\n");
+    printf("  --handoff <path>             Take the socket from a server running with the same path, and hand it to the next\n");
     printf("  --help                       Display this help message\n");
 }
 void parseCommandLineArgs(int argc, char* argv[]) {
@@ -50,6 +193,143 @@ void parseCommandLineArgs(int argc, char* argv[]) {
                 server_args.port = atoi(argv[i + 1]);
             } else if (strcmp(argv[i], "-s") == 0 || strcmp(argv[i], "--stratum") == 0) {
                 server_args.stratum = atoi(argv[i + 1]);
+            } else if (strcmp(argv[i], "-k") == 0 || strcmp(argv[i], "--key") == 0) {
+                uint32_t keyId;
+                uint8_t key[SNTP_AUTH_KEY_LEN];
+                size_t keyLen;
+                if (Sntp_AuthParseKeySpec(argv[i + 1], &keyId, key, &keyLen) != SntpSuccess ||
+                    Sntp_AuthAddKey(&authKeys, keyId, key, keyLen) != SntpSuccess) {
+                    fprintf(stderr, "Invalid key: %s\n", argv[i + 1]);
+                    exit(EXIT_FAILURE);
+                }
+            } else if (strcmp(argv[i], "--rt-prio") == 0) {
+                server_args.rt.priority = atoi(argv[i + 1]);
+            } else if (strcmp(argv[i], "--cpu") == 0) {
+                server_args.rt.cpu = atoi(argv[i + 1]);
+            } else if (strcmp(argv[i], "--mlock") == 0) {
+                server_args.rt.lockMemory = atoi(argv[i + 1]) != 0;
+            } else if (strcmp(argv[i], "--prefault") == 0) {
+                server_args.rt.prefaultStack = atoi(argv[i + 1]);
+            } else if (strcmp(argv[i], "--rcvbuf") == 0) {
+                server_args.rcvbuf = atoi(argv[i + 1]);
+            } else if (strcmp(argv[i], "--sndbuf") == 0) {
+                server_args.sndbuf = atoi(argv[i + 1]);
+            } else if (strcmp(argv[i], "--spin-idle") == 0) {
+                server_args.spin_idle = atoi(argv[i + 1]);
+            } else if (strcmp(argv[i], "--busy-poll") == 0) {
+                server_args.busy_poll = atoi(argv[i + 1]);
+            } else if (strcmp(argv[i], "--time-source") == 0) {
+                if (Sntp_TimeSelect(Sntp_TimeFind(argv[i + 1])) != SntpSuccess) {
+                    fprintf(stderr, "Unavailable time source: %s\n", argv[i + 1]);
+                    exit(EXIT_FAILURE);
+                }
+            } else if (strcmp(argv[i], "--timescale") == 0) {
+                serverCfg.scale = Sntp_TimeScaleFind(argv[i + 1]);
+                if (serverCfg.scale >= SNTP_SCALE_COUNT) {
+                    fprintf(stderr, "Unknown timescale: %s\n", argv[i + 1]);
+                    exit(EXIT_FAILURE);
+                }
+            } else if (strcmp(argv[i], "--shed-latency") == 0) {
+                shedCfg.latencyUs = atoi(argv[i + 1]);
+            } else if (strcmp(argv[i], "--shed-queue") == 0) {
+                shedCfg.queueBytes = atoi(argv[i + 1]);
+            } else if (strcmp(argv[i], "--shed-hold") == 0) {
+                shedCfg.holdMs = atoi(argv[i + 1]);
+            } else if (strcmp(argv[i], "--shed-kod") == 0) {
+                shedCfg.kod = atoi(argv[i + 1]) != 0;
+            } else if (strcmp(argv[i], "--shed-class") == 0) {
+                server_args.shed_class = atoi(argv[i + 1]);
+                if (server_args.shed_class >= SNTP_SHED_CLASS_COUNT) {
+                    fprintf(stderr, "Invalid class: %s\n", argv[i + 1]);
+                    exit(EXIT_FAILURE);
+                }
+            } else if (strcmp(argv[i], "--shed-prefix") == 0) {
+                if (shedCfg.ruleCount >= SNTP_SHED_MAX_RULES ||
+                    Sntp_ShedParseRule(argv[i + 1], &shedCfg.rules[shedCfg.ruleCount]) != SntpSuccess) {
+                    fprintf(stderr, "Invalid prefix rule: %s\n", argv[i + 1]);
+                    exit(EXIT_FAILURE);
+                }
+                shedCfg.ruleCount++;
+            } else if (strcmp(argv[i], "--leap") == 0) {
+                int dir;
+                char extra;
+                if (sscanf(argv[i + 1], "%u:%d%c", &server_args.leap_secs, &dir, &extra) != 2 ||
+                    ( dir != 1 && dir != -1 )) {
+                    fprintf(stderr, "Invalid leap second: %s\n", argv[i + 1]);
+                    exit(EXIT_FAILURE);
+                }
+                server_args.leap_dir = (int8_t)dir;
+            } else if (strcmp(argv[i], "--smear") == 0) {
+                server_args.smear = Sntp_TimeSmearFind(argv[i + 1]);
+                if (server_args.smear >= SNTP_SMEAR_SHAPE_COUNT) {
+                    fprintf(stderr, "Unknown smear shape: %s\n", argv[i + 1]);
+                    exit(EXIT_FAILURE);
+                }
+            } else if (strcmp(argv[i], "--smear-window") == 0) {
+                server_args.smear_secs = atoi(argv[i + 1]);
+            } else if (strcmp(argv[i], "--stage-sample") == 0) {
+                server_args.stage_sample = atoi(argv[i + 1]);
+            } else if (strcmp(argv[i], "--stage-file") == 0) {
+                server_args.stage_file = argv[i + 1];
+            } else if (strcmp(argv[i], "--stats-log") == 0) {
+                server_args.stats_log = argv[i + 1];
+            } else if (strcmp(argv[i], "--stats-records") == 0) {
+                server_args.stats_records = atoi(argv[i + 1]);
+            } else if (strcmp(argv[i], "--shm") == 0) {
+                server_args.shm = argv[i + 1];
+            } else if (strcmp(argv[i], "--shm-refclock") == 0) {
+                server_args.shm_refclock = atoi(argv[i + 1]);
+            } else if (strcmp(argv[i], "--handoff") == 0) {
+                server_args.handoff = argv[i + 1];
+            } else if (strcmp(argv[i], "--ctl-allow") == 0) {
+                if (ctlCfg.allowCount >= SNTP_CTL_MAX_ALLOW ||
+                    Sntp_CtlParsePrefix(argv[i + 1], &ctlCfg.allow[ctlCfg.allowCount]) != SntpSuccess) {
+                    fprintf(stderr, "Invalid or too many --ctl-allow prefixes: %s\n", argv[i + 1]);
+                    exit(EXIT_FAILURE);
+                }
+                ctlCfg.allowCount++;
+            } else if (strcmp(argv[i], "--ctl-rate") == 0) {
+                ctlCfg.clientRate = atoi(argv[i + 1]);
+            } else if (strcmp(argv[i], "--ctl-burst") == 0) {
+                ctlCfg.clientBurst = atoi(argv[i + 1]);
+            } else if (strcmp(argv[i], "--ctl-total") == 0) {
+                ctlCfg.totalRate = atoi(argv[i + 1]);
+            } else if (strcmp(argv[i], "--capture") == 0) {
+                server_args.capture = argv[i + 1];
+            } else if (strcmp(argv[i], "--capture-sample") == 0) {
+                server_args.capture_sample = atoi(argv[i + 1]);
+            } else if (strcmp(argv[i], "-b") == 0 || strcmp(argv[i], "--broadcast") == 0) {
+                char addr[64];
+                char *port;
+                struct sockaddr_in *dest = &server_args.bcast[server_args.bcast_count];
+                snprintf(addr, sizeof(addr), "%s", argv[i + 1]);
+                port = strchr(addr, ':');
+                if (port != NULL) {
+                    *port++ = '\0';
+                }
+                memset(dest, 0, sizeof(*dest));
+                dest->sin_family = AF_INET;
+                dest->sin_port = htons(port != NULL ? atoi(port) : 123);
+                if (server_args.bcast_count >= sizeof(server_args.bcast) / sizeof(server_args.bcast[0]) ||
+                    inet_pton(AF_INET, addr, &dest->sin_addr) != 1) {
+                    fprintf(stderr, "Invalid broadcast address: %s\n", argv[i + 1]);
+                    exit(EXIT_FAILURE);
+                }
+                server_args.bcast_count++;
+            } else if (strcmp(argv[i], "--bcast-interval") == 0) {
+                server_args.bcast_interval = atoi(argv[i + 1]);
+            } else if (strcmp(argv[i], "--bcast-key") == 0) {
+                server_args.bcast_key = atoi(argv[i + 1]);
+#ifdef SNTP_ENABLE_NTS
+            } else if (strcmp(argv[i], "--nts-cert") == 0) {
+                server_args.nts_cert = argv[i + 1];
+            } else if (strcmp(argv[i], "--nts-key") == 0) {
+                server_args.nts_key = argv[i + 1];
+            } else if (strcmp(argv[i], "--nts-port") == 0) {
+                server_args.nts_port = atoi(argv[i + 1]);
+            } else if (strcmp(argv[i], "--nts-rotate") == 0) {
+                server_args.nts_rotate = atoi(argv[i + 1]);
+#endif
             } else {
                 fprintf(stderr, "Unknown option: %s\n", argv[i]);
                 exit(EXIT_FAILURE);
@@ -59,109 +339,514 @@ void parseCommandLineArgs(int argc, char* argv[]) {
             exit(EXIT_FAILURE);
         }
     }
-    printf("Configuration:\n\t Server Port: %d\n\t Stratum: %d \n",
-	   server_args.port, server_args.stratum);
+    printf("Configuration:\n\t Server Port: %d\n\t Stratum: %d \n\t Auth Keys: %u\n",
+	   server_args.port, server_args.stratum, authKeys.count);
+    if (server_args.nts_cert != NULL) {
+	printf("\t NTS-KE Port: %d\n\t NTS Key Rotation: %us\n", server_args.nts_port, server_args.nts_rotate);
+    }
+    printf("\t Time Source: %s, Timescale: %s\n", Sntp_TimeInfo(Sntp_TimeSelected())->name,
+           Sntp_TimeScaleName(serverCfg.scale));
+    if (server_args.bcast_count != 0) {
+	printf("\t Broadcast Groups: %u every %us\n", server_args.bcast_count, server_args.bcast_interval);
+    }
+    if (shedCfg.latencyUs != 0 || shedCfg.queueBytes != 0) {
+	printf("\t Shedding: above %uus or %u bytes queued, %u prefixes\n", shedCfg.latencyUs, shedCfg.queueBytes,
+	       shedCfg.ruleCount);
+    }
+    if (ctlCfg.allowCount != 0) {
+	printf("\t Control Queries: %u prefixes, %u/s per client, %u/s in total\n", ctlCfg.allowCount,
+	       ctlCfg.clientRate, ctlCfg.totalRate);
+    }
 }
 
 
 /** Initialize socket */
+/** Take the bound socket, with any requests queued on it, from a server running with the same --handoff path */
+int takeSocket() {
+    int fd;
+
+    if (Sntp_HandoffTake(server_args.handoff, &fd, 1) != 1) {
+        if (errno != ENOENT && errno != ECONNREFUSED) {
+            perror("Unable to take the socket from the running server");
+        }
+        return -1;
+    }
+    if (!Sntp_HandoffValid(fd, server_args.port)) {
+        fprintf(stderr, "The running server handed off a socket not bound to port %u\n", server_args.port);
+        close(fd);
+        return -1;
+    }
+    printf("Took over the socket on port %u from the running server\n", server_args.port);
+    return fd;
+}
+
 void initUDPSocket() {
-    sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    sockfd = ( server_args.handoff != NULL ) ? takeSocket() : -1;
     if (sockfd < 0) {
-        perror("Error creating socket");
-        exit(EXIT_FAILURE);
-    }
+        sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (sockfd < 0) {
+            perror("Error creating socket");
+            exit(EXIT_FAILURE);
+        }
 
-    // Bind to server port
-    struct sockaddr_in serverAddr;
-    memset(&serverAddr, 0, sizeof(serverAddr));
-    serverAddr.sin_family = AF_INET;
-    serverAddr.sin_port = htons(server_args.port);
-    serverAddr.sin_addr.s_addr = htonl(INADDR_ANY);
+        // Bind to server port
+        struct sockaddr_in serverAddr;
+        memset(&serverAddr, 0, sizeof(serverAddr));
+        serverAddr.sin_family = AF_INET;
+        serverAddr.sin_port = htons(server_args.port);
+        serverAddr.sin_addr.s_addr = htonl(INADDR_ANY);
 
-    if (bind(sockfd, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) < 0) {
-	perror("Error binding to server port");
-	close(sockfd);
-	exit(EXIT_FAILURE);
+        if (bind(sockfd, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) < 0) {
+            perror("Error binding to server port");
+            close(sockfd);
+            exit(EXIT_FAILURE);
+        }
+    }
+    Sntp_RtEnableTimestamps(sockfd);
+    if (server_args.busy_poll > 0 && Sntp_RtSetBusyPoll(sockfd, server_args.busy_poll) != 0) {
+        perror("Unable to set SO_BUSY_POLL");
+    }
+    poller.idleUs = server_args.spin_idle;
+    if (Sntp_RtSetBuffers(sockfd, server_args.rcvbuf, server_args.sndbuf, &sockStats) != 0) {
+        perror("Unable to set socket buffer sizes");
     }
+    printf("Socket buffers: receive %d, send %d bytes\n", sockStats.rcvBuf, sockStats.sndBuf);
+    Sntp_SockTransportInit(&transport, sockfd, &poller, &sockStats);
 
     return;
 }
 
+/** Hold an admitted mode-6 query for answerControl(); the rest are dropped without a reply */
+void queueControl(const struct sockaddr_in *clientAddr, ssize_t len) {
+    if (!Sntp_CtlAdmit(&ctlCfg, &ctl, clientAddr->sin_addr.s_addr)) {
+        return;
+    }
+    if (ctlPending == sizeof(ctlQueue) / sizeof(ctlQueue[0]) || len > (ssize_t)sizeof(ctlQueue[0].buf)) {
+        ctl.limited++;
+        return;
+    }
+    ctlQueue[ctlPending].addr = *clientAddr;
+    ctlQueue[ctlPending].len = (uint16_t)len;
+    memcpy(ctlQueue[ctlPending++].buf, netBuf, len);
+}
+
+/** Answer queued mode-6 queries once no requests are waiting; they are dropped while shedding */
+void answerControl(void) {
+    Sntp_CtlVars_t vars;
+    struct timespec mono;
+
+    if (ctlPending == 0 || sockStats.queue != 0) {
+        return;
+    }
+    if (shed.level != 0) {
+        ctl.limited += ctlPending;
+        ctlPending = 0;
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &mono);
+    sysStats.uptime = sysStats.reset = (uint32_t)(mono.tv_sec - startSecond);
+    sysStats.badAuth = serverStats.authFailures + serverStats.ntsFailures;
+    sysStats.declined = shed.shed[0] + shed.shed[1] + shed.shed[2];
+    sysStats.kodSent = shed.kod;
+    vars.count = 0;
+    Sntp_CtlAddClockVars(&vars, &serverCfg);
+    Sntp_CtlAddSysStats(&vars, &sysStats, &ctl);
+    Sntp_CtlAddVar(&vars, "kernel_drops", "%u", sockStats.drops);
+    Sntp_CtlAddVar(&vars, "shed_level", "%u", shed.level);
+    Sntp_CtlAddVar(&vars, "wake_p50", "%u", Sntp_RtHistPercentile(wakeHist.buckets, 50));
+    Sntp_CtlAddVar(&vars, "wake_p99", "%u", Sntp_RtHistPercentile(wakeHist.buckets, 99));
+    Sntp_CtlAddVar(&vars, "wake_max", "%u", wakeHist.maxUs);
+    Sntp_CtlAddVar(&vars, "fleet_p50", "%d", Sntp_FleetPercentile(&fleet.last, SNTP_FLEET_ALL, 50));
+    Sntp_CtlAddVar(&vars, "fleet_p99", "%d", Sntp_FleetPercentile(&fleet.last, SNTP_FLEET_ALL, 99));
+    Sntp_CtlAddVar(&vars, "auth_keys", "%u", authKeys.count);
+    Sntp_CtlAddVar(&vars, "nts", "%u", (unsigned int)serverCfg.nts);
+    Sntp_CtlAddVar(&vars, "ports", "\"%u\"", server_args.port);
+    for (uint32_t i = 0; i < ctlPending; i++) {
+        Sntp_CtlRespond(&ctl, ctlQueue[i].buf, ctlQueue[i].len, &vars, &transport.base, &ctlQueue[i].addr);
+    }
+    ctlPending = 0;
+}
+
 /** Perform a single query of the SNTP server and await a response */
 SntpStatus_t run_sntp_server() {
     SntpStatus_t status;
-    SntpPacket_t request, response;
-    SntpTimestamp_t time;
+    uint8_t response[SNTP_SERVER_MAX_RESPONSE];
+    size_t respLen;
     struct sockaddr_in clientAddr;
-    socklen_t clientLen = sizeof(clientAddr);
-    memset(&response,0,sizeof(response));
+    Sntp_StageRecord_t *stage;
     
     // Wait on response (or timeout) and validate size.  Optional retry if read fails
     // Receive response from the server
-    ssize_t receivedBytes = recvfrom(sockfd, netBuf, NET_BUF_SIZE, 0, (struct sockaddr*)&clientAddr, &clientLen);
-    if (receivedBytes < 0) {
+    Sntp_RtRxMeta_t rxMeta;
+    ssize_t receivedBytes = Sntp_TransportRecv(&transport.base, netBuf, NET_BUF_SIZE, &clientAddr, &rxMeta);
+    if (receivedBytes > 0) {
+        uint32_t wakeUs = Sntp_RtRecordWake(&wakeHist, &rxMeta.rxTime);
+        sysStats.received++;
+        SNTP_PROBE6(request__receive, clientAddr.sin_addr.s_addr, clientAddr.sin_port, receivedBytes, serverCfg.scale,
+                    rxMeta.rxTime.tv_sec, rxMeta.rxTime.tv_nsec);
+        Sntp_TopKUpdate(&topTalkers, clientAddr.sin_addr.s_addr);
+        if (Sntp_PcapActive(&capture)) {
+            Sntp_PcapRecord(&capture, &rxMeta.rxTime, &clientAddr, netBuf, receivedBytes);
+        }
+        if (Sntp_ShedUpdate(&shedCfg, &shed, wakeUs, sockStats.queue)) {
+            printf("Shed level %u at %uus latency, %u bytes queued\n", shed.level, wakeUs, sockStats.queue);
+        }
+    }
+    if (receivedBytes > 0 && Sntp_CtlIsQuery(netBuf, receivedBytes)) {
+        queueControl(&clientAddr, receivedBytes);
+        return SntpNoResponseReceived;
+    }
+    if (receivedBytes < 0 && (errno == EINTR || errno == EAGAIN)) {
+        return SntpNoResponseReceived;
+    } else if (receivedBytes < 0) {
         perror("Error receiving data");
 	return SntpErrorNetworkFailure;
     } else if (receivedBytes == 0) {
 	perror("No data received");
 	return SntpNoResponseReceived;
-    } else if (receivedBytes != NET_BUF_SIZE ) {
+    } else if (!Sntp_ServerAcceptsLength(receivedBytes)) {
 	printf("Received unexpected number of bytes %zi\n", receivedBytes);
 	return SntpErrorNetworkFailure;
     }
+    if (Sntp_ShedCheck(&shedCfg, &shed, clientAddr.sin_addr.s_addr, server_args.shed_class)) {
+        SNTP_PROBE4(request__shed, clientAddr.sin_addr.s_addr, clientAddr.sin_port, server_args.shed_class, shed.level);
+        respLen = shedCfg.kod ? Sntp_ServerBuildKod(netBuf, receivedBytes, SNTP_KISS_OF_DEATH_CODE_RATE, response) : 0;
+        if (respLen > 0 && Sntp_TransportSend(&transport.base, response, respLen, &clientAddr) >= 0) {
+            shed.kod++;
+        }
+        return SntpRejectedResponse;
+    }
+    stage = Sntp_StageBegin(&rxMeta.rxTime, clientAddr.sin_addr.s_addr, clientAddr.sin_port, receivedBytes);
     printf("Received NTP Request\n");
 
-    // Receive Time when response is received. Used to calculate system clock offset
-    getCurrentSntpTime(&time);
-    encodeTime(&time, &response.receiveTime);
-
-    // NOTE: Skip auth decoding
+#ifdef SNTP_ENABLE_NTS
+    if (serverCfg.nts) {
+        Sntp_NtsRotateIfDue(server_args.nts_rotate);
+    }
+#endif
 
-    // De-serialize packet
-    status = Sntp_DeserializeRequest( netBuf, &request);
+    status = Sntp_ServerProcess(&serverCfg, &serverStats, netBuf, receivedBytes, response, &respLen);
     if (status != SntpSuccess) {
-        printf("ERROR: Invalid request\n");
-        return status;
+        printf("ERROR: Invalid request: %s\n", sntp_util_status_to_str(status));
+    } else if (Sntp_TransportSend(&transport.base, response, respLen, &clientAddr) < 0) {
+        printf("ERROR: Unable to send reply\n");
+        status = SntpErrorNetworkFailure;
     }
+    Sntp_StageEnd(stage, status);
+    if (status == SntpSuccess) {
+        Sntp_FleetRecord(&fleet, response, Sntp_ShedClassify(&shedCfg, clientAddr.sin_addr.s_addr, server_args.shed_class));
+    }
+    SNTP_PROBE4(request__send, clientAddr.sin_addr.s_addr, clientAddr.sin_port, status == SntpSuccess ? respLen : 0,
+                status);
 
-    // Echo request in response fields
-    encodeTime( &request.transmitTime, &response.originTime );
+    return status;
+}
 
-    // Set Details
-    response.leapVersionMode = SNTP_MODE_SERVER | ( SNTP_VERSION << SNTP_VERSION_LSB_POSITION );
-    response.stratum = server_args.stratum;
-    response.refId = htonl(SNTP_KISS_OF_DEATH_CODE_NONE);
-    
-    getCurrentSntpTime(&time);
-    encodeTime(&time, &response.transmitTime);
-    
-    if (sendto(sockfd, &response, sizeof(response), 0,
-               (struct sockaddr*)&clientAddr, clientLen) < 0)
-    {
-        printf("ERROR: Unable to send reply\n");
-        return SntpErrorNetworkFailure;
+/** Broadcast thread: one mode-5 packet per group every bcast_interval seconds */
+void *run_broadcast(void *arg) {
+    uint8_t pkt[SNTP_PACKET_BASE_SIZE + SNTP_AUTH_MAC_SIZE];
+    const Sntp_AuthKey_t *key = NULL;
+    int8_t pollExp = 0;
+    struct timespec next;
+
+    (void)arg;
+    while (pollExp < 17 && (1U << (pollExp + 1)) <= server_args.bcast_interval) {
+        pollExp++;
+    }
+    if (server_args.bcast_key != 0) {
+        key = Sntp_AuthFindKey(&authKeys, server_args.bcast_key);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    while (1) {
+        size_t len = Sntp_ServerBuildBroadcast(&serverCfg, pollExp, key, pkt);
+        for (uint32_t i = 0; i < server_args.bcast_count; i++) {
+            if (sendto(bcastSockfd, pkt, len, 0, (const struct sockaddr *)&server_args.bcast[i],
+                       sizeof(server_args.bcast[i])) < 0) {
+                perror("Error sending broadcast");
+            }
+        }
+        // Absolute deadlines keep the interval from drifting by the send time
+        next.tv_sec += server_args.bcast_interval;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+    return NULL;
+}
+
+void initBroadcast(void) {
+    pthread_t thread;
+    int on = 1;
+    unsigned char ttl = 1;
+
+    if (server_args.bcast_interval == 0) {
+        fprintf(stderr, "Broadcast interval must be at least 1s\n");
+        exit(EXIT_FAILURE);
+    }
+    if (server_args.bcast_key != 0 && Sntp_AuthFindKey(&authKeys, server_args.bcast_key) == NULL) {
+        fprintf(stderr, "Broadcast key %u was not given with -k\n", server_args.bcast_key);
+        exit(EXIT_FAILURE);
+    }
+    // An unbound socket of its own, so answers to the broadcasts never reach the served port
+    bcastSockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (bcastSockfd < 0) {
+        perror("Error opening broadcast socket");
+        exit(EXIT_FAILURE);
+    }
+    setsockopt(bcastSockfd, SOL_SOCKET, SO_BROADCAST, &on, sizeof(on));
+    setsockopt(bcastSockfd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+    pthread_create(&thread, NULL, run_broadcast, NULL);
+}
+
+/** Capture writer thread */
+void *run_capture(void *arg) {
+    (void)arg;
+    Sntp_PcapWriterRun(&capture);
+    return NULL;
+}
+
+void initCapture(void) {
+    if (Sntp_PcapInit(&capture) != 0 || Sntp_PcapStart(&capture, server_args.capture, server_args.capture_sample, server_args.port) != 0) {
+        perror("Unable to open capture file");
+        exit(EXIT_FAILURE);
+    }
+    pthread_create(&captureThread, NULL, run_capture, NULL);
+}
+
+#ifdef SNTP_ENABLE_NTS
+/** NTS-KE listener thread */
+void *run_nts_ke(void *arg) {
+    int listenFd = *(int *)arg;
+    while (1) {
+        SntpStatus_t status = Sntp_NtsKeServeOne(listenFd);
+        if (status != SntpNoResponseReceived) {
+            printf("NTS-KE session: %s\n", sntp_util_status_to_str(status));
+        }
+    }
+    return NULL;
+}
+
+void initNts(void) {
+    static int keFd;
+    pthread_t thread;
+
+    if (server_args.nts_key == NULL ||
+        Sntp_NtsInit(server_args.nts_cert, server_args.nts_key) != SntpSuccess) {
+        fprintf(stderr, "Unable to load NTS certificate/key\n");
+        exit(EXIT_FAILURE);
+    }
+    keFd = Sntp_NtsKeListen(server_args.nts_port);
+    if (keFd < 0) {
+        perror("Error binding to NTS-KE port");
+        exit(EXIT_FAILURE);
+    }
+    pthread_create(&thread, NULL, run_nts_ke, &keFd);
+    serverCfg.nts = true;
+}
+#endif
+
+/** Calibrate the time sources and report them */
+void initTime(void) {
+    Sntp_TimeCalibrate();
+    printf("Time sources:\n");
+    for (int i = 0; i < SNTP_TIME_SRC_COUNT; i++) {
+        const Sntp_TimeSrcInfo_t *info = Sntp_TimeInfo((Sntp_TimeSrc_t)i);
+        if (info->available) {
+            printf("\t%-8s read %uns, resolution %uns, precision %d%s\n", info->name, info->costNs,
+                   info->resolutionNs, info->precision, i == (int)Sntp_TimeSelected() ? " (serving)" : "");
+        }
+    }
+    if (server_args.leap_secs != 0) {
+        if (Sntp_TimeScheduleLeap(server_args.leap_secs, server_args.leap_dir, server_args.smear,
+                                  server_args.smear_secs) != SntpSuccess) {
+            fprintf(stderr, "Cannot schedule the leap second: it must be in the future, and smearing needs a TAI "
+                    "time source and a window of at most a week\n");
+            exit(EXIT_FAILURE);
+        }
+        printf("Leap second %+d at %u, smear %s over %us\n", server_args.leap_dir, server_args.leap_secs,
+               Sntp_TimeSmearName(server_args.smear), server_args.smear_secs);
+    }
+}
+
+/** Write the sampled request stage trace to --stage-file, or stdout */
+void printStages(void) {
+    FILE *out = ( server_args.stage_file != NULL ) ? fopen(server_args.stage_file, "w") : stdout;
+    int written = ( out != NULL ) ? Sntp_StageWrite(out) : -1;
+
+    if (out != NULL && out != stdout && fclose(out) != 0) {
+        written = -1;
     }
+    if (written < 0) {
+        perror("Unable to write the stage trace");
+    } else if (out != stdout) {
+        printf("Stage trace of %d sampled requests written to %s\n", written, server_args.stage_file);
+    }
+}
+
+void stopServer(int sig) {
+    (void)sig;
+    running = 0;
+}
 
-    return SntpSuccess;
+/** Print the wake latency histogram collected while serving */
+void printWakeHist(void) {
+    printf("Wake latency (packet arrival to recvmsg return), max %uus:\n", wakeHist.maxUs);
+    for (int i = 0; i < SNTP_RT_HIST_BUCKETS; i++) {
+        if (wakeHist.buckets[i] == 0) {
+            continue;
+        }
+        if (i == 0) {
+            printf("\t      <1us: %u\n", wakeHist.buckets[i]);
+        } else if (i == SNTP_RT_HIST_BUCKETS - 1) {
+            printf("\t  >=%6uus: %u\n", 1U << (i - 1), wakeHist.buckets[i]);
+        } else {
+            printf("\t%6u-%uus: %u\n", 1U << (i - 1), (1U << i) - 1, wakeHist.buckets[i]);
+        }
+    }
+}
+
+/** Count a request's outcome toward the current second of the statistics log */
+void countStatus(SntpStatus_t status) {
+    if (status == SntpSuccess) {
+        statSecond.requests++;
+        sysStats.processed++;
+    } else if (status == SntpRejectedResponse) {
+        statSecond.shed++;
+    } else if (status != SntpNoResponseReceived && status != SntpErrorNetworkFailure) {
+        statSecond.badRequests++;
+        sysStats.badFormat += (status != SntpServerNotAuthenticated && status != SntpErrorAuthFailure);
+    }
+}
+
+/** Append the second just served to the statistics log */
+void logStats(void) {
+    uint32_t wake[SNTP_RT_HIST_BUCKETS];
+    uint32_t authFailures = serverStats.authFailures + serverStats.ntsFailures;
+    SntpTimestamp_t now;
+    static uint32_t authPrev, dropsPrev;
+
+    for (int i = 0; i < SNTP_RT_HIST_BUCKETS; i++) {
+        wake[i] = wakeHist.buckets[i] - statWakePrev.buckets[i];
+        statSecond.wakeMaxUs = (wake[i] != 0) ? 1U << i : statSecond.wakeMaxUs;
+    }
+    // Authentication failures also fail Sntp_ServerProcess(), and were counted as bad requests
+    statSecond.authFailures = authFailures - authPrev;
+    statSecond.badRequests -= (statSecond.authFailures < statSecond.badRequests) ? statSecond.authFailures
+                                                                                  : statSecond.badRequests;
+    statSecond.kernelDrops = sockStats.drops - dropsPrev;
+    statSecond.wakeP50Us = Sntp_RtHistPercentile(wake, 50);
+    statSecond.wakeP99Us = Sntp_RtHistPercentile(wake, 99);
+    Sntp_TimeReadScale(SNTP_SCALE_UTC, &now);
+    statSecond.time = ((uint64_t)now.seconds << 32) | now.fractions;
+    statSecond.smearUs = (int32_t)((Sntp_TimeSmearOffset() * 1000000) / 4294967296LL);
+    statSecond.timeSource = Sntp_TimeSelected();
+    statSecond.leapIndicator = Sntp_TimeLeapIndicator();
+    statSecond.shedLevel = shed.level;
+    Sntp_StatLogAppend(&statLog, &statSecond);
+
+    memset(&statSecond, 0, sizeof(statSecond));
+    statWakePrev = wakeHist;
+    authPrev = authFailures;
+    dropsPrev = sockStats.drops;
 }
 
 int main( int argc, char *argv[] )
 {
     printf("SNTP Server Test App\n");
     parseCommandLineArgs(argc, argv);
+    initTime();
+    Sntp_TopKInit(&topTalkers);
+    Sntp_FleetInit(&fleet);
+    Sntp_StageConfigure(server_args.stage_sample);
+    serverCfg.stratum = server_args.stratum;
+    serverCfg.authKeys = &authKeys;
+#ifdef SNTP_ENABLE_NTS
+    if (server_args.nts_cert != NULL) {
+        initNts();
+    }
+#endif
 
     // Initialize pseudo-random number generator
     srand((unsigned int)time(NULL)); // TODO: Is this needed?
     
     // Create UDP Socket (to be reused for all requests/responses)
     initUDPSocket();
+    if (server_args.bcast_count != 0) {
+        initBroadcast();
+    }
+    if (server_args.capture != NULL) {
+        initCapture();
+    }
+    if (server_args.stats_log != NULL && Sntp_StatLogOpen(&statLog, server_args.stats_log, server_args.stats_records) != 0) {
+        perror("Unable to open the statistics log");
+    }
+    if (server_args.shm != NULL || server_args.handoff != NULL) {
+        // Wake at least once a second so the exported anchor does not go stale and a successor is not kept waiting
+        struct timeval tv = { .tv_sec = 1, .tv_usec = 0 };
+        setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    }
+    if (server_args.shm != NULL && Sntp_ShmOpen(&shmExport, server_args.shm, server_args.shm_refclock, 1000) != 0) {
+        perror("Unable to export the time to shared memory");
+    }
+    if (server_args.handoff != NULL && ( handoffFd = Sntp_HandoffListen(server_args.handoff) ) < 0) {
+        perror("Unable to listen for a successor");
+    }
+
+    const char *failed;
+    if (Sntp_RtApply(&server_args.rt, &failed) != SntpSuccess) {
+        fprintf(stderr, "Unable to apply %s: continuing without it\n", failed);
+    }
+
+    // SIGINT/SIGTERM interrupt recvmsg so the statistics can be printed on exit
+    struct sigaction sa = { .sa_handler = stopServer };
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
 
-    // Initial test: Only query server once
     printf("SNTP Server Listening\n");
-    while(1) {
-	run_sntp_server();
+    struct timespec mono;
+    clock_gettime(CLOCK_MONOTONIC, &mono);
+    startSecond = mono.tv_sec;
+    time_t offsetsRefreshed = time(NULL);
+    while(running) {
+	countStatus(run_sntp_server());
+	answerControl();
+	if (time(NULL) != offsetsRefreshed) {
+	    logStats();
+	    // Track leap second and clock step changes in the cached timescale offsets
+	    Sntp_TimeRefreshOffsets();
+	    Sntp_ShmPublish(&shmExport);
+	    Sntp_TopKRotateIfDue(&topTalkers, 60);
+	    Sntp_FleetRotateIfDue(&fleet, 60);
+	    offsetsRefreshed = time(NULL);
+	    // Requests arriving from here on queue on the socket for the successor
+	    if (handoffFd >= 0 && Sntp_HandoffOffer(handoffFd, &sockfd, 1) == 1) {
+	        printf("Handed the socket off to a new server\n");
+	        running = 0;
+	    }
+	}
+    }
+    if (server_args.capture != NULL) {
+        // Wait for the writer to drain the ring and close the file
+        Sntp_PcapShutdown(&capture);
+        pthread_join(captureThread, NULL);
+        printf("Captured %u requests to %s, %u dropped\n", capture.captured, server_args.capture, capture.dropped);
+    }
+    Sntp_StatLogClose(&statLog);
+    Sntp_ShmClose(&shmExport);
+    if (handoffFd >= 0) {
+        close(handoffFd);
+    }
+    printWakeHist();
+    Sntp_TopKWrite(&topTalkers, stdout);
+    Sntp_FleetWrite(&fleet, stdout);
+    if (server_args.stage_sample != 0) {
+        printStages();
     }
+    printf("Shed: critical %u, normal %u, best effort %u (%u KoD RATE sent), level %u\n", shed.shed[0], shed.shed[1],
+           shed.shed[2], shed.kod, shed.level);
+    printf("Kernel drops: %u, peak receive queue: %u bytes\n", sockStats.drops, sockStats.peakQueue);
+    printf("Spinning: %llums, sleeping: %llums\n", (unsigned long long)(poller.spinNs / 1000000),
+           (unsigned long long)(poller.sleepNs / 1000000));
     printf("Done\n");
 }
 
@@ -0,0 +1,129 @@
+/*
+ * Shared-memory time reader example.
+ *
+ * Attaches to the segment a server exports with --shm (or the app with
+ * SNTP_SHM_NAME) and prints the served time once a second with its age,
+ * the leap state and its difference from the system clock, then the cost
+ * of a read measured over many reads.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "shm_reader.h"
+
+#define NTP_UNIX_OFFSET 2208988800ULL
+#define TIMING_READS    1000000
+
+static const char *scaleNames[SNTP_SHM_SCALES] = { "utc", "tai", "met" };
+
+// Command-line Argument Parsing
+typedef struct {
+    const char *name;
+    unsigned    scale;
+    int         count;
+} example_args_t;
+
+example_args_t example_args = {
+    .name = "/sntp_time",
+    .scale = 0,
+    .count = 5
+};
+
+void printUsage() {
+    printf("Usage: sntp_shm_example [options]\n");
+    printf("Options:\n");
+    printf("  -n, --name <name>         Shared memory object (default: /sntp_time)\n");
+    printf("  -s, --scale <utc|tai|met> Timescale to read (default: utc)\n");
+    printf("  -c, --count <n>           Readings to print, one a second (default: 5)\n");
+    printf("  --help                    Display this help message\n");
+}
+
+void parseCommandLineArgs(int argc, char* argv[]) {
+    for (int i = 1; i < argc; i += 2) {
+        if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
+            printUsage();
+            exit(EXIT_SUCCESS);
+        } else if (i + 1 < argc) {
+            if (strcmp(argv[i], "-n") == 0 || strcmp(argv[i], "--name") == 0) {
+                example_args.name = argv[i + 1];
+            } else if (strcmp(argv[i], "-s") == 0 || strcmp(argv[i], "--scale") == 0) {
+                for (example_args.scale = 0; example_args.scale < SNTP_SHM_SCALES; example_args.scale++) {
+                    if (strcmp(argv[i + 1], scaleNames[example_args.scale]) == 0) {
+                        break;
+                    }
+                }
+                if (example_args.scale == SNTP_SHM_SCALES) {
+                    fprintf(stderr, "Unknown timescale: %s\n", argv[i + 1]);
+                    exit(EXIT_FAILURE);
+                }
+            } else if (strcmp(argv[i], "-c") == 0 || strcmp(argv[i], "--count") == 0) {
+                example_args.count = atoi(argv[i + 1]);
+            } else {
+                fprintf(stderr, "Unknown option: %s\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        } else {
+            fprintf(stderr, "Unknown option or missing value for option: %s\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+static void print_reading( const Sntp_ShmReading_t *r ) {
+    time_t secs = (time_t)( ( r->time >> 32 ) - NTP_UNIX_OFFSET );
+    struct timespec sys;
+    struct tm tm;
+    char when[32];
+    int64_t diffNs;
+
+    clock_gettime(CLOCK_REALTIME, &sys);
+    diffNs = ( (int64_t)( r->time >> 32 ) - (int64_t)NTP_UNIX_OFFSET - (int64_t)sys.tv_sec ) * 1000000000LL +
+             (int64_t)( ( ( r->time & 0xffffffffULL ) * 1000000000ULL ) >> 32 ) - sys.tv_nsec;
+    gmtime_r(&secs, &tm);
+    strftime(when, sizeof(when), "%Y-%m-%dT%H:%M:%S", &tm);
+    printf("%s %s.%06uZ  age %llu ms%s  leap %u%s  source %u  served - system %+lld us\n",
+           scaleNames[example_args.scale], when, (unsigned)( ( ( r->time & 0xffffffffULL ) * 1000000 ) >> 32 ),
+           (unsigned long long)( r->ageNs / 1000000 ), Sntp_ShmStale(r) ? " (stale)" : "", r->leapIndicator,
+           r->leapSecs != 0 ? " (scheduled)" : "", r->timeSource, (long long)( diffNs / 1000 ));
+}
+
+int main(int argc, char* argv[]) {
+    Sntp_ShmReader_t reader;
+    Sntp_ShmReading_t r;
+    struct timespec start, end;
+    uint64_t failed = 0;
+
+    parseCommandLineArgs(argc, argv);
+    if (Sntp_ShmReaderOpen(&reader, example_args.name) != 0) {
+        fprintf(stderr, "Unable to attach %s: %s\n", example_args.name, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    for (int i = 0; i < example_args.count; i++) {
+        if (i != 0) {
+            sleep(1);
+        }
+        if (Sntp_ShmRead(&reader, example_args.scale, &r)) {
+            print_reading(&r);
+        } else {
+            printf("no time published yet\n");
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < TIMING_READS; i++) {
+        failed += !Sntp_ShmRead(&reader, example_args.scale, &r);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("%d reads, %.1f ns per read, %llu failed\n", TIMING_READS,
+           ( ( end.tv_sec - start.tv_sec ) * 1e9 + ( end.tv_nsec - start.tv_nsec ) ) / TIMING_READS,
+           (unsigned long long)failed);
+
+    Sntp_ShmReaderClose(&reader);
+    return EXIT_SUCCESS;
+}
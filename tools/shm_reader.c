@@ -0,0 +1,94 @@
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "shm_reader.h"
+#include "sntp_utils.h"
+
+#define SHM_READ_RETRIES 1000
+
+int Sntp_ShmReaderOpen( Sntp_ShmReader_t *reader, const char *name ) {
+    int fd;
+    void *map;
+    const Sntp_ShmTime_t *seg;
+
+    reader->seg = NULL;
+    fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    map = mmap(NULL, sizeof(Sntp_ShmTime_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    seg = map;
+    if (seg->magic != SNTP_SHM_MAGIC || seg->version != SNTP_SHM_VERSION || seg->size != sizeof(Sntp_ShmTime_t)) {
+        munmap(map, sizeof(Sntp_ShmTime_t));
+        errno = EPROTO;
+        return -1;
+    }
+    reader->seg = map;
+    return 0;
+}
+
+/** Signed nanoseconds to an NTP 32.32 interval */
+static int64_t ns_to_ntp( int64_t ns ) {
+    uint64_t mag = ( ns < 0 ) ? (uint64_t)-ns : (uint64_t)ns;
+    uint64_t ntp = ( ( mag / 1000000000ULL ) << 32 ) + ( ( mag % 1000000000ULL ) << 32 ) / 1000000000ULL;
+    return ( ns < 0 ) ? -(int64_t)ntp : (int64_t)ntp;
+}
+
+bool Sntp_ShmRead( const Sntp_ShmReader_t *reader, unsigned scale, Sntp_ShmReading_t *out ) {
+    Sntp_ShmTime_t *seg = (Sntp_ShmTime_t *)reader->seg;
+    struct timespec now;
+    uint64_t monoNs, anchor, nowNs;
+    int64_t rate, dNs;
+    uint32_t seq;
+
+    if (seg == NULL || scale >= SNTP_SHM_SCALES) {
+        return false;
+    }
+    for (int tries = 0;; tries++) {
+        if (tries == SHM_READ_RETRIES) {
+            return false;
+        }
+        seq = __atomic_load_n(&seg->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) {
+            continue;
+        }
+        monoNs = __atomic_load_n(&seg->monoNs, __ATOMIC_RELAXED);
+        anchor = __atomic_load_n(&seg->anchor[scale], __ATOMIC_RELAXED);
+        rate = __atomic_load_n(&seg->rate, __ATOMIC_RELAXED);
+        out->periodMs = __atomic_load_n(&seg->periodMs, __ATOMIC_RELAXED);
+        out->leapSecs = __atomic_load_n(&seg->leapSecs, __ATOMIC_RELAXED);
+        out->leapIndicator = __atomic_load_n(&seg->leapIndicator, __ATOMIC_RELAXED);
+        out->timeSource = __atomic_load_n(&seg->timeSource, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&seg->seq, __ATOMIC_RELAXED) == seq) {
+            break;
+        }
+    }
+    if (monoNs == 0) {
+        return false;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    nowNs = (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+    dNs = (int64_t)( nowNs - monoNs );
+    out->ageNs = ( dNs > 0 ) ? (uint64_t)dNs : 0;
+    // The rate correction stays well inside 64 bits for any age under a day
+    dNs += Sntp_MulShift(dNs, rate, 32);
+    out->time = anchor + (uint64_t)ns_to_ntp(dNs);
+    return true;
+}
+
+void Sntp_ShmReaderClose( Sntp_ShmReader_t *reader ) {
+    if (reader->seg != NULL) {
+        munmap((void *)reader->seg, sizeof(Sntp_ShmTime_t));
+        reader->seg = NULL;
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef __SNTP_SHM_READER__
+#define __SNTP_SHM_READER__
+
+/**
+ * Reader for the shared-memory time export (sntp_shm.h).
+ *
+ * Link sntp_shm_reader into a process on the same host as the server to
+ * read the served time with no network round trip: a read is a few loads
+ * from the shared segment and a CLOCK_MONOTONIC read.  The reader never
+ * writes to the segment, so any number of processes can read at once and
+ * a reader cannot stall the server.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sntp_shm.h"
+
+typedef struct {
+    const volatile Sntp_ShmTime_t *seg;
+} Sntp_ShmReader_t;
+
+typedef struct {
+    uint64_t time;          /**< Served time, NTP seconds and 2^-32 fractions */
+    uint64_t ageNs;         /**< Time since the anchor it was extrapolated from */
+    uint32_t periodMs;      /**< Writer's publishing interval */
+    uint32_t leapSecs;      /**< Scheduled leap second in NTP seconds, 0 if none */
+    uint8_t  leapIndicator;
+    uint8_t  timeSource;
+} Sntp_ShmReading_t;
+
+/** Map the segment read-only
+ * @return 0, or -1 with errno set; EPROTO if the segment is not a known version of the layout
+ */
+int Sntp_ShmReaderOpen( Sntp_ShmReader_t *reader, const char *name );
+
+/** Extrapolate the served time on a timescale (0 UTC, 1 TAI, 2 MET) to now
+ * @return false if nothing has been published yet, or the writer kept the segment busy past the retry limit
+ */
+bool Sntp_ShmRead( const Sntp_ShmReader_t *reader, unsigned scale, Sntp_ShmReading_t *out );
+
+/** True if the anchor is older than a few publishing intervals, i.e. the writer has stopped */
+static inline bool Sntp_ShmStale( const Sntp_ShmReading_t *r ) {
+    return r->ageNs > 3ULL * r->periodMs * 1000000ULL;
+}
+
+void Sntp_ShmReaderClose( Sntp_ShmReader_t *reader );
+
+#endif
@@ -0,0 +1,244 @@
+/*
+ * Statistics log converter.
+ *
+ * Reads a per-second statistics log written by the app or the standalone
+ * server (sntp_statlog.h) and prints it, oldest record first, as CSV or as
+ * ntpd sysstats lines.  Logs written on a host of the other byte order are
+ * recognised by the header magic and swapped.  Records can be summed over
+ * longer intervals, e.g. -i 3600 for ntpd's usual hourly sysstats.
+ *
+ * Slots whose sequence number is not the expected one were overwritten
+ * while the log was copied, or never written, and are skipped.  Gaps in the
+ * record times show when the server was not running.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+
+#include "sntp_statlog.h"
+
+#define NTP_UNIX_OFFSET 2208988800ULL /* Seconds from 1900 to 1970 */
+#define NTP_MJD_OFFSET  15020         /* MJD of the NTP epoch */
+
+typedef enum {
+    OUTPUT_CSV,
+    OUTPUT_SYSSTATS
+} output_t;
+
+// Command-line Argument Parsing
+typedef struct {
+    const char *log;
+    const char *out;
+    output_t    format;
+    uint32_t    interval;
+} convert_args_t;
+
+convert_args_t convert_args = {
+    .log = NULL,
+    .out = NULL,
+    .format = OUTPUT_CSV,
+    .interval = 1
+};
+
+void printUsage() {
+    printf("Usage: sntp_statlog [options] <statistics log>\n");
+    printf("Options:\n");
+    printf("  -f, --format <csv|sysstats>  Output format (default: csv)\n");
+    printf("  -i, --interval <seconds>     Sum records over this many seconds (default: 1)\n");
+    printf("  -o, --output <file>          Write here instead of stdout\n");
+    printf("  --help                       Display this help message\n");
+}
+
+void parseCommandLineArgs(int argc, char* argv[]) {
+    for (int i = 1; i < argc; i += 2) {
+        if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
+            printUsage();
+            exit(EXIT_SUCCESS);
+        } else if (argv[i][0] != '-') {
+            convert_args.log = argv[i];
+            i--;
+        } else if (i + 1 < argc) {
+            if (strcmp(argv[i], "-f") == 0 || strcmp(argv[i], "--format") == 0) {
+                if (strcmp(argv[i + 1], "csv") == 0) {
+                    convert_args.format = OUTPUT_CSV;
+                } else if (strcmp(argv[i + 1], "sysstats") == 0) {
+                    convert_args.format = OUTPUT_SYSSTATS;
+                } else {
+                    fprintf(stderr, "Unknown format: %s\n", argv[i + 1]);
+                    exit(EXIT_FAILURE);
+                }
+            } else if (strcmp(argv[i], "-i") == 0 || strcmp(argv[i], "--interval") == 0) {
+                convert_args.interval = atoi(argv[i + 1]);
+            } else if (strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "--output") == 0) {
+                convert_args.out = argv[i + 1];
+            } else {
+                fprintf(stderr, "Unknown option: %s\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        } else {
+            fprintf(stderr, "Unknown option or missing value for option: %s\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (convert_args.log == NULL || convert_args.interval == 0) {
+        printUsage();
+        exit(EXIT_FAILURE);
+    }
+}
+
+/** Byte-swap every field; the record is made of 32- and 64-bit fields only */
+static void swap_record( Sntp_StatRecord_t *rec ) {
+    uint32_t *words = (uint32_t *)&rec->requests;
+
+    rec->seq = __builtin_bswap64(rec->seq);
+    rec->time = __builtin_bswap64(rec->time);
+    for (size_t i = 0; i < ( sizeof(*rec) - offsetof(Sntp_StatRecord_t, requests) ) / sizeof(uint32_t); i++) {
+        words[i] = __builtin_bswap32(words[i]);
+    }
+}
+
+/** Read and check the header, swapping it if the log was written in the other byte order */
+static bool read_header( FILE *in, Sntp_StatLogHeader_t *hdr, bool *swap ) {
+    if (fread(hdr, sizeof(*hdr), 1, in) != 1) {
+        return false;
+    }
+    *swap = ( hdr->magic == __builtin_bswap32(SNTP_STATLOG_MAGIC) );
+    if (*swap) {
+        hdr->version = __builtin_bswap16(hdr->version);
+        hdr->recordSize = __builtin_bswap16(hdr->recordSize);
+        hdr->capacity = __builtin_bswap32(hdr->capacity);
+        hdr->written = __builtin_bswap64(hdr->written);
+    } else if (hdr->magic != SNTP_STATLOG_MAGIC) {
+        return false;
+    }
+    return hdr->version == SNTP_STATLOG_VERSION && hdr->recordSize == sizeof(Sntp_StatRecord_t) &&
+           hdr->capacity != 0;
+}
+
+static void format_time( uint64_t ntp, char *buf, size_t len ) {
+    time_t secs = (time_t)( ( ntp >> 32 ) - NTP_UNIX_OFFSET );
+    struct tm tm;
+
+    gmtime_r(&secs, &tm);
+    strftime(buf, len, "%Y-%m-%dT%H:%M:%S", &tm);
+    snprintf(buf + strlen(buf), len - strlen(buf), ".%03uZ", (unsigned)( ( ( ntp & 0xffffffffULL ) * 1000 ) >> 32 ));
+}
+
+static void write_header( FILE *out ) {
+    if (convert_args.format == OUTPUT_CSV) {
+        fprintf(out, "time_utc,seconds,requests,bad_requests,auth_failures,shed,kernel_drops,wake_p50_us,wake_p99_us,"
+                     "wake_max_us,smear_us,time_source,leap_indicator,shed_level\n");
+    }
+}
+
+/** Write one interval: counts summed, latencies the worst second's, clock state the last second's */
+static void write_interval( FILE *out, const Sntp_StatRecord_t *sum, uint32_t seconds ) {
+    char when[40];
+    uint64_t ntpSecs = sum->time >> 32;
+    uint32_t received = sum->requests + sum->badRequests + sum->authFailures + sum->shed;
+
+    if (convert_args.format == OUTPUT_CSV) {
+        format_time(sum->time, when, sizeof(when));
+        fprintf(out, "%s,%u,%u,%u,%u,%u,%u,%u,%u,%u,%d,%u,%u,%u\n", when, seconds, sum->requests, sum->badRequests,
+                sum->authFailures, sum->shed, sum->kernelDrops, sum->wakeP50Us, sum->wakeP99Us, sum->wakeMaxUs,
+                sum->smearUs, sum->timeSource, sum->leapIndicator, sum->shedLevel);
+    } else {
+        // day, second, interval, received, for this host, current version, old version, access denied,
+        // bad length or format, bad authentication, declined, rate exceeded
+        fprintf(out, "%llu %llu.%03u %u %u %u %u 0 0 %u %u 0 %u\n",
+                (unsigned long long)( ntpSecs / 86400 + NTP_MJD_OFFSET ), (unsigned long long)( ntpSecs % 86400 ),
+                (unsigned)( ( ( sum->time & 0xffffffffULL ) * 1000 ) >> 32 ), seconds, received, sum->requests,
+                sum->requests, sum->badRequests, sum->authFailures, sum->shed);
+    }
+}
+
+static void accumulate( Sntp_StatRecord_t *sum, const Sntp_StatRecord_t *rec ) {
+    sum->requests += rec->requests;
+    sum->badRequests += rec->badRequests;
+    sum->authFailures += rec->authFailures;
+    sum->shed += rec->shed;
+    sum->kernelDrops += rec->kernelDrops;
+    sum->wakeP50Us = ( rec->wakeP50Us > sum->wakeP50Us ) ? rec->wakeP50Us : sum->wakeP50Us;
+    sum->wakeP99Us = ( rec->wakeP99Us > sum->wakeP99Us ) ? rec->wakeP99Us : sum->wakeP99Us;
+    sum->wakeMaxUs = ( rec->wakeMaxUs > sum->wakeMaxUs ) ? rec->wakeMaxUs : sum->wakeMaxUs;
+    sum->time = rec->time;
+    sum->smearUs = rec->smearUs;
+    sum->timeSource = rec->timeSource;
+    sum->leapIndicator = rec->leapIndicator;
+    sum->shedLevel = rec->shedLevel;
+}
+
+int main(int argc, char* argv[]) {
+    Sntp_StatLogHeader_t hdr;
+    Sntp_StatRecord_t rec, sum;
+    uint64_t count, first, stale = 0, converted = 0;
+    uint64_t intervalStart = 0;
+    uint32_t seconds = 0;
+    bool swap;
+    FILE *in, *out;
+
+    parseCommandLineArgs(argc, argv);
+    in = fopen(convert_args.log, "rb");
+    if (in == NULL) {
+        fprintf(stderr, "Unable to open %s: %s\n", convert_args.log, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    if (!read_header(in, &hdr, &swap)) {
+        fprintf(stderr, "%s is not a version %u statistics log\n", convert_args.log, SNTP_STATLOG_VERSION);
+        return EXIT_FAILURE;
+    }
+    out = ( convert_args.out != NULL ) ? fopen(convert_args.out, "w") : stdout;
+    if (out == NULL) {
+        fprintf(stderr, "Unable to open %s: %s\n", convert_args.out, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    count = ( hdr.written < hdr.capacity ) ? hdr.written : hdr.capacity;
+    first = hdr.written - count;
+    write_header(out);
+    memset(&sum, 0, sizeof(sum));
+    for (uint64_t i = first; i < hdr.written; i++) {
+        long offset = (long)( sizeof(hdr) + ( i % hdr.capacity ) * sizeof(rec) );
+        if (fseek(in, offset, SEEK_SET) != 0 || fread(&rec, sizeof(rec), 1, in) != 1) {
+            fprintf(stderr, "%s is truncated\n", convert_args.log);
+            break;
+        }
+        if (swap) {
+            swap_record(&rec);
+        }
+        if (rec.seq != i + 1) {
+            stale++;
+            continue;
+        }
+
+        // An interval ends after its length in seconds or at a gap in the log
+        if (seconds != 0 && ( ( rec.time >> 32 ) - intervalStart >= convert_args.interval ||
+                              ( rec.time >> 32 ) < ( sum.time >> 32 ) )) {
+            write_interval(out, &sum, seconds);
+            memset(&sum, 0, sizeof(sum));
+            seconds = 0;
+        }
+        if (seconds == 0) {
+            intervalStart = rec.time >> 32;
+        }
+        accumulate(&sum, &rec);
+        seconds++;
+        converted++;
+    }
+    if (seconds != 0) {
+        write_interval(out, &sum, seconds);
+    }
+
+    fprintf(stderr, "%llu records converted, %llu stale slots skipped, %llu written in total\n",
+            (unsigned long long)converted, (unsigned long long)stale, (unsigned long long)hdr.written);
+    if (out != stdout && fclose(out) != 0) {
+        fprintf(stderr, "Unable to write %s: %s\n", convert_args.out, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    fclose(in);
+    return EXIT_SUCCESS;
+}
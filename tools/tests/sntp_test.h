@@ -0,0 +1,37 @@
+#ifndef __SNTP_TEST__
+#define __SNTP_TEST__
+
+/**
+ * Minimal checks for the host unit tests run by ctest.
+ *
+ * A failed check prints its location and expression and the test carries
+ * on; main() returns TEST_RESULT() so ctest sees any failure.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+static int sntp_test_failures;
+
+#define CHECK(cond)                                                                   \
+    do {                                                                              \
+        if (!( cond )) {                                                              \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            sntp_test_failures++;                                                     \
+        }                                                                             \
+    } while (0)
+
+#define CHECK_EQ(a, b)                                                                                  \
+    do {                                                                                                \
+        long long va_ = (long long)( a ), vb_ = (long long)( b );                                       \
+        if (va_ != vb_) {                                                                               \
+            fprintf(stderr, "%s:%d: %s == %s failed: %lld != %lld\n", __FILE__, __LINE__, #a, #b, va_, vb_); \
+            sntp_test_failures++;                                                                       \
+        }                                                                                               \
+    } while (0)
+
+#define CHECK_MEM(a, b, len) CHECK(memcmp(( a ), ( b ), ( len )) == 0)
+
+#define TEST_RESULT() ( sntp_test_failures != 0 )
+
+#endif
@@ -0,0 +1,125 @@
+/*
+ * AES-128-CMAC and MAC trailer tests.
+ *
+ * The CMAC is checked against the RFC 4493 section 4 vectors, which cover an
+ * empty message, complete and padded final blocks and the subkeys; ntpd and
+ * chrony compute the same function, so passing these is what makes keys
+ * interchangeable with them.
+ */
+#include <stdint.h>
+#include <arpa/inet.h>
+
+#include "sntp_auth.h"
+#include "sntp_test.h"
+
+static const uint8_t rfcKey[16] = { 0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+                                    0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c };
+
+static const uint8_t rfcMsg[64] = {
+    0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a,
+    0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c, 0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51,
+    0x30, 0xc8, 0x1c, 0x46, 0xa3, 0x5c, 0xe4, 0x11, 0xe5, 0xfb, 0xc1, 0x19, 0x1a, 0x0a, 0x52, 0xef,
+    0xf6, 0x9f, 0x24, 0x45, 0xdf, 0x4f, 0x9b, 0x17, 0xad, 0x2b, 0x41, 0x7b, 0xe6, 0x6c, 0x37, 0x10
+};
+
+static const struct {
+    size_t  len;
+    uint8_t mac[16];
+} rfcVectors[] = {
+    { 0, { 0xbb, 0x1d, 0x69, 0x29, 0xe9, 0x59, 0x37, 0x28, 0x7f, 0xa3, 0x7d, 0x12, 0x9b, 0x75, 0x67, 0x46 } },
+    { 16, { 0x07, 0x0a, 0x16, 0xb4, 0x6b, 0x4d, 0x41, 0x44, 0xf7, 0x9b, 0xdd, 0x9d, 0xd0, 0x4a, 0x28, 0x7c } },
+    { 40, { 0xdf, 0xa6, 0x67, 0x47, 0xde, 0x9a, 0xe6, 0x30, 0x30, 0xca, 0x32, 0x61, 0x14, 0x97, 0xc8, 0x27 } },
+    { 64, { 0x51, 0xf0, 0xbe, 0xbf, 0x7e, 0x3b, 0x9d, 0x92, 0xfc, 0x49, 0x74, 0x17, 0x79, 0x36, 0x3c, 0xfe } },
+};
+
+static void test_rfc4493( void ) {
+    static const uint8_t k1[16] = { 0xfb, 0xee, 0xd6, 0x18, 0x35, 0x71, 0x33, 0x66,
+                                    0x7c, 0x85, 0xe0, 0x8f, 0x72, 0x36, 0xa8, 0xde };
+    static const uint8_t k2[16] = { 0xf7, 0xdd, 0xac, 0x30, 0x6a, 0xe2, 0x66, 0xcc,
+                                    0xf9, 0x0b, 0xc1, 0x1e, 0xe4, 0x6d, 0x51, 0x3b };
+    Sntp_AuthKeySet_t set;
+    uint8_t mac[SNTP_AUTH_DIGEST_SIZE];
+
+    Sntp_AuthClearKeys(&set);
+    CHECK_EQ(Sntp_AuthAddKey(&set, 1, rfcKey, sizeof(rfcKey)), SntpSuccess);
+    CHECK_MEM(set.keys[0].k1, k1, 16);
+    CHECK_MEM(set.keys[0].k2, k2, 16);
+
+    for (size_t i = 0; i < sizeof(rfcVectors) / sizeof(rfcVectors[0]); i++) {
+        Sntp_AuthCmac(&set.keys[0], rfcMsg, rfcVectors[i].len, mac);
+        CHECK_MEM(mac, rfcVectors[i].mac, sizeof(mac));
+    }
+}
+
+static void test_add_key( void ) {
+    Sntp_AuthKeySet_t set;
+    uint8_t key[SNTP_AUTH_KEY_LEN + 1] = { 0 };
+
+    Sntp_AuthClearKeys(&set);
+    CHECK_EQ(Sntp_AuthAddKey(&set, 0, key, SNTP_AUTH_KEY_LEN), SntpErrorBadParameter);
+    CHECK_EQ(Sntp_AuthAddKey(&set, 1, key, SNTP_AUTH_KEY_LEN - 1), SntpErrorBadParameter);
+    CHECK_EQ(Sntp_AuthAddKey(&set, 1, key, SNTP_AUTH_KEY_LEN + 1), SntpErrorBadParameter);
+    for (uint32_t id = 1; id <= SNTP_AUTH_MAX_KEYS; id++) {
+        CHECK_EQ(Sntp_AuthAddKey(&set, id, key, SNTP_AUTH_KEY_LEN), SntpSuccess);
+    }
+    CHECK_EQ(Sntp_AuthAddKey(&set, SNTP_AUTH_MAX_KEYS + 1, key, SNTP_AUTH_KEY_LEN), SntpErrorBadParameter);
+    CHECK(Sntp_AuthFindKey(&set, SNTP_AUTH_MAX_KEYS) != NULL);
+    CHECK(Sntp_AuthFindKey(&set, SNTP_AUTH_MAX_KEYS + 1) == NULL);
+}
+
+static void test_parse_spec( void ) {
+    uint8_t key[SNTP_AUTH_KEY_LEN];
+    uint32_t keyId;
+    size_t keyLen;
+
+    CHECK_EQ(Sntp_AuthParseKeySpec("7:000102030405060708090a0b0c0d0e0f", &keyId, key, &keyLen), SntpSuccess);
+    CHECK_EQ(keyId, 7);
+    CHECK_EQ(keyLen, SNTP_AUTH_KEY_LEN);
+    CHECK_EQ(key[15], 0x0f);
+    CHECK_EQ(Sntp_AuthParseKeySpec("7:000102030405060708090a0b0c0d0e0f10", &keyId, key, &keyLen), SntpErrorBadParameter);
+    CHECK_EQ(Sntp_AuthParseKeySpec("0:00", &keyId, key, &keyLen), SntpErrorBadParameter);
+    CHECK_EQ(Sntp_AuthParseKeySpec("7:0g", &keyId, key, &keyLen), SntpErrorBadParameter);
+    CHECK_EQ(Sntp_AuthParseKeySpec("7:000", &keyId, key, &keyLen), SntpErrorBadParameter);
+}
+
+static void test_sign_verify( void ) {
+    Sntp_AuthKeySet_t set;
+    const Sntp_AuthKey_t *key;
+    uint8_t pkt[SNTP_PACKET_BASE_SIZE + SNTP_AUTH_MAC_SIZE];
+    uint32_t keyId;
+    size_t len;
+
+    Sntp_AuthClearKeys(&set);
+    Sntp_AuthAddKey(&set, 42, rfcKey, sizeof(rfcKey));
+    for (size_t i = 0; i < SNTP_PACKET_BASE_SIZE; i++) {
+        pkt[i] = (uint8_t)i;
+    }
+
+    len = Sntp_AuthSign(&set.keys[0], pkt, SNTP_PACKET_BASE_SIZE);
+    CHECK_EQ(len, SNTP_PACKET_BASE_SIZE + SNTP_AUTH_MAC_SIZE);
+    memcpy(&keyId, pkt + SNTP_PACKET_BASE_SIZE, sizeof(keyId));
+    CHECK_EQ(ntohl(keyId), 42);
+    CHECK_EQ(Sntp_AuthVerify(&set, pkt, len, &key), SntpSuccess);
+    CHECK(key == &set.keys[0]);
+
+    // Any bit of the header or the digest breaks it
+    pkt[SNTP_PACKET_BASE_SIZE - 1] ^= 0x01;
+    CHECK_EQ(Sntp_AuthVerify(&set, pkt, len, &key), SntpErrorAuthFailure);
+    pkt[SNTP_PACKET_BASE_SIZE - 1] ^= 0x01;
+    pkt[len - 1] ^= 0x80;
+    CHECK_EQ(Sntp_AuthVerify(&set, pkt, len, &key), SntpErrorAuthFailure);
+    pkt[len - 1] ^= 0x80;
+
+    keyId = htonl(43);
+    memcpy(pkt + SNTP_PACKET_BASE_SIZE, &keyId, sizeof(keyId));
+    CHECK_EQ(Sntp_AuthVerify(&set, pkt, len, &key), SntpServerNotAuthenticated);
+    CHECK_EQ(Sntp_AuthVerify(&set, pkt, SNTP_PACKET_BASE_SIZE, &key), SntpErrorAuthFailure);
+}
+
+int main( void ) {
+    test_rfc4493();
+    test_add_key();
+    test_parse_spec();
+    test_sign_verify();
+    return TEST_RESULT();
+}
@@ -0,0 +1,144 @@
+/*
+ * Batch answering: Sntp_ServerProcessBatch() against the per-request engine.
+ */
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "sntp_server.h"
+#include "sntp_utils.h"
+#include "sntp_ext.h"
+#include "sntp_test.h"
+
+#define ORIGIN_OFFSET   24
+#define RECEIVE_OFFSET  32
+#define TRANSMIT_OFFSET 40
+
+static uint64_t get_ntp64( const uint8_t *p ) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) {
+        v = ( v << 8 ) | p[i];
+    }
+    return v;
+}
+
+/** NTP 32.32 difference in microseconds */
+static int64_t ntp_us( uint64_t later, uint64_t earlier ) {
+    return ( ( (int64_t)( later - earlier ) ) * 1000000 ) >> 32;
+}
+
+static void make_request( uint8_t *req, uint8_t mode, uint8_t fill ) {
+    memset(req, 0, SNTP_PACKET_BASE_SIZE);
+    req[0] = ( 4 << 3 ) | mode;
+    memset(req + TRANSMIT_OFFSET, fill, 8);
+}
+
+static struct timespec ago( const struct timespec *now, long ns ) {
+    struct timespec t = *now;
+    t.tv_nsec -= ns;
+    while (t.tv_nsec < 0) {
+        t.tv_nsec += 1000000000L;
+        t.tv_sec--;
+    }
+    return t;
+}
+
+/** Each receive time is backdated by its kernel timestamp's age; zero dates it at the transmit read */
+static void test_receive_times( void ) {
+    Sntp_ServerConfig_t cfg = { .stratum = 1, .scale = SNTP_SCALE_UTC };
+    Sntp_ServerStats_t stats = { 0 };
+    uint8_t reqBuf[4][SNTP_PACKET_BASE_SIZE + SNTP_EXT_MIN_FIELD];
+    uint8_t respBuf[4][SNTP_SERVER_MAX_RESPONSE];
+    const uint8_t *reqs[4];
+    uint8_t *resps[4];
+    size_t reqLens[4], respLens[4];
+    SntpStatus_t status[4];
+    struct timespec now, rxTimes[4];
+    const long agesNs[4] = { 0, 5000000L, 250000000L, 0 };
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    // The last carries an unknown extension field, so is answered by the engine rather than the kernel, and dated
+    // the same way
+    memset(reqBuf[3], 0, sizeof(reqBuf[3]));
+    for (int i = 0; i < 4; i++) {
+        make_request(reqBuf[i], SNTP_MODE_CLIENT, (uint8_t)( 0x11 * ( i + 1 ) ));
+        reqs[i] = reqBuf[i];
+        resps[i] = respBuf[i];
+        reqLens[i] = SNTP_PACKET_BASE_SIZE;
+        rxTimes[i] = ( agesNs[i] == 0 ) ? (struct timespec){ 0 } : ago(&now, agesNs[i]);
+    }
+    reqLens[3] = Sntp_ExtPutField(reqBuf[3], SNTP_PACKET_BASE_SIZE, 0x0f01, NULL, SNTP_EXT_MIN_FIELD - 4);
+
+    Sntp_ServerProcessBatch(&cfg, &stats, rxTimes, reqs, reqLens, resps, respLens, status, 4);
+
+    for (int i = 0; i < 4; i++) {
+        uint64_t rx = get_ntp64(respBuf[i] + RECEIVE_OFFSET), tx = get_ntp64(respBuf[i] + TRANSMIT_OFFSET);
+        int64_t ageUs = ntp_us(tx, rx);
+
+        CHECK_EQ(status[i], SntpSuccess);
+        CHECK_EQ(respLens[i], SNTP_PACKET_BASE_SIZE);
+        CHECK_EQ(respBuf[i][0] & SNTP_MODE_BITS_MASK, SNTP_MODE_SERVER);
+        CHECK_MEM(respBuf[i] + ORIGIN_OFFSET, reqBuf[i] + TRANSMIT_OFFSET, 8);
+        // The batch reads the clock a little after the test did, never before
+        CHECK(ageUs >= agesNs[i] / 1000);
+        CHECK(ageUs < agesNs[i] / 1000 + 50000);
+    }
+    CHECK_EQ(ntp_us(get_ntp64(respBuf[0] + TRANSMIT_OFFSET), get_ntp64(respBuf[0] + RECEIVE_OFFSET)), 0);
+    CHECK_EQ(get_ntp64(respBuf[0] + TRANSMIT_OFFSET), get_ntp64(respBuf[2] + TRANSMIT_OFFSET));
+}
+
+/** The kernel's responses match the engine's in every byte but the receive and transmit times */
+static void test_matches_engine( void ) {
+    static const uint8_t firstBytes[] = {
+        ( 4 << 3 ) | SNTP_MODE_CLIENT, ( 3 << 3 ) | SNTP_MODE_CLIENT, ( 1 << 3 ) | SNTP_MODE_CLIENT,
+        ( 4 << 3 ) | SNTP_MODE_SERVER, ( 4 << 3 ) | SNTP_MODE_BROADCAST, ( 0 << 3 ) | SNTP_MODE_CLIENT,
+        ( 7 << 3 ) | SNTP_MODE_CLIENT, 0xc0 | ( 4 << 3 ) | SNTP_MODE_CLIENT, ( 4 << 3 ) | 1,
+    };
+    enum { N = sizeof(firstBytes) };
+    Sntp_ServerConfig_t cfg = { .stratum = 3, .scale = SNTP_SCALE_UTC };
+    Sntp_ServerStats_t stats = { 0 };
+    uint8_t reqBuf[N][SNTP_PACKET_BASE_SIZE];
+    uint8_t respBuf[N][SNTP_SERVER_MAX_RESPONSE];
+    uint8_t single[SNTP_SERVER_MAX_RESPONSE];
+    const uint8_t *reqs[N];
+    uint8_t *resps[N];
+    size_t reqLens[N], respLens[N], singleLen;
+    SntpStatus_t status[N];
+    static const struct timespec rxTimes[N];
+    SntpTimestamp_t rxTime;
+
+    for (uint32_t i = 0; i < N; i++) {
+        make_request(reqBuf[i], SNTP_MODE_CLIENT, (uint8_t)( 0x21 + i ));
+        reqBuf[i][0] = firstBytes[i];
+        reqBuf[i][RECEIVE_OFFSET] = 0x5a; // Request fields the response must not echo
+        reqs[i] = reqBuf[i];
+        resps[i] = respBuf[i];
+        reqLens[i] = SNTP_PACKET_BASE_SIZE;
+    }
+
+    Sntp_ServerProcessBatch(&cfg, &stats, rxTimes, reqs, reqLens, resps, respLens, status, N);
+
+    Sntp_TimeRead(&rxTime);
+    for (uint32_t i = 0; i < N; i++) {
+        // Server, broadcast and other non-client packets are refused without a response
+        if (!Sntp_IsClientRequest(firstBytes[i])) {
+            CHECK_EQ(status[i], SntpErrorBadParameter);
+            CHECK_EQ(respLens[i], 0);
+            continue;
+        }
+        CHECK_EQ(status[i], SntpSuccess);
+        CHECK_EQ(Sntp_ServerProcessAt(&cfg, &stats, &rxTime, reqBuf[i], SNTP_PACKET_BASE_SIZE, single, &singleLen),
+                 SntpSuccess);
+        CHECK_EQ(respLens[i], singleLen);
+        CHECK_MEM(respBuf[i], single, RECEIVE_OFFSET);
+        // Kernel responses are dated by the batch's one read
+        CHECK_MEM(respBuf[i] + RECEIVE_OFFSET, respBuf[i] + TRANSMIT_OFFSET, 8);
+    }
+}
+
+int main( void ) {
+    Sntp_TimeCalibrate();
+    test_receive_times();
+    test_matches_engine();
+    return TEST_RESULT();
+}
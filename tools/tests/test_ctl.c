@@ -0,0 +1,159 @@
+/*
+ * Control query admission: allow list prefixes and the token bucket rate limits.
+ *
+ * Sntp_CtlAdmitAt() takes the time, so bucket refills are stepped rather than slept through.
+ */
+#include <stdint.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "sntp_ctl.h"
+#include "sntp_test.h"
+
+#define T0 1000000 /* A monotonic time to start from, ms; buckets last used at 0 are unused */
+
+static Sntp_CtlState_t state;
+
+static uint32_t addr( const char *dotted ) {
+    struct in_addr a;
+
+    inet_pton(AF_INET, dotted, &a);
+    return a.s_addr;
+}
+
+/** Queries from one address admitted at one instant, out of tries */
+static uint32_t admitted( const Sntp_CtlConfig_t *cfg, uint32_t from, uint64_t nowMs, uint32_t tries ) {
+    uint32_t n = 0;
+
+    for (uint32_t i = 0; i < tries; i++) {
+        n += Sntp_CtlAdmitAt(cfg, &state, from, nowMs);
+    }
+    return n;
+}
+
+static void test_prefix( void ) {
+    Sntp_CtlPrefix_t p;
+
+    CHECK_EQ(Sntp_CtlMakePrefix("192.168.1.77", 24, &p), SntpSuccess);
+    CHECK_EQ(p.net, addr("192.168.1.0"));
+    CHECK_EQ(p.mask, addr("255.255.255.0"));
+    CHECK_EQ(Sntp_CtlMakePrefix("10.1.2.3", 32, &p), SntpSuccess);
+    CHECK_EQ(p.net, addr("10.1.2.3"));
+    CHECK_EQ(p.mask, 0xffffffffU);
+    CHECK_EQ(Sntp_CtlMakePrefix("10.1.2.3", 0, &p), SntpSuccess);
+    CHECK_EQ(p.net, 0);
+    CHECK_EQ(p.mask, 0);
+    CHECK_EQ(Sntp_CtlMakePrefix("172.16.0.1", 12, &p), SntpSuccess);
+    CHECK_EQ(p.net, addr("172.16.0.0"));
+    CHECK_EQ(p.mask, addr("255.240.0.0"));
+
+    CHECK_EQ(Sntp_CtlMakePrefix("10.1.2.3", 33, &p), SntpErrorBadParameter);
+    CHECK_EQ(Sntp_CtlMakePrefix("256.1.2.3", 8, &p), SntpErrorBadParameter);
+    CHECK_EQ(Sntp_CtlMakePrefix("10.1.2", 8, &p), SntpErrorBadParameter);
+    CHECK_EQ(Sntp_CtlMakePrefix("", 8, &p), SntpErrorBadParameter);
+
+    CHECK_EQ(Sntp_CtlParsePrefix("10.0.0.0/8", &p), SntpSuccess);
+    CHECK_EQ(p.net, addr("10.0.0.0"));
+    CHECK_EQ(p.mask, addr("255.0.0.0"));
+    CHECK_EQ(Sntp_CtlParsePrefix("0.0.0.0/0", &p), SntpSuccess);
+    CHECK_EQ(p.mask, 0);
+    CHECK_EQ(Sntp_CtlParsePrefix("10.0.0.0", &p), SntpErrorBadParameter);
+    CHECK_EQ(Sntp_CtlParsePrefix("10.0.0.0/33", &p), SntpErrorBadParameter);
+    CHECK_EQ(Sntp_CtlParsePrefix("10.0.0.0/8x", &p), SntpErrorBadParameter);
+    CHECK_EQ(Sntp_CtlParsePrefix("10.0.0.0/", &p), SntpErrorBadParameter);
+    CHECK_EQ(Sntp_CtlParsePrefix("host/8", &p), SntpErrorBadParameter);
+}
+
+static void test_allow( void ) {
+    Sntp_CtlConfig_t cfg = { .clientRate = 100, .clientBurst = 100, .totalRate = 1000, .allowCount = 2 };
+
+    CHECK_EQ(Sntp_CtlParsePrefix("10.0.0.0/8", &cfg.allow[0]), SntpSuccess);
+    CHECK_EQ(Sntp_CtlParsePrefix("192.168.1.5/32", &cfg.allow[1]), SntpSuccess);
+    memset(&state, 0, sizeof(state));
+
+    CHECK(Sntp_CtlAdmitAt(&cfg, &state, addr("10.0.0.1"), T0));
+    CHECK(Sntp_CtlAdmitAt(&cfg, &state, addr("10.255.255.255"), T0));
+    CHECK(Sntp_CtlAdmitAt(&cfg, &state, addr("192.168.1.5"), T0));
+    CHECK(!Sntp_CtlAdmitAt(&cfg, &state, addr("11.0.0.1"), T0));
+    CHECK(!Sntp_CtlAdmitAt(&cfg, &state, addr("192.168.1.4"), T0));
+    CHECK(!Sntp_CtlAdmitAt(&cfg, &state, addr("9.255.255.255"), T0));
+    CHECK_EQ(state.queries, 6);
+    CHECK_EQ(state.restricted, 3);
+    CHECK_EQ(state.limited, 0);
+
+    // An empty list answers nobody, and 0.0.0.0/0 everybody
+    cfg.allowCount = 0;
+    CHECK(!Sntp_CtlAdmitAt(&cfg, &state, addr("10.0.0.1"), T0));
+    CHECK_EQ(Sntp_CtlParsePrefix("0.0.0.0/0", &cfg.allow[0]), SntpSuccess);
+    cfg.allowCount = 1;
+    CHECK(Sntp_CtlAdmitAt(&cfg, &state, addr("11.0.0.1"), T0));
+    CHECK_EQ(state.restricted, 4);
+}
+
+/** A client gets its burst at once, then one query per 1/rate seconds, and never more than the burst saved up */
+static void test_client_bucket( void ) {
+    Sntp_CtlConfig_t cfg = { .clientRate = 2, .clientBurst = 3, .totalRate = 1000, .allowCount = 1 };
+    uint32_t client = addr("10.0.0.7");
+
+    Sntp_CtlParsePrefix("0.0.0.0/0", &cfg.allow[0]);
+    memset(&state, 0, sizeof(state));
+
+    CHECK_EQ(admitted(&cfg, client, T0, 10), 3);
+    CHECK_EQ(state.limited, 7);
+    CHECK_EQ(admitted(&cfg, client, T0 + 499, 1), 0);
+    CHECK_EQ(admitted(&cfg, client, T0 + 500, 2), 1);
+    // Refill is kept to the thousandth of a query, so fractions are not lost between queries
+    CHECK_EQ(admitted(&cfg, client, T0 + 750, 1), 0);
+    CHECK_EQ(admitted(&cfg, client, T0 + 1000, 1), 1);
+    CHECK_EQ(admitted(&cfg, client, T0 + 2500, 10), 3);
+    CHECK_EQ(admitted(&cfg, client, T0 + 3600 * 1000, 10), 3);
+
+    // Other clients have buckets of their own
+    CHECK_EQ(admitted(&cfg, addr("10.0.0.8"), T0 + 3600 * 1000, 10), 3);
+    CHECK_EQ(state.queries, 45);
+    CHECK_EQ(state.restricted, 0);
+    CHECK_EQ(state.queries - state.limited, 14);
+}
+
+/** All clients share the total bucket, which bursts to one second's worth */
+static void test_total_bucket( void ) {
+    Sntp_CtlConfig_t cfg = { .clientRate = 5, .clientBurst = 5, .totalRate = 5, .allowCount = 1 };
+    uint32_t n = 0;
+
+    Sntp_CtlParsePrefix("0.0.0.0/0", &cfg.allow[0]);
+    memset(&state, 0, sizeof(state));
+
+    for (uint32_t i = 0; i < 20; i++) {
+        n += admitted(&cfg, htonl(0x0a000000U + i), T0, 1);
+    }
+    CHECK_EQ(n, 5);
+    CHECK_EQ(state.limited, 15);
+    CHECK_EQ(admitted(&cfg, htonl(0x0a000100U), T0 + 199, 1), 0);
+    CHECK_EQ(admitted(&cfg, htonl(0x0a000101U), T0 + 200, 1), 1);
+    CHECK_EQ(admitted(&cfg, htonl(0x0a000102U), T0 + 200, 1), 0);
+}
+
+/** A client taking over another's slot starts with a full burst, and the one it displaced does too on return */
+static void test_shared_slot( void ) {
+    Sntp_CtlConfig_t cfg = { .clientRate = 1, .clientBurst = 2, .totalRate = 1000, .allowCount = 1 };
+    uint32_t a = addr("10.0.0.1"), b = a + 1;
+
+    Sntp_CtlParsePrefix("0.0.0.0/0", &cfg.allow[0]);
+    memset(&state, 0, sizeof(state));
+    while (( ( b * 2654435761U ) >> 26 ) != ( ( a * 2654435761U ) >> 26 )) {
+        b++;
+    }
+
+    CHECK_EQ(admitted(&cfg, a, T0, 5), 2);
+    CHECK_EQ(admitted(&cfg, b, T0, 5), 2);
+    CHECK_EQ(admitted(&cfg, a, T0, 5), 2);
+}
+
+int main( void ) {
+    test_prefix();
+    test_allow();
+    test_client_bucket();
+    test_total_bucket();
+    test_shared_slot();
+    return TEST_RESULT();
+}
@@ -0,0 +1,157 @@
+/*
+ * Extension field scanning: field layout, the trailing MAC rule and Unique Identifier checks.
+ */
+#include <stdint.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "sntp_ext.h"
+#include "sntp_auth.h"
+#include "sntp_test.h"
+
+#define MAX_REQ 256
+
+static uint8_t req[MAX_REQ];
+
+/** Write a field header claiming fieldLen bytes, whatever follows it */
+static size_t put_header( size_t off, uint16_t type, uint16_t fieldLen ) {
+    uint16_t hdr[2] = { htons(type), htons(fieldLen) };
+
+    memcpy(req + off, hdr, sizeof(hdr));
+    return off + fieldLen;
+}
+
+static SntpStatus_t scan( size_t len, Sntp_ExtRequest_t *ext ) {
+    return Sntp_ExtScanRequest(req, len, ext);
+}
+
+static void test_fields( void ) {
+    uint8_t uid[SNTP_EXT_UID_MIN];
+    Sntp_ExtRequest_t ext;
+    size_t len;
+
+    memset(req, 0, sizeof(req));
+    memset(uid, 0xa5, sizeof(uid));
+    len = Sntp_ExtPutField(req, SNTP_PACKET_BASE_SIZE, SNTP_EXT_UNIQUE_ID, uid, sizeof(uid));
+    len = Sntp_ExtPutField(req, len, SNTP_EXT_NTS_COOKIE, NULL, 100);
+    len = Sntp_ExtPutField(req, len, SNTP_EXT_NTS_AUTH, NULL, 40);
+    CHECK_EQ(scan(len, &ext), SntpSuccess);
+    CHECK(ext.uid == req + SNTP_PACKET_BASE_SIZE + 4);
+    CHECK_EQ(ext.uidLen, sizeof(uid));
+    CHECK_EQ(ext.fieldsEnd, len);
+    CHECK(!ext.hasMac);
+    CHECK(ext.nts);
+
+    // A cookie without an authenticator is not NTS
+    len = Sntp_ExtPutField(req, SNTP_PACKET_BASE_SIZE, SNTP_EXT_NTS_COOKIE, NULL, 100);
+    CHECK_EQ(scan(len, &ext), SntpSuccess);
+    CHECK(ext.uid == NULL);
+    CHECK(!ext.nts);
+}
+
+/** A remainder of exactly SNTP_AUTH_MAC_SIZE bytes is a MAC, wherever the fields end */
+static void test_mac( void ) {
+    Sntp_ExtRequest_t ext;
+    size_t len;
+
+    memset(req, 0, sizeof(req));
+    CHECK_EQ(scan(SNTP_PACKET_BASE_SIZE + SNTP_AUTH_MAC_SIZE, &ext), SntpSuccess);
+    CHECK(ext.hasMac);
+    CHECK_EQ(ext.fieldsEnd, SNTP_PACKET_BASE_SIZE);
+
+    len = Sntp_ExtPutField(req, SNTP_PACKET_BASE_SIZE, 0x0f01, NULL, 12);
+    memset(req + len, 0xff, SNTP_AUTH_MAC_SIZE);
+    CHECK_EQ(scan(len + SNTP_AUTH_MAC_SIZE, &ext), SntpSuccess);
+    CHECK(ext.hasMac);
+    CHECK_EQ(ext.fieldsEnd, len);
+
+    // A well-formed 20 byte field in last place is still taken as a MAC
+    len = Sntp_ExtPutField(req, SNTP_PACKET_BASE_SIZE, 0x0f01, NULL, SNTP_AUTH_MAC_SIZE - 4);
+    CHECK_EQ(scan(len, &ext), SntpSuccess);
+    CHECK(ext.hasMac);
+    CHECK_EQ(ext.fieldsEnd, SNTP_PACKET_BASE_SIZE);
+
+    // Any other remainder is parsed as fields, so a 24 byte MAC (key ID and SHA-1 digest) is refused
+    len = Sntp_ExtPutField(req, SNTP_PACKET_BASE_SIZE, 0x0f01, NULL, 20);
+    CHECK_EQ(scan(len, &ext), SntpSuccess);
+    CHECK(!ext.hasMac);
+    CHECK_EQ(ext.fieldsEnd, len);
+    memset(req + SNTP_PACKET_BASE_SIZE, 0xff, 24);
+    CHECK_EQ(scan(SNTP_PACKET_BASE_SIZE + 24, &ext), SntpErrorBadParameter);
+}
+
+static void test_malformed( void ) {
+    Sntp_ExtRequest_t ext;
+
+    memset(req, 0, sizeof(req));
+    // Too short to hold a field header
+    CHECK_EQ(scan(SNTP_PACKET_BASE_SIZE + 2, &ext), SntpErrorBadParameter);
+
+    // Shorter than the smallest field
+    put_header(SNTP_PACKET_BASE_SIZE, 0x0f01, 12);
+    CHECK_EQ(scan(SNTP_PACKET_BASE_SIZE + 12, &ext), SntpErrorBadParameter);
+
+    // Not a multiple of 4
+    put_header(SNTP_PACKET_BASE_SIZE, 0x0f01, 18);
+    CHECK_EQ(scan(SNTP_PACKET_BASE_SIZE + 28, &ext), SntpErrorBadParameter);
+
+    // Longer than the packet
+    put_header(SNTP_PACKET_BASE_SIZE, 0x0f01, 32);
+    CHECK_EQ(scan(SNTP_PACKET_BASE_SIZE + 28, &ext), SntpErrorBadParameter);
+
+    // A good field followed by a truncated one
+    put_header(put_header(SNTP_PACKET_BASE_SIZE, 0x0f01, 16), 0x0f02, 16);
+    CHECK_EQ(scan(SNTP_PACKET_BASE_SIZE + 28, &ext), SntpErrorBadParameter);
+    CHECK_EQ(scan(SNTP_PACKET_BASE_SIZE + 32, &ext), SntpSuccess);
+}
+
+static void test_unique_id( void ) {
+    Sntp_ExtRequest_t ext;
+    size_t len;
+
+    memset(req, 0, sizeof(req));
+    len = Sntp_ExtPutField(req, SNTP_PACKET_BASE_SIZE, SNTP_EXT_UNIQUE_ID, NULL, SNTP_EXT_UID_MAX);
+    CHECK_EQ(scan(len, &ext), SntpSuccess);
+    CHECK_EQ(ext.uidLen, SNTP_EXT_UID_MAX);
+
+    len = Sntp_ExtPutField(req, SNTP_PACKET_BASE_SIZE, SNTP_EXT_UNIQUE_ID, NULL, SNTP_EXT_UID_MIN - 4);
+    CHECK_EQ(scan(len, &ext), SntpErrorBadParameter);
+    len = Sntp_ExtPutField(req, SNTP_PACKET_BASE_SIZE, SNTP_EXT_UNIQUE_ID, NULL, SNTP_EXT_UID_MAX + 4);
+    CHECK_EQ(scan(len, &ext), SntpErrorBadParameter);
+
+    // One Unique Identifier per request
+    len = Sntp_ExtPutField(req, SNTP_PACKET_BASE_SIZE, SNTP_EXT_UNIQUE_ID, NULL, SNTP_EXT_UID_MIN);
+    len = Sntp_ExtPutField(req, len, 0x0f01, NULL, 12);
+    CHECK_EQ(scan(len, &ext), SntpSuccess);
+    len = Sntp_ExtPutField(req, len, SNTP_EXT_UNIQUE_ID, NULL, SNTP_EXT_UID_MIN);
+    CHECK_EQ(scan(len, &ext), SntpErrorBadParameter);
+}
+
+/** Unknown fields, and the placeholder the server does not act on, are stepped over */
+static void test_unknown( void ) {
+    uint8_t uid[SNTP_EXT_UID_MIN];
+    Sntp_ExtRequest_t ext;
+    size_t len;
+
+    memset(req, 0, sizeof(req));
+    memset(uid, 0x5a, sizeof(uid));
+    len = Sntp_ExtPutField(req, SNTP_PACKET_BASE_SIZE, 0xffff, NULL, 12);
+    len = Sntp_ExtPutField(req, len, SNTP_EXT_NTS_PLACEHOLDER, NULL, 100);
+    len = Sntp_ExtPutField(req, len, SNTP_EXT_UNIQUE_ID, uid, sizeof(uid));
+    len = Sntp_ExtPutField(req, len, 0x2005, NULL, 17);
+    CHECK_EQ(scan(len, &ext), SntpSuccess);
+    CHECK_EQ(ext.fieldsEnd, len);
+    CHECK_EQ(ext.uidLen, sizeof(uid));
+    CHECK_MEM(ext.uid, uid, sizeof(uid));
+    CHECK(!ext.hasMac);
+    CHECK(!ext.nts);
+}
+
+int main( void ) {
+    test_fields();
+    test_mac();
+    test_malformed();
+    test_unique_id();
+    test_unknown();
+    return TEST_RESULT();
+}
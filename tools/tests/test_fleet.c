@@ -0,0 +1,163 @@
+/*
+ * Fleet clock offset histogram: binning and nearest-rank percentiles at their edges.
+ */
+#include <stdint.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "sntp_fleet.h"
+#include "sntp_test.h"
+
+#define RECEIVE_SECS 0xe0000000U
+
+static Sntp_Fleet_t fleet;
+
+static void put_ntp64( uint8_t *p, uint64_t v ) {
+    uint32_t sec = htonl((uint32_t)( v >> 32 )), frac = htonl((uint32_t)v);
+    memcpy(p, &sec, sizeof(sec));
+    memcpy(p + 4, &frac, sizeof(frac));
+}
+
+/** Record a response whose origin is diff (2^-32 s) from its receive time */
+static void record_units( int64_t diff, uint32_t group ) {
+    uint8_t resp[48] = { 0 };
+    uint64_t receive = (uint64_t)RECEIVE_SECS << 32;
+
+    put_ntp64(resp + 24, receive + (uint64_t)diff);
+    put_ntp64(resp + 32, receive);
+    Sntp_FleetRecord(&fleet, resp, group);
+}
+
+/** Record n samples of a client offset in microseconds; rounded up so the sample bins at or above us */
+static void record_us( int64_t us, uint32_t group, uint32_t n ) {
+    int64_t mag = us < 0 ? -us : us;
+    int64_t units = ( ( mag << 32 ) + 999999 ) / 1000000;
+
+    for (uint32_t i = 0; i < n; i++) {
+        record_units(us < 0 ? -units : units, group);
+    }
+}
+
+static int32_t pct( uint32_t group, uint32_t p ) {
+    return Sntp_FleetPercentile(&fleet.cur, group, p);
+}
+
+static void test_empty( void ) {
+    Sntp_FleetInit(&fleet);
+    CHECK_EQ(pct(SNTP_FLEET_ALL, 0), 0);
+    CHECK_EQ(pct(SNTP_FLEET_ALL, 50), 0);
+    CHECK_EQ(pct(0, 100), 0);
+    CHECK_EQ(fleet.cur.samples, 0);
+}
+
+/** Nearest rank: p is the smallest value with at least p% of the samples at or below it */
+static void test_rank_edges( void ) {
+    Sntp_FleetInit(&fleet);
+    record_us(-1000, 0, 1);
+    CHECK_EQ(pct(0, 0), pct(0, 100));
+    CHECK(pct(0, 50) < -800 && pct(0, 50) > -1250);
+
+    // Two samples: the median is the lower one, anything above it the upper one
+    record_us(1000, 0, 1);
+    CHECK(pct(0, 50) < 0);
+    CHECK(pct(0, 51) > 0);
+    CHECK(pct(0, 0) < 0);
+    CHECK(pct(0, 100) > 0);
+
+    // 1 low and 99 high: p1 is the low sample, p2 the high one; 99 low and 1 high mirrors it
+    Sntp_FleetInit(&fleet);
+    record_us(-500, 1, 1);
+    record_us(500, 1, 99);
+    CHECK(pct(1, 1) < 0);
+    CHECK(pct(1, 2) > 0);
+    CHECK(pct(1, 100) > 0);
+    Sntp_FleetInit(&fleet);
+    record_us(-500, 1, 99);
+    record_us(500, 1, 1);
+    CHECK(pct(1, 99) < 0);
+    CHECK(pct(1, 100) > 0);
+
+    // Percentages past 100 are the largest sample, not a bucket past the end
+    CHECK_EQ(pct(1, 101), pct(1, 100));
+    CHECK_EQ(pct(1, UINT32_MAX), pct(1, 100));
+}
+
+static void test_groups( void ) {
+    Sntp_FleetInit(&fleet);
+    record_us(-2000, 0, 3);
+    record_us(4000, 2, 1);
+    CHECK(pct(0, 100) < 0);
+    CHECK_EQ(pct(1, 50), 0);
+    CHECK(pct(2, 0) > 0);
+    CHECK(pct(SNTP_FLEET_ALL, 75) < 0);
+    CHECK(pct(SNTP_FLEET_ALL, 76) > 0);
+    CHECK_EQ(fleet.cur.samples, 4);
+}
+
+/** Exact powers of two land in the first sub-bucket of their octave, and nothing crosses zero */
+static void test_bucket_edges( void ) {
+    Sntp_FleetInit(&fleet);
+    record_units(0, 0);
+    record_units(4294, 0);  // Just under 1us
+    record_units(-4294, 0);
+    CHECK_EQ(pct(0, 0), 0);
+    CHECK_EQ(pct(0, 100), 0);
+
+    for (int k = 0; k < 31; k++) {
+        int64_t us = (int64_t)1 << k;
+
+        Sntp_FleetInit(&fleet);
+        record_us(us, 0, 1);
+        record_us(-us, 1, 1);
+        // Bucket midpoints are an eighth above the power of two, within the octave's first quarter
+        CHECK(pct(0, 50) >= us && pct(0, 50) <= us + us / 4);
+        CHECK_EQ(pct(1, 50), -pct(0, 50));
+        if (k >= 3) {
+            record_us(us - 1, 2, 1);
+            CHECK(pct(2, 50) < us);
+        }
+    }
+}
+
+/** Samples the histogram cannot place are only counted, and KoD replies not at all */
+static void test_unsynced( void ) {
+    uint8_t resp[48] = { 0 };
+
+    Sntp_FleetInit(&fleet);
+    record_units((int64_t)1 << 43, 0);
+    record_units(-( (int64_t)1 << 43 ), 0);
+    record_units(( (int64_t)1 << 43 ) - 1, 0);
+    CHECK_EQ(fleet.cur.unsynced, 2);
+    CHECK_EQ(fleet.cur.samples, 1);
+    CHECK(pct(0, 50) > 2000000000);
+
+    put_ntp64(resp + 32, (uint64_t)RECEIVE_SECS << 32);
+    Sntp_FleetRecord(&fleet, resp, 0);
+    CHECK_EQ(fleet.cur.unsynced, 3);
+
+    memset(resp, 0, sizeof(resp));
+    put_ntp64(resp + 24, (uint64_t)RECEIVE_SECS << 32);
+    Sntp_FleetRecord(&fleet, resp, 0);
+    CHECK_EQ(fleet.cur.unsynced, 3);
+    CHECK_EQ(fleet.cur.samples, 1);
+}
+
+static void test_rotate( void ) {
+    Sntp_FleetInit(&fleet);
+    record_us(100, 0, 5);
+    CHECK(!Sntp_FleetRotateIfDue(&fleet, 3600));
+    CHECK(Sntp_FleetRotateIfDue(&fleet, 0));
+    CHECK_EQ(fleet.cur.samples, 0);
+    CHECK_EQ(fleet.last.samples, 5);
+    CHECK(Sntp_FleetPercentile(&fleet.last, 0, 50) > 0);
+}
+
+int main( void ) {
+    test_empty();
+    test_rank_edges();
+    test_groups();
+    test_bucket_edges();
+    test_unsynced();
+    test_rotate();
+    return TEST_RESULT();
+}
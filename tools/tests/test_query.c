@@ -0,0 +1,112 @@
+/*
+ * Onboard time queries: Sntp_ServerRead() against the response the engine builds for the same request.
+ */
+#include <stdint.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "sntp_server.h"
+#include "sntp_utils.h"
+#include "sntp_test.h"
+
+#define ORIGIN_OFFSET   24
+#define RECEIVE_OFFSET  32
+#define TRANSMIT_OFFSET 40
+
+static uint64_t ntp64( const SntpTimestamp_t *t ) {
+    return ( (uint64_t)t->seconds << 32 ) | t->fractions;
+}
+
+static uint64_t get_ntp64( const uint8_t *p ) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) {
+        v = ( v << 8 ) | p[i];
+    }
+    return v;
+}
+
+/** A query read at rxTime carries what a UDP client's response for the same receive time does */
+static void check_scale( Sntp_TimeScale_t scale ) {
+    Sntp_ServerConfig_t cfg = { .stratum = 2, .scale = scale };
+    Sntp_ServerStats_t stats = { 0 };
+    Sntp_ServerReading_t reading;
+    uint8_t req[SNTP_PACKET_BASE_SIZE] = { ( 4 << 3 ) | SNTP_MODE_CLIENT };
+    uint8_t resp[SNTP_SERVER_MAX_RESPONSE];
+    const SntpPacket_t *pkt = (const SntpPacket_t *)resp;
+    size_t respLen;
+    SntpTimestamp_t rxTime;
+
+    memset(req + TRANSMIT_OFFSET, 0x37, 8);
+    Sntp_TimeRead(&rxTime);
+    CHECK_EQ(Sntp_ServerRead(&cfg, &rxTime, &reading), SntpSuccess);
+    CHECK_EQ(Sntp_ServerProcessAt(&cfg, &stats, &rxTime, req, sizeof(req), resp, &respLen), SntpSuccess);
+
+    CHECK_EQ(reading.leapIndicator, pkt->leapVersionMode >> SNTP_LEAP_INDICATOR_LSB_POSITION);
+    CHECK_EQ(reading.stratum, pkt->stratum);
+    CHECK_EQ(reading.precision, pkt->precision);
+    CHECK_EQ(reading.refId, ntohl(pkt->refId));
+    CHECK_EQ(pkt->rootDelay, 0);
+    CHECK_EQ(pkt->rootDispersion, 0);
+    CHECK_EQ(ntp64(&reading.receive), get_ntp64(resp + RECEIVE_OFFSET));
+    // Both read the clock after the receive time, the engine a little later
+    CHECK(ntp64(&reading.transmit) >= ntp64(&reading.receive));
+    CHECK(ntp64(&reading.transmit) <= get_ntp64(resp + TRANSMIT_OFFSET));
+    CHECK(ntp64(&reading.transmit) - ntp64(&reading.receive) < ( (uint64_t)1 << 32 ) / 10);
+}
+
+static void test_scales( void ) {
+    Sntp_ServerConfig_t cfg = { .stratum = 1 };
+    Sntp_ServerReading_t utc, tai;
+    SntpTimestamp_t rxTime;
+
+    check_scale(SNTP_SCALE_UTC);
+    check_scale(SNTP_SCALE_TAI);
+    check_scale(SNTP_SCALE_MET);
+
+    // Scales of one receive time differ by the cached whole-second offsets
+    Sntp_TimeRead(&rxTime);
+    cfg.scale = SNTP_SCALE_UTC;
+    Sntp_ServerRead(&cfg, &rxTime, &utc);
+    cfg.scale = SNTP_SCALE_TAI;
+    Sntp_ServerRead(&cfg, &rxTime, &tai);
+    CHECK_EQ(utc.receive.fractions, tai.receive.fractions);
+    CHECK(tai.receive.seconds - utc.receive.seconds < 100);
+
+    cfg.scale = SNTP_SCALE_COUNT;
+    CHECK_EQ(Sntp_ServerRead(&cfg, &rxTime, &utc), SntpErrorBadParameter);
+}
+
+/** A leap announced to UDP clients is announced to onboard ones, and only on UTC */
+static void test_leap( void ) {
+    Sntp_ServerConfig_t cfg = { .stratum = 2 };
+    Sntp_ServerReading_t reading;
+    uint8_t pkt[SNTP_PACKET_BASE_SIZE];
+    SntpTimestamp_t now;
+
+    Sntp_TimeReadScale(SNTP_SCALE_UTC, &now);
+    CHECK_EQ(Sntp_TimeScheduleLeap(now.seconds + 3600, 1, SNTP_SMEAR_NONE, 0), SntpSuccess);
+    check_scale(SNTP_SCALE_UTC);
+    CHECK_EQ(Sntp_TimeLeapIndicator(), 1);
+    CHECK_EQ(Sntp_ServerRead(&cfg, &now, &reading), SntpSuccess);
+    CHECK_EQ(reading.leapIndicator, 1);
+    Sntp_ServerBuildBroadcast(&cfg, 6, NULL, pkt);
+    CHECK_EQ(pkt[0] >> SNTP_LEAP_INDICATOR_LSB_POSITION, 1);
+
+    // TAI and MET have no leap seconds to announce
+    check_scale(SNTP_SCALE_TAI);
+    check_scale(SNTP_SCALE_MET);
+    for (cfg.scale = SNTP_SCALE_TAI; cfg.scale <= SNTP_SCALE_MET; cfg.scale++) {
+        CHECK_EQ(Sntp_ServerRead(&cfg, &now, &reading), SntpSuccess);
+        CHECK_EQ(reading.leapIndicator, 0);
+        Sntp_ServerBuildBroadcast(&cfg, 6, NULL, pkt);
+        CHECK_EQ(pkt[0] >> SNTP_LEAP_INDICATOR_LSB_POSITION, 0);
+    }
+    Sntp_TimeCancelLeap();
+}
+
+int main( void ) {
+    Sntp_TimeCalibrate();
+    test_scales();
+    test_leap();
+    return TEST_RESULT();
+}
@@ -0,0 +1,238 @@
+/*
+ * The serving loop on the in-memory ring transport: per-request accounting, control query diversion,
+ * shedding with KoD and batch draining, as the app runs them on its UDP listeners.
+ */
+#include <stdint.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "sntp_serve.h"
+#include "sntp_utils.h"
+#include "sntp_test.h"
+
+static Sntp_RingTransport_t ring;
+static Sntp_RtSockStats_t ringStats;
+static Sntp_ServerStats_t serverStats;
+static Sntp_ShedConfig_t shedCfg;
+static Sntp_ShedState_t shed;
+static Sntp_RtHist_t wakeHist;
+static Sntp_TopK_t topTalkers;
+static Sntp_Fleet_t fleet;
+static Sntp_CtlConfig_t ctlCfg;
+static Sntp_CtlState_t ctl;
+static Sntp_ServeListener_t listener;
+static Sntp_Serve_t serve;
+
+static uint32_t shedEvents, invalidEvents;
+static ssize_t invalidLen;
+
+static void on_shed( void *arg, uint32_t level, uint32_t latencyUs, uint32_t queueBytes ) {
+    (void)arg;
+    (void)level;
+    (void)latencyUs;
+    (void)queueBytes;
+    shedEvents++;
+}
+
+static void on_invalid( void *arg, ssize_t len, int err ) {
+    (void)arg;
+    (void)err;
+    invalidEvents++;
+    invalidLen = len;
+}
+
+static void setup( void ) {
+    Sntp_RingTransportInit(&ring);
+    memset(&ringStats, 0, sizeof(ringStats));
+    memset(&serverStats, 0, sizeof(serverStats));
+    memset(&shedCfg, 0, sizeof(shedCfg));
+    memset(&shed, 0, sizeof(shed));
+    memset(&ctlCfg, 0, sizeof(ctlCfg));
+    memset(&ctl, 0, sizeof(ctl));
+    Sntp_TopKInit(&topTalkers);
+    Sntp_FleetInit(&fleet);
+    shedEvents = invalidEvents = 0;
+
+    memset(&listener, 0, sizeof(listener));
+    listener.cfg.stratum = 2;
+    listener.cfg.scale = SNTP_SCALE_TAI;
+    listener.cls = SNTP_CLASS_NORMAL;
+    listener.transport = &ring.base;
+    listener.sockStats = &ringStats;
+
+    memset(&serve, 0, sizeof(serve));
+    serve.serverStats = &serverStats;
+    serve.shedCfg = &shedCfg;
+    serve.shed = &shed;
+    serve.wakeHist = &wakeHist;
+    serve.topTalkers = &topTalkers;
+    serve.fleet = &fleet;
+    serve.ctlCfg = &ctlCfg;
+    serve.ctl = &ctl;
+    serve.hooks.shedChanged = on_shed;
+    serve.hooks.invalid = on_invalid;
+}
+
+static void inject( uint8_t lvm, size_t len, const char *from ) {
+    uint8_t req[SNTP_PACKET_BASE_SIZE] = { lvm };
+    struct sockaddr_in src = { .sin_family = AF_INET, .sin_port = htons(40123) };
+
+    memset(req + 40, 0x5c, 8);
+    inet_pton(AF_INET, from, &src.sin_addr);
+    CHECK_EQ(Sntp_RingTransportInject(&ring, req, len, &src), 0);
+}
+
+static uint32_t responses( void ) {
+    uint32_t n = 0;
+
+    while (Sntp_RingTransportTake(&ring, NULL, 0, NULL) >= 0) {
+        n++;
+    }
+    return n;
+}
+
+static void test_one( void ) {
+    uint8_t resp[SNTP_SERVER_MAX_RESPONSE];
+    struct sockaddr_in dst;
+
+    setup();
+    inject(( 4 << 3 ) | SNTP_MODE_CLIENT, SNTP_PACKET_BASE_SIZE, "10.0.0.1");
+    CHECK(Sntp_ServeOne(&serve, &listener));
+    CHECK_EQ(Sntp_RingTransportTake(&ring, resp, sizeof(resp), &dst), SNTP_PACKET_BASE_SIZE);
+    CHECK_EQ(resp[0] & 0x7, SNTP_MODE_SERVER);
+    CHECK_EQ(resp[1], 2);
+    CHECK_EQ(dst.sin_port, htons(40123));
+    CHECK_EQ(serve.counts.received, 1);
+    CHECK_EQ(serve.counts.scaleRequests[SNTP_SCALE_TAI], 1);
+    CHECK_EQ(topTalkers.total, 1);
+
+    // Broadcasts and server replies are counted and dropped, so two servers cannot answer each other
+    inject(( 4 << 3 ) | SNTP_MODE_SERVER, SNTP_PACKET_BASE_SIZE, "10.0.0.2");
+    inject(( 4 << 3 ) | SNTP_MODE_BROADCAST, SNTP_PACKET_BASE_SIZE, "10.0.0.2");
+    CHECK(Sntp_ServeOne(&serve, &listener));
+    CHECK(Sntp_ServeOne(&serve, &listener));
+    CHECK_EQ(responses(), 0);
+    CHECK_EQ(serve.counts.received, 3);
+    CHECK_EQ(serve.counts.badRequests, 2);
+
+    // Too short to be a request
+    inject(( 4 << 3 ) | SNTP_MODE_CLIENT, 20, "10.0.0.3");
+    CHECK(Sntp_ServeOne(&serve, &listener));
+    CHECK_EQ(responses(), 0);
+    CHECK_EQ(serve.counts.invalid, 1);
+    CHECK_EQ(invalidEvents, 1);
+    CHECK_EQ(invalidLen, 20);
+
+    // Nothing waiting is not an error
+    CHECK(!Sntp_ServeOne(&serve, &listener));
+    CHECK_EQ(serve.counts.invalid, 1);
+    CHECK_EQ(topTalkers.total, 4);
+}
+
+static void test_control( void ) {
+    uint8_t query[SNTP_CTL_HEADER_SIZE] = { ( 2 << 3 ) | SNTP_CTL_MODE, 2 };
+    uint8_t resp[SNTP_CTL_HEADER_SIZE + SNTP_CTL_MAX_DATA];
+    struct sockaddr_in src = { .sin_family = AF_INET };
+    Sntp_CtlVars_t vars = { 0 };
+
+    setup();
+    ctlCfg.clientRate = ctlCfg.clientBurst = ctlCfg.totalRate = 10;
+    CHECK_EQ(Sntp_CtlParsePrefix("10.0.0.0/8", &ctlCfg.allow[0]), SntpSuccess);
+    ctlCfg.allowCount = 1;
+    Sntp_CtlAddVar(&vars, "stratum", "%u", 2U);
+
+    // Queued rather than answered, and not counted as time requests
+    inet_pton(AF_INET, "10.0.0.9", &src.sin_addr);
+    for (int i = 0; i < SNTP_CTL_QUEUE_DEPTH + 1; i++) {
+        CHECK_EQ(Sntp_RingTransportInject(&ring, query, sizeof(query), &src), 0);
+    }
+    inet_pton(AF_INET, "192.168.0.9", &src.sin_addr);
+    CHECK_EQ(Sntp_RingTransportInject(&ring, query, sizeof(query), &src), 0);
+    CHECK_EQ(Sntp_ServeBatch(&serve, &listener), SNTP_CTL_QUEUE_DEPTH + 2);
+    CHECK_EQ(responses(), 0);
+    CHECK_EQ(serve.counts.received, 0);
+    CHECK_EQ(serve.ctlPending, SNTP_CTL_QUEUE_DEPTH);
+    CHECK_EQ(ctl.limited, 1);
+    CHECK_EQ(ctl.restricted, 1);
+
+    CHECK(Sntp_ServeControlDue(&serve));
+    Sntp_ServeAnswerControl(&serve, &vars);
+    CHECK_EQ(serve.ctlPending, 0);
+    CHECK(Sntp_RingTransportTake(&ring, resp, sizeof(resp), NULL) > SNTP_CTL_HEADER_SIZE);
+    CHECK(resp[1] & 0x80);
+    CHECK_EQ(responses(), SNTP_CTL_QUEUE_DEPTH - 1);
+    CHECK(!Sntp_ServeControlDue(&serve));
+}
+
+static void test_shed( void ) {
+    uint8_t resp[SNTP_SERVER_MAX_RESPONSE];
+    uint8_t query[SNTP_CTL_HEADER_SIZE] = { ( 2 << 3 ) | SNTP_CTL_MODE, 2 };
+    struct sockaddr_in src = { .sin_family = AF_INET };
+
+    setup();
+    shedCfg.queueBytes = 100;
+    shedCfg.holdMs = 60000;
+    shedCfg.kod = true;
+    CHECK_EQ(Sntp_ShedParseRule("10.0.0.0/8=0", &shedCfg.rules[0]), SntpSuccess);
+    shedCfg.ruleCount = 1;
+    ctlCfg.clientRate = ctlCfg.clientBurst = ctlCfg.totalRate = 10;
+    CHECK_EQ(Sntp_CtlParsePrefix("0.0.0.0/0", &ctlCfg.allow[0]), SntpSuccess);
+    ctlCfg.allowCount = 1;
+
+    // Four times the backlog threshold sheds normal traffic; critical prefixes are still answered
+    ringStats.queue = 400;
+    inject(( 4 << 3 ) | SNTP_MODE_CLIENT, SNTP_PACKET_BASE_SIZE, "192.168.0.1");
+    CHECK(Sntp_ServeOne(&serve, &listener));
+    CHECK_EQ(shed.level, 2);
+    CHECK_EQ(shedEvents, 1);
+    CHECK_EQ(Sntp_RingTransportTake(&ring, resp, sizeof(resp), NULL), SNTP_PACKET_BASE_SIZE);
+    CHECK_EQ(resp[1], 0);
+    CHECK_MEM(resp + 12, "RATE", 4);
+    CHECK_EQ(shed.kod, 1);
+    CHECK_EQ(shed.shed[SNTP_CLASS_NORMAL], 1);
+
+    inject(( 4 << 3 ) | SNTP_MODE_CLIENT, SNTP_PACKET_BASE_SIZE, "10.1.2.3");
+    CHECK(Sntp_ServeOne(&serve, &listener));
+    CHECK_EQ(Sntp_RingTransportTake(&ring, resp, sizeof(resp), NULL), SNTP_PACKET_BASE_SIZE);
+    CHECK_EQ(resp[1], 2);
+    CHECK_EQ(serve.counts.received, 2);
+    CHECK_EQ(serve.counts.scaleRequests[SNTP_SCALE_TAI], 1);
+    CHECK_EQ(shedEvents, 1);
+
+    // Control queries queued while shedding are dropped as rate limited
+    inet_pton(AF_INET, "10.0.0.9", &src.sin_addr);
+    CHECK_EQ(Sntp_RingTransportInject(&ring, query, sizeof(query), &src), 0);
+    CHECK(Sntp_ServeOne(&serve, &listener));
+    CHECK_EQ(serve.ctlPending, 1);
+    CHECK(!Sntp_ServeControlDue(&serve));
+    CHECK_EQ(serve.ctlPending, 0);
+    CHECK_EQ(ctl.limited, 1);
+}
+
+/** More requests than a batch are drained a batch at a time, and non-client ones among them dropped */
+static void test_batch( void ) {
+    const uint32_t total = SNTP_LISTEN_BATCH + 8;
+
+    setup();
+    for (uint32_t i = 0; i < total; i++) {
+        inject(( 4 << 3 ) | ( ( i % 10 == 9 ) ? SNTP_MODE_SERVER : SNTP_MODE_CLIENT ), SNTP_PACKET_BASE_SIZE,
+               "10.0.0.1");
+    }
+    CHECK_EQ(Sntp_ServeBatch(&serve, &listener), SNTP_LISTEN_BATCH);
+    CHECK_EQ(responses(), SNTP_LISTEN_BATCH - SNTP_LISTEN_BATCH / 10);
+    CHECK_EQ(Sntp_ServeBatch(&serve, &listener), 8);
+    CHECK_EQ(Sntp_ServeBatch(&serve, &listener), 0);
+    CHECK_EQ(serve.counts.received, total);
+    CHECK_EQ(serve.counts.scaleRequests[SNTP_SCALE_TAI], total - total / 10);
+    CHECK_EQ(serve.counts.badRequests, total / 10);
+    CHECK_EQ(fleet.cur.samples + fleet.cur.unsynced, total - total / 10);
+}
+
+int main( void ) {
+    Sntp_TimeCalibrate();
+    test_one();
+    test_control();
+    test_shed();
+    test_batch();
+    return TEST_RESULT();
+}
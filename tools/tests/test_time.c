@@ -0,0 +1,155 @@
+/*
+ * Leap second scheduling and the smear table at the edges of its window.
+ *
+ * The smear is observed through Sntp_TimeApplyScale() on synthetic readings
+ * of the CLOCK_TAI source, so any point of the window can be checked now.
+ */
+#include <stdint.h>
+
+#include "sntp_time.h"
+#include "sntp_utils.h"
+#include "sntp_test.h"
+
+#define ONE_SEC   ( (int64_t)1 << 32 )
+#define TOLERANCE 2 /* Rounding of the table, 2^-32 s */
+
+static int64_t leapCount; /* TAI - UTC before any leap is scheduled, 2^-32 s */
+
+static uint64_t ntp64( const SntpTimestamp_t *t ) {
+    return ( (uint64_t)t->seconds << 32 ) | t->fractions;
+}
+
+/** Served UTC less raw TAI less the leap count: the correction the smear applies at raw */
+static int64_t smear( uint64_t raw ) {
+    SntpTimestamp_t t = { .seconds = (uint32_t)( raw >> 32 ), .fractions = (uint32_t)raw };
+
+    Sntp_TimeApplyScale(SNTP_SCALE_UTC, &t);
+    return (int64_t)( ntp64(&t) - raw ) + leapCount;
+}
+
+static int64_t abs64( int64_t v ) {
+    return v < 0 ? -v : v;
+}
+
+static uint32_t utc_now( void ) {
+    SntpTimestamp_t now;
+
+    Sntp_TimeReadScale(SNTP_SCALE_UTC, &now);
+    return now.seconds;
+}
+
+/** Zero up to the window, the full second from its end on, and continuous at every segment edge */
+static void check_window( int8_t direction, Sntp_SmearShape_t shape, uint32_t smearSecs ) {
+    uint32_t leapSecs = utc_now() + 30 * 86400;
+    int64_t span = (int64_t)smearSecs << 32;
+    uint64_t start = ( (uint64_t)leapSecs << 32 ) + (uint64_t)leapCount - (uint64_t)( span / 2 );
+    uint64_t end = start + (uint64_t)span;
+    int64_t full = -direction * ONE_SEC;
+    int64_t prev, curveTol;
+    uint32_t shift = 32;
+
+    // Segments are the shortest power of two seconds that fits the window in SNTP_SMEAR_SEGMENTS
+    while (( span >> shift ) >= SNTP_SMEAR_SEGMENTS) {
+        shift++;
+    }
+    // Straight segments stray from the smooth curve by up to h^2/8 of its peak curvature, 6 s per window^2
+    curveTol = TOLERANCE;
+    if (shape == SNTP_SMEAR_SMOOTH) {
+        double h = (double)( (int64_t)1 << shift ) / (double)span;
+        curveTol += (int64_t)( ONE_SEC * 0.75 * h * h );
+    }
+
+    CHECK_EQ(Sntp_TimeScheduleLeap(leapSecs, direction, shape, smearSecs), SntpSuccess);
+    CHECK_EQ(Sntp_TimeLeapIndicator(), 0);
+
+    CHECK_EQ(smear(start - ONE_SEC), 0);
+    CHECK_EQ(smear(start - 1), 0);
+    CHECK_EQ(smear(start), 0);
+    CHECK(abs64(smear(start + 1)) <= TOLERANCE);
+    CHECK(abs64(smear(start + span / 2) - full / 2) <= curveTol);
+    CHECK(abs64(smear(end - 1) - full) <= TOLERANCE);
+    CHECK_EQ(smear(end), full);
+    CHECK_EQ(smear(end + ONE_SEC), smear(end));
+    CHECK_EQ(smear(end + 86400 * ONE_SEC), smear(end));
+
+    // Monotonic towards the full second over the window, with no jump at segment edges
+    prev = 0;
+    for (int i = 1; i <= 1024; i++) {
+        int64_t v = smear(start + (uint64_t)( span / 1024 * i ));
+        CHECK(direction > 0 ? v <= prev : v >= prev);
+        CHECK(abs64(v - prev) <= abs64(full) / 1024 * 2 + TOLERANCE);
+        prev = v;
+    }
+    for (int64_t s = 1; ( s << shift ) < span; s++) {
+        uint64_t edge = start + (uint64_t)( s << shift );
+        CHECK(abs64(smear(edge) - smear(edge - 1)) <= TOLERANCE);
+    }
+
+    Sntp_TimeCancelLeap();
+    CHECK_EQ(smear(start + span / 2), 0);
+}
+
+static void test_smear( void ) {
+    check_window(1, SNTP_SMEAR_LINEAR, 86400);
+    check_window(-1, SNTP_SMEAR_LINEAR, 86400);
+    check_window(1, SNTP_SMEAR_SMOOTH, 86400);
+    check_window(-1, SNTP_SMEAR_SMOOTH, 86400);
+    check_window(1, SNTP_SMEAR_LINEAR, 1);
+    check_window(1, SNTP_SMEAR_SMOOTH, 604800);
+}
+
+/** The smear's 64x64-bit multiply floors like an arithmetic shift of the full product */
+static void test_mul_shift( void ) {
+    CHECK_EQ(Sntp_MulShift(3, 5, 1), 7);
+    CHECK_EQ(Sntp_MulShift(-3, 5, 1), -8);
+    CHECK_EQ(Sntp_MulShift(3, -4, 1), -6);
+    CHECK_EQ(Sntp_MulShift(-3, -5, 1), 7);
+    CHECK_EQ(Sntp_MulShift(ONE_SEC - 1, (int64_t)3 << 61, 62), ( ( ONE_SEC - 1 ) * 3 ) >> 1);
+    CHECK_EQ(Sntp_MulShift(-( ONE_SEC - 1 ), (int64_t)3 << 61, 62), -( ( ( ONE_SEC - 1 ) * 3 + 1 ) >> 1 ));
+    CHECK_EQ(Sntp_MulShift(INT64_MAX, INT64_MAX, 63), INT64_MAX - 1);
+    CHECK_EQ(Sntp_MulShift(INT64_MIN + 1, INT64_MAX, 63), INT64_MIN + 1);
+}
+
+static void test_schedule_bounds( void ) {
+    uint32_t now = utc_now();
+
+    CHECK_EQ(Sntp_TimeScheduleLeap(now + 86400, 1, SNTP_SMEAR_LINEAR, 0), SntpErrorBadParameter);
+    CHECK_EQ(Sntp_TimeScheduleLeap(now + 86400, 1, SNTP_SMEAR_LINEAR, 604801), SntpErrorBadParameter);
+    CHECK_EQ(Sntp_TimeScheduleLeap(now + 86400, 0, SNTP_SMEAR_NONE, 0), SntpErrorBadParameter);
+    CHECK_EQ(Sntp_TimeScheduleLeap(now + 86400, 1, SNTP_SMEAR_SHAPE_COUNT, 0), SntpErrorBadParameter);
+    CHECK_EQ(Sntp_TimeScheduleLeap(now, 1, SNTP_SMEAR_NONE, 0), SntpErrorBadParameter);
+    CHECK_EQ(Sntp_TimeLeapPending(), 0);
+
+    // Unsmeared leaps are announced only within SNTP_LEAP_ANNOUNCE_SECS
+    CHECK_EQ(Sntp_TimeScheduleLeap(now + SNTP_LEAP_ANNOUNCE_SECS + 60, 1, SNTP_SMEAR_NONE, 0), SntpSuccess);
+    CHECK_EQ(Sntp_TimeLeapIndicator(), 0);
+    CHECK_EQ(Sntp_TimeScheduleLeap(now + SNTP_LEAP_ANNOUNCE_SECS - 60, 1, SNTP_SMEAR_NONE, 0), SntpSuccess);
+    CHECK_EQ(Sntp_TimeLeapIndicator(), 1);
+    CHECK_EQ(Sntp_TimeScheduleLeap(now + SNTP_LEAP_ANNOUNCE_SECS - 60, -1, SNTP_SMEAR_NONE, 0), SntpSuccess);
+    CHECK_EQ(Sntp_TimeLeapIndicator(), 2);
+    Sntp_TimeCancelLeap();
+    CHECK_EQ(Sntp_TimeLeapIndicator(), 0);
+    CHECK_EQ(Sntp_TimeLeapPending(), 0);
+
+    // A smear table is keyed on TAI readings, so it needs a TAI source and keeps it
+    CHECK_EQ(Sntp_TimeSelect(SNTP_TIME_SRC_REALTIME), SntpSuccess);
+    CHECK_EQ(Sntp_TimeScheduleLeap(now + 86400, 1, SNTP_SMEAR_LINEAR, 3600), SntpErrorBadParameter);
+    CHECK_EQ(Sntp_TimeSelect(SNTP_TIME_SRC_TAI), SntpSuccess);
+    CHECK_EQ(Sntp_TimeScheduleLeap(now + 86400, 1, SNTP_SMEAR_LINEAR, 3600), SntpSuccess);
+    CHECK_EQ(Sntp_TimeSelect(SNTP_TIME_SRC_REALTIME), SntpErrorBadParameter);
+    Sntp_TimeCancelLeap();
+}
+
+int main( void ) {
+    SntpTimestamp_t t;
+
+    Sntp_TimeCalibrate();
+    CHECK_EQ(Sntp_TimeSelect(SNTP_TIME_SRC_TAI), SntpSuccess);
+    Sntp_TimeRead(&t);
+    leapCount = -smear(ntp64(&t));
+
+    test_smear();
+    test_mul_shift();
+    test_schedule_bounds();
+    return TEST_RESULT();
+}
@@ -0,0 +1,73 @@
+/*
+ * Warm start: checking a restored state block and moving its timestamps across a reboot.
+ */
+#include <stdint.h>
+#include <string.h>
+
+#include "sntp_warm.h"
+#include "sntp_test.h"
+
+#define VERSION 3
+#define REAL_MS 1700000000000LL /* Wall clock at the save, ms since 1970 */
+
+typedef struct {
+    Sntp_WarmHeader_t header;
+    uint32_t          counters[8];
+} Block_t;
+
+static void test_check( void ) {
+    Block_t block;
+
+    memset(&block, 0, sizeof(block));
+    Sntp_WarmSeal(&block.header, VERSION, sizeof(block), 5000, REAL_MS);
+    CHECK(Sntp_WarmCheck(&block.header, true, VERSION, sizeof(block)) == NULL);
+
+    // A CRC mismatch or failed read is reported by the store, whatever the header says
+    CHECK(Sntp_WarmCheck(&block.header, false, VERSION, sizeof(block)) != NULL);
+
+    // Saved by a build of another layout: same size, or one more counter
+    CHECK(Sntp_WarmCheck(&block.header, true, VERSION + 1, sizeof(block)) != NULL);
+    CHECK(Sntp_WarmCheck(&block.header, true, VERSION - 1, sizeof(block)) != NULL);
+    Sntp_WarmSeal(&block.header, VERSION, sizeof(block) + sizeof(uint32_t), 5000, REAL_MS);
+    CHECK(Sntp_WarmCheck(&block.header, true, VERSION, sizeof(block)) != NULL);
+    Sntp_WarmSeal(&block.header, VERSION, sizeof(block) - sizeof(uint32_t), 5000, REAL_MS);
+    CHECK(Sntp_WarmCheck(&block.header, true, VERSION, sizeof(block)) != NULL);
+
+    // A never-written block is all zeros
+    memset(&block, 0, sizeof(block));
+    CHECK(Sntp_WarmCheck(&block.header, true, VERSION, sizeof(block)) != NULL);
+}
+
+static void test_shift( void ) {
+    Sntp_WarmHeader_t hdr;
+    int64_t elapsed, shift;
+
+    // Same boot: the monotonic clock carried on, give or take the skew between the two clock reads
+    Sntp_WarmSeal(&hdr, VERSION, 0, 10000000, REAL_MS);
+    CHECK_EQ(Sntp_WarmShift(&hdr, 10060000, REAL_MS + 60000, &elapsed), 0);
+    CHECK_EQ(elapsed, 60000);
+    CHECK_EQ(Sntp_WarmShift(&hdr, 10060999, REAL_MS + 60000, &elapsed), 0);
+    CHECK_EQ(Sntp_WarmShift(&hdr, 10059001, REAL_MS + 60000, &elapsed), 0);
+
+    // Saved 60 s ago, and the host has been up for 100 s since a reboot: the save was at 40 s on the new clock
+    shift = Sntp_WarmShift(&hdr, 100000, REAL_MS + 60000, &elapsed);
+    CHECK_EQ(elapsed, 60000);
+    CHECK_EQ(Sntp_WarmShiftMs(10000000, shift), 40000);
+    CHECK_EQ(Sntp_WarmShiftMs(9990000, shift), 30000);
+
+    // Timestamps from before the new boot stay above zero, and unused slots stay zero
+    CHECK_EQ(Sntp_WarmShiftMs(10000, shift), 1);
+    CHECK_EQ(Sntp_WarmShiftMs(0, shift), 0);
+    CHECK_EQ(Sntp_WarmShiftMs(0, 5000), 0);
+
+    // The wall clock stepped back: no time is taken to have passed
+    Sntp_WarmShift(&hdr, 10000500, REAL_MS - 3600000, &elapsed);
+    CHECK_EQ(elapsed, 0);
+    CHECK_EQ(Sntp_WarmShift(&hdr, 10000500, REAL_MS - 3600000, &elapsed), 0);
+}
+
+int main( void ) {
+    test_check();
+    test_shift();
+    return TEST_RESULT();
+}